@@ -65,9 +65,8 @@ struct port_stats {
                                  beyond duration_sec */
 };
 
-struct rbuff *port_rbuff;
-
-extern struct rbuff *port_rbuff;
+/* port status changes, from ports_action of any thread to the datapath. */
+extern struct ring *port_ring;
 //
 #define BRCM_PLATFORM
 #ifdef BRCM_PLATFORM
@@ -31,7 +31,9 @@ enum ofp_extension_commands { /* Queue configuration commands */
     OFP_EXT_MAP_QUEUE,
 
     OFP_EXT_MOD_PORT_CONF,
-    OFP_EXT_SET_NETWORK
+    OFP_EXT_SET_NETWORK,
+
+    OFP_EXT_PACKET_IN_SUMMARY   /* Packet ins held back by a rate limit. */
 };
 
 struct ofp_extension_header {
@@ -131,6 +133,22 @@ struct openflow_ext_network_conf {
     unsigned int gw;    
 };
 
+/* Sent by the switch to the controllers that take packet ins, after the
+ * packet in that stands for the packet ins a rate limit of the datapath held
+ * back since its last summary. The packet in is the first of them; of the
+ * others, as many as there was room for were saved in the datapath buffers,
+ * and 'buffer_id' lists them. */
+struct openflow_ext_packet_in_summary {
+    struct ofp_extension_header header;
+    unsigned int n_held;            /* Packet ins held back, the packet in
+                                       sent included. */
+    unsigned char reason;           /* Of the packet in, one of OFPR_*. */
+    unsigned char table_id;         /* Of the packet in. */
+    unsigned short int n_buffers;   /* Entries in 'buffer_id'. */
+    unsigned int buffer_id[0];      /* Padded to 64 bits with zeros. */
+};
+OFP_ASSERT(sizeof(struct openflow_ext_packet_in_summary) == 24);
+
 struct openflow_ext_mod_qos_group
 {
     struct ofp_extension_header header;
@@ -97,7 +97,9 @@ lib_libopenflow_a_SOURCES = \
 	lib/jhash.h  \
 	lib/hlist.h  \
 	lib/rbuff.c  \
-	lib/rbuff.h 
+	lib/rbuff.h  \
+	lib/ring.c  \
+	lib/ring.h 
 	
 lib_libopenflow_a_LIBADD = oflib/ofl-actions.o \
                            oflib/ofl-actions-pack.o \
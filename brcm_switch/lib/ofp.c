@@ -161,12 +161,12 @@ put_openflow_xid(size_t openflow_len, unsigned char type, unsigned int xid,
 }
 
 /* Updates the 'length' field of the OpenFlow message in 'buffer' to
- * 'buffer->size'. */
+ * 'buffer->size', plus the size of the data chained to it. */
 void
 update_openflow_length(struct ofpbuf *buffer)
 {
     struct ofp_header *oh = ofpbuf_at_assert(buffer, 0, sizeof *oh);
-    oh->length = htons(buffer->size);
+    oh->length = htons(ofpbuf_msg_size(buffer));
 }
 
 /* Updates the 'len' field of the instruction header in 'buffer' to
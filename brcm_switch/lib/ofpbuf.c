@@ -36,8 +36,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include "dynamic-string.h"
+#include "ring.h"
 #include "util.h"
 
+struct ofpbuf_slab {
+    size_t size;                /* Data room, headroom included. */
+    unsigned int max_free;      /* Buffers kept in the free list. */
+    struct ring *free;          /* Created on first use. */
+    unsigned int n_buffers;     /* Buffers allocated from the heap. */
+};
+
+static struct ofpbuf_slab slabs[OFPBUF_SLABS] = {
+    { OFPBUF_SLAB_HEADROOM + 2048, 4096, NULL, 0 },
+    { OFPBUF_SLAB_HEADROOM + 9216, 256, NULL, 0 },
+};
+
+/* Returns true if the data of 'b' is the one allocated with it. */
+static inline int
+ofpbuf_is_inline__(const struct ofpbuf *b)
+{
+    return b->slab != NULL && b->base == (void *) (b + 1);
+}
+
 /* Initializes 'b' as an empty ofpbuf that contains the 'allocated' bytes of
  * memory starting at 'base'.
  *
@@ -54,6 +74,10 @@ ofpbuf_use(struct ofpbuf *b, void *base, size_t allocated)
     b->l2 = b->l3 = b->l4 = b->l7 = NULL;
     b->next = NULL;
     b->private_p = NULL;
+    b->slab = NULL;
+    b->refcount = 1;
+    b->parent = NULL;
+    b->more = NULL;
 }
 
 /* Initializes 'b' as an empty ofpbuf with an initial capacity of 'size'
@@ -68,7 +92,13 @@ ofpbuf_init(struct ofpbuf *b, size_t size)
 void
 ofpbuf_uninit(struct ofpbuf *b)
 {
-    if (b) {
+    if (b && b->more) {
+        ofpbuf_delete(b->more);
+        b->more = NULL;
+    }
+    if (b && b->parent) {
+        ofpbuf_delete(b->parent);
+    } else if (b && !ofpbuf_is_inline__(b)) {
         free(b->base);
     }
 }
@@ -125,14 +155,157 @@ ofpbuf_clone_data(const void *data, size_t size)
     return b;
 }
 
-/* Frees memory that 'b' points to, as well as 'b' itself. */
+/* Returns the free list of 'slab', creating it if it does not exist yet. */
+static struct ring *
+ofpbuf_slab_ring(struct ofpbuf_slab *slab)
+{
+    struct ring *r = slab->free;
+
+    if (r == NULL) {
+        r = ring_create(slab->max_free, 0);
+        if (!__sync_bool_compare_and_swap(&slab->free, NULL, r)) {
+            /* another thread created it first */
+            ring_destroy(r);
+            r = slab->free;
+        }
+    }
+    return r;
+}
+
+/* Creates and returns a new ofpbuf with room for 'size' bytes of data, and
+ * OFPBUF_SLAB_HEADROOM bytes of headroom, taken from the free list of the
+ * smallest size class it fits if possible. */
+struct ofpbuf *
+ofpbuf_slab_new(size_t size)
+{
+    struct ofpbuf_slab *slab;
+    struct ofpbuf *b;
+
+    for (slab = slabs; slab < &slabs[OFPBUF_SLABS]; slab++) {
+        if (size + OFPBUF_SLAB_HEADROOM <= slab->size) {
+            break;
+        }
+    }
+    if (slab == &slabs[OFPBUF_SLABS]) {
+        return ofpbuf_new_with_headroom(size, OFPBUF_SLAB_HEADROOM);
+    }
+
+    b = ring_get(ofpbuf_slab_ring(slab));
+    if (b == NULL) {
+        b = xmalloc(sizeof *b + slab->size);
+        __sync_fetch_and_add(&slab->n_buffers, 1);
+    }
+    ofpbuf_use(b, b + 1, slab->size);
+    b->slab = slab;
+    ofpbuf_reserve(b, OFPBUF_SLAB_HEADROOM);
+    return b;
+}
+
+/* Creates and returns a new slab ofpbuf whose data are copied from
+ * 'buffer'. */
+struct ofpbuf *
+ofpbuf_slab_clone(const struct ofpbuf *buffer)
+{
+    struct ofpbuf *b = ofpbuf_slab_new(buffer->size);
+    ofpbuf_put(b, buffer->data, buffer->size);
+    return b;
+}
+
+void
+ofpbuf_slab_get_stats(enum ofpbuf_slab_class class,
+                      struct ofpbuf_slab_stats *stats)
+{
+    const struct ofpbuf_slab *slab = &slabs[class];
+
+    stats->size = slab->size - OFPBUF_SLAB_HEADROOM;
+    stats->n_buffers = slab->n_buffers;
+    stats->n_free = slab->free != NULL ? ring_count(slab->free) : 0;
+}
+
+/* Adds an owner to 'b', and returns it. */
+struct ofpbuf *
+ofpbuf_ref(struct ofpbuf *b)
+{
+    __sync_fetch_and_add(&b->refcount, 1);
+    return b;
+}
+
+/* Creates and returns a new ofpbuf whose data are the 'size' bytes at
+ * 'offset' in the data of 'parent', which it adds an owner to. */
+struct ofpbuf *
+ofpbuf_view(struct ofpbuf *parent, size_t offset, size_t size)
+{
+    struct ofpbuf *b = xmalloc(sizeof *b);
+
+    assert(offset + size <= parent->size);
+    ofpbuf_use(b, (char *) parent->data + offset, size);
+    b->size = size;
+    b->parent = ofpbuf_ref(parent);
+    return b;
+}
+
+/* Makes 'more', which 'b' takes over, the data sent after the data of 'b'. */
+void
+ofpbuf_chain(struct ofpbuf *b, struct ofpbuf *more)
+{
+    assert(b->more == NULL && more->more == NULL);
+    b->more = more;
+}
+
+/* Copies the data chained to 'b' to its tail, and lets go of them. */
+void
+ofpbuf_linearize(struct ofpbuf *b)
+{
+    struct ofpbuf *more = b->more;
+
+    if (more != NULL) {
+        b->more = NULL;
+        ofpbuf_put(b, more->data, more->size);
+        ofpbuf_delete(more);
+    }
+}
+
+/* Returns the number of bytes of the message in 'b', counting the data
+ * chained to it. */
+size_t
+ofpbuf_msg_size(const struct ofpbuf *b)
+{
+    return b->size + (b->more != NULL ? b->more->size : 0);
+}
+
+/* Returns a view of the message in 'b', the data chained to it included, for
+ * another sender. */
+struct ofpbuf *
+ofpbuf_share(struct ofpbuf *b)
+{
+    struct ofpbuf *view = ofpbuf_view(b, 0, b->size);
+
+    if (b->more != NULL) {
+        ofpbuf_chain(view, ofpbuf_view(b->more, 0, b->more->size));
+    }
+    return view;
+}
+
+/* Frees memory that 'b' points to, as well as 'b' itself, once its last
+ * owner deletes it. */
 void
 ofpbuf_delete(struct ofpbuf *b)
 {
     if (b) {
-        ofpbuf_uninit(b);
+        /* an unshared buffer has a single owner, which is deleting it */
+        if (b->refcount != 1 && __sync_sub_and_fetch(&b->refcount, 1) != 0) {
+            return;
+        }
+        if (b->slab != NULL) {
+            ofpbuf_uninit(b);
+            if (ring_put(ofpbuf_slab_ring(b->slab), b) == 0) {
+                return;
+            }
+            __sync_fetch_and_sub(&b->slab->n_buffers, 1);
+        } else {
+            ofpbuf_uninit(b);
+        }
         free(b);
-        b = NULL;
     }
 }
 
@@ -182,8 +355,23 @@ ofpbuf_rebase__(struct ofpbuf *b, void *new_base)
 static void
 ofpbuf_resize_tailroom__(struct ofpbuf *b, size_t new_tailroom)
 {
-    b->allocated = ofpbuf_headroom(b) + b->size + new_tailroom;
-    ofpbuf_rebase__(b, xrealloc(b->base, b->allocated));
+    size_t used = ofpbuf_headroom(b) + b->size;
+    void *new_base;
+
+    if (ofpbuf_is_inline__(b) || b->parent) {
+        /* The data of a slab buffer cannot be reallocated on its own, nor
+         * the data of a view, which belong to its parent. */
+        new_base = xmalloc(used + new_tailroom);
+        memcpy(new_base, b->base, used);
+    } else {
+        new_base = xrealloc(b->base, used + new_tailroom);
+    }
+    b->allocated = used + new_tailroom;
+    ofpbuf_rebase__(b, new_base);
+    if (b->parent) {
+        ofpbuf_delete(b->parent);
+        b->parent = NULL;
+    }
 }
 
 /* Ensures that 'b' has room for at least 'size' bytes at its tail end,
@@ -204,11 +392,11 @@ ofpbuf_prealloc_headroom(struct ofpbuf *b, size_t size)
 }
 
 /* Trims the size of 'b' to fit its actual content, reducing its tailroom to
- * 0.  Its headroom, if any, is preserved. */
+ * 0.  Its headroom, if any, is preserved.  A slab buffer keeps its room. */
 void
 ofpbuf_trim(struct ofpbuf *b)
 {
-    if (ofpbuf_tailroom(b) > 0) {
+    if (ofpbuf_tailroom(b) > 0 && !ofpbuf_is_inline__(b)) {
         ofpbuf_resize_tailroom__(b, 0);
     }
 }
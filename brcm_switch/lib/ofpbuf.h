@@ -36,6 +36,8 @@
 
 #include <stddef.h>
 
+struct ofpbuf_slab;
+
 /* Buffer for holding arbitrary data.  An ofpbuf is automatically reallocated
  * as necessary if it grows too large for the available memory. */
 struct ofpbuf {
@@ -52,8 +54,67 @@ struct ofpbuf {
 
     struct ofpbuf *next;        /* Next in a list of ofpbufs. */
     void *private_p;            /* Private pointer for use by owner. */
+
+    struct ofpbuf_slab *slab;   /* Size class, if from ofpbuf_slab_new(). */
+    int refcount;               /* Owners; see ofpbuf_ref(). */
+    struct ofpbuf *parent;      /* Owner of the data, if from ofpbuf_view(). */
+    struct ofpbuf *more;        /* Data sent after these; see ofpbuf_chain(). */
+};
+
+/* Slab buffers.
+ *
+ * ofpbuf_slab_new() takes buffers from free lists per size class, which
+ * ofpbuf_delete() gives them back to, instead of allocating and freeing the
+ * memory of every packet. The struct ofpbuf and its data are allocated
+ * together, with OFPBUF_SLAB_HEADROOM bytes of headroom for the headers
+ * pushed in forwarding (VLAN, MPLS and PBB tags) and the headers of a packet
+ * in message, plus 2 bytes so that the IP header of an untagged frame is
+ * 4-byte aligned. The data of a slab buffer moves to the heap if it outgrows
+ * the buffer, and may not be taken over by another owner than the ofpbuf. */
+#define OFPBUF_SLAB_HEADROOM  (256 + 2)
+
+enum ofpbuf_slab_class {
+    OFPBUF_SLAB_2K,             /* Frames up to the usual MTUs. */
+    OFPBUF_SLAB_9K,             /* Jumbo frames. */
+    OFPBUF_SLABS
 };
 
+struct ofpbuf_slab_stats {
+    size_t size;                /* Data room, not counting the headroom. */
+    unsigned int n_buffers;     /* Buffers allocated from the heap. */
+    unsigned int n_free;        /* Buffers in the free list. */
+};
+
+struct ofpbuf *ofpbuf_slab_new(size_t);
+struct ofpbuf *ofpbuf_slab_clone(const struct ofpbuf *);
+void ofpbuf_slab_get_stats(enum ofpbuf_slab_class, struct ofpbuf_slab_stats *);
+
+/* Shared buffers.
+ *
+ * ofpbuf_ref() adds an owner to a buffer, which ofpbuf_delete() then only
+ * frees when its last owner deletes it. The owners of a shared buffer must
+ * not change it. */
+struct ofpbuf *ofpbuf_ref(struct ofpbuf *);
+
+/* Views.
+ *
+ * ofpbuf_view() returns a buffer whose data are a part of the data of
+ * another buffer, its parent, which it shares instead of copying them. The
+ * parent lives on until its views are deleted too. A view that needs more
+ * room than its data takes a copy of them, and lets go of its parent. */
+struct ofpbuf *ofpbuf_view(struct ofpbuf *parent, size_t offset, size_t size);
+
+/* Scatter/gather.
+ *
+ * A message may be sent from two buffers: ofpbuf_chain() hands 'more' over
+ * to 'b', which it follows on the wire, and which deletes it along with
+ * itself. The stream vconns write both in one system call; the other senders
+ * copy 'more' to the tail of 'b' with ofpbuf_linearize() first. */
+void ofpbuf_chain(struct ofpbuf *b, struct ofpbuf *more);
+void ofpbuf_linearize(struct ofpbuf *b);
+size_t ofpbuf_msg_size(const struct ofpbuf *b);
+struct ofpbuf *ofpbuf_share(struct ofpbuf *b);
+
 void ofpbuf_use(struct ofpbuf *, void *, size_t);
 
 void ofpbuf_init(struct ofpbuf *, size_t);
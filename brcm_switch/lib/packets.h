@@ -451,6 +451,27 @@ protocol_reset(struct protocols_std *proto) {
     proto->pbb       = NULL;
 }
 
+/* Moves the headers found in a frame along with it, by 'delta' bytes. */
+#define PROTOCOL_REBASE(P, DELTA) \
+    ((P) = (P) != NULL ? (void *) ((char *) (P) + (DELTA)) : NULL)
+
+static inline void
+protocol_rebase(struct protocols_std *proto, ptrdiff_t delta) {
+    PROTOCOL_REBASE(proto->eth, delta);
+    PROTOCOL_REBASE(proto->eth_snap, delta);
+    PROTOCOL_REBASE(proto->vlan, delta);
+    PROTOCOL_REBASE(proto->vlan_last, delta);
+    PROTOCOL_REBASE(proto->mpls, delta);
+    PROTOCOL_REBASE(proto->ipv4, delta);
+    PROTOCOL_REBASE(proto->ipv6, delta);
+    PROTOCOL_REBASE(proto->arp, delta);
+    PROTOCOL_REBASE(proto->tcp, delta);
+    PROTOCOL_REBASE(proto->udp, delta);
+    PROTOCOL_REBASE(proto->sctp, delta);
+    PROTOCOL_REBASE(proto->icmp, delta);
+    PROTOCOL_REBASE(proto->pbb, delta);
+}
+
 
 
 #endif /* packets.h */
@@ -86,6 +86,9 @@ struct rconn {
     bool reliable;
 
     struct ofp_queue txq;
+    size_t txq_bytes;           /* Bytes of the packets in 'txq'. */
+    bool corked;                /* See rconn_cork(). */
+    bool tx_pending;            /* The vconn may hold packets not written. */
 
     int backoff;
     int max_backoff;
@@ -200,6 +203,9 @@ rconn_create(int probe_interval, int max_backoff)
     rc->reliable = false;
 
     queue_init(&rc->txq);
+    rc->txq_bytes = 0;
+    rc->corked = false;
+    rc->tx_pending = false;
 
     rc->backoff = 2;    //0;
     rc->max_backoff = max_backoff ? max_backoff : 60;
@@ -373,19 +379,39 @@ run_CONNECTING(struct rconn *rc)
     }
 }
 
+/* Writes the packets that the vconn of 'rc' holds. */
+static void
+flush_vconn(struct rconn *rc)
+{
+    int error = vconn_uncork(rc->vconn);
+
+    rc->tx_pending = error == EAGAIN;
+    if (error && error != EAGAIN) {
+        disconnect(rc, error);
+    }
+}
+
+/* Passes the packets queued on 'rc' to the vconn, which holds them until they
+ * are all passed (or it is full), so that they are written together. */
 static void
 do_tx_work(struct rconn *rc)
 {
-    if (!rc->txq.n) {
+    bool queued = rc->txq.n > 0;
+
+    if (!queued && !rc->tx_pending) {
         return;
     }
+    vconn_cork(rc->vconn);
     while (rc->txq.n > 0) {
         int error = try_send(rc);
         if (error) {
             break;
         }
     }
-    if (!rc->txq.n) {
+    if (rc->vconn && !rc->corked) {
+        flush_vconn(rc);
+    }
+    if (queued && !rc->txq.n) {
         poll_immediate_wake();
     }
 }
@@ -471,7 +497,7 @@ rconn_run_wait(struct rconn *rc)
         poll_timer_wait(sat_mul(remaining, 1000));
     }
 
-    if ((rc->state & (S_ACTIVE | S_IDLE)) && rc->txq.n) {
+    if ((rc->state & (S_ACTIVE | S_IDLE)) && (rc->txq.n || rc->tx_pending)) {
         vconn_wait(rc->vconn, WAIT_SEND);
     }
 }
@@ -555,13 +581,16 @@ rconn_send(struct rconn *rc, struct ofpbuf *b, int *n_queued)
             ++*n_queued;
         }
         queue_push_tail(&rc->txq, b);
+        rc->txq_bytes += ofpbuf_msg_size(b);
 
         /* If the queue was empty before we added 'b', try to send some
          * packets.  (But if the queue had packets in it, it's because the
          * vconn is backlogged and there's no point in stuffing more into it
          * now.  We'll get back to that in rconn_run().) */
         if (rc->txq.n == 1) {
-            try_send(rc);
+            if (!try_send(rc) && !rc->corked) {
+                flush_vconn(rc);
+            }
         }
         return 0;
     } else {
@@ -593,6 +622,59 @@ rconn_send_with_limit(struct rconn *rc, struct ofpbuf *b,
     return retval;
 }
 
+/* Sends 'b' on 'rc'.  Returns 0 if successful, EAGAIN if the packets queued
+ * on 'rc' already amount to 'budget' bytes, or ENOTCONN if 'rc' is not
+ * currently connected.  Regardless of return value, 'b' is destroyed. */
+int
+rconn_send_with_budget(struct rconn *rc, struct ofpbuf *b, size_t budget)
+{
+    int retval;
+    retval = rc->txq_bytes >= budget ? EAGAIN : rconn_send(rc, b, NULL);
+    if (retval) {
+        ofpbuf_delete(b);
+    }
+    return retval;
+}
+
+/* Returns the number of bytes of the packets queued on 'rc'.  The packets
+ * already passed to the vconn, which holds a bounded number of them, are not
+ * counted. */
+size_t
+rconn_queued_bytes(const struct rconn *rc)
+{
+    return rc->txq_bytes;
+}
+
+/* Returns true if 'rc' holds packets, queued or in the vconn, that only
+ * rconn_run() will write. */
+bool
+rconn_tx_backlogged(const struct rconn *rc)
+{
+    return rc->txq.n > 0 || rc->tx_pending;
+}
+
+/* Holds the packets sent on 'rc' until rconn_uncork(), so that a burst of them
+ * is written with as few system calls as possible.  Packets are still
+ * written before then if too many are held. */
+void
+rconn_cork(struct rconn *rc)
+{
+    rc->corked = true;
+    if (rc->vconn) {
+        vconn_cork(rc->vconn);
+    }
+}
+
+/* Writes the packets held since rconn_cork(). */
+void
+rconn_uncork(struct rconn *rc)
+{
+    rc->corked = false;
+    if (rc->state & (S_ACTIVE | S_IDLE)) {
+        do_tx_work(rc);
+    }
+}
+
 /* Returns the total number of packets successfully sent on the underlying
  * vconn.  A packet is not counted as sent while it is still queued in the
  * rconn, only when it has been successfuly passed to the vconn.  */
@@ -796,6 +878,7 @@ try_send(struct rconn *rc)
     struct ofpbuf *next = rc->txq.head->next;
     struct ofp_header *h = rc->txq.head->data;
     int *n_queued = rc->txq.head->private_p;
+    size_t size = ofpbuf_msg_size(rc->txq.head);
     /* TODO Zoltan: Temporarily removed when moving to OpenFlow 1.1 */
     /* ofpstat_inc_protocol_stat(&rc->ofps_sent, h); */
     rc->idle_echo_xid = h->xid;
@@ -808,6 +891,8 @@ try_send(struct rconn *rc)
         return retval;
     }
     rc->packets_sent++;
+    rc->txq_bytes -= size;
+    rc->tx_pending = true;
     if (n_queued) {
         --*n_queued;
     }
@@ -873,6 +958,7 @@ flush_queue(struct rconn *rc)
         }
         ofpbuf_delete(b);
     }
+    rc->txq_bytes = 0;
     poll_immediate_wake();
 }
 
@@ -937,6 +1023,9 @@ copy_to_monitor(struct rconn *rc, const struct ofpbuf *b)
 
         if (!clone) {
             clone = ofpbuf_clone(b);
+            if (b->more) {
+                ofpbuf_put(clone, b->more->data, b->more->size);
+            }
         }
         retval = vconn_send(vconn, clone);
         if (!retval) {
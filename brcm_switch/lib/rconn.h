@@ -72,6 +72,11 @@ void rconn_recv_wait(struct rconn *);
 int rconn_send(struct rconn *, struct ofpbuf *, int *n_queued);
 int rconn_send_with_limit(struct rconn *, struct ofpbuf *,
                           int *n_queued, int queue_limit);
+int rconn_send_with_budget(struct rconn *, struct ofpbuf *, size_t budget);
+size_t rconn_queued_bytes(const struct rconn *);
+bool rconn_tx_backlogged(const struct rconn *);
+void rconn_cork(struct rconn *);
+void rconn_uncork(struct rconn *);
 unsigned int rconn_packets_sent(const struct rconn *);
 unsigned int rconn_packets_received(const struct rconn *);
 
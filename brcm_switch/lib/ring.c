@@ -0,0 +1,172 @@
+/******************************************************
+*filename:ring.c
+*function : Provide a lock-free ring to queue pointers between threads.
+*******************************************************/
+#include <config.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+#include "util.h"
+
+struct ring *
+ring_create(unsigned int count, unsigned int flags)
+{
+    struct ring *r;
+    unsigned int size = 1;
+
+    while (size < count) {
+        size <<= 1;
+    }
+
+    if (posix_memalign((void **) &r, RING_CACHE_LINE,
+                       sizeof *r + size * sizeof r->slots[0])) {
+        out_of_memory();
+    }
+    memset(r, 0, sizeof *r);
+    r->size = size;
+    r->mask = size - 1;
+    r->flags = flags;
+    return r;
+}
+
+void
+ring_destroy(struct ring *r)
+{
+    free(r);
+}
+
+/* Waits for the threads that claimed slots before ours to be done with them.
+ * Yields now and then, in case one of them was preempted. */
+static void
+ring_wait_tail(volatile unsigned int *tail, unsigned int head)
+{
+    unsigned int spins = 0;
+
+    while (*tail != head) {
+        if (++spins % 128 == 0) {
+            sched_yield();
+        }
+    }
+}
+
+/* Claims up to n slots for the producer, or exactly n if fixed. Returns the
+ * number claimed, the first of which is stored in *head. */
+static unsigned int
+ring_move_prod_head(struct ring *r, unsigned int n, bool fixed,
+                    unsigned int *head)
+{
+    unsigned int old_head, free_slots;
+
+    do {
+        old_head = r->prod.head;
+        free_slots = r->size + r->cons.tail - old_head;
+        if (n > free_slots) {
+            n = fixed ? 0 : free_slots;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (r->flags & RING_F_SP_ENQ) {
+            r->prod.head = old_head + n;
+            break;
+        }
+    } while (!__sync_bool_compare_and_swap(&r->prod.head, old_head,
+                                           old_head + n));
+    *head = old_head;
+    return n;
+}
+
+/* Claims up to n filled slots for the consumer, or exactly n if fixed.
+ * Returns the number claimed, the first of which is stored in *head. */
+static unsigned int
+ring_move_cons_head(struct ring *r, unsigned int n, bool fixed,
+                    unsigned int *head)
+{
+    unsigned int old_head, entries;
+
+    do {
+        old_head = r->cons.head;
+        entries = r->prod.tail - old_head;
+        if (n > entries) {
+            n = fixed ? 0 : entries;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (r->flags & RING_F_SC_DEQ) {
+            r->cons.head = old_head + n;
+            break;
+        }
+    } while (!__sync_bool_compare_and_swap(&r->cons.head, old_head,
+                                           old_head + n));
+    *head = old_head;
+    return n;
+}
+
+static unsigned int
+ring_enqueue(struct ring *r, void *const *objs, unsigned int n, bool fixed)
+{
+    unsigned int head, i;
+
+    n = ring_move_prod_head(r, n, fixed, &head);
+    if (n == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        r->slots[(head + i) & r->mask] = objs[i];
+    }
+    /* The slots are written before they are published; producers that
+     * claimed slots earlier publish them first. */
+    __sync_synchronize();
+    ring_wait_tail(&r->prod.tail, head);
+    r->prod.tail = head + n;
+    return n;
+}
+
+static unsigned int
+ring_dequeue(struct ring *r, void **objs, unsigned int n, bool fixed)
+{
+    unsigned int head, i;
+
+    n = ring_move_cons_head(r, n, fixed, &head);
+    if (n == 0) {
+        return 0;
+    }
+
+    /* The slots are read after the producer tail that published them. */
+    __sync_synchronize();
+    for (i = 0; i < n; i++) {
+        objs[i] = r->slots[(head + i) & r->mask];
+    }
+    /* The slots are read before producers may reuse them. */
+    __sync_synchronize();
+    ring_wait_tail(&r->cons.tail, head);
+    r->cons.tail = head + n;
+    return n;
+}
+
+unsigned int
+ring_put_bulk(struct ring *r, void *const *objs, unsigned int n)
+{
+    return ring_enqueue(r, objs, n, true);
+}
+
+unsigned int
+ring_put_burst(struct ring *r, void *const *objs, unsigned int n)
+{
+    return ring_enqueue(r, objs, n, false);
+}
+
+unsigned int
+ring_get_bulk(struct ring *r, void **objs, unsigned int n)
+{
+    return ring_dequeue(r, objs, n, true);
+}
+
+unsigned int
+ring_get_burst(struct ring *r, void **objs, unsigned int n)
+{
+    return ring_dequeue(r, objs, n, false);
+}
@@ -0,0 +1,107 @@
+/*****************************************************
+*filename: ring.h
+******************************************************/
+#ifndef RING_H
+#define RING_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/****************************************************************************
+ * Lock-free ring of pointers, for queues between threads.
+ *
+ * The ring has a power of two slots, addressed by free running indices. The
+ * producers and the consumers each keep a head, up to which they have
+ * claimed slots, and a tail, up to which they are done with them, on a cache
+ * line of their own, so that the two sides only share a line when one reads
+ * the tail of the other to find how many slots it may claim.
+ *
+ * A single producer, or a single consumer, moves its head with a plain
+ * store; several move it with a compare and swap, and then publish their
+ * slots in the order they claimed them. The flags at creation tell which
+ * sides have a single thread, which must then be the only one using that
+ * side of the ring.
+ *
+ * The bulk functions move all the given pointers, or none; the burst ones
+ * move as many as they can.
+ ****************************************************************************/
+
+#define RING_CACHE_LINE  64
+
+#define RING_F_SP_ENQ  0x1      /* a single producer. */
+#define RING_F_SC_DEQ  0x2      /* a single consumer. */
+
+struct ring_headtail {
+    volatile unsigned int head;
+    volatile unsigned int tail;
+} __attribute__((aligned(RING_CACHE_LINE)));
+
+struct ring {
+    unsigned int size;          /* number of slots, a power of two. */
+    unsigned int mask;          /* size - 1. */
+    unsigned int flags;         /* RING_F_*. */
+    struct ring_headtail prod;
+    struct ring_headtail cons;
+    void *slots[0] __attribute__((aligned(RING_CACHE_LINE)));
+};
+
+/* Creates a ring of at least count slots, rounded up to a power of two,
+ * for the producers and consumers given by flags. */
+struct ring *ring_create(unsigned int count, unsigned int flags);
+void ring_destroy(struct ring *r);
+
+/* Enqueues the n pointers of objs, all or none. Returns the number
+ * enqueued. */
+unsigned int ring_put_bulk(struct ring *r, void *const *objs, unsigned int n);
+
+/* Enqueues as many of the n pointers of objs as fit, in order. Returns the
+ * number enqueued. */
+unsigned int ring_put_burst(struct ring *r, void *const *objs, unsigned int n);
+
+/* Dequeues n pointers into objs, all or none. Returns the number
+ * dequeued. */
+unsigned int ring_get_bulk(struct ring *r, void **objs, unsigned int n);
+
+/* Dequeues up to n pointers into objs. Returns the number dequeued. */
+unsigned int ring_get_burst(struct ring *r, void **objs, unsigned int n);
+
+/* Enqueues obj. Returns 0 if successful, -1 if the ring is full. */
+static inline int
+ring_put(struct ring *r, void *obj)
+{
+    return ring_put_bulk(r, &obj, 1) ? 0 : -1;
+}
+
+/* Dequeues a pointer, or returns NULL if the ring is empty. */
+static inline void *
+ring_get(struct ring *r)
+{
+    void *obj;
+
+    return ring_get_bulk(r, &obj, 1) ? obj : NULL;
+}
+
+/* Returns the number of pointers in the ring, which other threads may
+ * change right away. */
+static inline unsigned int
+ring_count(const struct ring *r)
+{
+    unsigned int cons_tail = r->cons.tail;
+    unsigned int count = r->prod.tail - cons_tail;
+
+    return count > r->size ? r->size : count;
+}
+
+static inline bool
+ring_is_empty(const struct ring *r)
+{
+    return ring_count(r) == 0;
+}
+
+static inline bool
+ring_is_full(const struct ring *r)
+{
+    return ring_count(r) == r->size;
+}
+
+#endif /* ring.h */
@@ -2,141 +2,245 @@
 *filename:timer_wheel.c
 *function : Provide a timer_wheel mechanism to Aging the flow Entries.
 *******************************************************/
-#include <stdio.h>
-#include <stdlib.h>
-#include <malloc.h>
+#include <config.h>
+#include <limits.h>
 #include <string.h>
-#include <signal.h>
-#include <time.h>
-#include <sys/time.h>
 #include "timer_wheel.h"
-#include "timeval.h"
+#include "util.h"
 
-struct timerwheel g_tw;
-static int timer_add(struct timer *p)
+#define L0_MASK  (TIMER_WHEEL_L0_SLOTS - 1)
+#define LN_MASK  (TIMER_WHEEL_LN_SLOTS - 1)
+
+/* Number of time bits below the slot index of a level above the first. */
+#define LEVEL_SHIFT(LEVEL)  (TIMER_WHEEL_L0_BITS + (LEVEL) * TIMER_WHEEL_LN_BITS)
+
+/* Longest delay the wheel holds; later timers wait in the last slot. */
+#define MAX_DELAY  ((1LL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+static inline void
+l0_mark(struct timer_wheel *tw, unsigned int index, bool used)
 {
-    (void)p;
-#if 0
-    struct timer *timer;
-    bool insert_flag = 0;
-    //add two timers according to type
-    unsigned int index = (g_tw.cur_index + p->interval/g_tw.time_accuracy)%g_tw.num;
-    g_tw.cur_time = time_now_sec();
-    p->timeout= g_tw.cur_time +  p->interval/g_tw.time_accuracy;
-
-    LIST_FOR_EACH(timer, struct timer, node, g_tw.timer_list[index])
-    {
-        if(timer->timeout >= p->timeout)
-        {
-             list_insert(&timer->node, &p->node);
-             insert_flag = 1;
-             break;
-        }
+    if (used) {
+        tw->l0_map[index / 64] |= 1ULL << (index % 64);
+    } else {
+        tw->l0_map[index / 64] &= ~(1ULL << (index % 64));
     }
-    if( 0 == insert_flag )
-    {
-        list_push_back(g_tw.timer_list[index], &p->node);
-    }
-#endif
-    return 0;
 }
 
-void * timerwheel_add(struct timer *p,const alta_aclTimer interval, timer_expiry *func, void *user_data)
+static inline void
+ln_mark(struct timer_wheel *tw, int level, unsigned int index, bool used)
 {
-    //struct timer_node *p = (struct timer_node *)malloc(sizeof(struct timer_node));
-    if (!p)
-    {
-        return NULL;
+    if (used) {
+        tw->ln_map[level] |= 1ULL << index;
+    } else {
+        tw->ln_map[level] &= ~(1ULL << index);
     }
-    memset(p, 0, sizeof(struct timer));
-    p->func= func;
-    p->interval = interval;
-    p->user_data = user_data;
-    timer_add(p);
-    return p;
 }
 
-int timerwheel_del(struct timer *p)
+/* Returns the first marked slot of a bitmap of n_bits, starting from 'from'
+ * and wrapping around, or -1 if none is. */
+static int
+map_find(const unsigned long long int *map, unsigned int n_bits, unsigned int from)
 {
-    if(!p)
-    {
-        return 1;
+    unsigned int i = from;
+    unsigned int n = 0;
+
+    while (n < n_bits) {
+        unsigned long long int w = map[i / 64] >> (i % 64);
+
+        if (w != 0) {
+            unsigned int d = __builtin_ctzll(w);
+
+            return n + d < n_bits ? (int)(i + d) : -1;
+        }
+        n += 64 - i % 64;
+        i = (i + 64 - i % 64) % n_bits;
     }
-    list_remove(&p->node);
-    return 0;
+    return -1;
 }
 
-void  run_timers(void)
+/* Returns the earliest time a timer of the first level expires, or a level
+ * above turns over a slot holding timers, or LLONG_MAX if none does. The
+ * marks of the slots found empty are cleared. */
+static long long int
+timer_wheel_earliest(struct timer_wheel *tw)
 {
-#if 0
-    unsigned long diff;
-    struct timer *timer=NULL;
-    g_tw.cur_time = time_now_sec();
-    if (0 == g_tw.pre_time)
-    {
-        g_tw.pre_time = g_tw.cur_time;
+    long long int next = LLONG_MAX;
+    int slot, i;
+
+    while ((slot = map_find(tw->l0_map, TIMER_WHEEL_L0_SLOTS, tw->now & L0_MASK)) >= 0) {
+        if (!list_is_empty(&tw->l0[slot])) {
+            next = tw->now + ((slot - tw->now) & L0_MASK);
+            break;
+        }
+        l0_mark(tw, slot, false);
     }
-    diff = (g_tw.cur_time -g_tw.pre_time)/g_tw.time_accuracy;
-    if (diff > 0)
-    {
-        g_tw.pre_time = g_tw.cur_time;
-        g_tw.cur_index += 1;
-        if (g_tw.cur_index >= g_tw.num)
-        {
-            g_tw.cur_index = 0;
+
+    /* The current slot of a level above has been moved down already. */
+    for (i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+        long long int turn = (tw->now >> LEVEL_SHIFT(i)) + 1;
+
+        while ((slot = map_find(&tw->ln_map[i], TIMER_WHEEL_LN_SLOTS, turn & LN_MASK)) >= 0) {
+            if (!list_is_empty(&tw->ln[i][slot])) {
+                next = MIN(next, (turn + ((slot - turn) & LN_MASK)) << LEVEL_SHIFT(i));
+                break;
+            }
+            ln_mark(tw, i, slot, false);
         }
     }
-    else
-    {
+    return next;
+}
+
+/* Links an unlinked timer in the slot of its expiry time. */
+static void
+timer_wheel_place(struct timer_wheel *tw, struct wheel_timer *t)
+{
+    long long int expires = t->expires;
+    long long int delay = expires - tw->now;
+    int i;
+
+    if (delay <= 0) {
+        list_push_back(&tw->l0[tw->now & L0_MASK], &t->node);
+        l0_mark(tw, tw->now & L0_MASK, true);
+        return;
+    }
+    if (delay < TIMER_WHEEL_L0_SLOTS) {
+        list_push_back(&tw->l0[expires & L0_MASK], &t->node);
+        l0_mark(tw, expires & L0_MASK, true);
         return;
     }
 
-    while(!list_is_empty(g_tw.timer_list[g_tw.cur_index]))
-    {
-        timer = list_pop_front(g_tw.timer_list[g_tw.cur_index]);
-        //list_remove(&timer->node);
-        if (timer && g_tw.cur_time >= timer->timeout)
-        {
-            if(0 == timer->func( timer->user_data))
-            {
-                timer->timeout= g_tw.cur_time +  timer->interval/g_tw.time_accuracy;
-                list_push_back(g_tw.timer_list[g_tw.cur_index],&timer->node);
-                break;
-            }
+    if (delay > MAX_DELAY) {
+        expires = tw->now + MAX_DELAY;
+        delay = MAX_DELAY;
+    }
+    for (i = 0; i < TIMER_WHEEL_LEVELS - 1; i++) {
+        if (delay < 1LL << LEVEL_SHIFT(i + 1)) {
+            break;
         }
-        else
-        {
-             list_push_back(g_tw.timer_list[g_tw.cur_index],&timer->node);
-             break;
+    }
+    list_push_back(&tw->ln[i][(expires >> LEVEL_SHIFT(i)) & LN_MASK], &t->node);
+    ln_mark(tw, i, (expires >> LEVEL_SHIFT(i)) & LN_MASK, true);
+}
+
+/* Moves the timers of the current slot of a level down the wheel, and
+ * returns the slot index. */
+static unsigned int
+timer_wheel_cascade(struct timer_wheel *tw, int level)
+{
+    unsigned int index = (tw->now >> LEVEL_SHIFT(level)) & LN_MASK;
+    struct list *slot = &tw->ln[level][index];
+
+    /* The timers of the slot expire within a turn of the level below, or
+     * are held back by MAX_DELAY to the slot before this one. */
+    while (!list_is_empty(slot)) {
+        struct wheel_timer *t = CONTAINER_OF(list_pop_front(slot),
+                                             struct wheel_timer, node);
+        timer_wheel_place(tw, t);
+    }
+    ln_mark(tw, level, index, false);
+    return index;
+}
+
+void
+timer_wheel_init(struct timer_wheel *tw, long long int now)
+{
+    int i, j;
+
+    tw->now = now;
+    tw->next = LLONG_MAX;
+    tw->n_timers = 0;
+    memset(tw->l0_map, 0, sizeof tw->l0_map);
+    memset(tw->ln_map, 0, sizeof tw->ln_map);
+    for (i = 0; i < TIMER_WHEEL_L0_SLOTS; i++) {
+        list_init(&tw->l0[i]);
+    }
+    for (i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+        for (j = 0; j < TIMER_WHEEL_LN_SLOTS; j++) {
+            list_init(&tw->ln[i][j]);
         }
-     }
-   #endif
-    return;
+    }
 }
 
-int timerwheel_init(const unsigned int num, const unsigned int  time_accuracy)
+void
+wheel_timer_init(struct wheel_timer *t)
 {
-#if 0
-    int i = 0;
-    memset(&g_tw, 0, sizeof(struct timerwheel));
-    g_tw.timer_list = (struct list **)malloc(num*sizeof(struct list *));
-    if (NULL == g_tw.timer_list)
-    {
-        return 1;
+    list_init(&t->node);
+    t->expires = 0;
+}
+
+void
+timer_wheel_add(struct timer_wheel *tw, struct wheel_timer *t,
+                long long int expires)
+{
+    if (wheel_timer_is_armed(t)) {
+        list_remove(&t->node);
+    } else {
+        tw->n_timers++;
     }
-    for (i = 0;i < num; i++)
-    {
-        g_tw.timer_list[i] = (struct list *) malloc (sizeof(struct list)) ;
-        if(!g_tw.timer_list[i])
-        {
-            return 1;
+    t->expires = expires;
+    tw->next = MIN(tw->next, expires);
+    timer_wheel_place(tw, t);
+}
+
+void
+timer_wheel_cancel(struct timer_wheel *tw, struct wheel_timer *t)
+{
+    if (wheel_timer_is_armed(t)) {
+        list_remove(&t->node);
+        list_init(&t->node);
+        tw->n_timers--;
+    }
+}
+
+struct wheel_timer *
+timer_wheel_expire(struct timer_wheel *tw, long long int now)
+{
+    for (;;) {
+        unsigned int index = tw->now & L0_MASK;
+        struct list *slot = &tw->l0[index];
+        long long int next;
+        int i;
+
+        if (!list_is_empty(slot)) {
+            struct list *node = list_pop_front(slot);
+
+            if (list_is_empty(slot)) {
+                l0_mark(tw, index, false);
+            }
+            list_init(node);
+            tw->n_timers--;
+            return CONTAINER_OF(node, struct wheel_timer, node);
+        }
+        if (tw->n_timers == 0) {
+            tw->now = MAX(tw->now, now);
+            tw->next = LLONG_MAX;
+            memset(tw->l0_map, 0, sizeof tw->l0_map);
+            memset(tw->ln_map, 0, sizeof tw->ln_map);
+            return NULL;
+        }
+
+        next = timer_wheel_earliest(tw);
+        if (tw->now >= now || next > now) {
+            tw->now = MAX(tw->now, MIN(now, next));
+            tw->next = next;
+            return NULL;
+        }
+
+        /* the slots before next are empty */
+        tw->now = next;
+        if ((tw->now & L0_MASK) == 0) {
+            for (i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+                if (timer_wheel_cascade(tw, i) != 0) {
+                    break;
+                }
+            }
         }
-        list_init(g_tw.timer_list[i]); //ʼÿһͷ
     }
-    g_tw.time_accuracy = time_accuracy;
-    g_tw.num = num;
-#endif
-    (void)num;
-    (void)time_accuracy;
-    return 0;
+}
+
+long long int
+timer_wheel_next(const struct timer_wheel *tw)
+{
+    return tw->n_timers == 0 ? LLONG_MAX : tw->next;
 }
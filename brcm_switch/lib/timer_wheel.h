@@ -1,44 +1,81 @@
- /*****************************************************
+/*****************************************************
 *filename: timer_wheel.h
 ******************************************************/
 #ifndef __TIMER_WHEEL__
 #define __TIMER_WHEEL__
+#include <stdbool.h>
 #include "list.h"
-typedef int timer_expiry( void *user_data);
 
-typedef struct _alta_aclTimer
-{
-    unsigned char type;
-    /** timer for hardware timerout. */
-    int  hardtimer;
-
-    /** timer for idle timerout. */
-    int  idletimer;
+/****************************************************************************
+ * Hierarchical timing wheel, with a granularity of one millisecond.
+ *
+ * The first level has one slot per millisecond for the next 256 ms; each
+ * further level has 64 slots, each covering a whole turn of the level
+ * below. A timer is linked in the slot of its expiry time at the lowest
+ * level that reaches it, and moves down a level when the wheel turns over
+ * its slot, so the four upper levels cover about 49 days. Adding and
+ * cancelling a timer take constant time, and running the wheel only touches
+ * the timers that expire, plus a share of the timers moving down.
+ *
+ * The slots that hold timers are marked in a bitmap per level, so running
+ * the wheel skips straight over empty stretches of time, and the wheel
+ * keeps the time before which no timer expires.
+ *
+ * Timers are embedded in their owner, which is found with CONTAINER_OF
+ * when the timer expires; the wheel has no callbacks.
+ ****************************************************************************/
 
-} alta_aclTimer;
+#define TIMER_WHEEL_L0_BITS   8
+#define TIMER_WHEEL_L0_SLOTS  (1 << TIMER_WHEEL_L0_BITS)
+#define TIMER_WHEEL_LN_BITS   6
+#define TIMER_WHEEL_LN_SLOTS  (1 << TIMER_WHEEL_LN_BITS)
+#define TIMER_WHEEL_LEVELS    4     /* levels above the first one. */
 
-struct timer{
-    struct list node;
-    alta_aclTimer interval; /*ʱʱֵ*/
-    time_t timeout;	 /*ʱʱ */
-    timer_expiry *func;	 /*ʱص*/
-    void *user_data;	 /*ʱ*/
+struct wheel_timer {
+    struct list      node;     /* in a wheel slot, or empty if not armed. */
+    long long int    expires;  /* expiry time, in ms. */
 };
 
-/*ʱ*/
-struct timerwheel{
-    unsigned int   time_accuracy;	 /*ʱʱƬС*/
-    unsigned int   num;	 /*ʱ*/
-    unsigned int   cur_index;	 /*ʱǰʱƬС*/
-    time_t  cur_time;	 /*ʱǰʱ*/
-    time_t  pre_time;	 /*ʱһʱ*/
-    struct list **timer_list;
+struct timer_wheel {
+    long long int    now;      /* time of the slot being expired, in ms. */
+    long long int    next;     /* no timer expires earlier. */
+    unsigned int     n_timers; /* armed timers. */
+    struct list      l0[TIMER_WHEEL_L0_SLOTS];
+    struct list      ln[TIMER_WHEEL_LEVELS][TIMER_WHEEL_LN_SLOTS];
+    /* slots that may hold timers; cancelling a timer leaves its mark. */
+    unsigned long long int l0_map[TIMER_WHEEL_L0_SLOTS / 64];
+    unsigned long long int ln_map[TIMER_WHEEL_LEVELS];
 };
 
-int  timerwheel_init(const unsigned int num, const unsigned int  time_accuracy);
-int  timerwheel_del(struct timer *p);
-void *  timerwheel_add(struct timer *p,const alta_aclTimer interval, timer_expiry *func, void *user_data);
-void  run_timers(void);
+/* Initializes an empty wheel, whose time starts at now ms. */
+void timer_wheel_init(struct timer_wheel *tw, long long int now);
 
-#endif
+/* Initializes a timer as not armed. */
+void wheel_timer_init(struct wheel_timer *t);
+
+static inline bool
+wheel_timer_is_armed(const struct wheel_timer *t)
+{
+    return !list_is_empty(&t->node);
+}
 
+/* Arms a timer to expire at the given time in ms, re-arming it if it is
+ * armed already. A time in the past expires at the next run. */
+void timer_wheel_add(struct timer_wheel *tw, struct wheel_timer *t,
+                     long long int expires);
+
+/* Disarms a timer; does nothing if the timer is not armed. */
+void timer_wheel_cancel(struct timer_wheel *tw, struct wheel_timer *t);
+
+/* Advances the wheel up to now ms and returns one timer expired by then, or
+ * NULL if there are no more. The returned timer is disarmed, and may be
+ * re-armed, and other timers cancelled, before the next call. */
+struct wheel_timer *timer_wheel_expire(struct timer_wheel *tw, long long int now);
+
+/* Returns the time in ms by which timer_wheel_expire() should run next to
+ * deliver timers on time, or LLONG_MAX if no timer is armed. The time may
+ * be early when the next timers are still on a level above the first, or
+ * the earliest timer was cancelled since the last run. */
+long long int timer_wheel_next(const struct timer_wheel *tw);
+
+#endif
@@ -116,7 +116,10 @@ static int
 netlink_send(struct vconn *vconn, struct ofpbuf *buffer) 
 {
     struct netlink_vconn *netlink = netlink_vconn_cast(vconn);
-    int retval = dpif_send_openflow(&netlink->dp, netlink->dp_idx, buffer);
+    int retval;
+
+    ofpbuf_linearize(buffer);
+    retval = dpif_send_openflow(&netlink->dp, netlink->dp_idx, buffer);
     if (!retval) {
         ofpbuf_delete(buffer);
     }
@@ -154,4 +157,5 @@ struct vconn_class netlink_vconn_class = {
     netlink_recv,               /* recv */
     netlink_send,               /* send */
     netlink_wait,               /* wait */
+    NULL,                       /* flush */
 };
@@ -62,6 +62,7 @@ struct vconn {
     struct ofpstat ofps_rcvd;
     struct ofpstat ofps_sent;
     unsigned int xid;
+    bool corked;                /* Holding messages; see vconn_cork(). */
 };
 
 void vconn_init(struct vconn *, struct vconn_class *, int connect_status,
@@ -130,6 +131,14 @@ struct vconn_class {
     /* Arranges for the poll loop to wake up when 'vconn' is ready to take an
      * action of the given 'type'. */
     void (*wait)(struct vconn *vconn, enum vconn_wait_type type);
+
+    /* Writes the messages that 'vconn' holds, either because it is corked or
+     * because it could not write them all when they were sent.  Returns 0 if
+     * none are left, EAGAIN if some must wait for 'vconn' to become writable,
+     * otherwise a positive errno value.
+     *
+     * May be null if the send function never holds messages. */
+    int (*flush)(struct vconn *vconn);
 };
 
 /* Passive virtual connection to an OpenFlow device.
@@ -712,6 +712,7 @@ ssl_send(struct vconn *vconn, struct ofpbuf *buffer)
     } else {
         int error;
 
+        ofpbuf_linearize(buffer);
         sslv->txbuf = buffer;
         error = ssl_do_tx(vconn);
         switch (error) {
@@ -787,6 +788,7 @@ struct vconn_class ssl_vconn_class = {
     ssl_recv,                   /* recv */
     ssl_send,                   /* send */
     ssl_wait,                   /* wait */
+    NULL,                       /* flush */
 };
 
 /* Passive SSL. */
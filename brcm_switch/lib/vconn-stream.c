@@ -35,15 +35,19 @@
 #include "vconn-stream.h"
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "leak-checker.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
+#include "queue.h"
 #include "socket-util.h"
 #include "util.h"
 #include "vconn-provider.h"
@@ -54,20 +58,42 @@
 
 /* Active stream socket vconn. */
 
+/* Messages are received into a buffer of STREAM_RX_SIZE bytes, read() into at
+ * least STREAM_RX_MIN_READ bytes at a time.  Messages of STREAM_RX_VIEW_MIN
+ * bytes or more are sliced out of it and share it; the others are copied, so
+ * that a buffer kept by the messages holds at most STREAM_RX_SIZE /
+ * STREAM_RX_VIEW_MIN times the bytes they take. */
+#define STREAM_RX_SIZE      (256 * 1024)
+#define STREAM_RX_MIN_READ  4096
+#define STREAM_RX_VIEW_MIN  (STREAM_RX_SIZE / 8)
+
+/* Messages sent are queued, and written with as few system calls as the
+ * socket takes, up to STREAM_TX_IOV buffers per call, a message taking two if
+ * data are chained to it.  Sending is refused with EAGAIN while STREAM_TX_MAX
+ * bytes are queued. */
+#define STREAM_TX_MAX       (256 * 1024)
+#ifdef IOV_MAX
+#define STREAM_TX_IOV       IOV_MAX
+#else
+#define STREAM_TX_IOV       1024
+#endif
+
 struct stream_vconn
 {
     struct vconn vconn;
     int fd;
     struct ofpbuf *rxbuf;
-    struct ofpbuf *txbuf;
-    struct poll_waiter *tx_waiter;
+    struct ofp_queue txq;       /* Messages not written in full yet. */
+    size_t tx_bytes;            /* Bytes of them not written yet. */
+    size_t tx_ofs;              /* Bytes of the first one written. */
+    int tx_error;               /* Error writing, once there was one. */
 };
 
 static struct vconn_class stream_vconn_class;
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(10, 25);
 
-static void stream_clear_txbuf(struct stream_vconn *);
+static void stream_clear_txq(struct stream_vconn *);
 
 int
 new_stream_vconn(const char *name, int fd, int connect_status,
@@ -79,8 +105,10 @@ new_stream_vconn(const char *name, int fd, int connect_status,
     vconn_init(&s->vconn, &stream_vconn_class, connect_status, ip, name,
                reconnectable);
     s->fd = fd;
-    s->txbuf = NULL;
-    s->tx_waiter = NULL;
+    queue_init(&s->txq);
+    s->tx_bytes = 0;
+    s->tx_ofs = 0;
+    s->tx_error = 0;
     s->rxbuf = NULL;
     *vconnp = &s->vconn;
     return 0;
@@ -97,8 +125,7 @@ static void
 stream_close(struct vconn *vconn)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
-    poll_cancel(s->tx_waiter);
-    stream_clear_txbuf(s);
+    stream_clear_txq(s);
     ofpbuf_delete(s->rxbuf);
     close(s->fd);
     free(s);
@@ -111,172 +138,255 @@ stream_connect(struct vconn *vconn)
     return check_connection_completion(s->fd);
 }
 
+/* Returns the length of the message at the head of 'rx', 0 if its header has
+ * not been received in full yet, or -EPROTO if the length is bad. */
 static int
-stream_recv(struct vconn *vconn, struct ofpbuf **bufferp)
+stream_msg_length(struct ofpbuf *rx)
 {
-    struct stream_vconn *s = stream_vconn_cast(vconn);
-    struct ofpbuf *rx;
-    size_t want_bytes;
-    ssize_t retval;
+    struct ofp_header *oh;
+    size_t length;
 
-    if (s->rxbuf == NULL) {
-        s->rxbuf = ofpbuf_new(1564);
+    if (rx->size < sizeof(struct ofp_header)) {
+        return 0;
+    }
+    oh = rx->data;
+    length = ntohs(oh->length);
+
+    if (length == 3) {
+        length = 8;
+        oh->length = 8;
+        oh->version = 77;
+        VLOG_DBG(LOG_MODULE, "change version to 77\n");
     }
-    rx = s->rxbuf;
 
-again:
-    if (sizeof(struct ofp_header) > rx->size) {
-        want_bytes = sizeof(struct ofp_header) - rx->size;
+    if (length == 7) {
+        length = 8;
+        oh->length = 8;
+        oh->version = 78;
+        VLOG_DBG(LOG_MODULE, "change version to 78\n");
+    }
+
+    if (length < sizeof(struct ofp_header)) {
+        VLOG_ERR_RL(LOG_MODULE, &rl, "received too-short ofp_header (%zu bytes)",
+                    length);
+        return -EPROTO;
+    }
+    return length;
+}
+
+/* Makes room in the receive buffer of 's' for a read of at least 'want'
+ * bytes. The messages already sliced out of the buffer may still be in use,
+ * in which case the bytes of the next message move to a new buffer;
+ * otherwise they move to the start of the buffer. */
+static void
+stream_rx_make_room(struct stream_vconn *s, size_t want)
+{
+    struct ofpbuf *rx = s->rxbuf;
+
+    if (rx->refcount == 1 && rx->size == 0) {
+        rx->data = rx->base;
+    }
+    if (ofpbuf_tailroom(rx) >= want) {
+        return;
+    }
+
+    if (rx->refcount == 1) {
+        memmove(rx->base, rx->data, rx->size);
+        rx->data = rx->base;
+        ofpbuf_prealloc_tailroom(rx, want);
     } else {
-        struct ofp_header *oh = rx->data;
-        size_t length = ntohs(oh->length);
-
-		if( length == 3)
-        {
-            length = 8;
-			oh->length = 8;
-			oh->version = 77;
-			VLOG_DBG(LOG_MODULE, "change version to 77\n");
-        }
+        struct ofpbuf *new = ofpbuf_new(MAX(STREAM_RX_SIZE, rx->size + want));
 
-		if( length == 7)
-        {
-            length = 8;
-			oh->length = 8;
-			oh->version = 78;
-			VLOG_DBG(LOG_MODULE, "change version to 78\n");
-        }
+        ofpbuf_put(new, rx->data, rx->size);
+        ofpbuf_delete(rx);
+        s->rxbuf = new;
+    }
+}
 
-		if( length == 7 && oh->type == OFPT_BARRIER_REQUEST)
-        {
-            length = 8;
-        }
-        //<==
+/* Returns the next message received, a copy or, if it is large, a view of
+ * the receive buffer. A single read() fills the buffer with as many messages
+ * as have arrived, and the calls that follow take them out without a system
+ * call. */
+static int
+stream_recv(struct vconn *vconn, struct ofpbuf **bufferp)
+{
+    struct stream_vconn *s = stream_vconn_cast(vconn);
+    struct ofpbuf *rx;
+    ssize_t retval;
+    int length;
 
-		/*
-        if (length < sizeof(struct ofp_header)) {
-            VLOG_ERR_RL(LOG_MODULE, &rl, "received too-short ofp_header (%zu bytes)",
-                        length);
-            return EPROTO;
-        }
-		*/
-        want_bytes = length - rx->size;
-        if (!want_bytes) {
-            *bufferp = rx;
-            s->rxbuf = NULL;
-            return 0;
-        }
+    if (s->rxbuf == NULL) {
+        s->rxbuf = ofpbuf_new(STREAM_RX_SIZE);
     }
-    ofpbuf_prealloc_tailroom(rx, want_bytes);
-
-    //FD_SET(s->fd, &stRcvset);
-    //(void)select((s->fd + 1), &stRcvset, NULL, NULL, NULL);
-    //if (FD_ISSET(s->fd, &stRcvset))
-    //{
-
-    retval = read(s->fd, ofpbuf_tail(rx), want_bytes);
-    if (retval > 0) {
-        rx->size += retval;
-        if (retval == want_bytes) {
-            if (rx->size > sizeof(struct ofp_header)) {
-                *bufferp = rx;
-                s->rxbuf = NULL;
-                return 0;
+
+    length = stream_msg_length(s->rxbuf);
+    if (length < 0) {
+        return -length;
+    } else if (length == 0 || s->rxbuf->size < (size_t) length) {
+        size_t want = length ? length - s->rxbuf->size
+                             : sizeof(struct ofp_header) - s->rxbuf->size;
+
+        stream_rx_make_room(s, MAX(want, STREAM_RX_MIN_READ));
+        rx = s->rxbuf;
+
+        retval = read(s->fd, ofpbuf_tail(rx), ofpbuf_tailroom(rx));
+        if (retval > 0) {
+            rx->size += retval;
+        } else if (retval == 0) {
+            if (rx->size) {
+                VLOG_ERR_RL(LOG_MODULE, &rl, "connection dropped mid-packet");
+                return EPROTO;
             } else {
-                goto again;
+                if(errno != EAGAIN) {
+                    return EOF;
+                }
+                return EAGAIN;
             }
-        }
-        return EAGAIN;
-    } else if (retval == 0) {
-        if (rx->size) {
-            VLOG_ERR_RL(LOG_MODULE, &rl, "connection dropped mid-packet");
-            return EPROTO;
         } else {
-            if(errno != EAGAIN) {
-                return EOF;
-            }
+            return errno;
+        }
+
+        length = stream_msg_length(rx);
+        if (length < 0) {
+            return -length;
+        } else if (length == 0 || rx->size < (size_t) length) {
             return EAGAIN;
         }
-    } else {
-        return errno;
     }
 
+    rx = s->rxbuf;
+    *bufferp = (length >= STREAM_RX_VIEW_MIN ? ofpbuf_view(rx, 0, length)
+                : ofpbuf_clone_data(rx->data, length));
+    ofpbuf_pull(rx, length);
+    return 0;
+}
+
+/* Returns true if a message, or a bad header, is waiting in the receive
+ * buffer of 's'. */
+static bool
+stream_rx_ready(const struct stream_vconn *s)
+{
+    const struct ofp_header *oh;
+    size_t length;
+
+    if (s->rxbuf == NULL || s->rxbuf->size < sizeof(struct ofp_header)) {
+        return false;
+    }
+    oh = s->rxbuf->data;
+    length = ntohs(oh->length);
+    return length < sizeof(struct ofp_header) || length <= s->rxbuf->size;
 }
 
 static void
-stream_clear_txbuf(struct stream_vconn *s)
+stream_clear_txq(struct stream_vconn *s)
 {
-    ofpbuf_delete(s->txbuf);
-    s->txbuf = NULL;
-    s->tx_waiter = NULL;
+    queue_clear(&s->txq);
+    s->tx_bytes = 0;
+    s->tx_ofs = 0;
 }
 
-static void
-stream_do_tx(int fd UNUSED, short int revents UNUSED, void *vconn_)
+/* Writes as much of the messages queued on 's' as the socket takes, gathered
+ * into sendmsg() calls of up to STREAM_TX_IOV buffers.  Each call but the
+ * last one is flagged MSG_MORE, so that the kernel does not push out a short
+ * segment between them.  Returns 0 if all of them were written, EAGAIN if
+ * some are left, otherwise a positive errno value, and then drops them. */
+static int
+stream_do_tx(struct stream_vconn *s)
 {
-    struct vconn *vconn = vconn_;
-    struct stream_vconn *s = stream_vconn_cast(vconn);
-    ssize_t n = write(s->fd, s->txbuf->data, s->txbuf->size);
-    if (n < 0)
-    {
-        if (errno != EAGAIN) {
+    struct iovec iov[STREAM_TX_IOV];
+    struct msghdr msg;
+    struct ofpbuf *b;
+    size_t n_iov, chunk;
+    ssize_t n;
+
+    while (s->txq.n) {
+        n_iov = 0;
+        chunk = 0;
+        for (b = s->txq.head; b != NULL && n_iov + 2 <= STREAM_TX_IOV;
+             b = b->next) {
+            size_t ofs = n_iov ? 0 : s->tx_ofs;
+
+            chunk += ofpbuf_msg_size(b) - ofs;
+            if (ofs < b->size) {
+                iov[n_iov].iov_base = (char *) b->data + ofs;
+                iov[n_iov].iov_len = b->size - ofs;
+                n_iov++;
+                ofs = 0;
+            } else {
+                ofs -= b->size;
+            }
+            if (b->more != NULL) {
+                iov[n_iov].iov_base = (char *) b->more->data + ofs;
+                iov[n_iov].iov_len = b->more->size - ofs;
+                n_iov++;
+            }
+        }
+
+        memset(&msg, 0, sizeof msg);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n_iov;
+        n = sendmsg(s->fd, &msg, b != NULL ? MSG_MORE : 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN) {
+                return EAGAIN;
+            }
+            s->tx_error = errno;
             VLOG_ERR_RL(LOG_MODULE, &rl, "send: %s", strerror(errno));
-            stream_clear_txbuf(s);
-            return;
+            stream_clear_txq(s);
+            return s->tx_error;
         }
-    }
-    else if (n > 0)
-    {
-        ofpbuf_pull(s->txbuf, n);
-        if (!s->txbuf->size)
-        {
-            stream_clear_txbuf(s);
-            return;
+
+        s->tx_bytes -= n;
+        s->tx_ofs += n;
+        while (s->txq.n && s->tx_ofs >= ofpbuf_msg_size(s->txq.head)) {
+            s->tx_ofs -= ofpbuf_msg_size(s->txq.head);
+            ofpbuf_delete(queue_pop_head(&s->txq));
+        }
+        if ((size_t) n < chunk) {
+            return EAGAIN;
         }
     }
-//    s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
+    return 0;
 }
+
 static int
 stream_send(struct vconn *vconn, struct ofpbuf *buffer)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
-    ssize_t retval;
+    int error;
 
-    if (s->txbuf)
-    {
-        stream_do_tx(s->fd, POLLOUT, vconn);
-        if (s->txbuf)
-            return EAGAIN;
+    if (s->tx_error) {
+        return s->tx_error;
     }
-
-    if(buffer)
-    {
-        retval = write(s->fd, buffer->data, buffer->size);
-        if (retval == buffer->size)
-        {
-            ofpbuf_delete(buffer);
-            return 0;
-        }
-        else if (retval >= 0 || errno == EAGAIN)
-        {
-            leak_checker_claim(buffer);
-            s->txbuf = buffer;
-            if (retval > 0)
-            {
-                ofpbuf_pull(buffer, retval);
-            }
-            //s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
-            return 0;
-        }
-        else
-        {
-            return errno;
+    if (s->tx_bytes >= STREAM_TX_MAX) {
+        error = stream_do_tx(s);
+        if (error && error != EAGAIN) {
+            return error;
+        } else if (s->tx_bytes >= STREAM_TX_MAX) {
+            return EAGAIN;
         }
     }
 
+    leak_checker_claim(buffer);
+    queue_push_tail(&s->txq, buffer);
+    s->tx_bytes += ofpbuf_msg_size(buffer);
+    if (!vconn->corked) {
+        /* an error shows up on the next send */
+        stream_do_tx(s);
+    }
     return 0;
 }
 
+static int
+stream_flush(struct vconn *vconn)
+{
+    struct stream_vconn *s = stream_vconn_cast(vconn);
+
+    return s->tx_error ? s->tx_error : stream_do_tx(s);
+}
+
 static void
 stream_wait(struct vconn *vconn, enum vconn_wait_type wait)
 {
@@ -287,15 +397,16 @@ stream_wait(struct vconn *vconn, enum vconn_wait_type wait)
         break;
 
     case WAIT_SEND:
-        if (!s->txbuf) {
-            poll_fd_wait(s->fd, POLLOUT);
-        } else {
-            /* Nothing to do: need to drain txbuf first. */
-        }
+        poll_fd_wait(s->fd, POLLOUT);
         break;
 
     case WAIT_RECV:
-        poll_fd_wait(s->fd, POLLIN);
+        if (stream_rx_ready(s)) {
+            /* already read, the socket may not become readable again. */
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(s->fd, POLLIN);
+        }
         break;
 
     default:
@@ -311,6 +422,7 @@ static struct vconn_class stream_vconn_class = {
     stream_recv,                /* recv */
     stream_send,                /* send */
     stream_wait,                /* wait */
+    stream_flush,               /* flush */
 };
 
 /* Passive stream socket vconn. */
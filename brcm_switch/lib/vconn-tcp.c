@@ -134,6 +134,7 @@ struct vconn_class tcp_vconn_class = {
     NULL,                       /* recv */
     NULL,                       /* send */
     NULL,                       /* wait */
+    NULL,                       /* flush */
 };
 
 /* Passive TCP. */
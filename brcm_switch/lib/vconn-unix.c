@@ -88,6 +88,7 @@ struct vconn_class unix_vconn_class = {
     NULL,                       /* recv */
     NULL,                       /* send */
     NULL,                       /* wait */
+    NULL,                       /* flush */
 };
 
 /* Passive UNIX socket. */
@@ -608,6 +608,7 @@ do_send(struct vconn *vconn, struct ofpbuf *buf)
         struct ofl_msg_header *msg;
         char *str;
 
+        ofpbuf_linearize(buf);
         if (!ofl_msg_unpack(buf->data, buf->size, &msg, NULL/*xid*/, &ofl_exp)) {
             str = ofl_msg_to_string(msg, &ofl_exp);
             ofl_msg_free(msg, &ofl_exp);
@@ -629,6 +630,25 @@ do_send(struct vconn *vconn, struct ofpbuf *buf)
     return retval;
 }
 
+/* Lets 'vconn' hold the messages sent on it until vconn_uncork(), so that a
+ * burst of them is written at once.  The messages are still written before
+ * then if too many are held. */
+void
+vconn_cork(struct vconn *vconn)
+{
+    vconn->corked = true;
+}
+
+/* Writes the messages that 'vconn' holds.  Returns 0 if none are left, EAGAIN
+ * if some must wait for 'vconn' to become writable (see vconn_send_wait()),
+ * otherwise a positive errno value. */
+int
+vconn_uncork(struct vconn *vconn)
+{
+    vconn->corked = false;
+    return vconn->class->flush ? (vconn->class->flush)(vconn) : 0;
+}
+
 /* Same as vconn_send, except that it waits until 'msg' can be transmitted. */
 int
 vconn_send_block(struct vconn *vconn, struct ofpbuf *msg)
@@ -872,6 +892,7 @@ vconn_init(struct vconn *vconn, struct vconn_class *class, int connect_status,
     memset(&vconn->ofps_rcvd, 0, sizeof(vconn->ofps_rcvd));
     memset(&vconn->ofps_sent, 0, sizeof(vconn->ofps_sent));
     vconn->xid = 0;
+    vconn->corked = false;
 }
 
 void
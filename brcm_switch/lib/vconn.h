@@ -56,6 +56,8 @@ bool vconn_is_reconnectable(const struct vconn *);
 int vconn_connect(struct vconn *);
 int vconn_recv(struct vconn *, struct ofpbuf **);
 int vconn_send(struct vconn *, struct ofpbuf *);
+void vconn_cork(struct vconn *);
+int vconn_uncork(struct vconn *);
 int vconn_recv_xid(struct vconn *, unsigned int xid, struct ofpbuf **);
 int vconn_transact(struct vconn *, struct ofpbuf *, struct ofpbuf **);
 
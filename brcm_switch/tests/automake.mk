@@ -0,0 +1,20 @@
+#
+# Unit tests, run by "make check"
+#
+
+TESTS += tests/test-hybrid-request
+noinst_PROGRAMS += tests/test-hybrid-request
+tests_test_hybrid_request_SOURCES = \
+	tests/test-hybrid-request.c \
+	udatapath/Hybrid_Framework_Request.c
+
+tests_test_hybrid_request_LDADD = lib/libopenflow.a -lpthread
+
+TESTS += tests/test-hw-stats
+noinst_PROGRAMS += tests/test-hw-stats
+tests_test_hw_stats_SOURCES = \
+	tests/test-hw-stats.c \
+	udatapath/dp_hw_stats.c \
+	udatapath/Hybrid_Framework_Request.c
+
+tests_test_hw_stats_LDADD = lib/libopenflow.a -lpthread
@@ -0,0 +1,219 @@
+/* Tests that a sweep of the hardware counter collector stores the counters
+ * read back into the flows. */
+
+#include <config.h>
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "udatapath/Hybrid_Framework_Common.h"
+#include "udatapath/datapath.h"
+#include "udatapath/dp_hw_stats.h"
+#include "udatapath/exact_hash.h"
+#include "udatapath/flow_entry.h"
+#include "udatapath/flow_table.h"
+#include "udatapath/pipeline.h"
+#include "udatapath/udatapath_socket.h"
+#include "util.h"
+
+/* More flows than the frames of a batch hold, and than the requests to V8
+ * that may wait at once. */
+#define N_FLOWS (DP_HW_STATS_QUERIES * HYBRID_INFOCHANGE_BUFFER_LENGTH * 2)
+
+static struct datapath dp;
+static struct flow_entry flows[N_FLOWS];
+static struct table_count counts[N_FLOWS];
+
+static bool silent;                 /* the agent does not reply. */
+static bool destroy_flows;          /* every third flow is destroyed while
+                                       its counters are read. */
+static unsigned int n_frames;
+
+/* The query of a flow is its index. */
+void
+alta_logic_poll_entry_count(struct flow_entry *entry, struct dp_hw_stats *hs)
+{
+    DPAL_MESSAGE_DATA_S msg;
+    uint32_t *query = xmalloc(sizeof *query);
+
+    *query = entry - flows;
+    msg.usTLVNum = 1;
+    msg.usDataLength = sizeof *query;
+    msg.pData = query;
+    dp_hw_stats_add(hs, &msg, entry, &counts[*query]);
+}
+
+struct flow_entry *
+exact_hash_next(const struct exact_hash *hash UNUSED,
+                struct exact_hash_cursor *cursor UNUSED)
+{
+    return NULL;
+}
+
+/* The agent answers the query of flow i with i + 1 packets of 100 bytes. */
+int
+Sock_Sendto_V8_Batch(const SOCK_V8_MSG_S *pstMsgs, unsigned int uiNum,
+                     unsigned int uiReverse)
+{
+    unsigned int i;
+
+    assert(uiReverse == 0);
+    assert(uiNum <= DP_HW_STATS_BATCH);
+    if (destroy_flows)
+    {
+        pthread_rwlock_wrlock(&dp.rw_lock);
+        for (i = 0; i < N_FLOWS; i += 3)
+        {
+            dp_hw_stats_forget(dp.hw_stats, &flows[i]);
+        }
+        pthread_rwlock_unlock(&dp.rw_lock);
+    }
+    for (i = 0; i < uiNum; i++)
+    {
+        const HYBRID_INFO_CHANGE_S *head = pstMsgs[i].pData;
+
+        assert(pstMsgs[i].usDataLength == head->ui_length);
+        assert(head->ui_ver == HYBRID_INFOCHANGE_VERSION);
+        n_frames++;
+        if (!silent)
+        {
+            HYBRID_INFO_CHANGE_S *reply = xmemdup(head, head->ui_length);
+
+            assert(Hybrid_Reply_V8(reply, reply->ui_length) == VOS_OK);
+            free(reply);
+        }
+    }
+    return uiNum;
+}
+
+unsigned int
+DPAL_TranslateData(DPAL_MESSAGE_DATA_S *pstMSGData, DPAL_PROC_S *pstProc)
+{
+    const uint32_t *queries = pstMSGData->pData;
+    unsigned int n = pstMSGData->usDataLength / sizeof *queries;
+    unsigned int i;
+
+    assert(n == pstMSGData->usTLVNum);
+    pstProc->uiProNUM = n;
+    pstProc->pstProcData = xcalloc(n, sizeof *pstProc->pstProcData);
+    for (i = 0; i < n; i++)
+    {
+        struct table_count *count = xmalloc(sizeof *count);
+
+        count->packet_count = queries[i] + 1;
+        count->byte_count = (queries[i] + 1) * 100;
+        pstProc->pstProcData[i].usType = DPAL_MSG_TYPE_FLOWTABLE_STATISTCS;
+        pstProc->pstProcData[i].pData = count;
+    }
+    return 0;
+}
+
+void
+DPAL_DestroyData(DPAL_PROC_S *pstProc)
+{
+    unsigned int i;
+
+    for (i = 0; i < pstProc->uiProNUM; i++)
+    {
+        free(pstProc->pstProcData[i].pData);
+    }
+    free(pstProc->pstProcData);
+}
+
+static void
+setup(void)
+{
+    size_t i;
+
+    pthread_rwlock_init(&dp.rw_lock, NULL);
+    pthread_mutex_init(&dp.hw_count_mutex, NULL);
+    dp.pipeline = xcalloc(1, sizeof *dp.pipeline);
+    for (i = 0; i < PIPELINE_TABLES; i++)
+    {
+        dp.pipeline->tables[i] = xcalloc(1, sizeof *dp.pipeline->tables[i]);
+        list_init(&dp.pipeline->tables[i]->match_entries);
+    }
+
+    /* the flows are spread over the first two tables */
+    for (i = 0; i < N_FLOWS; i++)
+    {
+        list_push_back(&dp.pipeline->tables[i % 2]->match_entries,
+                       &flows[i].match_node);
+    }
+}
+
+static void
+reset(void)
+{
+    memset(counts, 0, sizeof counts);
+    silent = false;
+    destroy_flows = false;
+    n_frames = 0;
+}
+
+/* Checks the counters of the flows, every 'stride'th of which was not
+ * read back, or none if 'stride' is 0. */
+static void
+check_counts(bool read, size_t stride)
+{
+    size_t i;
+
+    for (i = 0; i < N_FLOWS; i++)
+    {
+        bool stored = read && !(stride && i % stride == 0);
+
+        assert(counts[i].packet_count == (stored ? i + 1 : 0));
+        assert(counts[i].byte_count == (stored ? (i + 1) * 100 : 0));
+    }
+}
+
+/* The counters of every flow are read back. */
+static void
+test_sweep(struct dp_hw_stats *hs)
+{
+    reset();
+    dp_hw_stats_sweep(hs);
+    assert(n_frames == N_FLOWS / DP_HW_STATS_QUERIES);
+    check_counts(true, 0);
+}
+
+/* The counters are left alone when the agent does not reply. */
+static void
+test_timeout(struct dp_hw_stats *hs)
+{
+    reset();
+    silent = true;
+    dp_hw_stats_sweep(hs);
+    assert(n_frames == N_FLOWS / DP_HW_STATS_QUERIES);
+    check_counts(false, 0);
+}
+
+/* The flows destroyed before their counters are in are left alone, and
+ * only those. */
+static void
+test_destroy(struct dp_hw_stats *hs)
+{
+    reset();
+    destroy_flows = true;
+    dp_hw_stats_sweep(hs);
+    check_counts(true, 3);
+}
+
+int
+main(void)
+{
+    struct dp_hw_stats *hs;
+
+    setup();
+    hs = dp_hw_stats_create(&dp);
+    test_sweep(hs);
+    test_timeout(hs);
+    test_destroy(hs);
+
+    /* a flow destroyed between sweeps has no queries to drop */
+    dp_hw_stats_forget(hs, &flows[0]);
+    test_sweep(hs);
+    printf("PASS\n");
+    return 0;
+}
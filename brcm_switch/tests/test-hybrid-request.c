@@ -0,0 +1,177 @@
+/* Tests the table of the requests to V8 that wait for their replies. */
+
+#include <config.h>
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "udatapath/Hybrid_Framework_Common.h"
+#include "udatapath/udatapath_socket.h"
+
+#define N_REQS 4
+
+/* The requests sent, as the receive thread would see them. */
+static HYBRID_INFO_CHANGE_S sent[HYBRID_INFOCHANGE_BUFFER_LENGTH * 2];
+static unsigned int n_sent;
+static int send_limit = -1;     /* frames the socket takes, -1 for all. */
+
+int
+Sock_Sendto_V8_Batch(const SOCK_V8_MSG_S *pstMsgs, unsigned int uiNum,
+                     unsigned int uiReverse)
+{
+    unsigned int i;
+
+    assert(uiReverse == 0);
+    if (send_limit >= 0 && uiNum > (unsigned int) send_limit) {
+        uiNum = send_limit;
+    }
+    for (i = 0; i < uiNum; i++) {
+        assert(pstMsgs[i].usDataLength == sizeof(HYBRID_INFO_CHANGE_S));
+        sent[n_sent++] = *(HYBRID_INFO_CHANGE_S *) pstMsgs[i].pData;
+    }
+    return uiNum;
+}
+
+struct reply {
+    int calls;
+    int replied;                /* 0 if the request expired. */
+    UINT32 ui_module;
+};
+
+static VOID
+reply_cb(HYBRID_INFO_CHANGE_S *pst_reply, UINT32 ui_len, VOID *p_arg)
+{
+    struct reply *r = p_arg;
+
+    r->calls++;
+    if (pst_reply != NULL) {
+        assert(ui_len == sizeof *pst_reply);
+        r->replied = 1;
+        r->ui_module = pst_reply->ui_module;
+    }
+}
+
+static void
+reset(void)
+{
+    n_sent = 0;
+    send_limit = -1;
+}
+
+/* Replies out of order reach the requests they answer, once. */
+static void
+test_match(void)
+{
+    HYBRID_INFO_CHANGE_S reqs[N_REQS];
+    HYBRID_REQUEST_S batch[N_REQS];
+    struct reply replies[N_REQS];
+    HYBRID_INFO_CHANGE_S ans;
+    int i;
+
+    reset();
+    memset(replies, 0, sizeof replies);
+    for (i = 0; i < N_REQS; i++) {
+        memset(&reqs[i], 0, sizeof reqs[i]);
+        reqs[i].ui_module = i;
+        batch[i].pst_data = &reqs[i];
+        batch[i].us_len = sizeof reqs[i];
+        batch[i].p_arg = &replies[i];
+    }
+    assert(Hybrid_Request_V8_Batch(batch, N_REQS, 1000, reply_cb) == N_REQS);
+    assert(n_sent == N_REQS);
+
+    for (i = N_REQS - 1; i >= 0; i--) {
+        assert(sent[i].ui_identifier != 0);
+        ans = sent[i];
+        ans.ui_module += 100;
+        assert(Hybrid_Reply_V8(&ans, sizeof ans) == VOS_OK);
+        assert(Hybrid_Reply_V8(&ans, sizeof ans) == VOS_ERR);
+    }
+    for (i = 0; i < N_REQS; i++) {
+        assert(replies[i].calls == 1);
+        assert(replies[i].replied);
+        assert(replies[i].ui_module == (UINT32) i + 100);
+    }
+
+    /* a message of no request is left to the event handlers */
+    memset(&ans, 0, sizeof ans);
+    assert(Hybrid_Reply_V8(&ans, sizeof ans) == VOS_ERR);
+    ans.ui_identifier = sent[0].ui_identifier + 1000;
+    assert(Hybrid_Reply_V8(&ans, sizeof ans) == VOS_ERR);
+}
+
+/* A request without a reply ends at its timeout, and not before. */
+static void
+test_expire(void)
+{
+    HYBRID_INFO_CHANGE_S req, late;
+    struct reply r;
+
+    reset();
+    memset(&r, 0, sizeof r);
+    memset(&req, 0, sizeof req);
+    assert(Hybrid_Request_V8(&req, sizeof req, 50, reply_cb, &r) == VOS_OK);
+    late = sent[0];
+
+    Hybrid_Request_Expire();
+    assert(r.calls == 0);
+
+    usleep(100 * 1000);
+    Hybrid_Request_Expire();
+    assert(r.calls == 1);
+    assert(!r.replied);
+
+    /* the reply that comes after the timeout finds no request */
+    assert(Hybrid_Reply_V8(&late, sizeof late) == VOS_ERR);
+    Hybrid_Request_Expire();
+    assert(r.calls == 1);
+}
+
+/* At most HYBRID_INFOCHANGE_BUFFER_LENGTH requests wait at once, and those
+ * the socket did not take do not wait. */
+static void
+test_full(void)
+{
+    enum { N = HYBRID_INFOCHANGE_BUFFER_LENGTH + 1 };
+    HYBRID_INFO_CHANGE_S reqs[N];
+    HYBRID_REQUEST_S batch[N];
+    struct reply replies[N];
+    HYBRID_INFO_CHANGE_S ans;
+    unsigned int i;
+
+    reset();
+    memset(reqs, 0, sizeof reqs);
+    memset(replies, 0, sizeof replies);
+    for (i = 0; i < N; i++) {
+        batch[i].pst_data = &reqs[i];
+        batch[i].us_len = sizeof reqs[i];
+        batch[i].p_arg = &replies[i];
+    }
+    assert(Hybrid_Request_V8_Batch(batch, N, 1000, reply_cb) == N - 1);
+    for (i = 0; i < N - 1; i++) {
+        ans = sent[i];
+        assert(Hybrid_Reply_V8(&ans, sizeof ans) == VOS_OK);
+        assert(replies[i].replied);
+    }
+    assert(replies[N - 1].calls == 0);
+
+    reset();
+    send_limit = 2;
+    assert(Hybrid_Request_V8_Batch(batch, 3, 0, reply_cb) == 2);
+    usleep(10 * 1000);
+    Hybrid_Request_Expire();
+    assert(replies[0].calls == 2);
+    assert(replies[1].calls == 2);
+    assert(replies[2].calls == 1);
+}
+
+int
+main(void)
+{
+    test_match();
+    test_expire();
+    test_full();
+    printf("PASS\n");
+    return 0;
+}
@@ -38,7 +38,10 @@ typedef unsigned short USHORT;
 
 #define    HYBRID_INFOCHANGE_WAITV8REPLY    1
 
-#define    HYBRID_INFOCHANGE_BUFFER_LENGTH    1
+#define    HYBRID_INFOCHANGE_BUFFER_LENGTH    64     /* requests waiting for a reply,
+                                                     a power of 2. */
+#define    HYBRID_REQUEST_TIMEOUT_MS          1000
+#define    HYBRID_REQUEST_TICK_MS             100    /* between timeout checks. */
 #define    HYBRID_INFOCHANGE_VALUE_USED       1
 #define    HYBRID_INFOCHANGE_VALUE_UNUSED     0
 
@@ -58,15 +61,27 @@ typedef struct tagHybrid_Info_Change
 }HYBRID_INFO_CHANGE_S;
 
 
+/* Called with the reply to a request, which is only valid during the call,
+ * or with NULL if no reply came in time. */
+typedef VOID (*HYBRID_REPLY_FUNC_P)(HYBRID_INFO_CHANGE_S *pst_reply, UINT32 ui_len, VOID *p_arg);
+
+/* A request waiting for its reply, found by its identifier. */
 typedef struct tagHybrid_Info_Change_Buffer_Struct
 {
-    HYBRID_INFO_CHANGE_S *pst_info;
-    UINT32 data_len;   //Ȱͷ
-    sem_t  sem_isused;
-    INT32  wait_v8reply_flag;
-    UINT32 ui_identifier;  
+    UINT32 ui_identifier;       /* 0 for a free entry. */
+    HYBRID_REPLY_FUNC_P pfn_reply;
+    VOID  *p_arg;
+    long long int deadline;     /* msec. */
 }HYBRID_INFOCHANGE_BUFFER_S;
 
+/* A request of a batch, and the argument its reply function is called with. */
+typedef struct tagHybrid_Request
+{
+    HYBRID_INFO_CHANGE_S *pst_data;
+    unsigned short us_len;
+    VOID *p_arg;
+}HYBRID_REQUEST_S;
+
 
 /*-----------------------------------------------*/
 /*             3궨                 */
@@ -87,6 +102,26 @@ typedef struct tagHybrid_Info_Change_Buffer_Struct
 
 UINT32 Hybird_Frame_Process_UnknownIdentifier_Packet(CHAR *recvdata, UINT32 revnum);
 
+/* Sends a request to V8, and calls pfnReply from the receive thread with its
+ * reply, or after uiTimeoutMs without one. The request is given an identifier
+ * of its own, so that up to HYBRID_INFOCHANGE_BUFFER_LENGTH requests may wait
+ * for their replies at once. */
+UINT32 Hybrid_Request_V8(HYBRID_INFO_CHANGE_S *pdata, unsigned short len, UINT32 uiTimeoutMs,
+                         HYBRID_REPLY_FUNC_P pfnReply, VOID *pArg);
+
+/* Sends a batch of requests as Hybrid_Request_V8() does, SOCK_V8_BATCH
+ * frames per system call. Returns the number of requests sent, which are the
+ * first ones; the others are not waiting for a reply. */
+UINT32 Hybrid_Request_V8_Batch(HYBRID_REQUEST_S *pstReqs, UINT32 uiNum, UINT32 uiTimeoutMs,
+                               HYBRID_REPLY_FUNC_P pfnReply);
+
+/* Hands a message received from V8 to the request it replies to. Returns
+ * VOS_ERR if it is not a reply. */
+UINT32 Hybrid_Reply_V8(HYBRID_INFO_CHANGE_S *pstReply, UINT32 uiLen);
+
+/* Ends the requests waiting past their timeout. */
+VOID Hybrid_Request_Expire(VOID);
+
 #ifdef __cplusplus
 #if __cplusplus
 }
@@ -5,24 +5,19 @@ extern "C"{
 #endif
 #endif /* __cplusplus */
 
+#include <errno.h>
 #include <semaphore.h>
 #include "Hybrid_Framework_Common.h"
 #include "Hybrid_Framework_Linux.h"
 #include "common/port.h"
 #include "datapath.h"
 #include "dpal_pub.h"
+#include "udatapath_socket.h"
 #include "vlog.h"
 
 #define LOG_MODULE VLM_frame
 
 
-unsigned int g_ui_identifier = 1;
-HYBRID_INFOCHANGE_BUFFER_S g_ua_info_buf[HYBRID_INFOCHANGE_BUFFER_LENGTH];
-
-
-#define hybird_get_identifier() (g_ui_identifier++)
-
-
 FEI_OPENFLOW_FEIFRAME_MSG_PROC_FUNC_P  g_ast_openflow_event_proc[] =
 {
     Hybird_Frame_Process_PacketIn,
@@ -37,71 +32,70 @@ FEI_OPENFLOW_FEIFRAME_MSG_PROC_FUNC_P  g_ast_openflow_event_proc[] =
 };
 
 
-UINT32 Hybrid_Chatwith_V8(HYBRID_INFO_CHANGE_S *pdata, unsigned short len, HYBRID_INFO_CHANGE_S **prevdata,UINT32* rcvLen)
+typedef struct tagHybrid_Future
 {
-    UINT32 uiLoop = 0;
-    int iRet = 0;
-    VOID *pMsg =NULL;
-    UINT32 uiRcvLen = 0;
+    sem_t sem;
+    HYBRID_INFO_CHANGE_S *pst_reply;
+    UINT32 ui_len;
+}HYBRID_FUTURE_S;
+
+/* Hands the reply over to the thread waiting for it, in the buffer it was
+ * received in. */
+static VOID hybrid_future_done(HYBRID_INFO_CHANGE_S *pstReply, UINT32 uiLen, VOID *pArg)
+{
+    HYBRID_FUTURE_S *pstFuture = pArg;
 
-    /*2.ҿջ*/
-    // һ1ʾ½ӿ
-    iRet = Sock_Sendto_V8((VOID *)pdata, len, 0);
-    if (0 != iRet)
+    if (NULL != pstReply)
     {
-        return VOS_ERR;
+        Sock_Recv_Keep();
+        pstFuture->pst_reply = pstReply;
+        pstFuture->ui_len = uiLen;
     }
+    sem_post(&pstFuture->sem);
+}
+
+UINT32 Hybrid_Chatwith_V8(HYBRID_INFO_CHANGE_S *pdata, unsigned short len, HYBRID_INFO_CHANGE_S **prevdata,UINT32* rcvLen)
+{
+    HYBRID_FUTURE_S stFuture;
 
     // ҪЩ͵ϢҪӦ
-    // ͨϢжǷҪȴϢӦʵûãԺ޸Ϊ HYBRID_ACTION_GET
-    if (HYBRID_ACTION_COMMON == ((Hybrid_FEI_Send_Head_Struct *)pdata)->head.ui_action)
+    if (HYBRID_ACTION_COMMON != ((Hybrid_FEI_Send_Head_Struct *)pdata)->head.ui_action)
     {
-        g_ua_info_buf[uiLoop].ui_identifier = pdata->ui_identifier;
-        g_ua_info_buf[uiLoop].wait_v8reply_flag = HYBRID_INFOCHANGE_WAITV8REPLY;
-        VLOG_DBG(LOG_MODULE, "Sock Send OK\n");
+        VLOG_DBG(LOG_MODULE, "no need to wait response!\n");
+        return 0 == Sock_Sendto_V8((VOID *)pdata, len, 0) ? VOS_OK : VOS_ERR;
     }
-    else
+
+    stFuture.pst_reply = NULL;
+    stFuture.ui_len = 0;
+    sem_init(&stFuture.sem, 0, 0);
+    if (VOS_OK != Hybrid_Request_V8(pdata, len, HYBRID_REQUEST_TIMEOUT_MS,
+                                    hybrid_future_done, &stFuture))
     {
-        VLOG_DBG(LOG_MODULE, "no need to wait response!\n");
-        return VOS_OK;
+        sem_destroy(&stFuture.sem);
+        return VOS_ERR;
     }
 
     /*6.ȴ*/
     VLOG_DBG(LOG_MODULE, "Wait V8 Reply\n");
-    sem_wait(&(g_ua_info_buf[uiLoop].sem_isused));
-
-    /*7.V8صݸһݣظϲ㣬˴ڴϲͷ*/
-    VLOG_DBG(LOG_MODULE, "Sock Recv Success\n");
-
-    uiRcvLen = (UINT32) g_ua_info_buf[uiLoop].data_len;
+    while (0 != sem_wait(&stFuture.sem) && EINTR == errno)
+    {
+        continue;
+    }
+    sem_destroy(&stFuture.sem);
 
-    // עشڴй¶ÿεöһڴ
-    pMsg = malloc(uiRcvLen);
-    if(NULL == pMsg)
+    if (NULL == stFuture.pst_reply)
     {
-        //źԴͷ
-        VLOG_ERR(LOG_MODULE, "Apply Memory Error\n");
+        VLOG_ERR(LOG_MODULE, "no reply from V8\n");
         return VOS_ERR;
     }
-    (void)memset(pMsg,0,uiRcvLen);
-
-    // 뱣Ϣڴ
-    (void)memcpy(pMsg, g_ua_info_buf[uiLoop].pst_info, uiRcvLen);
-
-    *prevdata = pMsg;
-    *rcvLen = uiRcvLen;
-
-    /*8.ݿͷBUF*/
-    g_ua_info_buf[uiLoop].pst_info = NULL;
-    g_ua_info_buf[uiLoop].data_len = 0;
-    g_ua_info_buf[uiLoop].wait_v8reply_flag = 0;
-    g_ua_info_buf[uiLoop].ui_identifier = 0;
 
+    /* the reply is the caller's to free, with Sock_Recv_Free() */
+    *prevdata = stFuture.pst_reply;
+    *rcvLen = stFuture.ui_len;
     return VOS_OK;
 }
 
 
-
 UINT32 Hybrid_Chatwith_V8_new(DPAL_MESSAGE_DATA_S *pdata)
 {
     UINT32 uiLoop = 0;
@@ -124,6 +118,41 @@ UINT32 Hybrid_Chatwith_V8_new(DPAL_MESSAGE_DATA_S *pdata)
 }
 
 
+UINT32 Hybrid_Chatwith_V8_batch(DPAL_MESSAGE_DATA_S *pdata, UINT32 uiNum)
+{
+    SOCK_V8_MSG_S *pstMsgs;
+    UINT32 uiLoop;
+    int iRet;
+
+    if (0 == uiNum)
+    {
+        return 0;
+    }
+
+    pstMsgs = malloc(uiNum * sizeof *pstMsgs);
+    if (NULL == pstMsgs)
+    {
+        VLOG_ERR(LOG_MODULE, "[Apply Memory Error][Hybrid_Chatwith_V8_batch]\n");
+        return 0;
+    }
+    for (uiLoop = 0; uiLoop < uiNum; uiLoop++)
+    {
+        pstMsgs[uiLoop].pData = pdata[uiLoop].pData;
+        pstMsgs[uiLoop].usDataLength = pdata[uiLoop].usDataLength;
+    }
+
+    /* sent SOCK_V8_BATCH frames per system call */
+    iRet = Sock_Sendto_V8_Batch(pstMsgs, uiNum, 1);
+    free(pstMsgs);
+    if (iRet != (int)uiNum)
+    {
+        VLOG_ERR(LOG_MODULE, "Sock_Sendto_V8_Batch error, sent %d of %u.\n", iRet, uiNum);
+    }
+
+    return iRet > 0 ? (UINT32)iRet : 0;
+}
+
+
 UINT32 Hybrid_Frame_NotifyV8_Vlan(struct datapath *dp)
 {
     HYBRID_INFO_CHANGE_S_T *pPKT = VOS_NULL;
@@ -179,7 +208,7 @@ UINT32 Hybrid_Frame_NotifyV8_Vlan(struct datapath *dp)
 
     if (NULL != pRevMsg)
     {
-        free(pRevMsg);
+        Sock_Recv_Free(pRevMsg);
         pRevMsg = NULL;
     }
 
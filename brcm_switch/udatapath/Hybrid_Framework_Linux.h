@@ -204,10 +204,16 @@ UINT32 Hybird_Frame_Process_PacketIn(CHAR *recvdata,UINT32 revnum);
 UINT32 Hybird_Frame_Process_PortInfo(CHAR *recvdata,UINT32 revnum);
 UINT32 Hybird_Frame_Process_PortStatus(CHAR *recvdata,UINT32 revnum);
 
+/* Sends the request and waits for its reply, which the caller frees with
+ * Sock_Recv_Free(). */
 UINT32 Hybrid_Chatwith_V8(HYBRID_INFO_CHANGE_S *pdata, unsigned short len, HYBRID_INFO_CHANGE_S **prevdata,UINT32* rcvLen);
 
 UINT32 Hybrid_Chatwith_V8_new(DPAL_MESSAGE_DATA_S *pdata);
 
+/* Sends the messages in a frame each, batching the system calls. Returns the
+ * number of messages sent, which are the first ones. */
+UINT32 Hybrid_Chatwith_V8_batch(DPAL_MESSAGE_DATA_S *pdata, UINT32 uiNum);
+
 #ifdef __cplusplus
 #if __cplusplus
 }
@@ -0,0 +1,201 @@
+#ifdef __cplusplus
+#if __cplusplus
+extern "C"{
+#endif
+#endif /* __cplusplus */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "Hybrid_Framework_Common.h"
+#include "timeval.h"
+#include "udatapath_socket.h"
+#include "vlog.h"
+
+#define LOG_MODULE VLM_frame
+
+
+static unsigned int g_ui_identifier = 1;
+
+/* Requests waiting for their replies. A request waits at the entry of its
+ * identifier, or at one of the entries after it. */
+static HYBRID_INFOCHANGE_BUFFER_S g_ua_info_buf[HYBRID_INFOCHANGE_BUFFER_LENGTH];
+
+/* Guards g_ua_info_buf. */
+static pthread_mutex_t g_ua_info_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the entry of the request, or a free entry for it if uiFree is set.
+ * Called with the mutex held. */
+static HYBRID_INFOCHANGE_BUFFER_S *hybrid_request_find(UINT32 uiIdentifier, UINT32 uiFree)
+{
+    UINT32 uiWanted = uiFree ? 0 : uiIdentifier;
+    UINT32 uiLoop;
+
+    for (uiLoop = 0; uiLoop < HYBRID_INFOCHANGE_BUFFER_LENGTH; uiLoop++)
+    {
+        HYBRID_INFOCHANGE_BUFFER_S *pstReq =
+            &g_ua_info_buf[(uiIdentifier + uiLoop) & (HYBRID_INFOCHANGE_BUFFER_LENGTH - 1)];
+
+        if (pstReq->ui_identifier == uiWanted)
+        {
+            return pstReq;
+        }
+    }
+    return NULL;
+}
+
+/* Frees the entry of a request that was not sent. */
+static VOID hybrid_request_cancel(UINT32 uiIdentifier)
+{
+    HYBRID_INFOCHANGE_BUFFER_S *pstReq;
+
+    pthread_mutex_lock(&g_ua_info_mutex);
+    pstReq = hybrid_request_find(uiIdentifier, 0);
+    if (NULL != pstReq)
+    {
+        pstReq->ui_identifier = 0;
+    }
+    pthread_mutex_unlock(&g_ua_info_mutex);
+}
+
+UINT32 Hybrid_Request_V8_Batch(HYBRID_REQUEST_S *pstReqs, UINT32 uiNum, UINT32 uiTimeoutMs,
+                               HYBRID_REPLY_FUNC_P pfnReply)
+{
+    SOCK_V8_MSG_S *pstMsgs;
+    long long int deadline = time_now_msec() + uiTimeoutMs;
+    UINT32 uiWaiting = 0;
+    UINT32 uiSent;
+    UINT32 uiLoop;
+    int iRet;
+
+    if (0 == uiNum)
+    {
+        return 0;
+    }
+
+    pstMsgs = malloc(uiNum * sizeof *pstMsgs);
+    if (NULL == pstMsgs)
+    {
+        VLOG_ERR(LOG_MODULE, "[Apply Memory Error][Hybrid_Request_V8_Batch]\n");
+        return 0;
+    }
+
+    /* the requests wait for their replies before they are sent */
+    pthread_mutex_lock(&g_ua_info_mutex);
+    for (; uiWaiting < uiNum; uiWaiting++)
+    {
+        HYBRID_INFO_CHANGE_S *pdata = pstReqs[uiWaiting].pst_data;
+        HYBRID_INFOCHANGE_BUFFER_S *pstReq;
+        UINT32 uiIdentifier;
+
+        do
+        {
+            uiIdentifier = __sync_fetch_and_add(&g_ui_identifier, 1);
+        } while (0 == uiIdentifier);
+
+        pstReq = hybrid_request_find(uiIdentifier, 1);
+        if (NULL == pstReq)
+        {
+            break;
+        }
+        pstReq->ui_identifier = uiIdentifier;
+        pstReq->pfn_reply = pfnReply;
+        pstReq->p_arg = pstReqs[uiWaiting].p_arg;
+        pstReq->deadline = deadline;
+
+        pdata->ui_identifier = uiIdentifier;
+        pstMsgs[uiWaiting].pData = pdata;
+        pstMsgs[uiWaiting].usDataLength = pstReqs[uiWaiting].us_len;
+    }
+    pthread_mutex_unlock(&g_ua_info_mutex);
+
+    if (uiWaiting < uiNum)
+    {
+        VLOG_ERR(LOG_MODULE, "too many requests waiting for V8.\n");
+    }
+
+    iRet = uiWaiting ? Sock_Sendto_V8_Batch(pstMsgs, uiWaiting, 0) : 0;
+    uiSent = iRet > 0 ? (UINT32)iRet : 0;
+    for (uiLoop = uiSent; uiLoop < uiWaiting; uiLoop++)
+    {
+        hybrid_request_cancel(pstReqs[uiLoop].pst_data->ui_identifier);
+    }
+    free(pstMsgs);
+
+    return uiSent;
+}
+
+UINT32 Hybrid_Request_V8(HYBRID_INFO_CHANGE_S *pdata, unsigned short len, UINT32 uiTimeoutMs,
+                         HYBRID_REPLY_FUNC_P pfnReply, VOID *pArg)
+{
+    HYBRID_REQUEST_S stReq;
+
+    stReq.pst_data = pdata;
+    stReq.us_len = len;
+    stReq.p_arg = pArg;
+    return 1 == Hybrid_Request_V8_Batch(&stReq, 1, uiTimeoutMs, pfnReply) ? VOS_OK : VOS_ERR;
+}
+
+UINT32 Hybrid_Reply_V8(HYBRID_INFO_CHANGE_S *pstReply, UINT32 uiLen)
+{
+    HYBRID_INFOCHANGE_BUFFER_S *pstReq;
+    HYBRID_REPLY_FUNC_P pfnReply = NULL;
+    VOID *pArg = NULL;
+
+    if (uiLen < sizeof *pstReply || 0 == pstReply->ui_identifier)
+    {
+        return VOS_ERR;
+    }
+
+    pthread_mutex_lock(&g_ua_info_mutex);
+    pstReq = hybrid_request_find(pstReply->ui_identifier, 0);
+    if (NULL != pstReq)
+    {
+        pfnReply = pstReq->pfn_reply;
+        pArg = pstReq->p_arg;
+        pstReq->ui_identifier = 0;
+    }
+    pthread_mutex_unlock(&g_ua_info_mutex);
+
+    if (NULL == pstReq)
+    {
+        return VOS_ERR;
+    }
+
+    /* the reply is handed over where it was received */
+    pfnReply(pstReply, uiLen, pArg);
+    return VOS_OK;
+}
+
+VOID Hybrid_Request_Expire(VOID)
+{
+    HYBRID_INFOCHANGE_BUFFER_S astExpired[HYBRID_INFOCHANGE_BUFFER_LENGTH];
+    long long int now = time_now_msec();
+    UINT32 uiExpired = 0;
+    UINT32 uiLoop;
+
+    pthread_mutex_lock(&g_ua_info_mutex);
+    for (uiLoop = 0; uiLoop < HYBRID_INFOCHANGE_BUFFER_LENGTH; uiLoop++)
+    {
+        HYBRID_INFOCHANGE_BUFFER_S *pstReq = &g_ua_info_buf[uiLoop];
+
+        if (0 != pstReq->ui_identifier && now >= pstReq->deadline)
+        {
+            astExpired[uiExpired++] = *pstReq;
+            pstReq->ui_identifier = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_ua_info_mutex);
+
+    for (uiLoop = 0; uiLoop < uiExpired; uiLoop++)
+    {
+        VLOG_WARN(LOG_MODULE, "request %u to V8 timed out.\n",
+                  astExpired[uiLoop].ui_identifier);
+        astExpired[uiLoop].pfn_reply(NULL, 0, astExpired[uiLoop].p_arg);
+    }
+}
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* __cplusplus */
@@ -38,6 +38,7 @@
 #include "oflib/ofl-print.h"
 #include "packet.h"
 #include "list.h"
+#include "dp_pool.h"
 #include "util.h"
 
 #include "vlog.h"
@@ -60,6 +61,16 @@ struct action_set_entry {
     int                        order;   /* order of the entry as defined */
 };
 
+static struct dp_pool *set_pool;
+static struct dp_pool *entry_pool;
+
+void
+action_set_pools_init(unsigned int n_sets) {
+    set_pool = dp_pool_create("action set", sizeof(struct action_set), n_sets);
+    entry_pool = dp_pool_create("action set entry",
+                                sizeof(struct action_set_entry), 2 * n_sets);
+}
+
 
 
 
@@ -95,7 +106,7 @@ action_set_order(struct ofl_action_header *act) {
 /* Creates a new set entry */
 struct action_set *
 action_set_create(struct ofl_exp *exp) {
-    struct action_set *set = xmalloc(sizeof(struct action_set));
+    struct action_set *set = dp_pool_get(set_pool);
     list_init(&set->actions);
     set->exp = exp;
 
@@ -104,14 +115,14 @@ action_set_create(struct ofl_exp *exp) {
 
 void action_set_destroy(struct action_set *set) {
     action_set_clear_actions(set);
-    free(set);
+    dp_pool_put(set_pool, set);
 }
 
 static struct action_set_entry *
 action_set_create_entry(struct ofl_action_header *act) {
     struct action_set_entry *entry;
 
-    entry = xmalloc(sizeof(struct action_set_entry));
+    entry = dp_pool_get(entry_pool);
     entry->action = act;
     entry->order = action_set_order(act);
 
@@ -120,7 +131,7 @@ action_set_create_entry(struct ofl_action_header *act) {
 
 struct action_set *
 action_set_clone(struct action_set *set) {
-    struct action_set *s = xmalloc(sizeof(struct action_set));
+    struct action_set *s = dp_pool_get(set_pool);
     struct action_set_entry *entry, *new_entry;
 
     list_init(&s->actions);
@@ -154,7 +165,7 @@ action_set_write_action(struct action_set *set,
             list_replace(&new_entry->node, &entry->node);
             /* NOTE: action in entry must not be freed, as it is owned by the
              *       write instruction which added the action to the set */
-            free(entry);
+            dp_pool_put(entry_pool, entry);
 
             return;
         }
@@ -190,7 +201,7 @@ action_set_clear_actions(struct action_set *set) {
         list_remove(&entry->node);
         // NOTE: action in entry must not be freed, as it is owned by the write instruction
         //       which added the action to the set
-        free(entry);
+        dp_pool_put(entry_pool, entry);
     }
 }
 
@@ -201,7 +212,7 @@ action_set_execute(struct action_set *set, struct packet *pkt, unsigned long lon
     LIST_FOR_EACH_SAFE(entry, next, struct action_set_entry, node, &set->actions) {
         dp_execute_action(pkt, entry->action);
         list_remove(&entry->node);
-        free(entry);
+        dp_pool_put(entry_pool, entry);
 
         /* According to the spec. if there was a group action, the output
          * port action should be ignored */
@@ -233,6 +244,8 @@ action_set_execute(struct action_set *set, struct packet *pkt, unsigned long lon
             /* end add */
 
             action_set_clear_actions(pkt->action_set);
+            /* the output of the action set is the last use of the packet */
+            pkt->last_output = true;
             dp_actions_output_port(pkt, port_id, queue_id, max_len, cookie);
             return;
         }
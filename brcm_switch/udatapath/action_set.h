@@ -55,6 +55,11 @@ struct group_listner
  * Implementation of an action set associated with a datapath packet
  ****************************************************************************/
 
+/* Creates the pools of action sets and their entries, with room for n_sets
+ * sets to start with. */
+void
+action_set_pools_init(unsigned int n_sets);
+
 struct action_set *
 action_set_create(struct ofl_exp *exp);
 
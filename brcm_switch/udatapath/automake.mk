@@ -26,6 +26,28 @@ udatapath_ofdatapath_SOURCES = \
 	udatapath/flow_table.h \
 	udatapath/flow_table_exact.c \
 	udatapath/flow_table_exact.h \
+	udatapath/flow_table_tss.c \
+	udatapath/flow_table_tss.h \
+	udatapath/flow_key.c \
+	udatapath/flow_key.h \
+	udatapath/exact_hash.c \
+	udatapath/exact_hash.h \
+	udatapath/megaflow.c \
+	udatapath/megaflow.h \
+	udatapath/emc.c \
+	udatapath/emc.h \
+	udatapath/lpm.c \
+	udatapath/lpm.h \
+	udatapath/dp_worker.c \
+	udatapath/dp_worker.h \
+	udatapath/dp_pool.c \
+	udatapath/dp_pool.h \
+	udatapath/dp_pi_limit.c \
+	udatapath/dp_pi_limit.h \
+	udatapath/dp_hw_installer.c \
+	udatapath/dp_hw_installer.h \
+	udatapath/dp_hw_stats.c \
+	udatapath/dp_hw_stats.h \
 	udatapath/flow_entry.c \
 	udatapath/flow_entry.h \
 	udatapath/flow_entry_exact.c \
@@ -49,6 +71,7 @@ udatapath_ofdatapath_SOURCES = \
 	udatapath/Hybrid_Framework_Common.h \
 	udatapath/Hybrid_Framework_Linux.h \
 	udatapath/Hybrid_Framework_Linux.c \
+	udatapath/Hybrid_Framework_Request.c \
 	udatapath/udatapath_socket.c \
 	udatapath/udatapath_socket.h \
 	udatapath/udatapath.c \
@@ -44,6 +44,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "csum.h"
 #include "dp_buffers.h"
 #include "dp_control.h"
@@ -67,7 +69,13 @@
 #include "vconn.h"
 #include "timer_wheel.h"
 #include "dp_ports.h"
+#include "dp_worker.h"
+#include "dp_pool.h"
+#include "dp_pi_limit.h"
+#include "dp_hw_installer.h"
+#include "dp_hw_stats.h"
 #include "dp_capabilities.h"
+#include "ring.h"
 #include "utilities/dpctl.h"
 #include "util.h"
 
@@ -76,25 +84,34 @@
 #include "rbuff.h"
 #endif
 
-struct rbuff * g_fwd_buff = NULL;
+static struct ring *g_fwd_ring = NULL;
+static struct dp_pool *fwding_ctx_pool = NULL;
 struct rbuff * g_net_fwd_buff;
 struct rbuff * g_out_buff;
 
 unsigned int g_msgType = 0;
 unsigned int configType = 0;
 
+/* Wakes the datapath thread up from dp_sleep(). Producer threads only write
+ * it while dp_sleeping is set, so they pay no system call while the thread
+ * is busy polling. */
+static int dp_wakeup_fd = -1;
+static volatile int dp_sleeping = 0;
+
 #define LOG_MODULE VLM_dp
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
 
 static struct remote *remote_create(struct datapath *, struct rconn *);
+static void remotes_cork(struct datapath *, bool cork);
+static void remote_update_async(struct remote *);
 static void remote_run(struct datapath *, struct remote *);
 static void remote_wait(struct remote *);
 static void remote_destroy(struct remote *);
 
 #if defined(OF_HW_PLAT)
-static int port_status_change(struct datapath *dp, struct rbuff *port_rbuff);
+static int port_status_change(struct datapath *dp, struct ring *port_ring);
 #endif
 
 #define MFR_DESC     "Opensource"
@@ -140,6 +157,8 @@ struct datapath * dp_new(void)
     int i = 0;
     int err = 0;
     struct datapath *dp;
+    pthread_mutexattr_t mutex_attr;
+    pthread_rwlockattr_t rw_attr;
     dp = xmalloc(sizeof(struct datapath));
 
     dp->mfr_desc   = strncpy(xmalloc(DESC_STR_LEN), MFR_DESC, DESC_STR_LEN);
@@ -160,8 +179,13 @@ struct datapath * dp_new(void)
 
     dp->generation_id = -1;
 
-    dp->last_timeout = time_now_sec();
+    dp->last_timeout = time_now_msec();
     list_init(&dp->remotes);
+    /* Recursive, as messages are sent while the remotes are being run. */
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&dp->remotes_mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
     dp->listeners = NULL;
     dp->n_listeners = 0;
 
@@ -191,17 +215,49 @@ struct datapath * dp_new(void)
     dp->packet_in_limit = true;
 
     dp->use_exact_table = false;
+    dp->flow_generation = 0;
+    dp->emc_size = EMC_DEFAULT_SIZE;
+    dp->rx_batch = DP_RX_BATCH_DEFAULT;
+    dp->poll_dwell_us = DP_POLL_DWELL_DEFAULT;
+    dp->poll_backoff_ms = DP_POLL_BACKOFF_DEFAULT;
+    dp->n_workers = 0;
+    dp->pi_limit = dp_pi_limit_create();
+    dp->hw_stats_interval_ms = DP_HW_STATS_INTERVAL_DEFAULT;
+    dp->hw_stats = NULL;
+    pthread_mutex_init(&dp->hw_count_mutex, NULL);
+    if (dp_wakeup_fd < 0)
+    {
+        dp_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (dp_wakeup_fd < 0)
+        {
+            VLOG_ERR(LOG_MODULE, "could not create wakeup eventfd (%s), "
+                     "the datapath will busy poll", strerror(errno));
+        }
+    }
     list_init(&dp->ofp_path);
     dp->delay_time = 8;
     dp->mac_aging_time = DEFAULT_MAC_AGING_TIME;
     dp->flow_table_max_entries = FLOW_TABLE_MAX_ENTRIES;
     dp->no_del_flow_entry = false;
     dp->openflowreset = false;
-    err = pthread_rwlock_init(&dp->rw_lock,NULL);
+    /* Flow table changes must not wait for the worker threads to run out
+     * of packets; no thread takes the lock for reading twice. */
+    pthread_rwlockattr_init(&rw_attr);
+    pthread_rwlockattr_setkind_np(&rw_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    err = pthread_rwlock_init(&dp->rw_lock,&rw_attr);
+    pthread_rwlockattr_destroy(&rw_attr);
     if ( err !=0 ) {
         VLOG_ERR(LOG_MODULE, "init rw lock failed err:%d.\n",err);
     }
 
+    packet_pools_init();
+    fwding_ctx_pool = dp_pool_create("forwarding context",
+                                     sizeof(struct forwarding_context),
+                                     DP_FWD_QUEUE_LEN);
+
+    /* packets received by the threads of the hardware driver */
+    g_fwd_ring = ring_create(DP_FWD_QUEUE_LEN, RING_F_SC_DEQ);
+
     memset(dp->alta_queue, 0, NETDEV_MAX_QUEUES);
 
     memset(dp->ip, 0, MAX_IP_V4_LEN+1);
@@ -242,11 +298,12 @@ void dp_add_pvconn(struct datapath *dp, struct pvconn *pvconn)
     dp->listeners[dp->n_listeners++] = pvconn;
 }
 
-void dp_run(struct datapath *dp)
+bool dp_run(struct datapath *dp)
 {
     struct remote *r, *rn;
     size_t i;
-    time_t now = time_now_sec();
+    long long int now = time_now_msec();
+    unsigned int n_received;
 
     if (now != dp->last_timeout) {
         dp->last_timeout = now;
@@ -255,21 +312,27 @@ void dp_run(struct datapath *dp)
 
 
     // 3
-    port_status_change(dp, port_rbuff);
+    port_status_change(dp, port_ring);
     //meter_table_add_tokens(dp->meters);
-    dp_ports_run(dp);//յݱ
+    /* The packet ins and the replies of the pass are written at its end. */
+    remotes_cork(dp, true);
+    n_received = dp_ports_run(dp);//յݱ
+    dp_pi_limit_run(dp);
 
     /* Talk to remotes. */
     LIST_FOR_EACH_SAFE (r, rn, struct remote, node, &dp->remotes) {
         remote_run(dp, r);
     }
+    remotes_cork(dp, false);
 
     for (i = 0; i < dp->n_listeners; ) {
         struct pvconn *pvconn = dp->listeners[i];
         struct vconn *new_vconn;
         int retval = pvconn_accept(pvconn, OFP_VERSION, &new_vconn);
         if (!retval) {
+            pthread_mutex_lock(&dp->remotes_mutex);
             remote_create(dp, rconn_new_from_vconn("passive", new_vconn));
+            pthread_mutex_unlock(&dp->remotes_mutex);
         } else if (retval != EAGAIN) {
             VLOG_WARN_RL(LOG_MODULE, &rl, "accept failed (%s)", strerror(retval));
             dp->listeners[i] = dp->listeners[--dp->n_listeners];
@@ -277,6 +340,24 @@ void dp_run(struct datapath *dp)
         }
         i++;
     }
+
+    return n_received != 0;
+}
+
+static void remotes_cork(struct datapath *dp, bool cork)
+{
+    struct remote *r;
+
+    pthread_mutex_lock(&dp->remotes_mutex);
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes)
+    {
+        if (cork) {
+            rconn_cork(r->rconn);
+        } else {
+            rconn_uncork(r->rconn);
+        }
+    }
+    pthread_mutex_unlock(&dp->remotes_mutex);
 }
 
 static void remote_run(struct datapath *dp, struct remote *r)
@@ -284,7 +365,11 @@ static void remote_run(struct datapath *dp, struct remote *r)
     ofl_err error;
     size_t i;
 
+    /* The lock is not held while a message is handled, which may take the
+     * datapath lock. */
+    pthread_mutex_lock(&dp->remotes_mutex);
     rconn_run(r->rconn);
+    pthread_mutex_unlock(&dp->remotes_mutex);
 
     /* Do some remote processing, but cap it at a reasonable amount so that
      * other processing doesn't starve. */
@@ -292,12 +377,13 @@ static void remote_run(struct datapath *dp, struct remote *r)
         if (!r->cb_dump) {
             struct ofpbuf *buffer;
 
+            pthread_mutex_lock(&dp->remotes_mutex);
             buffer = rconn_recv(r->rconn);
+            pthread_mutex_unlock(&dp->remotes_mutex);
             if (buffer == NULL)
             {
-                /*break;add for BII_testgroup260.Testcase_260_40_FlowmodCookies
-                  reason:sometimes ,the msg from ctrl is slower than the packet in,so continue to receive 50 times.*/
-                continue;
+                /* messages arriving later wake the datapath up again. */
+                break;
             }
             else
             {
@@ -320,6 +406,7 @@ static void remote_run(struct datapath *dp, struct remote *r)
                                  .data_length = 64,
                                  .data        = buffer->data};
                         dp_send_message(dp, (struct ofl_msg_header *)&err, &sender);
+                        ofpbuf_delete(buffer);
                         continue;
                     }
                 }
@@ -340,6 +427,7 @@ static void remote_run(struct datapath *dp, struct remote *r)
                                  .data_length = 64,
                                  .data        = buffer->data};
                         dp_send_message(dp, (struct ofl_msg_header *)&err, &sender);
+                        ofpbuf_delete(buffer);
                         continue;
                     }
                 }
@@ -390,7 +478,7 @@ static void remote_run(struct datapath *dp, struct remote *r)
                 ofpbuf_delete(buffer);
             }
         } else {
-            if (r->n_txq < TXQ_LIMIT) {
+            if (rconn_queued_bytes(r->rconn) < TXQ_BUDGET) {
                 int error = r->cb_dump(dp, r->cb_aux);
                 if (error <= 0) {
                     if (error) {
@@ -406,9 +494,11 @@ static void remote_run(struct datapath *dp, struct remote *r)
         }
     }
 
+    pthread_mutex_lock(&dp->remotes_mutex);
     if (!rconn_is_alive(r->rconn)) {
         remote_destroy(r);
     }
+    pthread_mutex_unlock(&dp->remotes_mutex);
 }
 
 static void
@@ -416,6 +506,9 @@ remote_wait(struct remote *r)
 {
     rconn_run_wait(r->rconn);
     rconn_recv_wait(r->rconn);
+    if (r->cb_dump && rconn_queued_bytes(r->rconn) < TXQ_BUDGET) {
+        poll_immediate_wake();
+    }
 }
 
 static void remote_destroy(struct remote *r)
@@ -437,7 +530,6 @@ static struct remote *remote_create(struct datapath *dp, struct rconn *rconn)
     list_push_back(&dp->remotes, &remote->node);
     remote->rconn = rconn;
     remote->cb_dump = NULL;
-    remote->n_txq = 0;
     remote->role = OFPCR_ROLE_EQUAL;
     /* Set the remote configuration to receive any asynchronous message*/
     remote->config.packet_in_mask[0]= 0x3;
@@ -447,16 +539,47 @@ static struct remote *remote_create(struct datapath *dp, struct rconn *rconn)
     remote->config.packet_in_mask[1]=0x0;
     remote->config.port_status_mask[1]= 0x7;
     remote->config.flow_removed_mask[1]=0x0;
+    remote_update_async(remote);
     return remote;
 }
 
+/* Works out which of the messages broadcast to all the remotes 'r' receives,
+ * from its role and asynchronous configuration, so that a broadcast tests a
+ * bit per remote. A controller with role slave receives only port status
+ * messages. Reasons without a bit in the configuration are always sent. */
+static void remote_update_async(struct remote *r)
+{
+    int i = r->role == OFPCR_ROLE_SLAVE ? 1 : 0;
+
+    r->async_types = i ? 1ULL << OFPT_PORT_STATUS : ~0ULL;
+    r->async_reasons[REMOTE_ASYNC_PACKET_IN] =
+        (r->config.packet_in_mask[i] & 0x7) | ~0x7U;
+    r->async_reasons[REMOTE_ASYNC_PORT_STATUS] =
+        (r->config.port_status_mask[i] & 0x7) | ~0x7U;
+    r->async_reasons[REMOTE_ASYNC_FLOW_REMOVED] =
+        (r->config.flow_removed_mask[i] & 0x1f) | ~0x1fU;
+}
+
+void remote_start_dump(struct remote *remote,
+                       int (*dump)(struct datapath *, void *),
+                       void (*done)(void *),
+                       void *aux)
+{
+    assert(!remote->cb_dump);
+    remote->cb_dump = dump;
+    remote->cb_done = done;
+    remote->cb_aux = aux;
+}
+
 
 void dp_wait(struct datapath *dp)
 {
     struct remote *r;
     size_t i;
 
-#if !defined(OF_HW_PLAT)
+#if !defined(OF_HW_PLAT) || defined(USE_NETDEV)
+    struct sw_port *p;
+
     LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list)
     {
         if (IS_HW_PORT(p)) {
@@ -465,16 +588,68 @@ void dp_wait(struct datapath *dp)
         netdev_recv_wait(p->netdev);
     }
 #endif
+    pthread_mutex_lock(&dp->remotes_mutex);
     LIST_FOR_EACH (r, struct remote, node, &dp->remotes)
     {
         remote_wait(r);
     }
+    pthread_mutex_unlock(&dp->remotes_mutex);
     for (i = 0; i < dp->n_listeners; i++)
     {
         pvconn_wait(dp->listeners[i]);
     }
 }
 
+bool dp_sleep(struct datapath *dp)
+{
+    long long int next, now;
+    unsigned long long int count;
+
+    if (dp->poll_backoff_ms == 0 || dp_wakeup_fd < 0)
+    {
+        return false;
+    }
+
+    /* Work queued after the check below finds dp_sleeping set, and writes
+     * the eventfd. */
+    dp_sleeping = 1;
+    __sync_synchronize();
+    if (dp_run(dp))
+    {
+        dp_sleeping = 0;
+        return true;
+    }
+
+    dp_wait(dp);
+    poll_fd_wait(dp_wakeup_fd, POLLIN);
+    next = MIN(pipeline_next_timeout(dp->pipeline),
+               dp_pi_limit_next(dp->pi_limit));
+    now = time_now_msec();
+    poll_timer_wait(next <= now ? 0 : MIN(next - now, (long long int)dp->poll_backoff_ms));
+    poll_block();
+
+    dp_sleeping = 0;
+    while (read(dp_wakeup_fd, &count, sizeof count) > 0)
+    {
+        continue;
+    }
+    return false;
+}
+
+void dp_wakeup(void)
+{
+    unsigned long long int one = 1;
+
+    __sync_synchronize();
+    if (dp_sleeping && dp_wakeup_fd >= 0)
+    {
+        if (write(dp_wakeup_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+        {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "datapath wakeup failed (%s)", strerror(errno));
+        }
+    }
+}
+
 void dp_set_dpid(struct datapath *dp, unsigned long long int dpid)
 {
     dp->id = dpid;
@@ -1579,16 +1754,27 @@ struct forwarding_context * fwding_ctx_alloc(int in_port, int head_size, int buf
 {
     struct forwarding_context *ctx;
 
-    ctx = malloc(sizeof(*ctx));
-    assert(ctx);
+    ctx = dp_pool_get(fwding_ctx_pool);
 
     memset(ctx, 0, sizeof(*ctx));
-    ctx->buff = ofpbuf_new_with_headroom(buff_size, head_size+128); 
+    if (head_size + 128 <= OFPBUF_SLAB_HEADROOM)
+    {
+        ctx->buff = ofpbuf_slab_new(buff_size);
+    }
+    else
+    {
+        ctx->buff = ofpbuf_new_with_headroom(buff_size, head_size+128);
+    }
     ctx->in_port = in_port;
 
     return ctx;
 }
 
+void fwding_ctx_release(struct forwarding_context *ctx)
+{
+    dp_pool_put(fwding_ctx_pool, ctx);
+}
+
 int get_port_link(int port_no)
 {
     return PORT_UP;
@@ -1614,6 +1800,7 @@ unsigned int fwding_evt_handle(unsigned int    ulNetID,       /*!<оƬ
 {
     int in_port = 0;
     struct forwarding_context *ctx;
+    struct dp_worker *worker;
     OPENFLOW_CtlWord_Sendtolinux_Linux_S_T2 *ctrl_word;
 
     VLOG_DBG(LOG_MODULE, "Enter fwding_evt_handle\n");
@@ -1624,12 +1811,9 @@ unsigned int fwding_evt_handle(unsigned int    ulNetID,       /*!<оƬ
     ctrl_word = (OPENFLOW_CtlWord_Sendtolinux_Linux_S_T2 *)pstCtrlWord;
 
 
-    if(g_fwd_buff == 0)
-    {
-        g_fwd_buff = rbuff_alloc(100);
-    }
-
-    if(rbuff_full(g_fwd_buff))
+    /* with worker threads, the worker of the flow takes the packet */
+    worker = dp_worker_select(pData, ulLen);
+    if(worker != NULL ? dp_worker_full(worker) : ring_is_full(g_fwd_ring))
     {
         g_port_recv_drop++;
         return -1;
@@ -1652,22 +1836,39 @@ unsigned int fwding_evt_handle(unsigned int    ulNetID,       /*!<оƬ
         delete_vlan((struct ofpbuf *)ctx->buff);
     }
 
-    rbuff_put(g_fwd_buff, ctx);
+    /* another receive thread may have filled the queue meanwhile */
+    if ((worker != NULL ? dp_worker_enqueue(worker, ctx) : fwding_ctx_put(ctx)) != 0)
+    {
+        ofpbuf_delete((struct ofpbuf *)ctx->buff);
+        fwding_ctx_release(ctx);
+        g_port_recv_drop++;
+        return -1;
+    }
     VLOG_DBG(LOG_MODULE, "put packet in to buff success\n");
 
     return 0;
 }
 
-void * fwding_ctx(void)
+int fwding_ctx_put(struct forwarding_context *ctx)
+{
+    if (ring_put(g_fwd_ring, ctx) != 0)
+    {
+        return -1;
+    }
+    dp_wakeup();
+    return 0;
+}
+
+unsigned int fwding_ctx_burst(struct forwarding_context **ctxs, unsigned int n)
 {
-    return rbuff_get(g_fwd_buff);
+    return ring_get_burst(g_fwd_ring, (void **)ctxs, n);
 }
 #endif
 
 
 static int send_openflow_buffer_to_remote(struct ofpbuf *buffer, struct remote *remote)
 {
-    int retval = rconn_send_with_limit(remote->rconn, buffer, &remote->n_txq, TXQ_LIMIT);
+    int retval = rconn_send_with_budget(remote->rconn, buffer, TXQ_BUDGET);
 
     if (retval) {
         //VLOG_WARN_RL(LOG_MODULE, &rl, "send to %s failed: %s",
@@ -1675,6 +1876,11 @@ static int send_openflow_buffer_to_remote(struct ofpbuf *buffer, struct remote *
         VLOG_ERR_RL(LOG_MODULE, &rl, "send to %s failed: %s \n",
                  rconn_get_name(remote->rconn), strerror(retval));
     }
+    /* Workers send packet-ins too; the datapath thread writes what they
+     * leave queued, so it must not sleep through it. */
+    if (rconn_tx_backlogged(remote->rconn)) {
+        dp_wakeup();
+    }
 
     return retval;
 }
@@ -1683,90 +1889,69 @@ int send_openflow_buffer(struct datapath *dp,
                          struct ofpbuf *buffer,
                          const struct sender *sender)
 {
+    int retval = 0;
+
     update_openflow_length(buffer);
+    pthread_mutex_lock(&dp->remotes_mutex);
     if (sender)
     {
         /* Send back to the sender. */
-        return send_openflow_buffer_to_remote(buffer, sender->remote);
+        retval = send_openflow_buffer_to_remote(buffer, sender->remote);
 
     }
     else
     {
         /* Broadcast to all remotes. */
+        struct ofp_header *oh = buffer->data;
         struct remote *r, *prev = NULL;
-        unsigned char msg_type;
-        /* Get the type of the message */
-        memcpy(&msg_type,((char* ) buffer->data) + 1, sizeof(unsigned char));
+        int async = -1;
+        unsigned char reason = 0;
+
+        switch (oh->type) {
+            case (OFPT_PACKET_IN):
+                async = REMOTE_ASYNC_PACKET_IN;
+                reason = ((struct ofp_packet_in *)oh)->reason;
+                break;
+            case (OFPT_PORT_STATUS):
+                async = REMOTE_ASYNC_PORT_STATUS;
+                reason = ((struct ofp_port_status *)oh)->reason;
+                break;
+            case (OFPT_FLOW_REMOVED):
+                async = REMOTE_ASYNC_FLOW_REMOVED;
+                reason = ((struct ofp_flow_removed *)oh)->reason;
+                break;
+        }
+
         LIST_FOR_EACH (r, struct remote, node, &dp->remotes)
         {
-            /* do not send to remotes with slave role apart from port status */
-            if (r->role == OFPCR_ROLE_EQUAL || r->role == OFPCR_ROLE_MASTER)
-            {
-                /*Check if the message is enabled in the asynchronous configuration*/
-                switch(msg_type){
-                    case (OFPT_PACKET_IN):{
-                        struct ofp_packet_in *p = (struct ofp_packet_in*)buffer->data;
-                        /* Do not send message if the reason is not enabled */
-                        if((p->reason == OFPR_NO_MATCH) && !(r->config.packet_in_mask[0] & 0x1))
-                            continue;
-                        if((p->reason == OFPR_ACTION) && !(r->config.packet_in_mask[0] & 0x2))
-                            continue;
-                        if((p->reason == OFPR_INVALID_TTL) && !(r->config.packet_in_mask[0] & 0x4))
-                            continue;
-                        break;
-                    }
-                    case (OFPT_PORT_STATUS):{
-                        struct ofp_port_status *p = (struct ofp_port_status*)buffer->data;
-                        if((p->reason == OFPPR_ADD) && !(r->config.port_status_mask[0] & 0x1))
-                            continue;
-                        if((p->reason == OFPPR_DELETE) && !(r->config.port_status_mask[0] & 0x2))
-                            continue;
-                        if((p->reason == OFPPR_MODIFY) && !(r->config.port_status_mask[0] & 0x4))
-                            continue;
-                    }
-                    case (OFPT_FLOW_REMOVED):{
-                        struct ofp_flow_removed *p= (struct ofp_flow_removed *)buffer->data;
-                        if((p->reason == OFPRR_IDLE_TIMEOUT) && !(r->config.flow_removed_mask[0] & 0x1))
-                            continue;
-                        if((p->reason == OFPRR_HARD_TIMEOUT) && !(r->config.flow_removed_mask[0] & 0x2))
-                            continue;
-                        if((p->reason == OFPRR_DELETE) && !(r->config.flow_removed_mask[0] & 0x4))
-                            continue;
-                        if((p->reason == OFPRR_GROUP_DELETE) && !(r->config.flow_removed_mask[0] & 0x8))
-                            continue;
-                        if((p->reason == OFPRR_METER_DELETE) && !(r->config.flow_removed_mask[0] & 0x10))
-                            continue;
-                    }
-                }
+            /* Check if the message is enabled for the role and in the
+             * asynchronous configuration of the remote */
+            if (oh->type < 64 && !(r->async_types & (1ULL << oh->type))) {
+                continue;
             }
-            else {
-                /* In this implementation we assume that a controller with role slave
-                   can is able to receive only port stats messages */
-                if (r->role == OFPCR_ROLE_SLAVE && msg_type != OFPT_PORT_STATUS) {
-                    continue;
-                }
-                else {
-                    struct ofp_port_status *p = (struct ofp_port_status*)buffer->data;
-                    if((p->reason == OFPPR_ADD) && !(r->config.port_status_mask[1] & 0x1))
-                        continue;
-                    if((p->reason == OFPPR_DELETE) && !(r->config.port_status_mask[1] & 0x2))
-                        continue;
-                    if((p->reason == OFPPR_MODIFY) && !(r->config.port_status_mask[1] & 0x4))
-                        continue;
-                }
+            if (async >= 0 && reason < 32 && !(r->async_reasons[async] & (1U << reason))) {
+                continue;
             }
             if (prev) {
-                send_openflow_buffer_to_remote(ofpbuf_clone(buffer), prev);
+                /* the remotes share the data of the message */
+                send_openflow_buffer_to_remote(ofpbuf_share(buffer), prev);
             }
             prev = r;
         }
-        if (prev) {
+        if (prev && buffer->more != NULL) {
+            /* a sender may linearize the message, which must not move the
+             * data under the views of the others */
+            send_openflow_buffer_to_remote(ofpbuf_share(buffer), prev);
+            ofpbuf_delete(buffer);
+        } else if (prev) {
             send_openflow_buffer_to_remote(buffer, prev);
         } else {
             ofpbuf_delete(buffer);
         }
-        return 0;
     }
+    pthread_mutex_unlock(&dp->remotes_mutex);
+
+    return retval;
 }
 
 int dp_send_message(struct datapath *dp, struct ofl_msg_header *msg,
@@ -1859,6 +2044,20 @@ dp_handle_show_perf(struct datapath *dp, struct ofl_exp_openflow_msg_show_perf *
     (void)sender;
     OF_PERF_SHOW_LOG();
     OF_PERF_SHOW_PKTIN();
+
+    if (dp->pipeline != NULL)
+    {
+        printf("**emc hit:[%llu], emc miss:[%llu]**\r\n",
+               dp->pipeline->main.emc.hit_count, dp->pipeline->main.emc.miss_count);
+        dp->pipeline->main.emc.hit_count = 0;
+        dp->pipeline->main.emc.miss_count = 0;
+    }
+    dp_workers_show();
+    dp_pools_show();
+    dp_data_buffers_show(dp->data_buffers);
+    dp_pi_limit_show(dp->pi_limit);
+    dp_hw_installer_show();
+    dp_hw_stats_show();
     ofl_msg_free((struct ofl_msg_header *)msg, dp->exp);
     return 0;
 }
@@ -2108,12 +2307,16 @@ dp_handle_role_request(struct datapath *dp, struct ofl_msg_role_request *msg,
                 return error;
             }
             /* Old master(s) must be changed to slave(s) */
+            pthread_mutex_lock(&dp->remotes_mutex);
             LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
                 if (r->role == OFPCR_ROLE_MASTER) {
                     r->role = OFPCR_ROLE_SLAVE;
+                    remote_update_async(r);
                 }
             }
             sender->remote->role = OFPCR_ROLE_MASTER;
+            remote_update_async(sender->remote);
+            pthread_mutex_unlock(&dp->remotes_mutex);
             break;
         }
 
@@ -2123,12 +2326,18 @@ dp_handle_role_request(struct datapath *dp, struct ofl_msg_role_request *msg,
                 VLOG_WARN_RL(LOG_MODULE, &rl, "Role message generation id is smaller than the current id!");
                 return error;
             }
+            pthread_mutex_lock(&dp->remotes_mutex);
             sender->remote->role = OFPCR_ROLE_SLAVE;
+            remote_update_async(sender->remote);
+            pthread_mutex_unlock(&dp->remotes_mutex);
             break;
         }
 
         case OFPCR_ROLE_EQUAL: {
+            pthread_mutex_lock(&dp->remotes_mutex);
             sender->remote->role = OFPCR_ROLE_EQUAL;
+            remote_update_async(sender->remote);
+            pthread_mutex_unlock(&dp->remotes_mutex);
             break;
         }
 
@@ -2185,12 +2394,15 @@ dp_handle_async_request(struct datapath *dp, struct ofl_msg_async_config *msg,
         }
         case (OFPT_SET_ASYNC):
         {
+            pthread_mutex_lock(&dp->remotes_mutex);
             for (i = 0; i < 2; i++)
             {
                 sender->remote->config.packet_in_mask[i] =  ntohl(msg->config->packet_in_mask[i]);
                 sender->remote->config.flow_removed_mask[i] =  ntohl(msg->config->flow_removed_mask[i]);
                 sender->remote->config.port_status_mask[i] = ntohl(msg->config->port_status_mask[i]);
             }
+            remote_update_async(sender->remote);
+            pthread_mutex_unlock(&dp->remotes_mutex);
             break;
         }
     }
@@ -2199,14 +2411,14 @@ dp_handle_async_request(struct datapath *dp, struct ofl_msg_async_config *msg,
 
 // add for brcm ports status change
 #if defined(OF_HW_PLAT)
-static int port_status_change(struct datapath *dp, struct rbuff *port_rbuff)
+static int port_status_change(struct datapath *dp, struct ring *port_ring)
 {
     ports_action *portsact;
     struct sw_port * port;
     struct ofl_msg_port_status msg;
     unsigned int flag = 1;
 
-    while((portsact =(ports_action *) rbuff_get(port_rbuff)) != NULL)
+    while((portsact =(ports_action *) ring_get(port_ring)) != NULL)
     {
         LIST_FOR_EACH(port, struct sw_port, node, &dp->port_list)
         {
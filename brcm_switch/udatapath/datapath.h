@@ -67,6 +67,8 @@
 
 
 struct rconn;
+struct dp_hw_stats;
+struct dp_pi_limit;
 struct pvconn;
 struct sender;
 
@@ -127,6 +129,9 @@ struct datapath {
     unsigned long long int  id;                     /* Unique identifier for this datapath. */
 
     struct list remotes;                            /* Remote connections. */
+    pthread_mutex_t         remotes_mutex;          /* Guards the remotes, which
+                                                       worker threads send to.
+                                                       Taken after rw_lock. */
 
     unsigned long long int  generation_id;          /* Identifies a given mastership view */
     bool                    generation_is_defined;  /* If generation_id has been given by controller */
@@ -134,7 +139,7 @@ struct datapath {
     /* Listeners. */
     struct pvconn **        listeners;
     size_t                  n_listeners;
-    time_t                  last_timeout;
+    long long int           last_timeout;   /* ms of the last flow expiry run. */
 
     struct dp_buffers *     buffers;
     struct data_buffers *   data_buffers;
@@ -159,13 +164,11 @@ struct datapath {
      * in the driver structure
      */
     of_hw_driver_t *hw_drv;
-    struct hw_pkt_q_entry *hw_pkt_list_head, *hw_pkt_list_tail;
 #endif
 
 
     unsigned short int      vlan;
 
-    struct meter_entry *    m_entry;
     unsigned short int      meter_choose_band;
     struct policer_config   pol_config;
     bool                    soft_switch;
@@ -180,6 +183,29 @@ struct datapath {
 
     bool                    use_mac_table;
     bool                    use_exact_table;
+    unsigned long long int  flow_generation;        /* moves on with every flow
+                                                       table, group or meter
+                                                       change. */
+    unsigned int            emc_size;               /* exact match cache slots. */
+    unsigned int            rx_batch;               /* packets received and
+                                                       processed per run. */
+    unsigned int            poll_dwell_us;          /* busy polling after the
+                                                       last packet. */
+    unsigned int            poll_backoff_ms;        /* longest sleep when idle,
+                                                       0 to never sleep. */
+    unsigned int            n_workers;              /* packet processing threads,
+                                                       0 to process packets in
+                                                       the datapath thread. */
+    struct dp_pi_limit     *pi_limit;               /* packet in rate limits. */
+    unsigned int            hw_stats_interval_ms;   /* between sweeps of the
+                                                       hardware counters, 0 to
+                                                       never read them. */
+    struct dp_hw_stats     *hw_stats;               /* hardware counter
+                                                       collector, if started. */
+    pthread_mutex_t         hw_count_mutex;         /* Guards the hardware
+                                                       counters cached in the
+                                                       logic entries. Taken
+                                                       after rw_lock. */
 
     unsigned long long int  time_point[20];
     char *                  mng_netdev_name;
@@ -214,12 +240,18 @@ struct sender {
 };
 
 
-#define TXQ_LIMIT 128               /* Max number of packets to queue for tx. */
+#define TXQ_BUDGET (256 * 1024)     /* Max bytes of packets to queue for tx. */
+enum remote_async_type {
+    REMOTE_ASYNC_PACKET_IN,
+    REMOTE_ASYNC_PORT_STATUS,
+    REMOTE_ASYNC_FLOW_REMOVED,
+    REMOTE_ASYNC_TYPES
+};
+
 /* A connection to a secure channel. */
 struct remote {
     struct list         node;
     struct rconn *      rconn;
-    int                 n_txq;      /* Number of packets queued for tx on rconn. */
 
     /* Support for reliable, multi-message replies to requests.
      *
@@ -233,6 +265,12 @@ struct remote {
     unsigned int        role;       /* OpenFlow controller role. */
     struct ofl_async_config config; /* Asynchronous messages configuration,
                                      * set from controller*/
+
+    /* The messages broadcast that the remote receives, for its role and
+     * config: a bit per message type, and of the asynchronous messages, a
+     * bit per reason. */
+    unsigned long long int async_types;
+    unsigned int        async_reasons[REMOTE_ASYNC_TYPES];
 };
 
 
@@ -248,6 +286,13 @@ struct forwarding_context
     void *buff;
 };
 
+/* Allocates a forwarding context and a buffer for a received packet of up
+ * to buff_size bytes, with head_size bytes of headroom on top of 128. */
+struct forwarding_context * fwding_ctx_alloc(int in_port, int head_size, int buff_size);
+
+/* Frees a forwarding context, whose buffer was handed over or deleted. */
+void fwding_ctx_release(struct forwarding_context *ctx);
+
 unsigned int fwding_evt_handle
 (
     unsigned int    ulNetID,       /*!<оƬ*/
@@ -265,15 +310,28 @@ void dp_new_table(struct datapath *dp);
 
 void dp_add_pvconn(struct datapath *dp, struct pvconn *pvconn);
 
+#define DP_POLL_DWELL_DEFAULT    100   /* us */
+#define DP_POLL_BACKOFF_DEFAULT  100   /* ms */
+
 /* Executes the datapath. The datapath works if this function is run
- * repeatedly. */
-void dp_run(struct datapath *dp);
+ * repeatedly. Returns true if packets were received. */
+bool dp_run(struct datapath *dp);
 
 /* This function should be called after dp_run. It sets up polling on all
  * event sources (listeners, remotes, ...), so that poll_block() will block
  * until an event occurs on any source. */
 void dp_wait(struct datapath *dp);
 
+/* Blocks until a source has work for dp_run(), a flow times out, or
+ * poll_backoff_ms elapse, running dp_run() once more first to catch work
+ * queued meanwhile. Returns true if that run received packets, in which case
+ * it did not block. */
+bool dp_sleep(struct datapath *dp);
+
+/* Wakes the datapath up from dp_sleep(). Called by the threads queueing
+ * work for it, after the work is queued. */
+void dp_wakeup(void);
+
 
 /* Setter functions for various datapath fields */
 void dp_set_dpid(struct datapath *dp, unsigned long long int dpid);
@@ -296,11 +354,30 @@ void dp_set_max_queues(struct datapath *dp, unsigned int max_queues);
 int dp_send_message(struct datapath *dp, struct ofl_msg_header *msg,
                      const struct sender *sender);
 
+/* Has the remote call dump with aux whenever its queue of replies has room,
+ * until dump returns 0 when done or a negative errno value, and then, or if
+ * the remote goes away first, done with aux. The messages of the remote are
+ * not read until the dump is done. */
+void remote_start_dump(struct remote *remote,
+                       int (*dump)(struct datapath *, void *),
+                       void (*done)(void *),
+                       void *aux);
+
 /* wangxin ʱ */
 int dp_send_message_asynchronism(struct datapath *dp, struct ofl_msg_header *msg,
                      unsigned int xid);
 
-void * fwding_ctx(void);
+/* Length of the queue of received packets to the datapath thread. */
+#define DP_FWD_QUEUE_LEN  4096
+
+/* Queues a received packet to the datapath thread, and wakes it up; any
+ * thread may queue packets. Returns 0 if successful, -1 if the queue is
+ * full. */
+int fwding_ctx_put(struct forwarding_context *ctx);
+
+/* Dequeues up to n received packets into ctxs, for the datapath thread.
+ * Returns the number dequeued. */
+unsigned int fwding_ctx_burst(struct forwarding_context **ctxs, unsigned int n);
 
 unsigned int dp_is_ip_digit(char aDigit);
 unsigned int dp_is_ip_formatvalid(char* paIP);
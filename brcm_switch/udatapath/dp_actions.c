@@ -1321,6 +1321,13 @@ dp_execute_action(struct packet *pkt,
         free(a);
     }
 
+    /* the frame may be shared with the packet in messages sent so far,
+     * which the actions that change it must leave alone */
+    if (action->type != OFPAT_OUTPUT && action->type != OFPAT_GROUP
+        && action->type != OFPAT_SET_QUEUE && action->type != OFPAT_PUSH_FHID) {
+        packet_unshare(pkt);
+    }
+
     switch (action->type) {
         case (OFPAT_SET_FIELD): {
             set_field(pkt,(struct ofl_action_set_field*) action);
@@ -1468,9 +1475,6 @@ dp_actions_output_port(struct packet *pkt, unsigned int out_port, unsigned int o
         {
             unsigned char reason = 0;
 
-            meter_table_apply(pkt->dp->meters, &pkt , OFPM_CONTROLLER);
-            if( pkt == NULL )
-                break;
             reason = pkt->mis_match_entry_hited == true ? OFPR_NO_MATCH : OFPR_ACTION;
 
             dp_flow_set_flag(pkt->dp->data_buffers, pkt->hash,true);
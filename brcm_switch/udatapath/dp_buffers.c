@@ -37,8 +37,12 @@
  * Author: Zoltán Lajos Kis <zoltan.lajos.kis@ericsson.com>
  */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "dp_buffers.h"
@@ -63,24 +67,59 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
 #define N_PKT_BUFFERS (1 << PKT_BUFFER_BITS)
 #define PKT_BUFFER_MASK (N_PKT_BUFFERS - 1)
-#define N_DATA_BUFFERS 4096
 #define N_PKT_UNIT 2048
-#define N_HASH_DIV 4087
 #define N_PKT_IN_PIPELINE 1
 
 #define OVERWRITE_SECS  1
 #define RESEND_SECS 2
 #define OVEROUT_SECS 20
 
-struct data_type{
-    struct list node;
-    bool run_pipeline;
-    unsigned int  hash;
-    unsigned int num_pkt_in_pipeline;
-    unsigned int num_pkt;
+/* The flow filters remember the flows recently sent to the controller, and
+ * those downloaded to the hardware. A filter is a fixed table of slots, in
+ * groups of FLOW_FILTER_WAYS that a flow hashes to: a new flow takes a free
+ * slot of its group, or evicts the entry the CLOCK hand of the group finds
+ * unused since it last passed, and entries idle for FLOW_FILTER_IDLE_SECS
+ * are freed as lookups come across them. Keys up to FLOW_FILTER_KEY_INLINE
+ * bytes are kept in the slot. The entries of the hardware filter are handed
+ * out as ids made of a slot number and a cookie, as the packet buffers are,
+ * so that a stale id does not remove another flow. */
+#define FLOW_FILTER_SLOT_BITS 13
+#define FLOW_COOKIE_BITS (32 - FLOW_FILTER_SLOT_BITS)
+
+#define N_FLOW_FILTER_SLOTS (1 << FLOW_FILTER_SLOT_BITS)
+#define FLOW_FILTER_SLOT_MASK (N_FLOW_FILTER_SLOTS - 1)
+#define FLOW_FILTER_WAYS 8
+#define N_FLOW_FILTER_GROUPS (N_FLOW_FILTER_SLOTS / FLOW_FILTER_WAYS)
+#define FLOW_FILTER_KEY_INLINE 64
+/* packet_hash_pi() puts at most all the fields of a flow key */
+#define FLOW_FILTER_KEY_MAX ROUND_UP(sizeof(struct flow_key_fields), sizeof(unsigned int))
+#define FLOW_FILTER_IDLE_SECS 60
+
+struct flow_filter_entry {
+    bool           in_use;
+    bool           referenced;  /* looked up since the CLOCK hand passed. */
+    bool           run_pipeline;
+    unsigned int   hash;
+    unsigned int   cookie;
+    unsigned int   num_pkt_in_pipeline;
     time_t         timeout;
-    unsigned int key_len;
-    unsigned char   *key;
+    time_t         last_used;
+    unsigned int   key_len;
+    union {
+        unsigned char  inline_key[FLOW_FILTER_KEY_INLINE];
+        unsigned char *key;     /* if key_len > FLOW_FILTER_KEY_INLINE. */
+    } k;
+};
+
+struct flow_filter {
+    const char                *name;
+    unsigned int               n_entries;
+    unsigned long long int     n_hits;
+    unsigned long long int     n_misses;
+    unsigned long long int     n_evictions;
+    unsigned long long int     n_aged;
+    unsigned char              hands[N_FLOW_FILTER_GROUPS];
+    struct flow_filter_entry   slots[N_FLOW_FILTER_SLOTS];
 };
 
 struct data_unit {
@@ -91,13 +130,6 @@ struct data_unit {
     time_t         timeout;
 };
 
-struct data_buffer{
-    struct list unit_head;
-    struct list type_head;
-    unsigned int units_num;
-    time_t         timeout;
-};
-
 struct packet_buffer {
     struct packet *pkt;
     unsigned int       cookie;
@@ -109,64 +141,173 @@ struct packet_buffer {
 //       the other will receive an invalid buffer response.
 //       In the current implementation this should not happen.
 
+/* Both kinds of buffers are shared by the packet processing threads and
+ * the datapath thread, and guarded by their lock. */
 struct data_buffers {
     struct datapath       *dp;
-    struct data_buffer   buffers[N_DATA_BUFFERS];
-    struct data_buffer   hwbuf[N_DATA_BUFFERS];
+    pthread_mutex_t        lock;
+    struct flow_filter     pi;     /* flows sent to the controller. */
+    struct flow_filter     hw;     /* flows downloaded to the hardware. */
 };
 
 struct dp_buffers {
     struct datapath       *dp;
+    pthread_mutex_t        lock;
     size_t                 buffer_idx;
     size_t                 buffers_num;
     struct packet_buffer   buffers[N_PKT_BUFFERS];
 };
 
-static unsigned char *malloc_pkt_key(int len)
+static inline const unsigned char *
+flow_filter_key(const struct flow_filter_entry *e)
 {
-    unsigned char *ptr;
-    ptr = xmalloc(len);
-    memset(ptr,0,len);
-    return ptr;
+    return e->key_len <= FLOW_FILTER_KEY_INLINE ? e->k.inline_key : e->k.key;
 }
 
-static void free_pkt_key(unsigned char* key)
+static inline struct flow_filter_entry *
+flow_filter_group(struct flow_filter *ff, unsigned int hash)
 {
-    if(key != NULL)
+    return &ff->slots[(hash % N_FLOW_FILTER_GROUPS) * FLOW_FILTER_WAYS];
+}
+
+static inline unsigned int
+flow_filter_id(struct flow_filter *ff, struct flow_filter_entry *e)
+{
+    return (e - ff->slots) | (e->cookie << FLOW_FILTER_SLOT_BITS);
+}
+
+static void
+flow_filter_free(struct flow_filter *ff, struct flow_filter_entry *e)
+{
+    if (e->key_len > FLOW_FILTER_KEY_INLINE)
     {
-        free(key);
+        free(e->k.key);
     }
+    e->in_use = false;
+    ff->n_entries--;
+}
 
-    return;
+/* Puts the key of the packet in key, which has room for FLOW_FILTER_KEY_MAX
+ * bytes, and returns its hash. */
+static unsigned int
+flow_filter_key_extract(struct packet *pkt, unsigned char *key, unsigned int *len)
+{
+    unsigned int hash;
+
+    *len = ROUND_UP(pkt->handle_std->match_len, sizeof(unsigned int));
+    memset(key, 0, *len);
+    hash = packet_hash_pi(key, pkt, *len);
+    return abs(hash);
 }
 
-static struct data_type*
-    dp_buffers_type_create(int len_key){
-    struct data_type *dpt = xmalloc(sizeof(struct data_type));
-    if(dpt != NULL)
+/* Returns the entry of a key, or NULL. Frees the idle entries of the group
+ * on the way. */
+static struct flow_filter_entry *
+flow_filter_lookup(struct flow_filter *ff, unsigned int hash,
+                   const unsigned char *key, unsigned int len, time_t now)
+{
+    struct flow_filter_entry *group = flow_filter_group(ff, hash);
+    size_t i;
+
+    for (i = 0; i < FLOW_FILTER_WAYS; i++)
     {
-        list_init(&dpt->node);
-        dpt->hash = 0;
-        dpt->run_pipeline = true;
-        dpt->num_pkt_in_pipeline = 0;
-        dpt->num_pkt = 0;
-        dpt->timeout = 0;
-        dpt->key_len = len_key;
-        dpt->key = malloc_pkt_key(len_key);
-    }
+        struct flow_filter_entry *e = &group[i];
 
-    return dpt;
+        if (!e->in_use)
+        {
+            continue;
+        }
+        if (now - e->last_used > FLOW_FILTER_IDLE_SECS)
+        {
+            flow_filter_free(ff, e);
+            ff->n_aged++;
+            continue;
+        }
+        if (e->hash == hash && e->key_len == len
+            && !memcmp(flow_filter_key(e), key, len))
+        {
+            e->referenced = true;
+            e->last_used = now;
+            ff->n_hits++;
+            return e;
+        }
+    }
+    ff->n_misses++;
+    return NULL;
 }
 
-static void dp_buffers_type_destroy(struct data_type *p)
+/* Adds the entry of a key that flow_filter_lookup() did not find. */
+static struct flow_filter_entry *
+flow_filter_insert(struct flow_filter *ff, unsigned int hash,
+                   const unsigned char *key, unsigned int len, time_t now)
 {
-    if(NULL != p)
+    struct flow_filter_entry *group = flow_filter_group(ff, hash);
+    unsigned char *hand = &ff->hands[hash % N_FLOW_FILTER_GROUPS];
+    struct flow_filter_entry *e = NULL;
+    size_t i;
+
+    for (i = 0; i < FLOW_FILTER_WAYS; i++)
     {
-        free(p);
+        if (!group[i].in_use)
+        {
+            e = &group[i];
+            break;
+        }
+    }
+    if (e == NULL)
+    {
+        /* the hand clears the referenced entries it passes, so it stops
+         * within two turns of the group */
+        for (;;)
+        {
+            e = &group[*hand];
+            *hand = (*hand + 1) % FLOW_FILTER_WAYS;
+            if (!e->referenced)
+            {
+                break;
+            }
+            e->referenced = false;
+        }
+        flow_filter_free(ff, e);
+        ff->n_evictions++;
     }
 
-    return ;
+    e->in_use = true;
+    e->referenced = true;
+    e->run_pipeline = true;
+    e->hash = hash;
+    /* the all-zeros id is NULL */
+    e->cookie = (e->cookie + 1) & ((1u << FLOW_COOKIE_BITS) - 1);
+    if (e->cookie == 0)
+    {
+        e->cookie = 1;
+    }
+    e->num_pkt_in_pipeline = 0;
+    e->timeout = 0;
+    e->last_used = now;
+    e->key_len = len;
+    if (len > FLOW_FILTER_KEY_INLINE)
+    {
+        e->k.key = xmalloc(len);
+    }
+    memcpy((unsigned char *) flow_filter_key(e), key, len);
+    ff->n_entries++;
+    return e;
 }
+
+static void
+flow_filter_show(struct flow_filter *ff)
+{
+    printf("**flow filter %s entries:[%u/%u], hits:[%llu], misses:[%llu], "
+           "evictions:[%llu], aged:[%llu]**\r\n",
+           ff->name, ff->n_entries, N_FLOW_FILTER_SLOTS, ff->n_hits,
+           ff->n_misses, ff->n_evictions, ff->n_aged);
+    ff->n_hits = 0;
+    ff->n_misses = 0;
+    ff->n_evictions = 0;
+    ff->n_aged = 0;
+}
+
 #if 0
 static struct data_unit*
     dp_buffers_unit_create(){
@@ -199,6 +340,7 @@ dp_buffers_create(struct datapath *dp) {
     size_t i;
 
     dpb->dp          = dp;
+    pthread_mutex_init(&dpb->lock, NULL);
     dpb->buffer_idx  = (size_t)-1;
     dpb->buffers_num = N_PKT_BUFFERS;
 
@@ -213,26 +355,24 @@ dp_buffers_create(struct datapath *dp) {
 
 struct data_buffers *
 dp_data_buffers_create(struct datapath *dp) {
-    struct data_buffers *dpb = xmalloc(sizeof(struct data_buffers));
-    size_t i;
+    struct data_buffers *dpb = xcalloc(1, sizeof(struct data_buffers));
 
     dpb->dp          = dp;
-
-    for (i=0; i<N_DATA_BUFFERS; i++) {
-        dpb->buffers[i].units_num = 0;
-        dpb->buffers[i].timeout = 0;
-        list_init(&(dpb->buffers[i].type_head));
-        list_init(&(dpb->buffers[i].unit_head));
-
-        dpb->hwbuf[i].units_num = 0;
-        dpb->hwbuf[i].timeout = 0;
-        list_init(&(dpb->hwbuf[i].type_head));
-        list_init(&(dpb->hwbuf[i].unit_head));
-    }
+    pthread_mutex_init(&dpb->lock, NULL);
+    dpb->pi.name     = "packet in";
+    dpb->hw.name     = "hardware";
 
     return dpb;
 }
 
+void
+dp_data_buffers_show(struct data_buffers *dpb) {
+    pthread_mutex_lock(&dpb->lock);
+    flow_filter_show(&dpb->pi);
+    flow_filter_show(&dpb->hw);
+    pthread_mutex_unlock(&dpb->lock);
+}
+
 size_t
 dp_buffers_size(struct dp_buffers *dpb) {
     return dpb->buffers_num;
@@ -242,107 +382,79 @@ dp_buffers_size(struct dp_buffers *dpb) {
 
 void dp_delete_data_type(struct data_buffers *dpb, void *data)
 {
-    struct data_buffer *p;
-    struct data_type *cur, *n, *org;
-    unsigned int buffer_idx;
+    unsigned int id = (unsigned int)(uintptr_t)data;
+    struct flow_filter_entry *e;
 
     if (!data)
         return;
 
-    org = (struct data_type *)data;
+    e = &dpb->hw.slots[id & FLOW_FILTER_SLOT_MASK];
 
-    buffer_idx = org->hash % N_HASH_DIV;
-    p = &dpb->hwbuf[buffer_idx];
-
-    LIST_FOR_EACH_SAFE(cur, n, struct data_type, node, &p->type_head)
+    pthread_mutex_lock(&dpb->lock);
+    if (e->in_use && e->cookie == id >> FLOW_FILTER_SLOT_BITS)
     {
-        if((org->hash== cur->hash)
-            && (cur->key_len == org->key_len)
-            && (!memcmp(cur->key,org->key,cur->key_len)))
-        {
-            list_remove(&cur->node);
-            //free(org->key);
-            //free(org);
-        }
+        flow_filter_free(&dpb->hw, e);
     }
-    free(org->key);
-    free(org);
-
+    pthread_mutex_unlock(&dpb->lock);
 }
 
 bool dp_hw_download(struct data_buffers *dpb, struct packet *pkt, struct path_contex *context)
 {
-    struct data_buffer *p;
-    struct data_type *type;
-    unsigned int hash = 0;
-    unsigned char *pkt_key;
-    unsigned int buffer_idx;
+    unsigned char key[FLOW_FILTER_KEY_MAX];
+    struct flow_filter_entry *e;
+    unsigned int hash;
     unsigned int len;
+    time_t now = time_now_sec();
     bool re = true;
-    unsigned char type_new = 1;
 
-    //return true;
     g_path_count ++;
-    len = ROUND_UP(pkt->handle_std->match.header.length, sizeof(unsigned int));
-    pkt_key = malloc_pkt_key(len);
+    hash = flow_filter_key_extract(pkt, key, &len);
 
-    hash = packet_hash_pi(pkt_key,pkt,len);
-    hash = abs(hash);
-
-    buffer_idx = hash % N_HASH_DIV;
-
-    p = &dpb->hwbuf[buffer_idx];
-    /*if((p->timeout == 0) || (p->timeout + OVEROUT_SECS < time_now_sec()))
-    {
-        p->timeout = time_now_sec();
-    }*/
-
-    LIST_FOR_EACH(type,struct data_type,node,&p->type_head)
+    pthread_mutex_lock(&dpb->lock);
+    e = flow_filter_lookup(&dpb->hw, hash, key, len, now);
+    if (e != NULL)
     {
-        if((hash == type->hash)
-            && (type->key_len == len)
-            && (!memcmp(type->key,pkt_key,len)))
+        if((now - e->timeout < OVEROUT_SECS)&&(0 == pkt->reason))
         {
-            if((time_now_sec() - type->timeout  < OVEROUT_SECS)&&(0 == pkt->reason))
-            {
-                re = false;
-            }
-            else
-            {
-                type->timeout = time_now_sec();
-                type_new = 0;
-            }
-            break;
+            re = false;
+        }
+        else
+        {
+            e->timeout = now;
         }
     }
-
-    if((true == re) && (1 == type_new))
+    else
     {
-        type = dp_buffers_type_create(len);
-        type->hash = hash;
-        memcpy(type->key,pkt_key,len);
-        type->num_pkt = 0;
-        type->num_pkt_in_pipeline = 0;
-        type->timeout = time_now_sec();
-        list_push_back(&p->type_head,&type->node);
-        p->units_num ++;
-        context->data_type = type;
-
+        e = flow_filter_insert(&dpb->hw, hash, key, len, now);
+        e->timeout = now;
+        context->data_type = (void *)(uintptr_t)flow_filter_id(&dpb->hw, e);
     }
-
-    free_pkt_key(pkt_key);
+    pthread_mutex_unlock(&dpb->lock);
 
     return re;
 }
 
+/* dp_buffers_is_alive(), with the lock held. */
+static bool
+buffer_is_alive(struct dp_buffers *dpb, unsigned int id) {
+    struct packet_buffer *p;
+
+    p = &dpb->buffers[id & PKT_BUFFER_MASK];
+    return ((p->cookie == id >> PKT_BUFFER_BITS) &&
+            (time_now() < p->timeout));
+}
+
 unsigned int
 dp_buffers_save(struct dp_buffers *dpb, struct packet *pkt) {
     struct packet_buffer *p;
+    struct packet *old = NULL;
     unsigned int id;
 
+    pthread_mutex_lock(&dpb->lock);
     /* if packet is already in buffer, do not save again */
     if (pkt->buffer_id != OFP_NO_BUFFER) {
-        if (dp_buffers_is_alive(dpb, pkt->buffer_id)) {
+        if (buffer_is_alive(dpb, pkt->buffer_id)) {
+            pthread_mutex_unlock(&dpb->lock);
             return pkt->buffer_id;
         }
     }
@@ -352,10 +464,11 @@ dp_buffers_save(struct dp_buffers *dpb, struct packet *pkt) {
     p = &dpb->buffers[dpb->buffer_idx];
     if (p->pkt != NULL) {
         if (time_now() < p->timeout) {
+            pthread_mutex_unlock(&dpb->lock);
             return OFP_NO_BUFFER;
         } else {
-            p->pkt->buffer_id = OFP_NO_BUFFER;
-            packet_destroy(p->pkt);
+            old = p->pkt;
+            old->buffer_id = OFP_NO_BUFFER;
         }
     }
     /* Don't use maximum cookie value since the all-bits-1 id is
@@ -367,78 +480,54 @@ dp_buffers_save(struct dp_buffers *dpb, struct packet *pkt) {
     id = dpb->buffer_idx | (p->cookie << PKT_BUFFER_BITS);
 
     pkt->buffer_id  = id;
+    pthread_mutex_unlock(&dpb->lock);
 
+    if (old != NULL) {
+        packet_destroy(old);
+    }
     return id;
 }
 
 unsigned int
 dp_flow_filter(struct data_buffers *dpb, struct packet *pkt,unsigned char *send_flag) {
-    struct data_buffer *p;
-    struct data_type *type;
+    unsigned char key[FLOW_FILTER_KEY_MAX];
+    struct flow_filter_entry *e;
     unsigned int hash = 0;
-    unsigned char *pkt_key;
-    unsigned char pkt_type_exit = 0;
-    unsigned int buffer_idx;
     unsigned int len;
+    time_t now = time_now_sec();
     *send_flag = 0;
 
-    len = ROUND_UP(pkt->handle_std->match.header.length, sizeof(unsigned int));
-    pkt_key = malloc_pkt_key(len);
-
-    hash = packet_hash_pi(pkt_key,pkt,len);
-    hash = abs(hash);
-
-    buffer_idx = hash % N_HASH_DIV;
-
-
-    p = &dpb->buffers[buffer_idx];
-
-    //make sure the packet type
-    LIST_FOR_EACH(type,struct data_type,node,&p->type_head)
-    {
-        if((type->key_len == len)&&(hash == type->hash)&&(0 == memcmp(pkt_key,type->key,len)))
-        {
-            pkt_type_exit = 1;
-            break;
-        }
-    }
-
+    hash = flow_filter_key_extract(pkt, key, &len);
 
-    if(0 == pkt_type_exit)
+    pthread_mutex_lock(&dpb->lock);
+    e = flow_filter_lookup(&dpb->pi, hash, key, len, now);
+    if (e == NULL)
     {
-        type = dp_buffers_type_create(len);
-        type->hash = hash;
-        memcpy(type->key,pkt_key,len);
-        type->num_pkt = 0;
-        type->num_pkt_in_pipeline = 0;
-        type->timeout = time_now_sec() + RESEND_SECS;
-        type->run_pipeline = true;
-        list_push_back(&p->type_head,&type->node);
+        e = flow_filter_insert(&dpb->pi, hash, key, len, now);
+        e->timeout = now + RESEND_SECS;
         *send_flag = 1;
     }
 
-    // u = dp_buffers_unit_create();
-
-    if(type->num_pkt_in_pipeline < N_PKT_IN_PIPELINE)
+    if(e->num_pkt_in_pipeline < N_PKT_IN_PIPELINE)
     {
         *send_flag = 1;
-        type->num_pkt_in_pipeline ++;
+        e->num_pkt_in_pipeline ++;
     }
 
-    if(time_now_sec() > type->timeout)
+    if(now > e->timeout)
     {
         *send_flag = 1;
-        type->timeout = time_now_sec() + RESEND_SECS;
-        type->num_pkt_in_pipeline = 1;
+        e->timeout = now + RESEND_SECS;
+        e->num_pkt_in_pipeline = 1;
     }
 
     /*do not limit transmiss flow*/
-    if(false == type->run_pipeline)
+    if(false == e->run_pipeline)
     {
         *send_flag = 1;
     }
+    pthread_mutex_unlock(&dpb->lock);
 
-    free_pkt_key(pkt_key);
     pkt->hash = hash;
 
     return hash;
@@ -446,22 +535,19 @@ dp_flow_filter(struct data_buffers *dpb, struct packet *pkt,unsigned char *send_
 
 void dp_flow_set_flag(struct data_buffers *dpb, unsigned int id,bool flag)
 {
-    struct data_buffer *p;
-    unsigned int buffer_idx;
-    struct data_type *type;
-
-    buffer_idx = id % N_HASH_DIV;
-    p = &dpb->buffers[buffer_idx];
-
+    struct flow_filter_entry *group = flow_filter_group(&dpb->pi, id);
+    size_t i;
 
-    LIST_FOR_EACH(type,struct data_type,node,&p->type_head)
+    pthread_mutex_lock(&dpb->lock);
+    for (i = 0; i < FLOW_FILTER_WAYS; i++)
     {
-        if(id == type->hash)
+        if(group[i].in_use && id == group[i].hash)
         {
-            type->run_pipeline = flag;
+            group[i].run_pipeline = flag;
             break;
         }
     }
+    pthread_mutex_unlock(&dpb->lock);
 
     return;
 }
@@ -472,6 +558,7 @@ dp_buffers_retrieve(struct dp_buffers *dpb, unsigned int id) {
     struct packet_buffer *p;
 
     p = &dpb->buffers[id & PKT_BUFFER_MASK];
+    pthread_mutex_lock(&dpb->lock);
     if (p->cookie == id >> PKT_BUFFER_BITS && p->pkt != NULL) {
         pkt = p->pkt;
         pkt->buffer_id = OFP_NO_BUFFER;
@@ -482,50 +569,63 @@ dp_buffers_retrieve(struct dp_buffers *dpb, unsigned int id) {
         VLOG_WARN_RL(LOG_MODULE, &rl, "cookie mismatch: %x != %x\n",
                           id >> PKT_BUFFER_BITS, p->cookie);
     }
+    pthread_mutex_unlock(&dpb->lock);
 
     return pkt;
 }
 ofl_err
 dp_buffers_verify(struct dp_buffers *dpb, unsigned int id) {
-    struct packet *pkt = NULL;
     struct packet_buffer *p;
+    ofl_err error;
+
     p = &dpb->buffers[id & PKT_BUFFER_MASK];
+    pthread_mutex_lock(&dpb->lock);
     if (p->cookie == id >> PKT_BUFFER_BITS && p->pkt != NULL)
     {
-        return 0;
+        error = 0;
     }
     else if(p->cookie == id >> PKT_BUFFER_BITS)
     {
-    	return ofl_error(OFPET_BAD_REQUEST, OFPBRC_BUFFER_EMPTY);
+    	error = ofl_error(OFPET_BAD_REQUEST, OFPBRC_BUFFER_EMPTY);
     }
     else
     {
-    	return ofl_error(OFPET_BAD_REQUEST, OFPBRC_BUFFER_UNKNOWN);
+    	error = ofl_error(OFPET_BAD_REQUEST, OFPBRC_BUFFER_UNKNOWN);
     }
+    pthread_mutex_unlock(&dpb->lock);
+    return error;
 }
 
 bool
 dp_buffers_is_alive(struct dp_buffers *dpb, unsigned int id) {
-    struct packet_buffer *p;
+    bool alive;
 
-    p = &dpb->buffers[id & PKT_BUFFER_MASK];
-    return ((p->cookie == id >> PKT_BUFFER_BITS) &&
-            (time_now() < p->timeout));
+    pthread_mutex_lock(&dpb->lock);
+    alive = buffer_is_alive(dpb, id);
+    pthread_mutex_unlock(&dpb->lock);
+    return alive;
 }
 
 
 void
 dp_buffers_discard(struct dp_buffers *dpb, unsigned int id, bool destroy) {
     struct packet_buffer *p;
+    struct packet *pkt = NULL;
 
     p = &dpb->buffers[id & PKT_BUFFER_MASK];
 
+    pthread_mutex_lock(&dpb->lock);
     if (p->cookie == id >> PKT_BUFFER_BITS) {
         if (destroy) {
-            p->pkt->buffer_id = OFP_NO_BUFFER;
-            packet_destroy(p->pkt);
+            pkt = p->pkt;
+            pkt->buffer_id = OFP_NO_BUFFER;
         }
         p->pkt = NULL;
     }
+    pthread_mutex_unlock(&dpb->lock);
+
+    if (pkt != NULL) {
+        packet_destroy(pkt);
+    }
 }
 
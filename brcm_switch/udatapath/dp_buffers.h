@@ -66,6 +66,11 @@ dp_buffers_create(struct datapath *dp);
 struct data_buffers *
 dp_data_buffers_create(struct datapath *dp);
 
+/* Prints the occupancy and counters of the flow filters, and clears the
+ * counters. */
+void
+dp_data_buffers_show(struct data_buffers *dpb);
+
 /* Returns the number of buffers */
 size_t
 dp_buffers_size(struct dp_buffers *dpb);
@@ -100,6 +105,8 @@ bool
  dp_hw_download(struct data_buffers *dpb, struct packet *pkt, struct path_contex *context);
 
 
+/* Forgets a flow downloaded to the hardware, given the id dp_hw_download()
+ * put in context->data_type. */
 void dp_delete_data_type(struct data_buffers *dpb, void *data);
 
 #endif /* DP_BUFFERS_H */
@@ -0,0 +1,385 @@
+/* Hardware flow installer of the datapath. */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "Hybrid_Framework_Common.h"
+#include "Hybrid_Framework_Linux.h"
+#include "datapath.h"
+#include "dp_buffers.h"
+#include "dp_hw_installer.h"
+#include "dp_pool.h"
+#include "hash.h"
+#include "ring.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_dp
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+struct hw_install {
+    DPAL_MESSAGE_DATA_S     msg;
+    void                   *data_type;  /* id of the flow in the hardware
+                                           filter. */
+    unsigned int            hash;       /* of the message data. */
+    unsigned int            retries;
+    long long int           queued;     /* usec. */
+};
+
+struct hw_installer {
+    struct datapath        *dp;
+    pthread_t               thread;
+    struct ring            *queue;      /* of struct hw_install. */
+    int                     wakeup_fd;  /* written while the installer sleeps. */
+    volatile int            sleeping;
+    struct hw_install      *retry[DP_HW_INSTALL_BATCH];
+    unsigned int            n_retry;    /* messages to send again. */
+    unsigned char           frames[DP_HW_INSTALL_BATCH][DP_HW_INSTALL_FRAME];
+
+    /* queued by the forwarding threads. */
+    volatile unsigned long long int n_queued;
+    volatile unsigned long long int n_full;
+    unsigned int            max_depth;  /* sampled without a lock. */
+
+    unsigned long long int  n_installed;
+    unsigned long long int  n_frames;
+    unsigned long long int  n_sends;    /* batches of frames sent. */
+    unsigned long long int  n_dups;
+    unsigned long long int  n_retries;
+    unsigned long long int  n_failed;
+    long long int           latency_sum;    /* usec, queued to sent. */
+    long long int           latency_max;
+};
+
+static struct hw_installer *installer = NULL;
+static struct dp_pool *install_pool;
+
+static void
+hw_install_free(struct hw_install *hi)
+{
+    free(hi->msg.pData);
+    dp_pool_put(install_pool, hi);
+}
+
+/* Forgets the flow of a message that will not be sent, so that the next
+ * packet of the flow downloads it again. */
+static void
+hw_install_drop(struct datapath *dp, struct hw_install *hi)
+{
+    dp_delete_data_type(dp->data_buffers, hi->data_type);
+    hw_install_free(hi);
+}
+
+static bool
+hw_install_is_dup(struct hw_install **batch, unsigned int n,
+                  const struct hw_install *hi)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (batch[i]->hash == hi->hash
+            && batch[i]->msg.usDataLength == hi->msg.usDataLength
+            && !memcmp(batch[i]->msg.pData, hi->msg.pData, hi->msg.usDataLength))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Packs the messages in a frame, the data of the messages one after the
+ * other, as the agent reads the TLVs of a frame up to its data length. */
+static void
+hw_installer_pack(unsigned char *buf, struct hw_install **batch, unsigned int n,
+                  DPAL_MESSAGE_DATA_S *frame)
+{
+    unsigned int i;
+
+    if (n == 1)
+    {
+        *frame = batch[0]->msg;
+        return;
+    }
+
+    frame->usTLVNum = 0;
+    frame->usDataLength = 0;
+    frame->pData = buf;
+    for (i = 0; i < n; i++)
+    {
+        memcpy(buf + frame->usDataLength, batch[i]->msg.pData,
+               batch[i]->msg.usDataLength);
+        frame->usTLVNum += batch[i]->msg.usTLVNum;
+        frame->usDataLength += batch[i]->msg.usDataLength;
+    }
+}
+
+/* Frees the messages of a frame once sent, or keeps them to send again. */
+static void
+hw_installer_done(struct hw_installer *ins, struct hw_install **batch,
+                  unsigned int n, bool sent, long long int now)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        struct hw_install *hi = batch[i];
+
+        if (sent)
+        {
+            ins->latency_sum += now - hi->queued;
+            ins->latency_max = MAX(ins->latency_max, now - hi->queued);
+            ins->n_installed++;
+            hw_install_free(hi);
+        }
+        else if (++hi->retries > DP_HW_INSTALL_RETRIES)
+        {
+            ins->n_failed++;
+            hw_install_drop(ins->dp, hi);
+        }
+        else
+        {
+            ins->n_retries++;
+            ins->retry[ins->n_retry++] = hi;
+        }
+    }
+}
+
+/* Sends the messages to send again, and a batch of the queued ones, the
+ * frames in one go. */
+static void
+hw_installer_run(struct hw_installer *ins)
+{
+    struct hw_install *batch[DP_HW_INSTALL_BATCH];
+    DPAL_MESSAGE_DATA_S frames[DP_HW_INSTALL_BATCH];
+    unsigned int firsts[DP_HW_INSTALL_BATCH + 1];
+    unsigned int n, end, i, len, n_frames, n_sent;
+    long long int now;
+
+    n = ins->n_retry;
+    memcpy(batch, ins->retry, n * sizeof *batch);
+    ins->n_retry = 0;
+
+    end = n + ring_get_burst(ins->queue, (void **) &batch[n], DP_HW_INSTALL_BATCH - n);
+    for (i = n; i < end; i++)
+    {
+        struct hw_install *hi = batch[i];
+
+        hi->hash = hash_bytes(hi->msg.pData, hi->msg.usDataLength, 0);
+        if (hw_install_is_dup(batch, n, hi))
+        {
+            ins->n_dups++;
+            hw_install_free(hi);
+            continue;
+        }
+        batch[n++] = hi;
+    }
+    if (n == 0)
+    {
+        return;
+    }
+
+    n_frames = 0;
+    for (i = 0; i < n; )
+    {
+        /* a message larger than a frame goes alone */
+        firsts[n_frames] = i;
+        len = batch[i++]->msg.usDataLength;
+        while (i < n && len + batch[i]->msg.usDataLength <= DP_HW_INSTALL_FRAME)
+        {
+            len += batch[i++]->msg.usDataLength;
+        }
+        hw_installer_pack(ins->frames[n_frames], &batch[firsts[n_frames]],
+                          i - firsts[n_frames], &frames[n_frames]);
+        n_frames++;
+    }
+    firsts[n_frames] = n;
+
+    n_sent = Hybrid_Chatwith_V8_batch(frames, n_frames);
+    if (n_sent < n_frames)
+    {
+        VLOG_ERR_RL(LOG_MODULE, &rl, "install of %u flows, send to v8 failed!",
+                    n - firsts[n_sent]);
+    }
+
+    now = time_now_usec();
+    for (i = 0; i < n_frames; i++)
+    {
+        hw_installer_done(ins, &batch[firsts[i]], firsts[i + 1] - firsts[i],
+                          i < n_sent, now);
+    }
+    ins->n_frames += n_sent;
+    if (n_sent > 0)
+    {
+        ins->n_sends++;
+    }
+}
+
+/* Blocks until messages are queued, or DP_HW_INSTALL_RETRY_MS elapse if
+ * there are messages to send again. */
+static void
+hw_installer_sleep(struct hw_installer *ins)
+{
+    int timeout = ins->n_retry ? DP_HW_INSTALL_RETRY_MS : -1;
+    unsigned long long int count;
+    struct pollfd pfd;
+
+    if (ins->wakeup_fd < 0)
+    {
+        poll(NULL, 0, timeout < 0 ? 1 : timeout);
+        return;
+    }
+
+    /* Messages queued after the check below find sleeping set, and write
+     * the eventfd. */
+    ins->sleeping = 1;
+    __sync_synchronize();
+    if (ins->n_retry || ring_is_empty(ins->queue))
+    {
+        pfd.fd = ins->wakeup_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+        {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "hardware installer poll failed (%s)",
+                         strerror(errno));
+        }
+    }
+    ins->sleeping = 0;
+
+    while (read(ins->wakeup_fd, &count, sizeof count) > 0)
+    {
+        continue;
+    }
+}
+
+static void *
+hw_installer_main(void *ins_)
+{
+    struct hw_installer *ins = ins_;
+
+    for (;;)
+    {
+        if (ins->n_retry || ring_is_empty(ins->queue))
+        {
+            hw_installer_sleep(ins);
+        }
+        hw_installer_run(ins);
+    }
+    return NULL;
+}
+
+int
+dp_hw_installer_start(struct datapath *dp)
+{
+    struct hw_installer *ins = xcalloc(1, sizeof *ins);
+    int error;
+
+    install_pool = dp_pool_create("hardware install", sizeof(struct hw_install),
+                                  DP_HW_INSTALL_BATCH);
+    ins->dp = dp;
+    ins->queue = ring_create(DP_HW_INSTALL_QUEUE_LEN, RING_F_SC_DEQ);
+    ins->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ins->wakeup_fd < 0)
+    {
+        VLOG_ERR(LOG_MODULE, "could not create wakeup eventfd of the hardware "
+                 "installer (%s), it will poll", strerror(errno));
+    }
+
+    error = pthread_create(&ins->thread, NULL, hw_installer_main, ins);
+    if (error)
+    {
+        VLOG_ERR(LOG_MODULE, "could not create the hardware installer (%s)",
+                 strerror(error));
+        return error;
+    }
+
+    __sync_synchronize();
+    installer = ins;
+    return 0;
+}
+
+void
+dp_hw_install(struct datapath *dp, DPAL_MESSAGE_DATA_S *msg, void *data_type)
+{
+    struct hw_installer *ins = installer;
+    unsigned long long int one = 1;
+    struct hw_install *hi;
+    unsigned int depth;
+
+    if (ins == NULL)
+    {
+        if (Hybrid_Chatwith_V8_new(msg) != VOS_OK)
+        {
+            VLOG_ERR_RL(LOG_MODULE, &rl, "flow table add, send to v8 failed!");
+        }
+        free(msg->pData);
+        return;
+    }
+
+    hi = dp_pool_get(install_pool);
+    hi->msg = *msg;
+    hi->data_type = data_type;
+    hi->retries = 0;
+    hi->queued = time_now_usec();
+    if (ring_put(ins->queue, hi) != 0)
+    {
+        __sync_fetch_and_add(&ins->n_full, 1);
+        hw_install_drop(dp, hi);
+        return;
+    }
+    __sync_fetch_and_add(&ins->n_queued, 1);
+
+    depth = ring_count(ins->queue);
+    if (depth > ins->max_depth)
+    {
+        ins->max_depth = depth;
+    }
+
+    __sync_synchronize();
+    if (ins->sleeping && ins->wakeup_fd >= 0)
+    {
+        if (write(ins->wakeup_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+        {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "hardware installer wakeup failed (%s)",
+                         strerror(errno));
+        }
+    }
+}
+
+void
+dp_hw_installer_show(void)
+{
+    struct hw_installer *ins = installer;
+
+    if (ins == NULL)
+    {
+        return;
+    }
+
+    printf("**hw install queued:[%llu], full:[%llu], depth:[%u], max depth:[%u], "
+           "installed:[%llu], frames:[%llu], sends:[%llu], dups:[%llu], retries:[%llu], "
+           "failed:[%llu], latency avg:[%lld]us, max:[%lld]us**\r\n",
+           ins->n_queued, ins->n_full, ring_count(ins->queue), ins->max_depth,
+           ins->n_installed, ins->n_frames, ins->n_sends, ins->n_dups, ins->n_retries,
+           ins->n_failed,
+           ins->n_installed ? ins->latency_sum / (long long int) ins->n_installed : 0,
+           ins->latency_max);
+    ins->n_queued = 0;
+    ins->n_full = 0;
+    ins->max_depth = 0;
+    ins->n_installed = 0;
+    ins->n_frames = 0;
+    ins->n_sends = 0;
+    ins->n_dups = 0;
+    ins->n_retries = 0;
+    ins->n_failed = 0;
+    ins->latency_sum = 0;
+    ins->latency_max = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef DP_HW_INSTALLER_H
+#define DP_HW_INSTALLER_H 1
+
+#include "dpal_pub.h"
+
+/****************************************************************************
+ * Hardware flow installer of the datapath.
+ *
+ * The pipeline translates the path of a new flow into its DPAL message, and
+ * queues the message to the installer instead of sending it to the hardware
+ * agent itself. The installer thread drops the messages queued twice, packs
+ * as many messages as fit into a frame to the agent, sends the frames of a
+ * batch together, and sends them again a few times if the agent cannot be
+ * reached. A message that is never sent, or that finds the queue full, has
+ * its flow forgotten by the hardware filter, so that a later packet of the
+ * flow downloads it again.
+ *
+ * The messages are queued translated, not as path contexts, since a context
+ * points at the packet and at the flow entries of the path, none of which
+ * live past the pipeline run.
+ ****************************************************************************/
+
+#define DP_HW_INSTALL_QUEUE_LEN  1024   /* messages queued to the installer. */
+#define DP_HW_INSTALL_BATCH      32     /* messages taken off the queue at once. */
+#define DP_HW_INSTALL_FRAME      1400   /* bytes of messages in a frame. */
+#define DP_HW_INSTALL_RETRIES    3
+#define DP_HW_INSTALL_RETRY_MS   10
+
+struct datapath;
+
+/* Starts the installer thread. Returns 0 if successful, otherwise an errno
+ * value. */
+int
+dp_hw_installer_start(struct datapath *dp);
+
+/* Queues the translated message of a flow, which the installer frees once
+ * sent; data_type is the id dp_hw_download() gave the flow. Any thread may
+ * queue messages. Until the installer is started, the message is sent
+ * right away. */
+void
+dp_hw_install(struct datapath *dp, DPAL_MESSAGE_DATA_S *msg, void *data_type);
+
+/* Prints the counters of the installer, and clears them. */
+void
+dp_hw_installer_show(void);
+
+#endif /* DP_HW_INSTALLER_H */
@@ -0,0 +1,461 @@
+/* Hardware counter collector of the datapath. */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "Hybrid_Framework_Common.h"
+#include "Hybrid_Framework_Linux.h"
+#include "datapath.h"
+#include "dp_hw_stats.h"
+#include "exact_hash.h"
+#include "flow_entry.h"
+#include "flow_table.h"
+#include "pipeline.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_dp
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* A frame of counter queries, and the counters read back.
+ *
+ * The queries follow a HYBRID_INFO_CHANGE_S header, whose identifier the
+ * agent copies into its reply. The reply carries, after its header, the
+ * TLVs of the counters of the queries, in the order of the queries, which
+ * DPAL_TranslateData() turns into DPAL_MSG_TYPE_FLOWTABLE_STATISTCS data,
+ * each a struct table_count. */
+struct hw_stats_frame {
+    struct dp_hw_stats     *hs;
+    unsigned char           buf[sizeof(HYBRID_INFO_CHANGE_S) + DP_HW_STATS_FRAME];
+    unsigned int            len;        /* of the queries in buf. */
+    unsigned int            n_queries;
+    struct table_count     *targets[DP_HW_STATS_QUERIES]; /* NULL once the
+                                                             flow is gone. */
+    struct table_count      counts[DP_HW_STATS_QUERIES];
+    unsigned int            n_counts;   /* counts read back. */
+};
+
+struct dp_hw_stats {
+    struct datapath        *dp;
+    pthread_t               thread;
+
+    /* frames of the table being swept. */
+    struct hw_stats_frame  *frames;
+    size_t                  n_frames, allocated_frames;
+    unsigned long long int  round;      /* of the table being swept. */
+    bool                    in_flight;  /* while its queries are. */
+
+    pthread_mutex_t         mutex;      /* guards n_pending. */
+    pthread_cond_t          cond;       /* signaled as frames are answered. */
+    unsigned int            n_pending;  /* frames awaiting their replies. */
+
+    volatile long long int  last_sweep; /* msec the last sweep ended, 0 if
+                                           none has. */
+    long long int           sweep_msec; /* of the last sweep. */
+
+    unsigned long long int  n_sweeps;
+    unsigned long long int  n_queries;  /* logic entries queried. */
+    unsigned long long int  n_frames_sent;
+    unsigned long long int  n_sends;
+    unsigned long long int  n_failed;   /* queries or frames not sent. */
+    unsigned long long int  n_timeouts; /* frames without a reply. */
+    unsigned long long int  n_stale;    /* counters read back for flows
+                                           destroyed in the meantime. */
+};
+
+static struct dp_hw_stats *collector = NULL;
+
+/* Stores the counters of the reply into the frame. Called where the reply
+ * was received, before the frame is marked answered. */
+static void
+hw_stats_decode(struct hw_stats_frame *frame, HYBRID_INFO_CHANGE_S *reply,
+                UINT32 len)
+{
+    DPAL_MESSAGE_DATA_S msg;
+    DPAL_PROC_S proc;
+    unsigned int i;
+
+    msg.usTLVNum = frame->n_queries;
+    msg.usDataLength = len - sizeof *reply;
+    msg.pData = reply + 1;
+    memset(&proc, 0, sizeof proc);
+    if (DPAL_TranslateData(&msg, &proc) != 0)
+    {
+        VLOG_ERR_RL(LOG_MODULE, &rl, "DPAL_TranslateData flow table statics failed!");
+        return;
+    }
+
+    for (i = 0; i < proc.uiProNUM && frame->n_counts < frame->n_queries; i++)
+    {
+        DPAL_PROC_DATA_S *data = &proc.pstProcData[i];
+
+        if (data->usType == DPAL_MSG_TYPE_FLOWTABLE_STATISTCS && data->pData != NULL)
+        {
+            frame->counts[frame->n_counts++] = *(struct table_count *) data->pData;
+        }
+    }
+    DPAL_DestroyData(&proc);
+}
+
+/* Called with the reply to a frame, or with NULL if it timed out. */
+static VOID
+hw_stats_reply(HYBRID_INFO_CHANGE_S *reply, UINT32 len, VOID *frame_)
+{
+    struct hw_stats_frame *frame = frame_;
+    struct dp_hw_stats *hs = frame->hs;
+
+    if (reply != NULL)
+    {
+        hw_stats_decode(frame, reply, len);
+    }
+
+    pthread_mutex_lock(&hs->mutex);
+    if (reply == NULL)
+    {
+        hs->n_timeouts++;
+    }
+    hs->n_pending--;
+    pthread_cond_signal(&hs->cond);
+    pthread_mutex_unlock(&hs->mutex);
+}
+
+/* Waits until no frame awaits its reply. The frames time out in the table
+ * of the requests to V8, which is expired here too in case the receive
+ * thread is busy. */
+static void
+hw_stats_wait(struct dp_hw_stats *hs)
+{
+    long long int deadline = time_now_msec() + DP_HW_STATS_TIMEOUT_MS;
+    struct timespec abstime;
+
+    pthread_mutex_lock(&hs->mutex);
+    while (hs->n_pending > 0)
+    {
+        abstime.tv_sec = deadline / 1000;
+        abstime.tv_nsec = (deadline % 1000) * 1000 * 1000;
+        if (pthread_cond_timedwait(&hs->cond, &hs->mutex, &abstime) == ETIMEDOUT)
+        {
+            pthread_mutex_unlock(&hs->mutex);
+            Hybrid_Request_Expire();
+            pthread_mutex_lock(&hs->mutex);
+            deadline += HYBRID_REQUEST_TICK_MS;
+        }
+    }
+    pthread_mutex_unlock(&hs->mutex);
+}
+
+/* Sends the frames of the table being swept, a batch at a time, and waits
+ * for their replies. */
+static void
+hw_stats_query(struct dp_hw_stats *hs)
+{
+    HYBRID_REQUEST_S reqs[DP_HW_STATS_BATCH];
+    size_t i;
+
+    for (i = 0; i < hs->n_frames; i += DP_HW_STATS_BATCH)
+    {
+        unsigned int n = MIN(hs->n_frames - i, DP_HW_STATS_BATCH);
+        unsigned int n_sent;
+        unsigned int j;
+
+        for (j = 0; j < n; j++)
+        {
+            struct hw_stats_frame *frame = &hs->frames[i + j];
+            HYBRID_INFO_CHANGE_S *head = (HYBRID_INFO_CHANGE_S *) frame->buf;
+
+            memset(head, 0, sizeof *head);
+            head->ui_ver = HYBRID_INFOCHANGE_VERSION;
+            head->ui_method = HYBRID_METHOD_TRANSACT;
+            head->ui_module = HYBRID_RESOURCE_ACL;
+            head->ui_action = HYBRID_ACTION_GET;
+            head->ui_length = sizeof *head + frame->len;
+
+            reqs[j].pst_data = head;
+            reqs[j].us_len = head->ui_length;
+            reqs[j].p_arg = frame;
+        }
+
+        /* the replies may come before the send returns */
+        pthread_mutex_lock(&hs->mutex);
+        hs->n_pending += n;
+        pthread_mutex_unlock(&hs->mutex);
+
+        n_sent = Hybrid_Request_V8_Batch(reqs, n, DP_HW_STATS_TIMEOUT_MS, hw_stats_reply);
+        if (n_sent < n)
+        {
+            VLOG_ERR_RL(LOG_MODULE, &rl, "counter queries, send to v8 failed!");
+            hs->n_failed += n - n_sent;
+            pthread_mutex_lock(&hs->mutex);
+            hs->n_pending -= n - n_sent;
+            pthread_mutex_unlock(&hs->mutex);
+        }
+        if (n_sent > 0)
+        {
+            hs->n_frames_sent += n_sent;
+            hs->n_sends++;
+        }
+
+        hw_stats_wait(hs);
+    }
+}
+
+/* Stores the counters read back into the logic entries of the flows that
+ * are still there. Called with the datapath lock held for reading. */
+static void
+hw_stats_update(struct dp_hw_stats *hs)
+{
+    size_t i;
+
+    pthread_mutex_lock(&hs->dp->hw_count_mutex);
+    for (i = 0; i < hs->n_frames; i++)
+    {
+        struct hw_stats_frame *frame = &hs->frames[i];
+        unsigned int j;
+
+        for (j = 0; j < frame->n_counts; j++)
+        {
+            if (frame->targets[j] != NULL)
+            {
+                *frame->targets[j] = frame->counts[j];
+            }
+            else
+            {
+                hs->n_stale++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&hs->dp->hw_count_mutex);
+}
+
+void
+dp_hw_stats_add(struct dp_hw_stats *hs, DPAL_MESSAGE_DATA_S *msg,
+                struct flow_entry *entry, struct table_count *count)
+{
+    struct hw_stats_frame *frame;
+
+    hs->n_queries++;
+    if (msg->usDataLength > DP_HW_STATS_FRAME)
+    {
+        VLOG_ERR_RL(LOG_MODULE, &rl, "counter query of %u bytes does not fit a frame",
+                    msg->usDataLength);
+        hs->n_failed++;
+        free(msg->pData);
+        return;
+    }
+
+    frame = hs->n_frames ? &hs->frames[hs->n_frames - 1] : NULL;
+    if (frame == NULL || frame->n_queries == DP_HW_STATS_QUERIES
+        || frame->len + msg->usDataLength > DP_HW_STATS_FRAME)
+    {
+        if (hs->n_frames == hs->allocated_frames)
+        {
+            hs->frames = x2nrealloc(hs->frames, &hs->allocated_frames,
+                                    sizeof *hs->frames);
+        }
+        frame = &hs->frames[hs->n_frames++];
+        frame->hs = hs;
+        frame->len = 0;
+        frame->n_queries = 0;
+        frame->n_counts = 0;
+    }
+
+    /* the flow finds its queries again if it is destroyed */
+    if (entry->hw_stats_round != hs->round)
+    {
+        entry->hw_stats_round = hs->round;
+        entry->hw_stats_frame = hs->n_frames - 1;
+        entry->hw_stats_query = frame->n_queries;
+        entry->hw_stats_n = 0;
+    }
+    entry->hw_stats_n++;
+
+    /* the agent reads the TLVs of a frame up to its data length */
+    memcpy(frame->buf + sizeof(HYBRID_INFO_CHANGE_S) + frame->len, msg->pData,
+           msg->usDataLength);
+    frame->len += msg->usDataLength;
+    frame->targets[frame->n_queries++] = count;
+    free(msg->pData);
+}
+
+void
+dp_hw_stats_forget(struct dp_hw_stats *hs, struct flow_entry *entry)
+{
+    size_t i = entry->hw_stats_frame;
+    unsigned int j = entry->hw_stats_query;
+    unsigned int n;
+
+    if (hs == NULL || !hs->in_flight || entry->hw_stats_round != hs->round)
+    {
+        return;
+    }
+
+    /* the queries of a flow follow each other, maybe into the next frame */
+    for (n = 0; n < entry->hw_stats_n; n++, j++)
+    {
+        if (j == hs->frames[i].n_queries)
+        {
+            i++;
+            j = 0;
+        }
+        hs->frames[i].targets[j] = NULL;
+    }
+}
+
+static void
+hw_stats_sweep_table(struct dp_hw_stats *hs, struct flow_table *table)
+{
+    struct flow_entry *entry;
+    size_t i;
+
+    LIST_FOR_EACH(entry, struct flow_entry, match_node, &table->match_entries)
+    {
+        alta_logic_poll_entry_count(entry, hs);
+    }
+
+    if (!hs->dp->use_exact_table)
+    {
+        return;
+    }
+    for (i = 0; i < MAX_HASH_BUCKETS_NUM && table->hash_match[i] != 0; i++)
+    {
+        struct exact_hash_cursor cursor;
+
+        EXACT_HASH_FOR_EACH(entry, cursor, &table->exact[i])
+        {
+            alta_logic_poll_entry_count(entry, hs);
+        }
+    }
+}
+
+/* Reads the counters of all the flows, a table at a time. The datapath lock
+ * is only held to gather the queries of a table and to store the counters
+ * read back; the flows destroyed in between, which take the lock for
+ * writing, drop their queries. */
+void
+dp_hw_stats_sweep(struct dp_hw_stats *hs)
+{
+    struct datapath *dp = hs->dp;
+    long long int start = time_now_msec();
+    size_t i;
+
+    for (i = 0; i < PIPELINE_TABLES; i++)
+    {
+        pthread_rwlock_rdlock(&dp->rw_lock);
+        hs->n_frames = 0;
+        hs->round++;
+        hw_stats_sweep_table(hs, dp->pipeline->tables[i]);
+        hs->in_flight = hs->n_frames != 0;
+        pthread_rwlock_unlock(&dp->rw_lock);
+
+        if (!hs->in_flight)
+        {
+            continue;
+        }
+        hw_stats_query(hs);
+
+        pthread_rwlock_rdlock(&dp->rw_lock);
+        hw_stats_update(hs);
+        hs->in_flight = false;
+        pthread_rwlock_unlock(&dp->rw_lock);
+    }
+
+    hs->last_sweep = time_now_msec();
+    hs->sweep_msec = hs->last_sweep - start;
+    hs->n_sweeps++;
+}
+
+static void *
+hw_stats_main(void *hs_)
+{
+    struct dp_hw_stats *hs = hs_;
+
+    for (;;)
+    {
+        poll(NULL, 0, hs->dp->hw_stats_interval_ms);
+        dp_hw_stats_sweep(hs);
+    }
+    return NULL;
+}
+
+struct dp_hw_stats *
+dp_hw_stats_create(struct datapath *dp)
+{
+    struct dp_hw_stats *hs;
+
+    hs = xcalloc(1, sizeof *hs);
+    hs->dp = dp;
+    pthread_mutex_init(&hs->mutex, NULL);
+    pthread_cond_init(&hs->cond, NULL);
+    dp->hw_stats = hs;
+    return hs;
+}
+
+int
+dp_hw_stats_start(struct datapath *dp)
+{
+    struct dp_hw_stats *hs;
+    int error;
+
+    if (dp->hw_stats_interval_ms == 0)
+    {
+        return 0;
+    }
+
+    hs = dp_hw_stats_create(dp);
+    error = pthread_create(&hs->thread, NULL, hw_stats_main, hs);
+    if (error)
+    {
+        VLOG_ERR(LOG_MODULE, "could not create the hardware counter collector (%s)",
+                 strerror(error));
+        dp->hw_stats = NULL;
+        pthread_cond_destroy(&hs->cond);
+        pthread_mutex_destroy(&hs->mutex);
+        free(hs);
+        return error;
+    }
+
+    collector = hs;
+    return 0;
+}
+
+long long int
+dp_hw_stats_age(void)
+{
+    struct dp_hw_stats *hs = collector;
+
+    if (hs == NULL || hs->last_sweep == 0)
+    {
+        return -1;
+    }
+    return time_now_msec() - hs->last_sweep;
+}
+
+void
+dp_hw_stats_show(void)
+{
+    struct dp_hw_stats *hs = collector;
+
+    if (hs == NULL)
+    {
+        return;
+    }
+
+    printf("**hw stats age:[%lld]ms, sweeps:[%llu], last sweep:[%lld]ms, "
+           "queries:[%llu], frames:[%llu], sends:[%llu], failed:[%llu], "
+           "timeouts:[%llu], stale:[%llu]**\r\n",
+           dp_hw_stats_age(), hs->n_sweeps, hs->sweep_msec, hs->n_queries,
+           hs->n_frames_sent, hs->n_sends, hs->n_failed, hs->n_timeouts,
+           hs->n_stale);
+    hs->n_sweeps = 0;
+    hs->n_queries = 0;
+    hs->n_frames_sent = 0;
+    hs->n_sends = 0;
+    hs->n_failed = 0;
+    hs->n_timeouts = 0;
+    hs->n_stale = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef DP_HW_STATS_H
+#define DP_HW_STATS_H 1
+
+#include "dpal_pub.h"
+
+/****************************************************************************
+ * Hardware counter collector of the datapath.
+ *
+ * Every hw_stats_interval_ms, the collector thread sweeps the flow tables,
+ * a table at a time, and queries the counters of all the logic entries of
+ * the flows. The queries are packed into frames to the hardware agent, and
+ * the frames of a batch sent in a single system call, instead of a round
+ * trip per logic entry. Each frame waits for its reply in the table of the
+ * requests to V8, for at most DP_HW_STATS_TIMEOUT_MS.
+ *
+ * The datapath lock is not held while the replies are awaited. Once they
+ * are in, the counters are cached in the logic entries, under
+ * dp->hw_count_mutex, where the flow timeouts and the flow and aggregate
+ * stats find them without asking the hardware. A flow destroyed in the
+ * meantime drops the queries of its logic entries, which the flow entry
+ * keeps track of; the rest of the table is not affected.
+ ****************************************************************************/
+
+#define DP_HW_STATS_INTERVAL_DEFAULT  1000   /* ms */
+#define DP_HW_STATS_BATCH             32     /* frames sent at once. */
+#define DP_HW_STATS_FRAME             1400   /* bytes of queries in a frame. */
+#define DP_HW_STATS_QUERIES           32     /* queries in a frame. */
+#define DP_HW_STATS_TIMEOUT_MS        100    /* for the reply to a frame. */
+
+struct datapath;
+struct dp_hw_stats;
+struct flow_entry;
+
+/* Counters of a logic entry. */
+struct table_count
+{
+  unsigned long long int packet_count;
+  unsigned long long int byte_count;
+};
+
+/* Creates the collector of 'dp', without starting its thread, and makes it
+ * dp->hw_stats. */
+struct dp_hw_stats *
+dp_hw_stats_create(struct datapath *dp);
+
+/* Starts the collector thread, unless dp->hw_stats_interval_ms is 0.
+ * Returns 0 if successful, otherwise an errno value. */
+int
+dp_hw_stats_start(struct datapath *dp);
+
+/* Reads the counters of all the flows of the datapath once. */
+void
+dp_hw_stats_sweep(struct dp_hw_stats *hs);
+
+/* Adds the translated counter query of a logic entry of 'entry' to the
+ * sweep, which frees it. The counters read back are stored into 'count'.
+ * The queries of the logic entries of a flow are added one after another. */
+void
+dp_hw_stats_add(struct dp_hw_stats *hs, DPAL_MESSAGE_DATA_S *msg,
+                struct flow_entry *entry, struct table_count *count);
+
+/* Drops the queries in flight of a flow that is destroyed. Called with the
+ * datapath lock held for writing; 'hs' may be NULL. */
+void
+dp_hw_stats_forget(struct dp_hw_stats *hs, struct flow_entry *entry);
+
+/* Returns the msec since the last sweep ended, or -1 if none has. */
+long long int
+dp_hw_stats_age(void);
+
+/* Prints the counters of the collector, and clears them. */
+void
+dp_hw_stats_show(void);
+
+#endif /* DP_HW_STATS_H */
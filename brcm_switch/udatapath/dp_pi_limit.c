@@ -0,0 +1,544 @@
+/* Packet in rate limits of the datapath. */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datapath.h"
+#include "dp_buffers.h"
+#include "dp_pi_limit.h"
+#include "dp_ports.h"
+#include "ofp.h"
+#include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
+#include "packet.h"
+#include "pipeline.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_dp
+
+#define PI_TOKENS      1000     /* tokens of a packet in, as in secchan. */
+#define PI_RATE_MAX    1000000
+#define PI_HELD_BUFFERS 16      /* packets held back saved in the buffers
+                                   per summary, after the first. */
+
+struct pi_bucket {
+    unsigned int            rate;       /* packet ins per second, 0 for no
+                                           limit. */
+    unsigned int            burst;
+    volatile int            tokens;     /* PI_TOKENS per packet in. */
+    volatile unsigned int   last_fill;  /* msec. */
+
+    pthread_mutex_t         mutex;      /* for the held packets. */
+    struct packet          *held;       /* first packet held back since the
+                                           last summary. */
+    unsigned char           table_id;   /* of the held packet in. */
+    unsigned char           reason;
+    volatile unsigned int   n_held;     /* packet ins held back since the
+                                           last summary. */
+    unsigned int            n_buffers;  /* of the others, saved in the
+                                           datapath buffers. */
+    unsigned int            buffer_ids[PI_HELD_BUFFERS];
+
+    unsigned long long int  n_summaries;
+    unsigned long long int  n_dropped;
+};
+
+struct dp_pi_limit {
+    bool                    enabled;    /* a bucket has a rate. */
+    volatile unsigned int   n_pending;  /* buckets holding a packet. */
+    struct pi_bucket        reasons[DP_PI_LIMIT_REASONS];
+    struct pi_bucket        tables[PIPELINE_TABLES];
+    struct pi_bucket        ports[DP_MAX_PORTS];
+};
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+static const char *reason_names[DP_PI_LIMIT_REASONS] = {
+    "no-match", "action", "invalid-ttl"
+};
+
+static inline unsigned int
+pi_now(void)
+{
+    return (unsigned int) time_now_msec();
+}
+
+/* Adds the tokens of the time elapsed since the last fill. The thread that
+ * moves last_fill adds them, the others go on with the tokens there are. */
+static void
+pi_bucket_refill(struct pi_bucket *b, unsigned int now)
+{
+    unsigned int last = b->last_fill;
+    int elapsed = (int) (now - last);
+    int max = b->burst * PI_TOKENS;
+    int old, new;
+
+    if (elapsed == 0
+        || !__sync_bool_compare_and_swap(&b->last_fill, last, now)
+        || elapsed < 0)
+    {
+        /* refilled already, or the clock went back */
+        return;
+    }
+
+    do
+    {
+        long long int tokens = (long long int) elapsed * b->rate;
+
+        old = b->tokens;
+        new = tokens >= max - old ? max : old + (int) tokens;
+    } while (!__sync_bool_compare_and_swap(&b->tokens, old, new));
+}
+
+static bool
+pi_bucket_take(struct pi_bucket *b, unsigned int now)
+{
+    pi_bucket_refill(b, now);
+    if (__sync_sub_and_fetch(&b->tokens, PI_TOKENS) >= 0)
+    {
+        return true;
+    }
+    __sync_add_and_fetch(&b->tokens, PI_TOKENS);
+    return false;
+}
+
+/* Returns the msec from 'now' until 'b' has a token. */
+static unsigned int
+pi_bucket_wait(const struct pi_bucket *b, unsigned int now)
+{
+    int deficit = PI_TOKENS - b->tokens;
+    int elapsed = (int) (now - b->last_fill);
+    long long int wait;
+
+    if (deficit <= 0 || b->rate == 0)
+    {
+        return 0;
+    }
+    wait = (deficit + b->rate - 1) / b->rate - MAX(elapsed, 0);
+    return wait > 0 ? wait : 0;
+}
+
+/* Stores into 'buckets' the buckets with a rate that apply to a packet in,
+ * and returns how many there are. */
+static unsigned int
+pi_buckets(struct dp_pi_limit *lim, unsigned int in_port,
+           unsigned char table_id, unsigned char reason,
+           struct pi_bucket *buckets[3])
+{
+    unsigned int n = 0;
+
+    if (reason < DP_PI_LIMIT_REASONS && lim->reasons[reason].rate != 0)
+    {
+        buckets[n++] = &lim->reasons[reason];
+    }
+    if (table_id < PIPELINE_TABLES && lim->tables[table_id].rate != 0)
+    {
+        buckets[n++] = &lim->tables[table_id];
+    }
+    if (in_port < DP_MAX_PORTS && lim->ports[in_port].rate != 0)
+    {
+        buckets[n++] = &lim->ports[in_port];
+    }
+    return n;
+}
+
+/* Takes a token from each of the 'n' buckets, or from none of them. Returns
+ * NULL if successful, otherwise the bucket out of tokens. */
+static struct pi_bucket *
+pi_buckets_take(struct pi_bucket *buckets[], unsigned int n, unsigned int now)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (!pi_bucket_take(buckets[i], now))
+        {
+            struct pi_bucket *b = buckets[i];
+
+            /* give back the tokens taken from the other buckets */
+            while (i-- > 0)
+            {
+                __sync_add_and_fetch(&buckets[i]->tokens, PI_TOKENS);
+            }
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Counts a packet in held back by the bucket. The first packet since the
+ * last summary is kept for the summary, the next PI_HELD_BUFFERS are saved
+ * in the datapath buffers if there is room, and the others are only
+ * counted. */
+static void
+pi_bucket_hold(struct dp_pi_limit *lim, struct pi_bucket *b, struct packet *pkt,
+               unsigned char table_id, unsigned char reason)
+{
+    struct packet *clone;
+    bool first = false;
+
+    if (__sync_fetch_and_add(&b->n_held, 1) > PI_HELD_BUFFERS)
+    {
+        return;
+    }
+
+    clone = packet_clone(pkt);
+    clone->cookie = pkt->cookie;
+    pthread_mutex_lock(&b->mutex);
+    if (b->held == NULL)
+    {
+        b->held = clone;
+        b->table_id = table_id;
+        b->reason = reason;
+        clone = NULL;
+        first = true;
+        __sync_fetch_and_add(&lim->n_pending, 1);
+    }
+    else if (b->n_buffers < PI_HELD_BUFFERS)
+    {
+        unsigned int id = dp_buffers_save(pkt->dp->buffers, clone);
+
+        if (id != OFP_NO_BUFFER)
+        {
+            b->buffer_ids[b->n_buffers++] = id;
+            clone = NULL;
+        }
+    }
+    pthread_mutex_unlock(&b->mutex);
+
+    if (clone != NULL)
+    {
+        packet_destroy(clone);
+    }
+    if (first)
+    {
+        /* the datapath thread sleeps until the summary is due */
+        dp_wakeup();
+    }
+}
+
+static void
+pi_summary_send(struct datapath *dp, unsigned char table_id,
+                unsigned char reason, unsigned int n_held,
+                const unsigned int *buffer_ids, unsigned int n_buffers)
+{
+    struct openflow_ext_packet_in_summary *s;
+    struct ofpbuf *buf;
+    unsigned int i;
+
+    s = make_openflow(sizeof *s + ROUND_UP(n_buffers, 2) * sizeof *buffer_ids,
+                      OFPT_EXPERIMENTER, &buf);
+    s->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    s->header.subtype = htonl(OFP_EXT_PACKET_IN_SUMMARY);
+    s->n_held = htonl(n_held);
+    s->reason = reason;
+    s->table_id = table_id;
+    s->n_buffers = htons(n_buffers);
+    for (i = 0; i < n_buffers; i++)
+    {
+        s->buffer_id[i] = htonl(buffer_ids[i]);
+    }
+    send_openflow_buffer(dp, buf, NULL);
+}
+
+static void
+pi_bucket_run(struct datapath *dp, struct pi_bucket *b, unsigned int now)
+{
+    struct dp_pi_limit *lim = dp->pi_limit;
+    struct pi_bucket *buckets[3];
+    unsigned int buffer_ids[PI_HELD_BUFFERS];
+    struct packet *pkt;
+    unsigned char table_id, reason;
+    unsigned int n_held, n_buffers, n;
+
+    if (b->held == NULL)
+    {
+        return;
+    }
+
+    /* only this thread lets go of the held packet */
+    pthread_mutex_lock(&b->mutex);
+    pkt = b->held;
+    table_id = b->table_id;
+    reason = b->reason;
+    pthread_mutex_unlock(&b->mutex);
+
+    /* the summary takes a token from all the limits of its packet in */
+    n = pi_buckets(lim, pkt->in_port, table_id, reason, buckets);
+    if (pi_buckets_take(buckets, n, now) != NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&b->mutex);
+    b->held = NULL;
+    n_held = __sync_lock_test_and_set(&b->n_held, 0);
+    n_buffers = b->n_buffers;
+    memcpy(buffer_ids, b->buffer_ids, n_buffers * sizeof *buffer_ids);
+    b->n_buffers = 0;
+    pthread_mutex_unlock(&b->mutex);
+    __sync_fetch_and_sub(&lim->n_pending, 1);
+
+    b->n_summaries++;
+    if (n_held > 1 + n_buffers)
+    {
+        b->n_dropped += n_held - 1 - n_buffers;
+    }
+    VLOG_DBG_RL(LOG_MODULE, &rl, "packet in of table %u, reason %u, for %u "
+                "packets held back, %u buffered", table_id, reason, n_held,
+                n_buffers);
+
+    /* nothing else uses the packet */
+    pkt->last_output = true;
+    pthread_rwlock_rdlock(&dp->rw_lock);
+    pi_pkt2ofp_send(dp->pipeline, pkt, table_id, reason);
+    packet_destroy(pkt);
+    pthread_rwlock_unlock(&dp->rw_lock);
+    pi_summary_send(dp, table_id, reason, n_held, buffer_ids, n_buffers);
+}
+
+/* Returns the msec from 'now' until the summary of 'b' may be sent, or
+ * UINT_MAX if it holds no packet. */
+static unsigned int
+pi_bucket_next(struct dp_pi_limit *lim, struct pi_bucket *b, unsigned int now)
+{
+    struct pi_bucket *buckets[3];
+    unsigned int wait = 0;
+    unsigned int n, i;
+
+    if (b->held == NULL)
+    {
+        return UINT_MAX;
+    }
+    n = pi_buckets(lim, b->held->in_port, b->table_id, b->reason, buckets);
+    for (i = 0; i < n; i++)
+    {
+        wait = MAX(wait, pi_bucket_wait(buckets[i], now));
+    }
+    return wait;
+}
+
+static void
+pi_bucket_show(struct pi_bucket *b, const char *scope, const char *name,
+               unsigned int id)
+{
+    if (b->rate == 0 && b->n_summaries == 0)
+    {
+        return;
+    }
+    if (name == NULL)
+    {
+        printf("**packet in limit %s %u ", scope, id);
+    }
+    else
+    {
+        printf("**packet in limit %s %s ", scope, name);
+    }
+    printf("rate:[%u], burst:[%u], summaries:[%llu], dropped:[%llu]**\r\n",
+           b->rate, b->burst, b->n_summaries, b->n_dropped);
+    b->n_summaries = 0;
+    b->n_dropped = 0;
+}
+
+struct dp_pi_limit *
+dp_pi_limit_create(void)
+{
+    struct dp_pi_limit *lim = xcalloc(1, sizeof *lim);
+    size_t i;
+
+    for (i = 0; i < DP_PI_LIMIT_REASONS; i++)
+    {
+        pthread_mutex_init(&lim->reasons[i].mutex, NULL);
+    }
+    for (i = 0; i < PIPELINE_TABLES; i++)
+    {
+        pthread_mutex_init(&lim->tables[i].mutex, NULL);
+    }
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        pthread_mutex_init(&lim->ports[i].mutex, NULL);
+    }
+    return lim;
+}
+
+int
+dp_pi_limit_parse(struct dp_pi_limit *lim, const char *spec)
+{
+    const char *eq = strchr(spec, '=');
+    struct pi_bucket *b = NULL;
+    unsigned long rate, burst, id;
+    size_t len;
+    char *end;
+
+    if (eq == NULL)
+    {
+        return EINVAL;
+    }
+    len = eq - spec;
+
+    for (id = 0; id < DP_PI_LIMIT_REASONS; id++)
+    {
+        if (len == strlen(reason_names[id]) && !strncmp(spec, reason_names[id], len))
+        {
+            b = &lim->reasons[id];
+        }
+    }
+    if (b == NULL && !strncmp(spec, "table:", 6))
+    {
+        id = strtoul(spec + 6, &end, 10);
+        if (end == spec + 6 || end != eq || id >= PIPELINE_TABLES)
+        {
+            return EINVAL;
+        }
+        b = &lim->tables[id];
+    }
+    else if (b == NULL && !strncmp(spec, "port:", 5))
+    {
+        id = strtoul(spec + 5, &end, 10);
+        if (end == spec + 5 || end != eq || id >= DP_MAX_PORTS)
+        {
+            return EINVAL;
+        }
+        b = &lim->ports[id];
+    }
+    if (b == NULL)
+    {
+        return EINVAL;
+    }
+
+    rate = strtoul(eq + 1, &end, 10);
+    if (end == eq + 1 || rate > PI_RATE_MAX)
+    {
+        return EINVAL;
+    }
+    burst = rate;
+    if (*end == '/')
+    {
+        const char *s = end + 1;
+
+        burst = strtoul(s, &end, 10);
+        if (end == s || burst > PI_RATE_MAX)
+        {
+            return EINVAL;
+        }
+    }
+    if (*end != '\0')
+    {
+        return EINVAL;
+    }
+
+    b->rate = rate;
+    b->burst = MAX(burst, 1);
+    b->tokens = b->burst * PI_TOKENS;
+    b->last_fill = pi_now();
+    if (rate != 0)
+    {
+        lim->enabled = true;
+    }
+    return 0;
+}
+
+bool
+dp_pi_limit_admit(struct dp_pi_limit *lim, struct packet *pkt,
+                  unsigned char table_id, unsigned char reason)
+{
+    struct pi_bucket *buckets[3], *b;
+    unsigned int n;
+
+    if (lim == NULL || !lim->enabled)
+    {
+        return true;
+    }
+
+    n = pi_buckets(lim, pkt->in_port, table_id, reason, buckets);
+    b = pi_buckets_take(buckets, n, pi_now());
+    if (b != NULL)
+    {
+        pi_bucket_hold(lim, b, pkt, table_id, reason);
+        return false;
+    }
+    return true;
+}
+
+void
+dp_pi_limit_run(struct datapath *dp)
+{
+    struct dp_pi_limit *lim = dp->pi_limit;
+    unsigned int now;
+    size_t i;
+
+    if (lim == NULL || lim->n_pending == 0)
+    {
+        return;
+    }
+
+    now = pi_now();
+    for (i = 0; i < DP_PI_LIMIT_REASONS; i++)
+    {
+        pi_bucket_run(dp, &lim->reasons[i], now);
+    }
+    for (i = 0; i < PIPELINE_TABLES; i++)
+    {
+        pi_bucket_run(dp, &lim->tables[i], now);
+    }
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        pi_bucket_run(dp, &lim->ports[i], now);
+    }
+}
+
+long long int
+dp_pi_limit_next(struct dp_pi_limit *lim)
+{
+    unsigned int wait = UINT_MAX;
+    unsigned int now;
+    size_t i;
+
+    if (lim == NULL || lim->n_pending == 0)
+    {
+        return LLONG_MAX;
+    }
+
+    now = pi_now();
+    for (i = 0; i < DP_PI_LIMIT_REASONS; i++)
+    {
+        wait = MIN(wait, pi_bucket_next(lim, &lim->reasons[i], now));
+    }
+    for (i = 0; i < PIPELINE_TABLES; i++)
+    {
+        wait = MIN(wait, pi_bucket_next(lim, &lim->tables[i], now));
+    }
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        wait = MIN(wait, pi_bucket_next(lim, &lim->ports[i], now));
+    }
+    return wait == UINT_MAX ? LLONG_MAX : time_now_msec() + wait;
+}
+
+void
+dp_pi_limit_show(struct dp_pi_limit *lim)
+{
+    size_t i;
+
+    if (lim == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < DP_PI_LIMIT_REASONS; i++)
+    {
+        pi_bucket_show(&lim->reasons[i], "reason", reason_names[i], 0);
+    }
+    for (i = 0; i < PIPELINE_TABLES; i++)
+    {
+        pi_bucket_show(&lim->tables[i], "table", NULL, i);
+    }
+    for (i = 0; i < DP_MAX_PORTS; i++)
+    {
+        pi_bucket_show(&lim->ports[i], "port", NULL, i);
+    }
+}
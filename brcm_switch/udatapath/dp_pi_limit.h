@@ -0,0 +1,62 @@
+#ifndef DP_PI_LIMIT_H
+#define DP_PI_LIMIT_H 1
+
+#include <stdbool.h>
+
+/****************************************************************************
+ * Packet in rate limits of the datapath.
+ *
+ * Token buckets, per packet in reason, per table and per ingress port, are
+ * checked before a packet in is built; a packet in is sent only if all the
+ * buckets that apply to it have a token. Taking a token is a few atomic
+ * operations, so that any thread may check the limits without a lock.
+ *
+ * While a bucket is out of tokens, it keeps a copy of the first packet it
+ * held back, saves copies of the next PI_HELD_BUFFERS in the datapath
+ * buffers while there is room, and only counts the others, which are dropped
+ * without more work. Once all the limits of the kept packet have a token
+ * again, the datapath thread sends a packet in for it, then a summary
+ * (OFP_EXT_PACKET_IN_SUMMARY) with the number of packets held back and the
+ * buffer ids of those saved.
+ ****************************************************************************/
+
+#define DP_PI_LIMIT_REASONS  3      /* OFPR_NO_MATCH, OFPR_ACTION and
+                                       OFPR_INVALID_TTL. */
+
+struct datapath;
+struct dp_pi_limit;
+struct packet;
+
+/* Creates a set of limits, with no bucket limiting yet. */
+struct dp_pi_limit *
+dp_pi_limit_create(void);
+
+/* Sets a limit from a "SCOPE=RATE[/BURST]" string, where SCOPE is one of
+ * "no-match", "action", "invalid-ttl", "table:ID" or "port:NO", RATE the
+ * packet ins per second, 0 for no limit, and BURST the packet ins sent back
+ * to back, RATE by default. Returns 0 if successful, otherwise EINVAL. */
+int
+dp_pi_limit_parse(struct dp_pi_limit *lim, const char *spec);
+
+/* Returns true if a packet in may be sent for the packet. Otherwise the
+ * packet in is counted in the summary of the bucket that held it back, and
+ * the caller keeps the packet. */
+bool
+dp_pi_limit_admit(struct dp_pi_limit *lim, struct packet *pkt,
+                  unsigned char table_id, unsigned char reason);
+
+/* Sends the summary packet ins of the buckets that have a token again. Runs
+ * in the datapath thread. */
+void
+dp_pi_limit_run(struct datapath *dp);
+
+/* Returns the msec at which the next summary is due, or LLONG_MAX if there is
+ * none to send. Runs in the datapath thread. */
+long long int
+dp_pi_limit_next(struct dp_pi_limit *lim);
+
+/* Prints the counters of the limits, and clears them. */
+void
+dp_pi_limit_show(struct dp_pi_limit *lim);
+
+#endif /* DP_PI_LIMIT_H */
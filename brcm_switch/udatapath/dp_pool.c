@@ -0,0 +1,177 @@
+/* Pools of fixed size objects. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "dp_pool.h"
+#include "ofpbuf.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_dp
+
+/* Free objects of a pool cached by a thread. */
+struct dp_pool_cache {
+    void               *free;
+    unsigned int        n_free;
+};
+
+static struct dp_pool *pools[DP_POOLS_MAX];
+static unsigned int n_pools = 0;
+
+static __thread struct dp_pool_cache caches[DP_POOLS_MAX];
+
+/* Free objects are linked through their first word. */
+static inline void *
+obj_next(void *obj)
+{
+    return *(void **)obj;
+}
+
+static inline void
+obj_set_next(void *obj, void *next)
+{
+    *(void **)obj = next;
+}
+
+/* Allocates n objects and links them in the shared free list of the pool,
+ * whose mutex is held or which is not used yet. */
+static void
+dp_pool_grow(struct dp_pool *pool, unsigned int n)
+{
+    char *chunk = xmalloc(n * pool->obj_size);
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        void *obj = chunk + i * pool->obj_size;
+
+        obj_set_next(obj, pool->free);
+        pool->free = obj;
+    }
+    pool->n_free += n;
+    pool->n_objects += n;
+}
+
+struct dp_pool *
+dp_pool_create(const char *name, size_t obj_size, unsigned int n_prealloc)
+{
+    struct dp_pool *pool;
+
+    if (n_pools == DP_POOLS_MAX)
+    {
+        ofp_fatal(0, "too many datapath pools (%s)", name);
+    }
+
+    pool = xmalloc(sizeof *pool);
+    pool->name = name;
+    pool->id = n_pools;
+    /* keep the objects aligned as malloc() does */
+    obj_size = MAX(obj_size, sizeof(void *));
+    pool->obj_size = ROUND_UP(obj_size, sizeof(long long int));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pool->free = NULL;
+    pool->n_free = 0;
+    pool->n_objects = 0;
+    pool->n_grows = 0;
+    if (n_prealloc != 0)
+    {
+        dp_pool_grow(pool, n_prealloc);
+    }
+
+    pools[n_pools++] = pool;
+    return pool;
+}
+
+void *
+dp_pool_get(struct dp_pool *pool)
+{
+    struct dp_pool_cache *cache = &caches[pool->id];
+    void *obj;
+
+    if (cache->n_free == 0)
+    {
+        unsigned int i;
+
+        /* refill the cache with a batch from the shared free list */
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->n_free < DP_POOL_BATCH)
+        {
+            dp_pool_grow(pool, DP_POOL_CHUNK);
+            pool->n_grows++;
+            VLOG_DBG(LOG_MODULE, "pool %s grown to %u objects",
+                     pool->name, pool->n_objects);
+        }
+        cache->free = pool->free;
+        obj = pool->free;
+        for (i = 1; i < DP_POOL_BATCH; i++)
+        {
+            obj = obj_next(obj);
+        }
+        pool->free = obj_next(obj);
+        obj_set_next(obj, NULL);
+        pool->n_free -= DP_POOL_BATCH;
+        pthread_mutex_unlock(&pool->mutex);
+        cache->n_free = DP_POOL_BATCH;
+    }
+
+    obj = cache->free;
+    cache->free = obj_next(obj);
+    cache->n_free--;
+    return obj;
+}
+
+void
+dp_pool_put(struct dp_pool *pool, void *obj)
+{
+    struct dp_pool_cache *cache = &caches[pool->id];
+
+    obj_set_next(obj, cache->free);
+    cache->free = obj;
+    cache->n_free++;
+
+    if (cache->n_free == 2 * DP_POOL_BATCH)
+    {
+        void *first = cache->free;
+        unsigned int i;
+
+        /* give a batch back, for the threads that allocate more objects
+         * than they free */
+        for (i = 1; i < DP_POOL_BATCH; i++)
+        {
+            obj = obj_next(obj);
+        }
+        cache->free = obj_next(obj);
+        cache->n_free -= DP_POOL_BATCH;
+
+        pthread_mutex_lock(&pool->mutex);
+        obj_set_next(obj, pool->free);
+        pool->free = first;
+        pool->n_free += DP_POOL_BATCH;
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+void
+dp_pools_show(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < n_pools; i++)
+    {
+        struct dp_pool *pool = pools[i];
+
+        pthread_mutex_lock(&pool->mutex);
+        printf("**pool %s objects:[%u], free:[%u], taken:[%u], grows:[%u]**\r\n",
+               pool->name, pool->n_objects, pool->n_free,
+               pool->n_objects - pool->n_free, pool->n_grows);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    for (i = 0; i < OFPBUF_SLABS; i++)
+    {
+        struct ofpbuf_slab_stats stats;
+
+        ofpbuf_slab_get_stats(i, &stats);
+        printf("**ofpbuf slab %zu buffers:[%u], free:[%u]**\r\n",
+               stats.size, stats.n_buffers, stats.n_free);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef DP_POOL_H
+#define DP_POOL_H 1
+
+#include <stddef.h>
+#include <pthread.h>
+
+/****************************************************************************
+ * Pools of fixed size objects, for the structures the datapath allocates
+ * and frees for every packet.
+ *
+ * Each thread keeps a small cache of free objects per pool, and only takes
+ * the pool mutex to move a batch of objects between its cache and the shared
+ * free list of the pool. The pool is filled when it is created, and grows by
+ * a chunk of objects when its free list runs out; objects are never given
+ * back to the heap, so once the pool has grown to the number of objects in
+ * flight the datapath does not allocate any more.
+ *
+ * Objects may be freed by another thread than the one allocating them.
+ ****************************************************************************/
+
+#define DP_POOLS_MAX         8
+#define DP_POOL_BATCH        32     /* objects moved to or from a thread cache. */
+#define DP_POOL_CHUNK        256    /* objects allocated when a pool grows. */
+
+struct dp_pool {
+    const char         *name;
+    unsigned int        id;         /* index of the thread caches. */
+    size_t              obj_size;
+
+    pthread_mutex_t     mutex;
+    void               *free;       /* shared free list. */
+    unsigned int        n_free;     /* objects in the shared free list. */
+    unsigned int        n_objects;  /* objects allocated. */
+    unsigned int        n_grows;    /* chunks allocated after creation. */
+};
+
+/* Creates a pool of objects of obj_size bytes, with n_prealloc objects to
+ * start with. Pools are created at initialization, before the threads using
+ * them run, and are never destroyed. */
+struct dp_pool *
+dp_pool_create(const char *name, size_t obj_size, unsigned int n_prealloc);
+
+/* Returns an object of the pool. Its content is undefined. */
+void *
+dp_pool_get(struct dp_pool *pool);
+
+/* Gives an object back to its pool. */
+void
+dp_pool_put(struct dp_pool *pool, void *obj);
+
+/* Prints the occupancy of the pools, and of the ofpbuf slabs. Objects taken
+ * out of the shared free lists are in use, or cached by a thread. */
+void
+dp_pools_show(void);
+
+#endif /* DP_POOL_H */
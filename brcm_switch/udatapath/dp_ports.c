@@ -50,6 +50,7 @@
 #include "oflib/ofl-messages.h"
 #include "oflib-exp/ofl-exp-openflow.h"
 #include "oflib/ofl-log.h"
+#include "ring.h"
 #include "util.h"
 
 #include "vlog.h"
@@ -65,8 +66,6 @@
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
 #if defined(OF_HW_PLAT)
-#include <pthread.h>
-#include "rbuff.h"
 #include "common/port.h"
 #include "dpal_pub.h"
 #endif
@@ -74,12 +73,6 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 PORT_STATUS_REF_S g_port_status_ref = {0};
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
-/* Queue to decouple receive packet thread from rconn control thread */
-/* Could make mutex per-DP */
-static pthread_mutex_t pkt_q_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define PKT_Q_LOCK pthread_mutex_lock(&pkt_q_mutex)
-#define PKT_Q_UNLOCK pthread_mutex_unlock(&pkt_q_mutex)
-
 static void
 dp_port_time_update(struct sw_port *port) {
     port->stats->duration_sec  =  (time_now_msec() - port->created) / 1000;
@@ -111,30 +104,6 @@ static void port_stats_updata(struct port_stats * pstStat, struct sw_port * port
     return ;
 }
 
-static void
-enqueue_pkt(struct datapath *dp, struct ofpbuf *buffer, unsigned int port_no,
-            int reason)
-{
-    struct hw_pkt_q_entry *q_entry;
-
-    if ((q_entry = xmalloc(sizeof(*q_entry))) == NULL) {
-        VLOG_WARN(LOG_MODULE, "Could not alloc q entry\n");
-        /* FIXME: Dealloc buffer */
-        return;
-    }
-    q_entry->buffer = buffer;
-    q_entry->next = NULL;
-    q_entry->port_no = port_no;
-    q_entry->reason = reason;
-    pthread_mutex_lock(&pkt_q_mutex);
-    if (dp->hw_pkt_list_head == NULL) {
-        dp->hw_pkt_list_head = q_entry;
-    } else {
-        dp->hw_pkt_list_tail->next = q_entry;
-    }
-    dp->hw_pkt_list_tail = q_entry;
-    pthread_mutex_unlock(&pkt_q_mutex);
-}
 static int dequeue_net_pkt(struct datapath *dp,
                        struct ofpbuf **buffer,
                        unsigned int *port_no,
@@ -162,39 +131,7 @@ static int dequeue_net_pkt(struct datapath *dp,
     return 0;
 }
 
-/* ctx->buff freed by others */
-void fwding_ctx_release(struct forwarding_context *ctx)
-{
-    free(ctx);
 
-    return;
-}
-
-/* If queue non-empty, fill out params and return 1; else return 0 */
-static int dequeue_pkt(struct datapath *dp,
-                       struct ofpbuf **buffer,
-                       unsigned int *port_no,
-                       int *reason, unsigned char *rx_cos, unsigned char *flag)
-{
-    struct forwarding_context *ctx;
-
-    ctx = fwding_ctx();
-    if (ctx)
-    {
-        *buffer = (struct ofpbuf *)ctx->buff;
-        *port_no = ctx->in_port;
-        *reason = ctx->reason;
-        *rx_cos = ctx->rx_cos;
-        *flag = ctx->untag_flag;
-        fwding_ctx_release(ctx);
-
-        g_port_recv_count ++;
-        return 1;
-    }
-
-    (void)dp;
-    return 0;
-}
 #else
 static void port_stats_updata(port_stats * pstStat, sw_port * port)
 {
@@ -203,7 +140,7 @@ static void port_stats_updata(port_stats * pstStat, sw_port * port)
 
 #endif
 
-struct rbuff *port_rbuff;
+struct ring *port_ring;
 
 static PORT_STATUS_REF_S * create_new_port_status_node(UINT32 port)
 {
@@ -249,19 +186,14 @@ static PORT_STATUS_REF_S * port_node_get_by_port(unsigned int port)
 
 /* wangxin ʱ */
 #if 1 /* ˿ͳƻظ */
-struct rbuff * g_port_stat_buff = NULL;
+static struct ring *g_port_stat_ring = NULL;
 unsigned int g_Port_Statistics_xid = 0;
 
 int Port_Statisitcs_put(void *recvdata, unsigned int revnum)
 {
     void *msg;
 
-    if(g_port_stat_buff == NULL)
-    {
-        g_port_stat_buff = rbuff_alloc(10000);
-    }
-
-    if(rbuff_full(g_port_stat_buff))
+    if(ring_is_full(g_port_stat_ring))
     {
         return -1;
     }
@@ -276,14 +208,19 @@ int Port_Statisitcs_put(void *recvdata, unsigned int revnum)
 
     memcpy((unsigned int *)msg + 1, recvdata, revnum);
 
-    rbuff_put(g_port_stat_buff, msg);
+    if(ring_put(g_port_stat_ring, msg) != 0)
+    {
+        free(msg);
+        return -1;
+    }
+    dp_wakeup();
 
     return 0;
 }
 
 void * Port_Statisitcs_get(void)
 {
-    return rbuff_get(g_port_stat_buff);
+    return ring_get(g_port_stat_ring);
 }
 
 void Port_Statisitcs_release(void *msg)
@@ -311,7 +248,9 @@ unsigned int Port_State_Init(struct datapath *dp)
         }
     }
 
-    port_rbuff = rbuff_alloc(1000);
+    /* the receive threads of the HW driver may all queue messages */
+    port_ring = ring_create(PORT_STATUS_QUEUE_LEN, RING_F_SC_DEQ);
+    g_port_stat_ring = ring_create(PORT_STATS_QUEUE_LEN, RING_F_SC_DEQ);
     VLOG_DBG(LOG_MODULE, "Port state init ok \n");
 
     return VOS_OK;
@@ -359,16 +298,12 @@ void port_evt_handle(int port, unsigned int linkst)
         }
     }
     portsact->port_no = port;
-    if (port_rbuff == NULL)
-    {
-        port_rbuff = rbuff_alloc(10000);
-    }
-    if(rbuff_full(port_rbuff))
+    if(ring_put(port_ring, portsact) != 0)
     {
         free(portsact);
         return;
     }
-    rbuff_put(port_rbuff,portsact);
+    dp_wakeup();
     return;
 }
 
@@ -449,9 +384,8 @@ hw_packet_in(unsigned int port_no, of_packet_t *packet, int reason,
              void *cookie)
 {
     struct sw_port *port;
-    struct ofpbuf *buffer = NULL;
+    struct forwarding_context *ctx;
     struct datapath *dp = (struct datapath *)cookie;
-    const int headroom = 128 + 2;
     const int hard_header = VLAN_ETH_HEADER_LEN;
     const int tail_room = sizeof(unsigned int);  /* For crc if needed later */
 
@@ -482,18 +416,17 @@ hw_packet_in(unsigned int port_no, of_packet_t *packet, int reason,
     //port->stats->rx_bytes += packet->length;
 
     /* For now, copy data into OFP buffer; eventually may steal packet
-     * from RX to avoid copy.  As per dp_run, add headroom and offset bytes.
+     * from RX to avoid copy.  Queue it to the datapath thread as the
+     * packets of fwding_evt_handle().
      */
-    buffer = ofpbuf_new(headroom + hard_header + packet->length + tail_room);
-    if (buffer == NULL) {
-        VLOG_WARN(LOG_MODULE, "Could not alloc ofpbuf on hw pkt in\n");
-        fprintf(stderr, "Could not alloc ofpbuf on hw pkt in\n");
-    } else {
-        buffer->data = (char*)buffer->data + headroom;
-        buffer->size = packet->length;
-        memcpy(buffer->data, packet->data, packet->length);
-        enqueue_pkt(dp, buffer, port_no, reason);
-        poll_immediate_wake();
+    ctx = fwding_ctx_alloc(port_no, 0, hard_header + packet->length + tail_room);
+    ctx->reason = reason;
+    ofpbuf_put((struct ofpbuf *)ctx->buff, packet->data, packet->length);
+    if (fwding_ctx_put(ctx) != 0) {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "Receive queue full, dropping packet "
+                     "from port %u", port_no);
+        ofpbuf_delete((struct ofpbuf *)ctx->buff);
+        fwding_ctx_release(ctx);
     }
 
     return 0;
@@ -504,9 +437,6 @@ hw_packet_in(unsigned int port_no, of_packet_t *packet, int reason,
 int
 dp_hw_drv_init(struct datapath *dp)
 {
-    dp->hw_pkt_list_head = NULL;
-    dp->hw_pkt_list_tail = NULL;
-
     // ʱע͵
     //dp->hw_drv = new_of_hw_driver();
     if (dp->hw_drv == NULL) {
@@ -526,19 +456,19 @@ dp_hw_drv_init(struct datapath *dp)
 #endif
 
 
-/* Runs a datapath packet through the pipeline, if the port is not set to down. */
-static void
-process_buffer(struct datapath *dp, struct sw_port *p, struct ofpbuf *buffer) {
+/* Creates the packet of a datapath buffer to run through the pipeline, if
+ * the port is not set to down and the flow filter lets it in. Returns NULL
+ * if the buffer was dropped. */
+static struct packet *
+receive_buffer(struct datapath *dp, struct sw_port *p, struct ofpbuf *buffer) {
     struct packet *pkt;
     unsigned char uInPipeline = 0;
 
-    //unsigned int i;
-
     if ((!p || !p->conf) || p->conf->config & ((OFPPC_NO_RECV | OFPPC_PORT_DOWN) != 0))
     {
         g_no_match ++;
         ofpbuf_delete(buffer);
-        return;
+        return NULL;
     }
 
     // packet takes ownership of ofpbuf buffer
@@ -550,53 +480,65 @@ process_buffer(struct datapath *dp, struct sw_port *p, struct ofpbuf *buffer) {
         if(0 == uInPipeline)
         {
             packet_destroy(pkt);
-            return;
+            return NULL;
         }
     }
 
-    pipeline_process_packet(dp->pipeline, pkt);
+    return pkt;
 }
-#define PACKET_COUNT 10
 
-void
+struct packet *
+dp_ports_receive(struct datapath *dp, unsigned int port_no, struct ofpbuf *buffer) {
+    struct sw_port *p = dp_ports_lookup(dp, port_no);
+
+    //we will drop the packet from port which  it is not notify controller.
+    if (NULL == p || p->conf == NULL)
+    {
+        ofpbuf_delete(buffer);
+        return NULL;
+    }
+
+    if (VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE))
+    {
+        VLOG_DBG(LOG_MODULE, "recv data:\n");
+        ofp_hex_dump(stdout, buffer->data, buffer->size, 0, 1);
+    }
+
+    return receive_buffer(dp, p, buffer);
+}
+
+unsigned int
 dp_ports_run(struct datapath *dp) {
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
+    unsigned int receive_count = 0;
+
     {
-        struct ofpbuf *buffer;
-        unsigned int port_no;
-        int reason;
-        unsigned char rx_cos, flag;
-        struct sw_port *p;
-        static int receive_count = 0;
+        struct forwarding_context *ctxs[PIPELINE_BATCH_MAX];
+        struct packet *pkts[PIPELINE_BATCH_MAX];
+        size_t n_pkts = 0;
+        unsigned int i;
 
-        while (dequeue_pkt(dp, &buffer, &port_no, &reason, &rx_cos, &flag))
+        /* Dequeue a batch, bounded so that the control plane work of
+         * dp_run() is not held back for long. */
+        receive_count = fwding_ctx_burst(ctxs, dp->rx_batch);
+        g_port_recv_count += receive_count;
+        for (i = 0; i < receive_count; i++)
         {
-            p = dp_ports_lookup(dp, port_no);
-            /* FIXME:  We're throwing away the reason that came from HW */
-            receive_count ++;
-
-            //we will drop the packet from port which  it is not notify controller.
-            if (NULL == p || p->conf == NULL)
-            {
-                ofpbuf_delete(buffer);
-                break;
-            }
+            struct packet *pkt;
 
-            if (VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE))
+            /* FIXME:  We're throwing away the reason that came from HW */
+            pkt = dp_ports_receive(dp, ctxs[i]->in_port, ctxs[i]->buff);
+            fwding_ctx_release(ctxs[i]);
+            if (pkt != NULL)
             {
-                VLOG_DBG(LOG_MODULE, "recv data:\n");
-                ofp_hex_dump(stdout, buffer->data, buffer->size, 0, 1);
+                pkts[n_pkts++] = pkt;
             }
+        }
 
-            process_buffer(dp, p, buffer);
-
-            //if (receive_count >= PACKET_COUNT)
-            if (receive_count >= 1)
-            {
-                receive_count = 0;
-                break;
-            }
+        if (n_pkts != 0)
+        {
+            pipeline_process_batch(dp->pipeline, pkts, n_pkts);
         }
     }
 
@@ -605,9 +547,12 @@ dp_ports_run(struct datapath *dp) {
         Port_Statisitcs_reply(dp);
     }
 
-    return;
+    return receive_count;
 #else
     static struct ofpbuf *buffer = NULL;
+    struct packet *pkts[PIPELINE_BATCH_MAX];
+    unsigned int receive_count = 0;
+    size_t n_pkts = 0;
     struct sw_port *p, *pn;
     LIST_FOR_EACH_SAFE (p, pn, struct sw_port, node, &dp->port_list) {
         int error;
@@ -615,27 +560,37 @@ dp_ports_run(struct datapath *dp) {
         if (IS_HW_PORT(p)) {
             continue;
         }
+        if (receive_count >= dp->rx_batch) {
+            break;
+        }
         if (buffer == NULL) {
-            /* Allocate buffer with some headroom to add headers in forwarding
-             * to the controller or adding a vlan tag, plus an extra 2 bytes to
+            /* Slab buffers have headroom to add headers in forwarding to
+             * the controller or adding a vlan tag, plus an extra 2 bytes to
              * allow IP headers to be aligned on a 4-byte boundary.  */
-            const int headroom = 128 + 2;
             const int hard_header = VLAN_ETH_HEADER_LEN;
             const int mtu = netdev_get_mtu(p->netdev);
-            buffer = ofpbuf_new_with_headroom(hard_header + mtu, headroom);
+            buffer = ofpbuf_slab_new(hard_header + mtu);
         }
         error = netdev_recv(p->netdev, buffer);
         if (!error) {
             p->stats->rx_packets++;
             p->stats->rx_bytes += buffer->size;
-            // process_buffer takes ownership of ofpbuf buffer
-            process_buffer(dp, p, buffer);
+            receive_count++;
+            // receive_buffer takes ownership of ofpbuf buffer
+            pkts[n_pkts] = receive_buffer(dp, p, buffer);
+            if (pkts[n_pkts] != NULL) {
+                n_pkts++;
+            }
             buffer = NULL;
         } else if (error != EAGAIN) {
             VLOG_ERR_RL(LOG_MODULE, &rl, "error receiving data from %s: %s",
                         netdev_get_name(p->netdev), strerror(error));
         }
     }
+    if (n_pkts != 0) {
+        pipeline_process_batch(dp->pipeline, pkts, n_pkts);
+    }
+    return receive_count;
   #endif
 }
 //extern struct rbuff * g_fwd_buff;
@@ -700,19 +655,14 @@ UINT32 dp_set_port_status(unsigned int uiPort, unsigned int uiEnable)
     }
 
     portsact->port_no = uiPort;
-    if (port_rbuff == NULL)
-    {
-        port_rbuff = rbuff_alloc(10000);
-    }
-
-    if(rbuff_full(port_rbuff))
+    if(ring_put(port_ring, portsact) != 0)
     {
         /* ͷڴ */
         free(portsact);
         return -1;
     }
 
-    rbuff_put(port_rbuff,portsact);
+    dp_wakeup();
 
     return 0;
 }
@@ -55,6 +55,7 @@
 #define MNG_PORT_NUM        52
 
 struct sender;
+struct packet;
 
 struct sw_queue {
     struct sw_port *port; /* reference to the parent port */
@@ -172,15 +173,6 @@ struct sw_port {
 };
 
 
-#if defined(OF_HW_PLAT)
-struct hw_pkt_q_entry {
-    struct ofpbuf *buffer;
-    struct hw_pkt_q_entry *next;
-    unsigned int port_no;
-    int reason;
-};
-#endif
-
 typedef struct port_status_ref
 {
     struct list node;
@@ -204,10 +196,21 @@ dp_ports_add(struct datapath *dp, const char *netdev);
 int
 dp_ports_add_local(struct datapath *dp, const char *netdev);
 
-/* Receives datapath packets, and runs them through the pipeline. */
-void
+/* Default number of packets dp_ports_run() receives and processes per call,
+ * before handing back to the control plane. */
+#define DP_RX_BATCH_DEFAULT  64
+
+/* Receives datapath packets, up to the datapath rx_batch, and runs them
+ * through the pipeline as a batch. Returns the number of packets received. */
+unsigned int
 dp_ports_run(struct datapath *dp);
 
+/* Creates the packet of a buffer received on the given port, to run through
+ * the pipeline. Returns NULL, and frees the buffer, if the port does not
+ * take the packet in. */
+struct packet *
+dp_ports_receive(struct datapath *dp, unsigned int port_no, struct ofpbuf *buffer);
+
 /* Returns the given port. */
 struct sw_port *
 dp_ports_lookup(struct datapath *, unsigned int);
@@ -277,6 +280,11 @@ int dp_port_init_queue(struct datapath *dp,int port_no);
 //void *dp_mng_port_thread(void* arg);
 int port_up(int port_no);
 
+/* Lengths of the queues of port status changes and port statistics replies
+ * to the datapath thread. */
+#define PORT_STATUS_QUEUE_LEN  1024
+#define PORT_STATS_QUEUE_LEN   1024
+
 int Port_Statisitcs_put(void *recvdata, unsigned int revnum);
 void * Port_Statisitcs_get(void);
 unsigned int Port_State_Init(struct datapath *dp);
@@ -0,0 +1,352 @@
+/* Packet processing worker threads. */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "datapath.h"
+#include "dp_ports.h"
+#include "dp_worker.h"
+#include "hash.h"
+#include "packet.h"
+#include "packets.h"
+#include "pipeline.h"
+#include "ring.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_dp
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+struct dp_worker {
+    struct datapath        *dp;
+    unsigned int            id;
+    pthread_t               thread;
+    struct ring            *queue;      /* of struct forwarding_context. */
+    int                     wakeup_fd;  /* written while the worker sleeps. */
+    volatile int            sleeping;
+    volatile int            stop;       /* set to make the worker exit. */
+    struct pipeline_thread *pt;         /* pipeline caches. */
+    unsigned long long int  n_packets;  /* run through the pipeline. */
+    unsigned long long int  n_batches;
+};
+
+static struct dp_worker *workers = NULL;
+static unsigned int n_workers = 0;
+
+/* Reads a 16 bit field of a frame. */
+static inline unsigned short int
+frame_get16(const unsigned char *frame, size_t ofs)
+{
+    return frame[ofs] << 8 | frame[ofs + 1];
+}
+
+/* Hashes the addresses, protocol and ports of an IP frame, leaving out the
+ * ports of fragments so that all the fragments of a packet hash alike, or
+ * the MAC addresses of another frame. */
+static unsigned int
+frame_flow_hash(const unsigned char *frame, size_t len)
+{
+    size_t ofs = 2 * ETH_ADDR_LEN;
+    unsigned short int type = 0;
+    unsigned int hash;
+    unsigned char proto;
+    size_t l4_ofs;
+
+    if (len < ETH_HEADER_LEN)
+    {
+        return hash_bytes(frame, len, 0);
+    }
+
+    /* skip the VLAN tags */
+    for (;;)
+    {
+        if (ofs + 2 > len)
+        {
+            return hash_bytes(frame, 2 * ETH_ADDR_LEN, type);
+        }
+        type = frame_get16(frame, ofs);
+        ofs += 2;
+        if (type != ETH_TYPE_VLAN && type != ETH_TYPE_VLAN_PBB_B &&
+            type != ETH_TYPE_VLAN_QinQ)
+        {
+            break;
+        }
+        ofs += VLAN_HEADER_LEN - 2;
+    }
+
+    if (type == ETH_TYPE_IP && ofs + IP_HEADER_LEN <= len)
+    {
+        proto = frame[ofs + 9];
+        hash = hash_bytes(&frame[ofs + 12], 8, proto);
+        if (frame_get16(frame, ofs + 6) & (IP_MORE_FRAGMENTS | IP_FRAG_OFF_MASK))
+        {
+            return hash;
+        }
+        l4_ofs = ofs + IP_IHL(frame[ofs]) * 4;
+    }
+    else if (type == ETH_TYPE_IPV6 && ofs + 40 <= len)
+    {
+        proto = frame[ofs + 6];
+        hash = hash_bytes(&frame[ofs + 8], 32, proto);
+        l4_ofs = ofs + 40;
+    }
+    else
+    {
+        return hash_bytes(frame, 2 * ETH_ADDR_LEN, type);
+    }
+
+    if ((proto == IP_TYPE_TCP || proto == IP_TYPE_UDP || proto == IP_TYPE_SCTP)
+        && l4_ofs + 4 <= len)
+    {
+        hash = hash_bytes(&frame[l4_ofs], 4, hash);
+    }
+    return hash;
+}
+
+/* Runs a batch of the packets queued to the worker through the pipeline.
+ * Returns the number of packets dequeued. */
+static unsigned int
+dp_worker_run(struct dp_worker *w)
+{
+    struct datapath *dp = w->dp;
+    struct packet *pkts[PIPELINE_BATCH_MAX];
+    struct forwarding_context *ctxs[PIPELINE_BATCH_MAX];
+    unsigned int n_received, i;
+    size_t n_pkts = 0;
+
+    n_received = ring_get_burst(w->queue, (void **)ctxs, dp->rx_batch);
+    for (i = 0; i < n_received; i++)
+    {
+        struct packet *pkt;
+
+        /* the packet takes ownership of ctxs[i]->buff */
+        pkt = dp_ports_receive(dp, ctxs[i]->in_port, ctxs[i]->buff);
+        fwding_ctx_release(ctxs[i]);
+        if (pkt != NULL)
+        {
+            pkts[n_pkts++] = pkt;
+        }
+    }
+
+    if (n_pkts != 0)
+    {
+        pthread_rwlock_rdlock(&dp->rw_lock);
+        pipeline_process_batch(dp->pipeline, pkts, n_pkts);
+        pthread_rwlock_unlock(&dp->rw_lock);
+        w->n_packets += n_pkts;
+        w->n_batches++;
+    }
+    return n_received;
+}
+
+/* Blocks until packets are queued to the worker, or poll_backoff_ms
+ * elapse. */
+static void
+dp_worker_sleep(struct dp_worker *w)
+{
+    struct pollfd pfd;
+    unsigned long long int count;
+
+    if (w->dp->poll_backoff_ms == 0 || w->wakeup_fd < 0)
+    {
+        return;
+    }
+
+    /* Packets queued after the check below find sleeping set, and write
+     * the eventfd. */
+    w->sleeping = 1;
+    __sync_synchronize();
+    if (ring_is_empty(w->queue))
+    {
+        pfd.fd = w->wakeup_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, w->dp->poll_backoff_ms) < 0 && errno != EINTR)
+        {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "worker %u poll failed (%s)",
+                         w->id, strerror(errno));
+        }
+    }
+    w->sleeping = 0;
+
+    while (read(w->wakeup_fd, &count, sizeof count) > 0)
+    {
+        continue;
+    }
+}
+
+static void *
+dp_worker_main(void *w_)
+{
+    struct dp_worker *w = w_;
+    long long int busy_until = 0;
+
+    pipeline_thread_set(w->pt);
+
+    /* Busy poll while packets come in, and for poll_dwell_us after the last
+     * one, as the datapath thread does. */
+    while (!w->stop)
+    {
+        if (dp_worker_run(w) != 0)
+        {
+            busy_until = time_now_usec() + w->dp->poll_dwell_us;
+        }
+        else if (time_now_usec() >= busy_until)
+        {
+            dp_worker_sleep(w);
+        }
+    }
+    return NULL;
+}
+
+/* Releases the queue, wakeup eventfd and pipeline caches of a worker whose
+ * thread is not running. */
+static void
+dp_worker_uninit(struct dp_worker *w)
+{
+    ring_destroy(w->queue);
+    if (w->wakeup_fd >= 0)
+    {
+        close(w->wakeup_fd);
+    }
+    pipeline_thread_destroy(w->pt);
+}
+
+/* Stops and waits for the threads of the first 'n' workers of 'ws', and
+ * frees 'ws'. Packets are not queued to them yet. */
+static void
+dp_workers_abort(struct dp_worker *ws, unsigned int n)
+{
+    unsigned long long int one = 1;
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        ws[i].stop = 1;
+        __sync_synchronize();
+        if (ws[i].wakeup_fd >= 0 && write(ws[i].wakeup_fd, &one, sizeof one) < 0)
+        {
+            VLOG_WARN(LOG_MODULE, "worker %u wakeup failed (%s)",
+                      i, strerror(errno));
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        pthread_join(ws[i].thread, NULL);
+        dp_worker_uninit(&ws[i]);
+    }
+    free(ws);
+}
+
+int
+dp_workers_start(struct datapath *dp)
+{
+    struct dp_worker *ws;
+    unsigned int i;
+
+    if (dp->n_workers == 0)
+    {
+        return 0;
+    }
+
+    ws = xmalloc(dp->n_workers * sizeof *ws);
+    for (i = 0; i < dp->n_workers; i++)
+    {
+        struct dp_worker *w = &ws[i];
+        int error;
+
+        w->dp = dp;
+        w->id = i;
+        w->queue = ring_create(DP_WORKER_QUEUE_LEN, RING_F_SC_DEQ);
+        w->sleeping = 0;
+        w->stop = 0;
+        w->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (w->wakeup_fd < 0)
+        {
+            VLOG_ERR(LOG_MODULE, "could not create wakeup eventfd of worker %u "
+                     "(%s), it will busy poll", i, strerror(errno));
+        }
+        w->pt = pipeline_thread_create(dp->pipeline);
+        w->n_packets = 0;
+        w->n_batches = 0;
+
+        error = pthread_create(&w->thread, NULL, dp_worker_main, w);
+        if (error)
+        {
+            VLOG_ERR(LOG_MODULE, "could not create worker %u (%s)", i, strerror(error));
+            dp_worker_uninit(w);
+            dp_workers_abort(ws, i);
+            return error;
+        }
+    }
+
+    /* the workers are only handed packets once all are running */
+    workers = ws;
+    __sync_synchronize();
+    n_workers = dp->n_workers;
+    VLOG_INFO(LOG_MODULE, "%u packet processing workers started", n_workers);
+    return 0;
+}
+
+struct dp_worker *
+dp_worker_select(const void *frame, size_t len)
+{
+    if (n_workers == 0)
+    {
+        return NULL;
+    }
+    return &workers[frame_flow_hash(frame, len) % n_workers];
+}
+
+bool
+dp_worker_full(struct dp_worker *w)
+{
+    return ring_is_full(w->queue);
+}
+
+int
+dp_worker_enqueue(struct dp_worker *w, struct forwarding_context *ctx)
+{
+    unsigned long long int one = 1;
+
+    if (ring_put(w->queue, ctx) != 0)
+    {
+        return -1;
+    }
+    __sync_synchronize();
+    if (w->sleeping && w->wakeup_fd >= 0)
+    {
+        if (write(w->wakeup_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+        {
+            VLOG_WARN_RL(LOG_MODULE, &rl, "worker %u wakeup failed (%s)",
+                         w->id, strerror(errno));
+        }
+    }
+    return 0;
+}
+
+void
+dp_workers_show(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < n_workers; i++)
+    {
+        struct dp_worker *w = &workers[i];
+
+        printf("**worker %u packets:[%llu], batches:[%llu], "
+               "emc hit:[%llu], emc miss:[%llu]**\r\n",
+               i, w->n_packets, w->n_batches,
+               w->pt->emc.hit_count, w->pt->emc.miss_count);
+        w->n_packets = 0;
+        w->n_batches = 0;
+        w->pt->emc.hit_count = 0;
+        w->pt->emc.miss_count = 0;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef DP_WORKER_H
+#define DP_WORKER_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/****************************************************************************
+ * Packet processing worker threads.
+ *
+ * With workers, the packets received from the hardware are spread over
+ * them by a hash of their 5-tuple, so that all the packets of a flow go to
+ * the same worker and keep their order. Each worker has its own queue,
+ * pipeline caches and counters, and runs batches of its packets through
+ * the pipeline holding the datapath lock for reading: the flow tables are
+ * shared, and only held off the workers while the datapath thread changes
+ * them. The datapath thread keeps the controller connections and the flow
+ * timeouts.
+ ****************************************************************************/
+
+#define DP_WORKERS_MAX       16
+#define DP_WORKER_QUEUE_LEN  1024   /* packets queued to a worker. */
+
+struct datapath;
+struct dp_worker;
+struct forwarding_context;
+
+/* Starts the dp->n_workers worker threads, once the pipeline is created.
+ * Returns 0 if successful, otherwise an errno value. */
+int
+dp_workers_start(struct datapath *dp);
+
+/* Returns the worker of the flow of a received frame, or NULL if there are
+ * no workers, in which case the datapath thread processes the frame. */
+struct dp_worker *
+dp_worker_select(const void *frame, size_t len);
+
+/* Returns true if the queue of the worker is full. */
+bool
+dp_worker_full(struct dp_worker *w);
+
+/* Queues a received packet to the worker, and wakes it up; any thread may
+ * queue packets. Returns 0 if successful, -1 if the queue is full. */
+int
+dp_worker_enqueue(struct dp_worker *w, struct forwarding_context *ctx);
+
+/* Prints the counters of the workers, and clears them. */
+void
+dp_workers_show(void);
+
+#endif /* DP_WORKER_H */
@@ -0,0 +1,96 @@
+/* Exact match microflow cache. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "emc.h"
+#include "hash.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_pipeline
+
+void
+emc_init(struct emc *emc, unsigned int size)
+{
+    unsigned int n = 1;
+
+    emc->hit_count = 0;
+    emc->miss_count = 0;
+    emc->mask = 0;
+    emc->entries = NULL;
+
+    if (size == 0)
+    {
+        return;
+    }
+
+    size = MIN(size, EMC_MAX_SIZE);
+    while (n * 2 <= size)
+    {
+        n *= 2;
+    }
+
+    emc->entries = xmalloc(n * sizeof *emc->entries);
+    memset(emc->entries, 0, n * sizeof *emc->entries);
+    emc->mask = n - 1;
+    VLOG_DBG(LOG_MODULE, "exact match cache of %u entries", n);
+}
+
+void
+emc_destroy(struct emc *emc)
+{
+    free(emc->entries);
+    emc->entries = NULL;
+    emc->mask = 0;
+}
+
+unsigned int
+emc_hash(const struct flow_key *key)
+{
+    return hash_words((const unsigned int *)key->w,
+                      FLOW_KEY_WORDS * (sizeof key->w[0] / sizeof(unsigned int)),
+                      (unsigned int)(key->present ^ (key->present >> 32)));
+}
+
+const struct emc_entry *
+emc_lookup(struct emc *emc, const struct flow_key *key, unsigned int hash,
+           unsigned long long int generation)
+{
+    const struct emc_entry *e;
+
+    if (emc->entries == NULL)
+    {
+        return NULL;
+    }
+
+    e = &emc->entries[hash & emc->mask];
+    if (e->n_entries != 0 && e->hash == hash && e->generation == generation &&
+        e->key.present == key->present &&
+        !memcmp(e->key.w, key->w, sizeof key->w))
+    {
+        emc->hit_count++;
+        return e;
+    }
+
+    emc->miss_count++;
+    return NULL;
+}
+
+void
+emc_insert(struct emc *emc, const struct flow_key *key, unsigned int hash,
+           struct flow_entry *const *entries, unsigned char n_entries,
+           unsigned long long int generation)
+{
+    struct emc_entry *e;
+
+    if (emc->entries == NULL || n_entries == 0 || n_entries > PIPELINE_TABLES)
+    {
+        return;
+    }
+
+    e = &emc->entries[hash & emc->mask];
+    e->hash = hash;
+    e->n_entries = n_entries;
+    e->generation = generation;
+    e->key = *key;
+    memcpy(e->entries, entries, n_entries * sizeof *entries);
+}
@@ -0,0 +1,63 @@
+#ifndef EMC_H
+#define EMC_H 1
+
+#include <stdbool.h>
+#include "flow_key.h"
+#include "oflib/ofl.h"
+
+/****************************************************************************
+ * Exact match microflow cache.
+ *
+ * A small direct mapped cache in front of the megaflow cache, keyed on the
+ * whole packet flow key, i.e. every L2 to L4 field the packet carries. A
+ * slot is picked by the key hash and checked by comparing the hash, then
+ * the key. It holds the flow entries of the path of the packet, so a hit
+ * costs one hash and one compare for all the pipeline tables.
+ * Each packet processing thread owns its cache, which needs no locking. A
+ * slot is only valid for the datapath flow generation it was filled in.
+ ****************************************************************************/
+
+#define EMC_DEFAULT_SIZE  8192
+#define EMC_MAX_SIZE      (1 << 20)
+
+struct flow_entry;
+
+struct emc_entry {
+    unsigned int             hash;
+    unsigned char            n_entries;  /* 0 if the slot is free. */
+    unsigned long long int   generation;
+    struct flow_key          key;
+    struct flow_entry       *entries[PIPELINE_TABLES]; /* in pipeline order. */
+};
+
+struct emc {
+    struct emc_entry        *entries;    /* NULL if the cache is disabled. */
+    unsigned int             mask;       /* number of slots - 1. */
+    unsigned long long int   hit_count;
+    unsigned long long int   miss_count;
+};
+
+/* Creates a cache with size slots, rounded down to a power of 2 and capped
+ * to EMC_MAX_SIZE. A size of 0 disables the cache. */
+void
+emc_init(struct emc *emc, unsigned int size);
+
+void
+emc_destroy(struct emc *emc);
+
+/* Returns the hash of a packet flow key used to index the cache. */
+unsigned int
+emc_hash(const struct flow_key *key);
+
+/* Returns the slot holding the key in the given generation, or NULL. */
+const struct emc_entry *
+emc_lookup(struct emc *emc, const struct flow_key *key, unsigned int hash,
+           unsigned long long int generation);
+
+/* Stores the path of a packet, replacing the slot content. */
+void
+emc_insert(struct emc *emc, const struct flow_key *key, unsigned int hash,
+           struct flow_entry *const *entries, unsigned char n_entries,
+           unsigned long long int generation);
+
+#endif /* EMC_H */
@@ -0,0 +1,415 @@
+/* Bucketized cuckoo hash for the exact flow tables. */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "exact_hash.h"
+#include "flow_entry.h"
+#include "jhash.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_flow_t_exact
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+#define EXACT_HASH_MIGRATE_STEP  64    /* old buckets migrated per step. */
+#define EXACT_HASH_PATH_NODES    128   /* buckets visited by a cuckoo path search. */
+
+static inline unsigned int
+exact_hash_bucket1(unsigned int hash, unsigned int seed, unsigned int mask)
+{
+    return jhash_1word(hash, seed) & mask;
+}
+
+static inline unsigned int
+exact_hash_bucket2(unsigned int hash, unsigned int seed, unsigned int mask)
+{
+    return jhash_1word(hash, ~seed) & mask;
+}
+
+/* Returns the other candidate bucket of a hash found in 'bucket'. */
+static inline unsigned int
+exact_hash_alt(unsigned int hash, unsigned int seed, unsigned int mask,
+               unsigned int bucket)
+{
+    unsigned int b1 = exact_hash_bucket1(hash, seed, mask);
+
+    return bucket == b1 ? exact_hash_bucket2(hash, seed, mask) : b1;
+}
+
+static struct exact_hash_bucket *
+exact_hash_alloc(unsigned int n_buckets)
+{
+    void *p;
+
+    if (posix_memalign(&p, sizeof(struct exact_hash_bucket),
+                       n_buckets * sizeof(struct exact_hash_bucket)) != 0)
+    {
+        out_of_memory();
+    }
+    memset(p, 0, n_buckets * sizeof(struct exact_hash_bucket));
+    return p;
+}
+
+static inline int
+exact_hash_bucket_free_slot(const struct exact_hash_bucket *b)
+{
+    int i;
+
+    for (i = 0; i < EXACT_HASH_SLOTS; i++)
+    {
+        if (b->entry[i] == NULL)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline struct flow_entry *
+exact_hash_bucket_find(const struct exact_hash_bucket *b, unsigned int hash,
+                       const unsigned char *key, int key_len)
+{
+    int i;
+
+    for (i = 0; i < EXACT_HASH_SLOTS; i++)
+    {
+        struct flow_entry *entry = b->entry[i];
+
+        if (b->sig[i] == hash && entry != NULL && entry->key_len == key_len &&
+            !memcmp(entry->key, key, key_len))
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static struct flow_entry *
+exact_hash_probe(const struct exact_hash_bucket *buckets, unsigned int mask,
+                 unsigned int seed, unsigned int hash,
+                 const unsigned char *key, int key_len)
+{
+    struct flow_entry *entry;
+
+    entry = exact_hash_bucket_find(&buckets[exact_hash_bucket1(hash, seed, mask)],
+                                   hash, key, key_len);
+    if (entry == NULL)
+    {
+        entry = exact_hash_bucket_find(&buckets[exact_hash_bucket2(hash, seed, mask)],
+                                       hash, key, key_len);
+    }
+    return entry;
+}
+
+/* Returns the slot holding an entry in one of its buckets, or NULL. */
+static struct flow_entry **
+exact_hash_slot_of(struct exact_hash_bucket *buckets, unsigned int mask,
+                   unsigned int seed, const struct flow_entry *entry)
+{
+    struct exact_hash_bucket *b;
+    int i;
+
+    b = &buckets[exact_hash_bucket1(entry->hash, seed, mask)];
+    for (i = 0; i < EXACT_HASH_SLOTS; i++)
+    {
+        if (b->entry[i] == entry)
+        {
+            return &b->entry[i];
+        }
+    }
+
+    b = &buckets[exact_hash_bucket2(entry->hash, seed, mask)];
+    for (i = 0; i < EXACT_HASH_SLOTS; i++)
+    {
+        if (b->entry[i] == entry)
+        {
+            return &b->entry[i];
+        }
+    }
+    return NULL;
+}
+
+static struct flow_entry **
+exact_hash_find_slot(struct exact_hash *h, const struct flow_entry *entry)
+{
+    struct flow_entry **slot;
+
+    slot = exact_hash_slot_of(h->buckets, h->mask, h->seed, entry);
+    if (slot == NULL && h->old != NULL)
+    {
+        slot = exact_hash_slot_of(h->old, h->old_mask, h->seed, entry);
+    }
+    return slot;
+}
+
+struct exact_hash_path_node {
+    unsigned int             bucket;
+    int                      parent;  /* index of the parent node, or -1. */
+    unsigned char            slot;    /* slot of the parent bucket whose entry
+                                         moves to this bucket. */
+};
+
+static bool
+exact_hash_path_has(const struct exact_hash_path_node *path, int node,
+                    unsigned int bucket)
+{
+    for (; node >= 0; node = path[node].parent)
+    {
+        if (path[node].bucket == bucket)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Places an entry in one of its buckets of h->buckets. If both are full, the
+ * shortest cuckoo path to a free slot is searched breadth-first and the
+ * entries on it are moved, starting from the free slot, so that every entry
+ * stays findable while the path is shifted. Returns false if no path was
+ * found. */
+static bool
+exact_hash_place(struct exact_hash *h, struct flow_entry *entry)
+{
+    struct exact_hash_path_node path[EXACT_HASH_PATH_NODES];
+    unsigned int b1 = exact_hash_bucket1(entry->hash, h->seed, h->mask);
+    unsigned int b2 = exact_hash_bucket2(entry->hash, h->seed, h->mask);
+    int head = 0;
+    int tail = 0;
+
+    path[tail].bucket = b1;
+    path[tail].parent = -1;
+    path[tail++].slot = 0;
+    if (b2 != b1)
+    {
+        path[tail].bucket = b2;
+        path[tail].parent = -1;
+        path[tail++].slot = 0;
+    }
+
+    for (head = 0; head < tail; head++)
+    {
+        struct exact_hash_bucket *b = &h->buckets[path[head].bucket];
+        int slot = exact_hash_bucket_free_slot(b);
+        int node = head;
+        int i;
+
+        if (slot >= 0)
+        {
+            while (path[node].parent >= 0)
+            {
+                struct exact_hash_bucket *to = &h->buckets[path[node].bucket];
+                struct exact_hash_bucket *from = &h->buckets[path[path[node].parent].bucket];
+                unsigned char from_slot = path[node].slot;
+
+                to->sig[slot] = from->sig[from_slot];
+                to->entry[slot] = from->entry[from_slot];
+                slot = from_slot;
+                node = path[node].parent;
+            }
+            b = &h->buckets[path[node].bucket];
+            b->sig[slot] = entry->hash;
+            b->entry[slot] = entry;
+            return true;
+        }
+
+        for (i = 0; i < EXACT_HASH_SLOTS && tail < EXACT_HASH_PATH_NODES; i++)
+        {
+            unsigned int alt = exact_hash_alt(b->sig[i], h->seed, h->mask,
+                                              path[head].bucket);
+
+            /* a bucket must not appear twice on a path */
+            if (exact_hash_path_has(path, head, alt))
+            {
+                continue;
+            }
+            path[tail].bucket = alt;
+            path[tail].parent = head;
+            path[tail++].slot = i;
+        }
+    }
+    return false;
+}
+
+/* Moves up to n_buckets old buckets to the new array. */
+static void
+exact_hash_migrate(struct exact_hash *h, unsigned int n_buckets)
+{
+    while (h->old != NULL && n_buckets-- > 0)
+    {
+        struct exact_hash_bucket *b = &h->old[h->migrate_pos];
+        int i;
+
+        for (i = 0; i < EXACT_HASH_SLOTS; i++)
+        {
+            if (b->entry[i] == NULL)
+            {
+                continue;
+            }
+            if (!exact_hash_place(h, b->entry[i]))
+            {
+                /* keep it in the old bucket, where lookups still find it */
+                VLOG_WARN_RL(LOG_MODULE, &rl, "Exact hash migration stalled at bucket %u.",
+                             h->migrate_pos);
+                return;
+            }
+            b->entry[i] = NULL;
+        }
+
+        if (h->migrate_pos++ == h->old_mask)
+        {
+            free(h->old);
+            h->old = NULL;
+        }
+    }
+}
+
+static bool
+exact_hash_grow(struct exact_hash *h)
+{
+    exact_hash_migrate(h, UINT_MAX);
+    if (h->old != NULL)
+    {
+        return false;
+    }
+
+    h->old = h->buckets;
+    h->old_mask = h->mask;
+    h->migrate_pos = 0;
+    h->mask = h->mask * 2 + 1;
+    h->buckets = exact_hash_alloc(h->mask + 1);
+    VLOG_DBG(LOG_MODULE, "exact hash grows to %u buckets\n", h->mask + 1);
+    return true;
+}
+
+void
+exact_hash_init(struct exact_hash *h, unsigned int seed, unsigned int max_entries)
+{
+    h->buckets = exact_hash_alloc(EXACT_HASH_MIN_BUCKETS);
+    h->mask = EXACT_HASH_MIN_BUCKETS - 1;
+    h->old = NULL;
+    h->old_mask = 0;
+    h->migrate_pos = 0;
+    h->seed = seed;
+    h->n_entries = 0;
+    h->max_entries = max_entries;
+}
+
+void
+exact_hash_destroy(struct exact_hash *h)
+{
+    free(h->buckets);
+    free(h->old);
+    h->buckets = NULL;
+    h->old = NULL;
+    h->n_entries = 0;
+}
+
+bool
+exact_hash_insert(struct exact_hash *h, struct flow_entry *entry)
+{
+    if (h->n_entries >= h->max_entries)
+    {
+        return false;
+    }
+
+    exact_hash_migrate(h, EXACT_HASH_MIGRATE_STEP);
+
+    /* keep the load under 7/8 so that cuckoo paths stay short */
+    if ((h->n_entries + 1) * 8 > (h->mask + 1) * EXACT_HASH_SLOTS * 7)
+    {
+        exact_hash_grow(h);
+    }
+
+    while (!exact_hash_place(h, entry))
+    {
+        if (!exact_hash_grow(h))
+        {
+            return false;
+        }
+    }
+    h->n_entries++;
+    return true;
+}
+
+bool
+exact_hash_remove(struct exact_hash *h, struct flow_entry *entry)
+{
+    struct flow_entry **slot = exact_hash_find_slot(h, entry);
+
+    if (slot == NULL)
+    {
+        return false;
+    }
+    *slot = NULL;
+    h->n_entries--;
+    return true;
+}
+
+void
+exact_hash_replace(struct exact_hash *h, struct flow_entry *old_entry,
+                   struct flow_entry *new_entry)
+{
+    struct flow_entry **slot = exact_hash_find_slot(h, old_entry);
+
+    if (slot != NULL)
+    {
+        *slot = new_entry;
+    }
+}
+
+struct flow_entry *
+exact_hash_find(const struct exact_hash *h, unsigned int hash,
+                const unsigned char *key, int key_len)
+{
+    struct flow_entry *entry;
+
+    entry = exact_hash_probe(h->buckets, h->mask, h->seed, hash, key, key_len);
+    if (entry == NULL && h->old != NULL)
+    {
+        entry = exact_hash_probe(h->old, h->old_mask, h->seed, hash, key, key_len);
+    }
+    return entry;
+}
+
+void
+exact_hash_run(struct exact_hash *h)
+{
+    exact_hash_migrate(h, EXACT_HASH_MIGRATE_STEP);
+}
+
+struct flow_entry *
+exact_hash_next(const struct exact_hash *h, struct exact_hash_cursor *cursor)
+{
+    while (!cursor->in_old || h->old != NULL)
+    {
+        const struct exact_hash_bucket *buckets = cursor->in_old ? h->old : h->buckets;
+        unsigned int mask = cursor->in_old ? h->old_mask : h->mask;
+
+        for (; cursor->bucket <= mask; cursor->bucket++, cursor->slot = 0)
+        {
+            const struct exact_hash_bucket *b = &buckets[cursor->bucket];
+
+            while (cursor->slot < EXACT_HASH_SLOTS)
+            {
+                struct flow_entry *entry = b->entry[cursor->slot++];
+
+                if (entry != NULL)
+                {
+                    return entry;
+                }
+            }
+        }
+
+        if (cursor->in_old)
+        {
+            break;
+        }
+        cursor->in_old = true;
+        cursor->bucket = 0;
+        cursor->slot = 0;
+    }
+    return NULL;
+}
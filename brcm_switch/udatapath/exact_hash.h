@@ -0,0 +1,85 @@
+#ifndef EXACT_HASH_H
+#define EXACT_HASH_H 1
+
+#include <stdbool.h>
+
+/****************************************************************************
+ * Bucketized cuckoo hash holding the entries of an exact flow table.
+ *
+ * Every entry has two candidate buckets derived from its key hash. A bucket
+ * is one cache line holding the key hashes of its slots next to the entry
+ * pointers, so a lookup reads at most two buckets and only dereferences the
+ * entries whose hash matches. When both buckets are full, entries are moved
+ * along a breadth-first cuckoo path to make room.
+ * The hash grows by doubling. The old buckets are migrated a few at a time
+ * on each insertion and on exact_hash_run(), and lookups probe both arrays
+ * until the migration is done, so no operation pays for a full rehash.
+ ****************************************************************************/
+
+#define EXACT_HASH_SLOTS        4     /* entries per bucket. */
+#define EXACT_HASH_MIN_BUCKETS  256
+
+struct flow_entry;
+
+struct exact_hash_bucket {
+    unsigned int             sig[EXACT_HASH_SLOTS];   /* flow_entry.hash. */
+    struct flow_entry       *entry[EXACT_HASH_SLOTS]; /* NULL if free. */
+} __attribute__((aligned(64)));
+
+struct exact_hash {
+    struct exact_hash_bucket *buckets;
+    unsigned int              mask;         /* number of buckets - 1. */
+    struct exact_hash_bucket *old;          /* buckets being migrated, or NULL. */
+    unsigned int              old_mask;
+    unsigned int              migrate_pos;  /* old buckets below are migrated. */
+    unsigned int              seed;
+    unsigned int              n_entries;
+    unsigned int              max_entries;
+};
+
+/* Position of an iteration over an exact hash. */
+struct exact_hash_cursor {
+    bool                      in_old;
+    unsigned int              bucket;
+    unsigned int              slot;
+};
+
+void
+exact_hash_init(struct exact_hash *h, unsigned int seed, unsigned int max_entries);
+
+void
+exact_hash_destroy(struct exact_hash *h);
+
+/* Inserts an entry under entry->hash. Returns false if the hash holds
+ * max_entries entries already. */
+bool
+exact_hash_insert(struct exact_hash *h, struct flow_entry *entry);
+
+/* Removes an entry. Returns false if the entry is not in the hash. */
+bool
+exact_hash_remove(struct exact_hash *h, struct flow_entry *entry);
+
+/* Puts new_entry in the slot of old_entry, which must have the same key. */
+void
+exact_hash_replace(struct exact_hash *h, struct flow_entry *old_entry,
+                   struct flow_entry *new_entry);
+
+/* Returns the entry with the given key, or NULL. */
+struct flow_entry *
+exact_hash_find(const struct exact_hash *h, unsigned int hash,
+                const unsigned char *key, int key_len);
+
+/* Migrates some old buckets if the hash is growing. */
+void
+exact_hash_run(struct exact_hash *h);
+
+/* Returns the next entry of an iteration, or NULL at the end. The current
+ * entry may be removed while iterating. */
+struct flow_entry *
+exact_hash_next(const struct exact_hash *h, struct exact_hash_cursor *cursor);
+
+#define EXACT_HASH_FOR_EACH(ENTRY, CURSOR, HASH)                             \
+    for ((CURSOR).in_old = false, (CURSOR).bucket = 0, (CURSOR).slot = 0;    \
+         ((ENTRY) = exact_hash_next(HASH, &(CURSOR))) != NULL; )
+
+#endif /* EXACT_HASH_H */
@@ -34,6 +34,7 @@
 #include "dp_actions.h"
 #include "dp_capabilities.h"
 #include "dp_buffers.h"
+#include "dp_hw_stats.h"
 #include "flow_table.h"
 #include "flow_entry.h"
 #include "group_table.h"
@@ -93,12 +94,6 @@ struct meter_ref_entry {
     unsigned int      meter_id;
 };
 
-struct table_count
-{
-  unsigned long long int packet_count;
-  unsigned long long int byte_count;
-};
-
 /* get from openflow1.2 */
 typedef struct alta_table_desc
 {
@@ -160,6 +155,7 @@ struct logic_entry
     logic_action *action;       /* for fast forwarding in software layer */
     logic_portcfg config;       /* for vlan port management */
     void *data_type;
+    struct table_count hw_count;    /* counters last read from the hardware. */
 };
 
 
@@ -468,8 +464,10 @@ bool is_exact_flow_entry(struct flow_table *table,struct ofl_match  *match,
             return false;
         table->cur_index  = index;
 
-        if (cmd_type == OFPFC_ADD)
+        if (cmd_type == OFPFC_ADD && table->hash_match[index] != new_match) {
             table->hash_match[index] = new_match;
+            exact_key_plan_compile(&table->key_plan[index], new_match);
+        }
         return true;
     }
     else {
@@ -881,6 +879,9 @@ flow_entry_create(struct datapath *dp, struct flow_table *table, struct ofl_msg_
     entry->old_packet_count = 0;
     //entry->age_flag = false;
     entry->match = mod->match; /* TODO: MOD MATCH? */
+    entry->match_keyed = (mod->match->type == OFPMT_OXM) &&
+                         flow_key_from_match(&entry->match_key, &entry->match_mask,
+                                             (struct ofl_match *)mod->match);
     entry->key_len = 0;
     entry->created      = now;
     entry->remove_at    = mod->hard_timeout == 0 ? 0
@@ -888,10 +889,12 @@ flow_entry_create(struct datapath *dp, struct flow_table *table, struct ofl_msg_
     entry->last_used    = now;
     entry->read_hardware =  now;
     entry->send_removed = ((mod->flags & OFPFF_SEND_FLOW_REM) != 0);
-    entry->entry_timer = NULL;
     list_init(&entry->match_node);
-    list_init(&entry->idle_node);
-    list_init(&entry->hard_node);
+    list_init(&entry->tss_node);
+    entry->tss_rule = NULL;
+    entry->lpm_rule = NULL;
+    wheel_timer_init(&entry->idle_timer);
+    wheel_timer_init(&entry->hard_timer);
     list_init(&entry->o2l_head);
 
     entry->modify_time = now;
@@ -908,6 +911,7 @@ flow_entry_create(struct datapath *dp, struct flow_table *table, struct ofl_msg_
     init_meter_refs(entry);
 
     list_init(&entry->path_refs);
+    entry->hw_stats_round = 0;
 
     return entry;
 }
@@ -916,6 +920,11 @@ void
 flow_entry_destroy(struct flow_entry *entry) {
     // NOTE: This will be called when the group entry itself destroys the
     //       flow; but it won't be a problem.
+    tss_classifier_remove(entry);
+    timer_wheel_cancel(&entry->table->hard_timers, &entry->hard_timer);
+    timer_wheel_cancel(&entry->table->idle_timers, &entry->idle_timer);
+    entry->dp->flow_generation++;
+    dp_hw_stats_forget(entry->dp->hw_stats, entry);
     del_group_refs(entry);
     del_meter_refs(entry);
     ofl_structs_free_flow_stats(entry->stats, entry->dp->exp);
@@ -957,9 +966,8 @@ flow_entry_remove(struct flow_entry *entry, unsigned char reason) {
         }
     }
 
-    list_remove(&entry->match_node);
-    list_remove(&entry->hard_node);
-    list_remove(&entry->idle_node);
+    flow_table_cursors_skip(entry->table, entry, NULL);
+    flow_table_unlink(entry->table, entry);
     entry->table->stats->active_count--;
     flow_entry_destroy(entry);
 }
@@ -1027,49 +1035,39 @@ int flow_bucket_action_scan(struct ofl_bucket * bucket,
 
 void alta_logic_get_entry_count(struct flow_entry *entry,unsigned long long int *p_pkt_counter,unsigned long long int *p_byte_counter)
 {
-    unsigned int uiRet;
-    DPAL_MESSAGE_DATA_S stMSGData = {0};
     struct logic_entry *logic_entry;
-    //struct alta_table_class *logic_tabe_class = logic_class();
-    struct table_count  t_count;
     unsigned long long int  packet_count = 0;
     unsigned long long int byte_count = 0;
 
-    (void)p_byte_counter;
-    memset(&t_count,0,sizeof(struct table_count));
+    /* the counters cached by the hardware counter collector */
+    pthread_mutex_lock(&entry->dp->hw_count_mutex);
+    LIST_FOR_EACH(logic_entry,struct logic_entry,o2l_node[entry->stats->table_id],&entry->o2l_head)
+    {
+        packet_count += logic_entry->hw_count.packet_count;
+        byte_count += logic_entry->hw_count.byte_count;
+    }
+    pthread_mutex_unlock(&entry->dp->hw_count_mutex);
+
+    *p_pkt_counter = packet_count + entry->stats->ofp_packet_count;
+    *p_byte_counter = byte_count + entry->stats->ofp_byte_count;
+}
+
+void alta_logic_poll_entry_count(struct flow_entry *entry, struct dp_hw_stats *hs)
+{
+    unsigned int uiRet;
+    DPAL_MESSAGE_DATA_S stMSGData = {0};
+    struct logic_entry *logic_entry;
 
     LIST_FOR_EACH(logic_entry,struct logic_entry,o2l_node[entry->stats->table_id],&entry->o2l_head)
     {
-        //logic_tabe_class->count(0,0,logic_entry,&t_count);
         uiRet = DPAL_TranslatePkt(DPAL_MSG_TYPE_FLOWTABLE_STATISTCS, logic_entry, &stMSGData);
         if (uiRet)
         {
             VLOG_ERR(LOG_MODULE, "DPAL_TranslatePkt flow table statics failed!\n");
             continue;
         }
-
-        //ͱ
-        uiRet = Hybrid_Chatwith_V8_new(&stMSGData);
-        if (uiRet)
-        {
-            VLOG_ERR(LOG_MODULE, "alta logic get entry count, send to v8 failed!\n");
-            free(stMSGData.pData);
-            continue;
-        }
-
-        free(stMSGData.pData);
-
-        // ԺѯϢӦ
-        packet_count += t_count.packet_count;
-        byte_count += t_count.byte_count;
+        dp_hw_stats_add(hs, &stMSGData, entry, &logic_entry->hw_count);
     }
-
-    // ԺѯϢӦ
-    *p_pkt_counter = packet_count + entry->stats->ofp_packet_count;
-    *p_byte_counter = byte_count + entry->stats->ofp_byte_count;
-
-     return;
-
 }
 
 void alta_logic_set_entry_count(struct flow_entry *entry,unsigned long long int packet_count,unsigned long long int byte_count)
@@ -1139,16 +1137,17 @@ int alta_logic_entry_count(struct flow_entry *entry)
     unsigned long long int byte_count = 0;
     unsigned long long int ret_byte_count = 0;
 
+    pthread_mutex_lock(&entry->dp->hw_count_mutex);
     LIST_FOR_EACH(logic_entry,struct logic_entry,o2l_node[entry->stats->table_id],&entry->o2l_head)
     {
-        t_count.byte_count = 0;
-        t_count.packet_count = 0;
+        t_count = logic_entry->hw_count;
 
       // ע͵
       //  ret += logic_tabe_class->count(0,0,logic_entry,&t_count);
         packet_count += t_count.packet_count;
         byte_count += t_count.byte_count;
     }
+    pthread_mutex_unlock(&entry->dp->hw_count_mutex);
     if (!entry->no_pkt_count)
     {
         entry->stats->packet_count = entry->stats->ofp_packet_count + packet_count;
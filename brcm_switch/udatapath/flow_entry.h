@@ -42,6 +42,7 @@
 #include "timeval.h"
 
 #include "timer_wheel.h"
+#include "flow_key.h"
 /****************************************************************************
  * Implementation of a flow table entry.
  ****************************************************************************/
@@ -54,10 +55,12 @@ struct path_ref_entry
 };
 
 struct flow_entry {
-    struct hlist_node        hash_node;
     struct list              match_node;  /* list nodes in flow table lists. */
-    struct list              hard_node;
-    struct list              idle_node;
+    struct list              tss_node;    /* list node in the classifier rule. */
+    struct tss_rule         *tss_rule;    /* classifier rule holding the entry. */
+    struct lpm_rule         *lpm_rule;    /* or prefix trie rule. */
+    struct wheel_timer       hard_timer;  /* in table.hard_timers. */
+    struct wheel_timer       idle_timer;  /* in table.idle_timers. */
     //struct list              l2o_node[PATH_BRCM_MAX];    /* openflow to logic node */
     struct list              o2l_head;    /* openflow to logic head */
 
@@ -67,6 +70,9 @@ struct flow_entry {
     struct ofl_match_header *match; /* Original match structure is stored in stats;
                                        this one is a modified version, which reflects
                                        1.2 matching rules. */
+    struct flow_key          match_key;   /* match in flow key layout, */
+    struct flow_key          match_mask;  /* and its mask. */
+    bool                     match_keyed; /* true if the match fits the flow key. */
     unsigned long long int                 created;  /* time the entry was created at. */
     unsigned long long int                 remove_at; /* time the entry should be removed at
                                            due to its hard timeout. */
@@ -79,7 +85,6 @@ struct flow_entry {
     bool                     no_byt_count; /* true if doesn't keep track of flow matched bytes*/
     struct list              group_refs;  /* list of groups referencing the flow. */
     struct list              meter_refs;  /* list of meters referencing the flow. */
-    struct timer            *entry_timer;
 
     unsigned long long int                 modify_time;
     struct list              path_refs;
@@ -88,6 +93,13 @@ struct flow_entry {
     unsigned int                 hash;
     unsigned char                 *key;                        /*  ֽķʽmatch fields */
     int                      key_len;
+    unsigned char            hash_index;  /* exact hash holding the entry. */
+
+    /* counter queries of the logic entries in flight, see dp_hw_stats.h. */
+    unsigned long long int   hw_stats_round; /* sweep round they are in. */
+    unsigned int             hw_stats_frame; /* frame of the first one, */
+    unsigned int             hw_stats_query; /* its place in the frame, */
+    unsigned int             hw_stats_n;     /* and how many there are. */
 
     //unsigned long long int                old_byte_count;
     //unsigned long long int                cycle;
@@ -100,6 +112,7 @@ struct flow_entry {
 };
 
 struct packet;
+struct dp_hw_stats;
 
 enum E_DEL_REASON
 {
@@ -194,6 +207,9 @@ int flow_bucket_action_scan(struct ofl_bucket * bucket,
 int alta_logic_entry_remove(struct flow_entry *entry,enum E_DEL_REASON e_reason);
 void alta_logic_set_entry_count(struct flow_entry *entry,unsigned long long int packet_count,unsigned long long int byte_count);
 void alta_logic_get_entry_count(struct flow_entry *entry,unsigned long long int *p_pkt_counter,unsigned long long int *p_byte_counter);
+/* Adds the counter queries of the logic entries of the flow to a sweep of
+ * the hardware counter collector. */
+void alta_logic_poll_entry_count(struct flow_entry *entry, struct dp_hw_stats *hs);
 int alta_logic_entry_count(struct flow_entry *entry);
 
 bool flow_entry_instruction_equal(struct flow_entry *new_entry,struct flow_entry *old_entry);
@@ -58,18 +58,6 @@ void free_flow_key(unsigned char *ptr)
         free(ptr);
 }
 
-struct hlist_head *exact_flow_entry_pos(unsigned int hash,
-                                            struct flow_table *table)
-{
-    struct hlist_head *head = NULL;
-
-    hash = jhash_1word(hash, table->hash_seed[table->cur_index]);
-    head = &table->buckets[table->cur_index][hash % EXACT_FLOW_TABLE_MAX_ENTRIES_MODE];
-
-    VLOG_DBG(LOG_MODULE, "flow position hash:0x%x,index:%d \n",hash,(hash % EXACT_FLOW_TABLE_MAX_ENTRIES));
-    return head;
-}
-
 unsigned int exact_flow_entry_hash(unsigned char *dst,unsigned long long int tbl_match,
                                struct ofl_match *match,int *key_len)
 {
@@ -84,9 +72,14 @@ unsigned int exact_flow_entry_hash(unsigned char *dst,unsigned long long int tbl
     return hash;
 }
 
+void exact_flow_entry_unlink(struct flow_entry *entry)
+{
+    exact_hash_remove(&entry->table->exact[entry->hash_index], entry);
+}
+
 void exact_flow_entry_timeout(struct flow_entry *entry)
 {
-    hlist_del(&entry->hash_node);
+    exact_flow_entry_unlink(entry);
 }
 
 struct flow_entry *exact_flow_entry_lookup(struct flow_table *table,struct ofl_match  *match)
@@ -94,8 +87,6 @@ struct flow_entry *exact_flow_entry_lookup(struct flow_table *table,struct ofl_m
     unsigned char hash_index = 0;
     struct flow_entry *entry = NULL;
     unsigned int hash;
-    struct hlist_head *head = NULL;
-    struct hlist_node *n;
     unsigned char *flow_key;
     int key_len;
 
@@ -107,27 +98,15 @@ struct flow_entry *exact_flow_entry_lookup(struct flow_table *table,struct ofl_m
         hash = exact_flow_entry_hash(flow_key, table->hash_match[hash_index],
                                (struct ofl_match *)match, &key_len);
 
-        head = exact_flow_entry_pos(hash, table);
-        assert(head);
-
         if ( VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE)) {
             VLOG_DBG(LOG_MODULE, "tid:%d,h_index:%d,flow mod key: \n", table->stats->table_id, hash_index);
             ofp_hex_dump(stdout, flow_key, key_len, 0, false);
         }
 
-        hlist_for_each_entry(entry, n, head, hash_node)
+        entry = exact_hash_find(&table->exact[hash_index], hash, flow_key, key_len);
+        if (entry != NULL)
         {
-            if ((entry->hash == hash)
-                && (entry->key_len == key_len)
-                && !memcmp(entry->key, flow_key, key_len))
-            {
-                VLOG_DBG(LOG_MODULE, "exact table found a entry!\n");
-                break;
-            }
-            else
-            {
-                entry = NULL;
-            }
+            VLOG_DBG(LOG_MODULE, "exact table found a entry!\n");
         }
 
         free_flow_key(flow_key);
@@ -149,6 +128,7 @@ struct flow_entry *exact_flow_entry_create(struct datapath *dp,
     entry->key = xmalloc(key_len);
     memcpy(entry->key,key,key_len);
     entry->key_len = key_len;
+    entry->hash_index = table->cur_index;
     return entry;
 }
 
@@ -12,16 +12,14 @@
 #include "jhash.h"
 
 
-#define EXACT_FLOW_TABLE_MAX_ENTRIES 143360  //  140k
-#define EXACT_TABLE_CLASH_COUNT 40           // ͻ
-#define EXACT_FLOW_TABLE_MAX_ENTRIES_MODE  143357
+#define EXACT_FLOW_TABLE_MAX_ENTRIES (1 << 20)  //  1M
 
 void free_flow_key(unsigned char *ptr);
 unsigned char *malloc_flow_key(int len);
 
-struct hlist_head *exact_flow_entry_pos(unsigned int hash,struct flow_table *table);
 unsigned int exact_flow_entry_hash(unsigned char *dst,unsigned long long int tbl_match,
                                struct ofl_match *match,int *key_len);
+void exact_key_plan_compile(struct flow_key_plan *plan,unsigned long long int tbl_match);
 struct flow_entry *exact_flow_entry_lookup(struct flow_table *table,struct ofl_match  *match);
 bool exact_flow_entry_overlaps(struct flow_table *table, struct ofl_msg_flow_mod *mod);
 
@@ -33,6 +31,7 @@ struct flow_entry *exact_flow_entry_create(struct datapath *dp,
                                                  unsigned char *key,
                                                  int  key_len);
 void exact_flow_entry_timeout(struct flow_entry *entry);
+void exact_flow_entry_unlink(struct flow_entry *entry);
 
 #endif
 
@@ -0,0 +1,311 @@
+/* Fixed layout flow key of packets and flow entries. */
+
+#include <stdbool.h>
+#include <string.h>
+#include <netinet/in.h>
+#include "byte-order.h"
+#include "flow_key.h"
+#include "packets.h"
+#include "oflib/ofl-structs.h"
+#include "oflib/oxm-match.h"
+#include "openflow/openflow.h"
+
+#define FLOW_KEY_FIELD(FIELD, MEMBER) \
+    [FIELD] = { offsetof(struct flow_key_fields, MEMBER), \
+                sizeof(((struct flow_key_fields *)0)->MEMBER) }
+
+const struct flow_key_layout flow_key_layout[FLOW_KEY_FIELDS] = {
+    FLOW_KEY_FIELD(OFPXMT_OFB_IN_PORT,        in_port),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IN_PHY_PORT,    in_phy_port),
+    FLOW_KEY_FIELD(OFPXMT_OFB_METADATA,       metadata),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ETH_DST,        eth_dst),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ETH_SRC,        eth_src),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ETH_TYPE,       eth_type),
+    FLOW_KEY_FIELD(OFPXMT_OFB_VLAN_VID,       vlan_vid),
+    FLOW_KEY_FIELD(OFPXMT_OFB_VLAN_PCP,       vlan_pcp),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IP_DSCP,        ip_dscp),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IP_ECN,         ip_ecn),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IP_PROTO,       ip_proto),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV4_SRC,       ipv4_src),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV4_DST,       ipv4_dst),
+    FLOW_KEY_FIELD(OFPXMT_OFB_TCP_SRC,        tcp_src),
+    FLOW_KEY_FIELD(OFPXMT_OFB_TCP_DST,        tcp_dst),
+    FLOW_KEY_FIELD(OFPXMT_OFB_UDP_SRC,        udp_src),
+    FLOW_KEY_FIELD(OFPXMT_OFB_UDP_DST,        udp_dst),
+    FLOW_KEY_FIELD(OFPXMT_OFB_SCTP_SRC,       sctp_src),
+    FLOW_KEY_FIELD(OFPXMT_OFB_SCTP_DST,       sctp_dst),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ICMPV4_TYPE,    icmpv4_type),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ICMPV4_CODE,    icmpv4_code),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ARP_OP,         arp_op),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ARP_SPA,        arp_spa),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ARP_TPA,        arp_tpa),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ARP_SHA,        arp_sha),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ARP_THA,        arp_tha),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV6_SRC,       ipv6_src),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV6_DST,       ipv6_dst),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV6_FLABEL,    ipv6_flabel),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ICMPV6_TYPE,    icmpv6_type),
+    FLOW_KEY_FIELD(OFPXMT_OFB_ICMPV6_CODE,    icmpv6_code),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV6_ND_TARGET, ipv6_nd_target),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV6_ND_SLL,    ipv6_nd_sll),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV6_ND_TLL,    ipv6_nd_tll),
+    FLOW_KEY_FIELD(OFPXMT_OFB_MPLS_LABEL,     mpls_label),
+    FLOW_KEY_FIELD(OFPXMT_OFB_MPLS_TC,        mpls_tc),
+    FLOW_KEY_FIELD(OFPXMT_OFB_MPLS_BOS,       mpls_bos),
+    FLOW_KEY_FIELD(OFPXMT_OFB_PBB_ISID,       pbb_isid),
+    FLOW_KEY_FIELD(OFPXMT_OFB_TUNNEL_ID,      tunnel_id),
+    FLOW_KEY_FIELD(OFPXMT_OFB_IPV6_EXTHDR,    ipv6_exthdr),
+};
+
+static inline unsigned char *
+flow_key_slot(struct flow_key *key, unsigned int field)
+{
+    return (unsigned char *)key->w + flow_key_layout[field].offset;
+}
+
+void
+flow_key_init(struct flow_key *key)
+{
+    memset(key, 0, sizeof *key);
+}
+
+void
+flow_key_set(struct flow_key *key, unsigned int header, const void *value)
+{
+    unsigned int field = OXM_FIELD(header);
+
+    if (OXM_VENDOR(header) != OFPXMC_OPENFLOW_BASIC || field >= FLOW_KEY_FIELDS ||
+        flow_key_layout[field].len != OXM_LENGTH(header))
+    {
+        return;
+    }
+
+    memcpy(flow_key_slot(key, field), value, flow_key_layout[field].len);
+    key->present |= 1ULL << field;
+}
+
+unsigned char *
+flow_key_get(struct flow_key *key, unsigned int header)
+{
+    unsigned int field = OXM_FIELD(header);
+
+    if (OXM_VENDOR(header) != OFPXMC_OPENFLOW_BASIC || !flow_key_has(key, field))
+    {
+        return NULL;
+    }
+    return flow_key_slot(key, field);
+}
+
+unsigned int
+flow_key_length(const struct flow_key *key, unsigned int *n_fields)
+{
+    unsigned int field;
+    unsigned int len = 0;
+    unsigned int n = 0;
+
+    for (field = 0; field < FLOW_KEY_FIELDS; field++)
+    {
+        if (flow_key_has(key, field))
+        {
+            len += flow_key_layout[field].len;
+            n++;
+        }
+    }
+
+    if (n_fields != NULL)
+    {
+        *n_fields = n;
+    }
+    return len;
+}
+
+/* Converts a value of a flow entry match to packet byte order. oflib keeps
+ * the 16, 32 and 64-bit match values in host byte order, except the IPv4 and
+ * ARP protocol addresses and the metadata. */
+static void
+flow_key_match_value(unsigned int field, unsigned char len,
+                     const unsigned char *src, unsigned char *dst)
+{
+    switch (len)
+    {
+        case (sizeof(unsigned short int)):
+        {
+            unsigned short int v;
+
+            memcpy(&v, src, sizeof v);
+            v = htons(v);
+            memcpy(dst, &v, sizeof v);
+            break;
+        }
+        case (sizeof(unsigned int)):
+        {
+            unsigned int v;
+
+            memcpy(&v, src, sizeof v);
+            if (field != OFPXMT_OFB_IPV4_SRC && field != OFPXMT_OFB_IPV4_DST &&
+                field != OFPXMT_OFB_ARP_SPA && field != OFPXMT_OFB_ARP_TPA)
+            {
+                v = htonl(v);
+            }
+            memcpy(dst, &v, sizeof v);
+            break;
+        }
+        case (sizeof(unsigned long long int)):
+        {
+            unsigned long long int v;
+
+            memcpy(&v, src, sizeof v);
+            /* metadata in host byte order */
+            if (field != OFPXMT_OFB_METADATA)
+            {
+                v = htonll(v);
+            }
+            memcpy(dst, &v, sizeof v);
+            break;
+        }
+        default:
+        {
+            memcpy(dst, src, len);
+            break;
+        }
+    }
+}
+
+bool
+flow_key_from_match(struct flow_key *key, struct flow_key *mask, struct ofl_match *match)
+{
+    struct ofl_match_tlv *f;
+    size_t i;
+
+    flow_key_init(key);
+    flow_key_init(mask);
+
+    HMAP_FOR_EACH(f, struct ofl_match_tlv, hmap_node, &match->match_fields)
+    {
+        unsigned int field = OXM_FIELD(f->header);
+        bool has_mask = OXM_HASMASK(f->header);
+        unsigned char len = has_mask ? OXM_LENGTH(f->header) / 2 : OXM_LENGTH(f->header);
+        unsigned char *value, *m;
+
+        if (OXM_VENDOR(f->header) != OFPXMC_OPENFLOW_BASIC ||
+            field >= FLOW_KEY_FIELDS || flow_key_layout[field].len != len)
+        {
+            return false;
+        }
+
+        value = flow_key_slot(key, field);
+        m = flow_key_slot(mask, field);
+        flow_key_match_value(field, len, f->value, value);
+        if (has_mask)
+        {
+            flow_key_match_value(field, len, f->value + len, m);
+        }
+        else
+        {
+            memset(m, 0xff, len);
+        }
+        key->present |= 1ULL << field;
+        mask->present |= 1ULL << field;
+
+        if (field == OFPXMT_OFB_VLAN_VID)
+        {
+            unsigned short int *vid = (unsigned short int *)value;
+            unsigned short int *vid_mask = (unsigned short int *)m;
+
+            /* OFPVID_NONE matches untagged packets, whose key holds a zero
+             * VLAN id; any other value only matches tagged packets. */
+            if (*vid == htons(OFPVID_NONE))
+            {
+                mask->present &= ~(1ULL << field);
+            }
+            else
+            {
+                *vid |= htons(OFPVID_PRESENT);
+            }
+            *vid_mask |= htons(OFPVID_PRESENT);
+        }
+    }
+
+    for (i = 0; i < FLOW_KEY_WORDS; i++)
+    {
+        key->w[i] &= mask->w[i];
+    }
+    return true;
+}
+
+void
+flow_key_to_ofl_match(struct flow_key *key, struct ofl_match *match)
+{
+    unsigned int field;
+
+    for (field = 0; field < FLOW_KEY_FIELDS; field++)
+    {
+        unsigned char len = flow_key_layout[field].len;
+        unsigned int header = OXM_HEADER(OFPXMC_OPENFLOW_BASIC, field, len);
+        unsigned char *value = flow_key_slot(key, field);
+
+        if (!flow_key_has(key, field))
+        {
+            continue;
+        }
+
+        switch (len)
+        {
+            case (sizeof(unsigned char)):
+            {
+                ofl_structs_match_put8(match, header, *value);
+                break;
+            }
+            case (sizeof(unsigned short int)):
+            {
+                ofl_structs_match_put16(match, header, *(unsigned short int *)value);
+                break;
+            }
+            case (sizeof(unsigned int)):
+            {
+                ofl_structs_match_put32(match, header, *(unsigned int *)value);
+                break;
+            }
+            case (ETH_ADDR_LEN):
+            {
+                ofl_structs_match_put_eth(match, header, value);
+                break;
+            }
+            case (sizeof(unsigned long long int)):
+            {
+                ofl_structs_match_put64(match, header, *(unsigned long long int *)value);
+                break;
+            }
+            case (IPv6_ADDR_LEN):
+            {
+                ofl_structs_match_put_ipv6(match, header, value);
+                break;
+            }
+        }
+    }
+}
+
+size_t
+flow_key_put_oxm(struct flow_key *key, unsigned char *oxm_fields)
+{
+    unsigned char *p = oxm_fields;
+    unsigned int field;
+
+    for (field = 0; field < FLOW_KEY_FIELDS; field++)
+    {
+        unsigned char len = flow_key_layout[field].len;
+        unsigned int oxm_header;
+
+        if (!flow_key_has(key, field))
+        {
+            continue;
+        }
+
+        oxm_header = htonl(OXM_HEADER(OFPXMC_OPENFLOW_BASIC, field, len));
+        memcpy(p, &oxm_header, sizeof oxm_header);
+        p += sizeof oxm_header;
+        memcpy(p, flow_key_slot(key, field), len);
+        p += len;
+    }
+    return p - oxm_fields;
+}
@@ -0,0 +1,188 @@
+#ifndef FLOW_KEY_H
+#define FLOW_KEY_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/****************************************************************************
+ * Fixed layout flow key. Every OXM basic field has a fixed place in the key
+ * and a bitmap records the fields that are present. A packet fills its key
+ * in one pass while it is parsed. Flow entries carry a key and a mask with
+ * the same layout, so matching a packet is a masked compare of 64-bit words.
+ *
+ * Values are kept in the byte order of the packet fields: network byte
+ * order, except the metadata which is in host byte order.
+ ****************************************************************************/
+
+#define FLOW_KEY_FIELDS  40    /* OXM_FIELD() of the OpenFlow basic class. */
+
+struct ofl_match;
+
+struct flow_key_fields {
+    unsigned long long int   metadata;
+    unsigned long long int   tunnel_id;
+    unsigned char            ipv6_src[16];
+    unsigned char            ipv6_dst[16];
+    unsigned char            ipv6_nd_target[16];
+    unsigned int             in_port;
+    unsigned int             in_phy_port;
+    unsigned int             ipv4_src;
+    unsigned int             ipv4_dst;
+    unsigned int             arp_spa;
+    unsigned int             arp_tpa;
+    unsigned int             ipv6_flabel;
+    unsigned int             mpls_label;
+    unsigned int             pbb_isid;
+    unsigned char            eth_dst[6];
+    unsigned char            eth_src[6];
+    unsigned char            arp_sha[6];
+    unsigned char            arp_tha[6];
+    unsigned char            ipv6_nd_sll[6];
+    unsigned char            ipv6_nd_tll[6];
+    unsigned short int       eth_type;
+    unsigned short int       vlan_vid;
+    unsigned short int       tcp_src;
+    unsigned short int       tcp_dst;
+    unsigned short int       udp_src;
+    unsigned short int       udp_dst;
+    unsigned short int       sctp_src;
+    unsigned short int       sctp_dst;
+    unsigned short int       arp_op;
+    unsigned short int       ipv6_exthdr;
+    unsigned char            vlan_pcp;
+    unsigned char            ip_dscp;
+    unsigned char            ip_ecn;
+    unsigned char            ip_proto;
+    unsigned char            icmpv4_type;
+    unsigned char            icmpv4_code;
+    unsigned char            icmpv6_type;
+    unsigned char            icmpv6_code;
+    unsigned char            mpls_tc;
+    unsigned char            mpls_bos;
+};
+
+#define FLOW_KEY_WORDS (sizeof(struct flow_key_fields) / sizeof(unsigned long long int))
+
+struct flow_key {
+    unsigned long long int   present;   /* bitmap of the OXM_FIELD()s set. */
+    union {
+        struct flow_key_fields  f;
+        unsigned long long int  w[FLOW_KEY_WORDS];
+    };
+};
+
+/* Place of an OXM field in the key, relative to flow_key.w. len is 0 for
+ * fields the key does not hold. */
+struct flow_key_layout {
+    unsigned short int       offset;
+    unsigned char            len;
+};
+
+extern const struct flow_key_layout flow_key_layout[FLOW_KEY_FIELDS];
+
+static inline bool
+flow_key_has(const struct flow_key *key, unsigned int field)
+{
+    return field < FLOW_KEY_FIELDS && (key->present & (1ULL << field)) != 0;
+}
+
+/* Clears the key. */
+void
+flow_key_init(struct flow_key *key);
+
+/* Stores the value of an OXM field, given in packet byte order. */
+void
+flow_key_set(struct flow_key *key, unsigned int header, const void *value);
+
+/* Returns the value of an OXM field, or NULL if it is not present. */
+unsigned char *
+flow_key_get(struct flow_key *key, unsigned int header);
+
+/* Returns the total length of the present field values, and stores the
+ * number of present fields in n_fields if it is not NULL. */
+unsigned int
+flow_key_length(const struct flow_key *key, unsigned int *n_fields);
+
+/* Builds the key and the mask of a flow entry match. The fields required to
+ * be in the packet are set in mask->present. Returns false if the match
+ * holds fields the key cannot represent. */
+bool
+flow_key_from_match(struct flow_key *key, struct flow_key *mask, struct ofl_match *match);
+
+/* Returns true if the packet key matches the flow key under the mask. */
+static inline bool
+flow_key_match(const struct flow_key *pkt, const struct flow_key *key,
+               const struct flow_key *mask)
+{
+    size_t i;
+
+    if ((pkt->present & mask->present) != mask->present)
+    {
+        return false;
+    }
+    for (i = 0; i < FLOW_KEY_WORDS; i++)
+    {
+        if ((pkt->w[i] ^ key->w[i]) & mask->w[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* A precompiled list of key fields, gathered back to back into a flat buffer
+ * that is zero padded to a multiple of 4 bytes. */
+#define FLOW_KEY_PLAN_MAX_LEN  (sizeof(struct flow_key_fields) + sizeof(unsigned int))
+
+struct flow_key_plan_step {
+    unsigned short int       offset;    /* place in flow_key.w. */
+    unsigned char            len;
+};
+
+struct flow_key_plan {
+    unsigned long long int   required;  /* fields the key must hold. */
+    unsigned char            n_steps;
+    unsigned short int       key_len;   /* gathered length, rounded up. */
+    struct flow_key_plan_step steps[FLOW_KEY_FIELDS];
+    struct flow_key          mask;      /* all ones over the gathered fields. */
+};
+
+/* Gathers the fields of the plan from the key into dst, which must hold
+ * FLOW_KEY_PLAN_MAX_LEN bytes. Absent optional fields are gathered as zeros.
+ * Returns the key length, or -1 if a required field is missing. */
+static inline int
+flow_key_plan_extract(const struct flow_key_plan *plan, const struct flow_key *key,
+                      unsigned char *dst)
+{
+    const unsigned char *src = (const unsigned char *)key->w;
+    unsigned char *p = dst;
+    unsigned char i;
+
+    if ((key->present & plan->required) != plan->required)
+    {
+        return -1;
+    }
+
+    if (plan->key_len > 0)
+    {
+        memset(dst + plan->key_len - sizeof(unsigned int), 0, sizeof(unsigned int));
+    }
+    for (i = 0; i < plan->n_steps; i++)
+    {
+        memcpy(p, src + plan->steps[i].offset, plan->steps[i].len);
+        p += plan->steps[i].len;
+    }
+    return plan->key_len;
+}
+
+/* Adds the present fields of the key to an ofl_match. */
+void
+flow_key_to_ofl_match(struct flow_key *key, struct ofl_match *match);
+
+/* Writes the present fields of the key as OXM TLVs to oxm_fields. Returns the
+ * number of bytes written. */
+size_t
+flow_key_put_oxm(struct flow_key *key, unsigned char *oxm_fields);
+
+#endif /* FLOW_KEY_H */
@@ -41,14 +41,13 @@
 #include "oflib/ofl-print.h"
 #include "time.h"
 #include "dp_capabilities.h"
+#include "hash.h"
 #include "table_miss.h"
 //#include "packet_handle_std.h"
 #include "timer_wheel.h"
 #include "vlog.h"
 #define LOG_MODULE VLM_flow_t
 
-static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
-
 /*unsigned int  oxm_ids[]={OXM_OF_IN_PORT,OXM_OF_IN_PHY_PORT,OXM_OF_METADATA,OXM_OF_ETH_DST,
                         OXM_OF_ETH_SRC,OXM_OF_ETH_TYPE, OXM_OF_VLAN_VID, OXM_OF_VLAN_PCP, OXM_OF_IP_DSCP,
                         OXM_OF_IP_ECN, OXM_OF_IP_PROTO, OXM_OF_IPV4_SRC, OXM_OF_IPV4_DST, OXM_OF_TCP_SRC,
@@ -104,49 +103,138 @@ struct ofl_action_header actions[] = { {OFPAT_OUTPUT, 4},
                             {OFPAT_POP_MPLS, 4},{OFPAT_SET_QUEUE, 4}, {OFPAT_GROUP, 4}, {OFPAT_SET_NW_TTL, 4},
                                 {OFPAT_DEC_NW_TTL, 4},{OFPAT_SET_FIELD, 4} } ;
 
-/* When inserting an entry, this function adds the flow entry to the list of
- * hard and idle timeout entries, if appropriate. */
+/* Returns the time after which an entry not used since last_used is idle,
+ * as checked by flow_entry_idle_timeout(). */
+static long long int
+idle_timer_deadline(struct flow_entry *entry) {
+    unsigned int idle_timeout = entry->stats->idle_timeout;
+
+    return entry->last_used + 1
+           + (idle_timeout > 1 ? idle_timeout - 1 : idle_timeout) * 1000;
+}
+
+/* When inserting an entry, this function arms the hard and idle timers of
+ * the flow entry, if appropriate. */
 void
-add_to_timeout_lists(struct flow_table *table, struct flow_entry *entry) {
+add_to_timeout_wheels(struct flow_table *table, struct flow_entry *entry) {
     if (entry->stats->idle_timeout > 0) {
-        list_insert(&table->idle_entries, &entry->idle_node);
+        timer_wheel_add(&table->idle_timers, &entry->idle_timer,
+                        idle_timer_deadline(entry));
     }
 
     if (entry->remove_at > 0) {
-        struct flow_entry *e;
+        timer_wheel_add(&table->hard_timers, &entry->hard_timer,
+                        entry->remove_at + 1);
+    }
+}
 
-        /* hard timeout entries are ordered by the time they should be removed at. */
-        LIST_FOR_EACH (e, struct flow_entry, hard_node, &table->hard_entries) {
-            if (e->remove_at > entry->remove_at) {
-                list_insert(&e->hard_node, &entry->hard_node);
-                return;
-            }
+static struct flow_priority *
+flow_priority_find(const struct flow_table *table, unsigned short int priority)
+{
+    struct flow_priority *p;
+
+    HMAP_FOR_EACH_WITH_HASH (p, struct flow_priority, node, hash_int(priority, 0),
+                             &table->priorities)
+    {
+        if (p->priority == priority)
+        {
+            return p;
         }
-        list_insert(&e->hard_node, &entry->hard_node);
     }
+    return NULL;
 }
 
-static ofl_err
-flow_table_priority(struct flow_table *table, struct ofl_msg_flow_mod *mod)
+/* Puts a new wildcard entry in the match entries, behind those with equal
+ * priority. */
+static void
+flow_table_link(struct flow_table *table, struct flow_entry *entry)
 {
-    struct flow_entry *entry = NULL, *ret_entry = NULL;
+    unsigned short int priority = entry->stats->priority;
+    struct flow_priority *p = flow_priority_find(table, priority);
+    struct list *before;
 
-    LIST_FOR_EACH (entry, struct flow_entry, match_node, &table->match_entries)
+    if (p == NULL)
     {
-        if (match_std_strict((struct ofl_match *)mod->match,
-                                (struct ofl_match *)entry->stats->match))
+        struct flow_priority *iter;
+
+        p = xmalloc(sizeof *p);
+        p->priority = priority;
+        hmap_insert(&table->priorities, &p->node, hash_int(priority, 0));
+        LIST_FOR_EACH (iter, struct flow_priority, list_node, &table->priority_list)
         {
-            //flow_entry_print(entry, stdout);
-            VLOG_DBG(LOG_MODULE, "entry priority:%d,mod priority:%d\n", entry->stats->priority, mod->priority);
-            if (entry->stats->priority < mod->priority) {
-               ret_entry = entry;
-               break;
+            if (priority > iter->priority)
+            {
+                break;
             }
         }
+        list_insert(&iter->list_node, &p->list_node);
+
+        /* behind the entries of the next higher priority, if any */
+        if (p->list_node.prev == &table->priority_list)
+        {
+            before = table->match_entries.next;
+        }
+        else
+        {
+            iter = CONTAINER_OF(p->list_node.prev, struct flow_priority, list_node);
+            before = iter->last->match_node.next;
+        }
+    }
+    else
+    {
+        before = p->last->match_node.next;
     }
 
-    if (ret_entry != NULL)
+    list_insert(before, &entry->match_node);
+    p->last = entry;
+}
+
+void
+flow_table_unlink(struct flow_table *table, struct flow_entry *entry)
+{
+    struct flow_priority *p = flow_priority_find(table, entry->stats->priority);
+
+    /* the entries of the exact and miss tables are not indexed, and never
+     * the last of a priority */
+    if (p != NULL && p->last == entry)
+    {
+        struct list *prev = entry->match_node.prev;
+        struct flow_entry *prev_entry = CONTAINER_OF(prev, struct flow_entry, match_node);
+
+        if (prev != &table->match_entries && prev_entry->stats->priority == p->priority)
+        {
+            p->last = prev_entry;
+        }
+        else
+        {
+            hmap_remove(&table->priorities, &p->node);
+            list_remove(&p->list_node);
+            free(p);
+        }
+    }
+    list_remove(&entry->match_node);
+}
+
+/* Removes from the hardware the entry with the same match as a newly added
+ * one and the next lower priority. */
+static ofl_err
+flow_table_priority(struct flow_table *table, struct ofl_msg_flow_mod *mod,
+                    const struct flow_key *key, const struct flow_key *mask)
+{
+    struct flow_entry *ret_entry = NULL;
+
+    if (mod->priority > 0)
+    {
+        ret_entry = tss_classifier_find(&table->classifier, key, mask, mod->priority - 1);
+    }
+
+    if (ret_entry != NULL &&
+        match_std_strict((struct ofl_match *)mod->match,
+                         (struct ofl_match *)ret_entry->stats->match))
+    {
+        VLOG_DBG(LOG_MODULE, "entry priority:%d,mod priority:%d\n", ret_entry->stats->priority, mod->priority);
         alta_logic_entry_remove(ret_entry,FLOW_DELETE);
+    }
 
     return 0;
 }
@@ -156,18 +244,32 @@ static ofl_err
 flow_table_add(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool check_overlap, bool *match_kept, bool *insts_kept) {
     // Note: new entries will be placed behind those with equal priority
     struct flow_entry *entry, *new_entry;
-    if (table->stats->active_count >= table->dp->flow_table_max_entries)
+    struct flow_priority *p;
+    struct flow_key key, mask;
+
+    /* The classifier cannot index a match that does not fit the flow key,
+     * and lookups would never find the entry. */
+    if (mod->match->type != OFPMT_OXM ||
+        !flow_key_from_match(&key, &mask, (struct ofl_match *)mod->match))
     {
-        return ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_TABLE_FULL);
+        return ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_UNKNOWN);
     }
-    LIST_FOR_EACH (entry, struct flow_entry, match_node, &table->match_entries)
+
+    if (check_overlap)
     {
-        if (check_overlap && flow_entry_overlaps(entry, mod)) {
-            return ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_OVERLAP);
+        LIST_FOR_EACH (entry, struct flow_entry, match_node, &table->match_entries)
+        {
+            if (flow_entry_overlaps(entry, mod)) {
+                return ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_OVERLAP);
+            }
         }
+    }
 
-        /* if the entry equals, replace the old one */
-        // modified , according to ofp1.3.2 p 66, cookie is not checked in flow entry adding;
+    /* if the entry equals, replace the old one */
+    // modified , according to ofp1.3.2 p 66, cookie is not checked in flow entry adding;
+    entry = tss_classifier_find(&table->classifier, &key, &mask, mod->priority);
+    if (entry != NULL)
+    {
         if (flow_entry_matches(entry, mod, true/*strict*/, false/*check_cookie*/) )
         {
             new_entry = flow_entry_create(table->dp, table, mod);
@@ -186,9 +288,14 @@ flow_table_add(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool chec
             new_entry->flow_id = table->dp->enty_xid;
 
             /* NOTE: no flow removed message should be generated according to spec. */
+            flow_table_cursors_skip(table, entry, new_entry);
             list_replace(&new_entry->match_node, &entry->match_node);
-            list_remove(&entry->hard_node);
-            list_remove(&entry->idle_node);
+            p = flow_priority_find(table, mod->priority);
+            if (p->last == entry)
+            {
+                p->last = new_entry;
+            }
+            tss_classifier_replace(entry, new_entry);
 
             //del_entry_form_timer(entry);
 
@@ -197,17 +304,18 @@ flow_table_add(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool chec
 
 
             flow_entry_destroy(entry);
-            add_to_timeout_lists(table, new_entry);
+            add_to_timeout_wheels(table, new_entry);
             return 0;
         }
-
-
-        if (mod->priority > entry->stats->priority)
-        {
-            break;
-        }
     }
 
+    /* the entries of the prefix tries have a limit of their own */
+    if (!tss_classifier_lpm_fits(&table->classifier, &key, &mask, mod->priority) &&
+        table->stats->active_count - tss_classifier_lpm_entries(&table->classifier)
+        >= table->dp->flow_table_max_entries)
+    {
+        return ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_TABLE_FULL);
+    }
 
     table->stats->active_count++;
     table->dp->enty_xid ++;
@@ -217,8 +325,9 @@ flow_table_add(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool chec
     *match_kept = true;
     *insts_kept = true;
 
-    list_insert(&entry->match_node, &new_entry->match_node);
-    add_to_timeout_lists(table, new_entry);
+    flow_table_link(table, new_entry);
+    tss_classifier_insert(&table->classifier, new_entry);
+    add_to_timeout_wheels(table, new_entry);
 
     if (VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE))
     {
@@ -231,7 +340,7 @@ flow_table_add(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool chec
         }
     }
 
-    flow_table_priority(table, mod);
+    flow_table_priority(table, mod, &key, &mask);
 
     return 0;
 }
@@ -291,8 +400,6 @@ flow_table_modify(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool s
             }
             *insts_kept = false;
             alta_logic_entry_remove(entry,FLOW_MODIFY);
-            list_remove(&entry->idle_node);
-            list_init(&entry->idle_node);
         }
     }
 
@@ -405,122 +512,106 @@ flow_table_flow_mod(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool
     return ret;
 }
 
-static struct flow_entry *wildcard_flow_table_lookup(struct flow_table *table, struct packet *pkt)
+static struct flow_entry *wildcard_flow_table_lookup(struct flow_table *table, struct packet *pkt,
+                                                     struct flow_key *wc)
 {
-    struct flow_entry *entry;
     struct flow_entry *ret_entry = NULL;
-    unsigned short int priority = 0;
 
-    table->ofp_lookup_count++;
+    /* the workers look up and count concurrently */
+    __sync_fetch_and_add(&table->ofp_lookup_count, 1);
 
-    LIST_FOR_EACH(entry, struct flow_entry, match_node, &table->match_entries) {
-        struct ofl_match_header *m;
-
-        m = entry->match == NULL ? entry->stats->match : entry->match;
-
-        /* select appropriate handler, based on match type of flow entry. */
-        switch (m->type)
+    if (!pkt->handle_std->valid)
+    {
+        packet_handle_std_validate(pkt->handle_std);
+        if (!pkt->handle_std->valid)
         {
-            case (OFPMT_OXM):
-            {
-               if (packet_handle_std_match(pkt->handle_std,(struct ofl_match *)m))
-               {
-                    if (entry->stats->priority >= priority)
-                    {
-                        ret_entry = entry;
-                    }
-
-                    priority = entry->stats->priority;
-                }
-                break;
-            }
-            default:
-            {
-                VLOG_WARN_RL(LOG_MODULE, &rl, "Trying to process flow entry with unknown match type (%u).", m->type);
-            }
+            return NULL;
         }
     }
 
+    ret_entry = tss_classifier_lookup(&table->classifier, &pkt->handle_std->key, wc);
+
     if (ret_entry) {
         if (!ret_entry->no_byt_count)
-            ret_entry->stats->ofp_byte_count += pkt->buffer->size;
+            __sync_fetch_and_add(&ret_entry->stats->ofp_byte_count, pkt->buffer->size);
         if (!ret_entry->no_pkt_count)
-            ret_entry->stats->ofp_packet_count++;
+            __sync_fetch_and_add(&ret_entry->stats->ofp_packet_count, 1);
 
         ret_entry->last_used = time_now_msec();
 
-        table->ofp_matched_count ++;
+        __sync_fetch_and_add(&table->ofp_matched_count, 1);
     }
     return ret_entry;
 }
 
-struct flow_entry *flow_table_lookup(struct flow_table *table, struct packet *pkt)
+struct flow_entry *flow_table_lookup_wc(struct flow_table *table, struct packet *pkt,
+                                        struct flow_key *wc)
 {
     struct flow_entry *entry = NULL;
     if(table->dp->use_exact_table == true)
     {
-        entry = exact_flow_table_lookup(table,pkt);
+        entry = exact_flow_table_lookup(table,pkt,wc);
         if (entry == NULL ) {
-            entry = wildcard_flow_table_lookup(table,pkt);
+            entry = wildcard_flow_table_lookup(table,pkt,wc);
         }
     }
     else
     {
-    entry = wildcard_flow_table_lookup(table,pkt);
+    entry = wildcard_flow_table_lookup(table,pkt,wc);
     }
     return entry;
 }
 
+struct flow_entry *flow_table_lookup(struct flow_table *table, struct packet *pkt)
+{
+    return flow_table_lookup_wc(table, pkt, NULL);
+}
+
+void flow_table_count_hit(struct flow_table *table, struct packet *pkt, struct flow_entry *entry)
+{
+    __sync_fetch_and_add(&table->ofp_lookup_count, 1);
+
+    if (!entry->no_byt_count)
+        __sync_fetch_and_add(&entry->stats->ofp_byte_count, pkt->buffer->size);
+    if (!entry->no_pkt_count)
+        __sync_fetch_and_add(&entry->stats->ofp_packet_count, 1);
+
+    entry->last_used = time_now_msec();
+
+    __sync_fetch_and_add(&table->ofp_matched_count, 1);
+}
+
 
 
 void
 flow_table_timeout(struct flow_table *table) {
-    struct flow_entry *entry, *next;
-    unsigned int i = 0;
-    unsigned int j = 0;
-    //bool need_timeout = false;
-    unsigned int start_entry = table->timeout_entries.start_entry;
-
-#if 1
-    /* NOTE: hard timeout entries are ordered by the time they should be removed at,
-     * so if one is not removed, the rest will not be either. */
-    LIST_FOR_EACH_SAFE (entry, next, struct flow_entry, hard_node, &table->hard_entries) {
+    long long int now = time_now_msec();
+    struct wheel_timer *timer;
+
+    while ((timer = timer_wheel_expire(&table->hard_timers, now)) != NULL) {
+        struct flow_entry *entry = CONTAINER_OF(timer, struct flow_entry, hard_timer);
+
         if (!flow_entry_hard_timeout(entry)) {
-            break;
-        } else {
-            j ++;
-            if(j > NUM_TIMEOUT_ONTIME)
-            {
-                /* 500ȴһϻ */
-                table->timeout_entries.need_timeout = true;
-                return;
-            }
+            timer_wheel_add(&table->hard_timers, timer, MAX(entry->remove_at + 1, now + 1));
         }
     }
 
-    LIST_FOR_EACH_SAFE (entry, next, struct flow_entry, idle_node, &table->idle_entries) {
-        if(i < start_entry)
-        {
-            i++;
-        }
-        else
-        {
-            j++;
-            table->timeout_entries.start_entry ++;
-            flow_entry_idle_timeout(entry);
-            if(j > NUM_TIMEOUT_ONTIME)
-            {
-                /* 500ȴһϻ */
-                table->timeout_entries.need_timeout = true;
-                return;
-            }
+    /* Idle timers are only re-armed when they run out: an entry used
+     * meanwhile moves its deadline on from last_used. */
+    while ((timer = timer_wheel_expire(&table->idle_timers, now)) != NULL) {
+        struct flow_entry *entry = CONTAINER_OF(timer, struct flow_entry, idle_timer);
+
+        if (!flow_entry_idle_timeout(entry)) {
+            timer_wheel_add(&table->idle_timers, timer,
+                            MAX(idle_timer_deadline(entry), now + IDLE_TIMEOUT_RECHECK_MS));
         }
     }
-    /* ȫentry󣬱Ǹtableϻɣstart entry */
-    table->timeout_entries.need_timeout = false;
-    table->timeout_entries.start_entry = 0;
-#endif
+}
 
+long long int
+flow_table_next_timeout(const struct flow_table *table) {
+    return MIN(timer_wheel_next(&table->hard_timers),
+               timer_wheel_next(&table->idle_timers));
 }
 
 
@@ -662,7 +753,7 @@ flow_table_features(struct flow_table *table)
 struct flow_table *
 flow_table_create(struct datapath *dp, unsigned char table_id)
 {
-    int i,j;
+    int j;
     struct flow_table *table;
     struct ds string = DS_EMPTY_INITIALIZER;
 
@@ -692,8 +783,12 @@ flow_table_create(struct datapath *dp, unsigned char table_id)
 
 
     list_init(&table->match_entries);
-    list_init(&table->hard_entries);
-    list_init(&table->idle_entries);
+    list_init(&table->cursors);
+    hmap_init(&table->priorities);
+    list_init(&table->priority_list);
+    tss_classifier_init(&table->classifier);
+    timer_wheel_init(&table->hard_timers, time_now_msec());
+    timer_wheel_init(&table->idle_timers, time_now_msec());
 
     if(dp->flow_table_type == AFTT_FULL_WILDCARD)
     {
@@ -709,84 +804,104 @@ flow_table_create(struct datapath *dp, unsigned char table_id)
     //ȷϣͨڴ
     if (table->wildcards == EXACT_TABLE)
     {
-        table->features->max_entries = dp->flow_table_max_entries;
-        table->buckets[0] = xmalloc(sizeof(struct hlist_head *) * EXACT_FLOW_TABLE_MAX_ENTRIES);
-        for (i = 0; i < EXACT_FLOW_TABLE_MAX_ENTRIES; i++)
-        {
-            INIT_HLIST_HEAD(&table->buckets[0][i]);
-        }
+        table->features->max_entries = EXACT_FLOW_TABLE_MAX_ENTRIES;
     }
     else
     {
-         table->features->max_entries = dp->flow_table_max_entries;
-
-         for (j = 0; j < MAX_HASH_BUCKETS_NUM; j++)
-         {
-             table->buckets[j] = xmalloc(sizeof(struct hlist_head *) * EXACT_FLOW_TABLE_MAX_ENTRIES);
-             for (i = 0; i < EXACT_FLOW_TABLE_MAX_ENTRIES; i++)
-             {
-                 INIT_HLIST_HEAD(&table->buckets[j][i]);
-             }
-             table->hash_seed[j] = random_uint32();
-         }
+        table->features->max_entries = dp->flow_table_max_entries;
+    }
+
+    for (j = 0; j < MAX_HASH_BUCKETS_NUM; j++)
+    {
+        table->hash_match[j] = 0;
+        exact_hash_init(&table->exact[j], random_uint32(), EXACT_FLOW_TABLE_MAX_ENTRIES);
     }
     flow_table_features(table);
-    table->timeout_entries.need_timeout = true;
-    table->timeout_entries.start_entry = 0;
     return table;
 }
 
 void
 flow_table_destroy(struct flow_table *table) {
     struct flow_entry *entry, *next;
+    struct flow_priority *p, *pnext;
+    int i;
 
     LIST_FOR_EACH_SAFE (entry, next, struct flow_entry, match_node, &table->match_entries) {
         alta_logic_entry_remove(entry,FLOW_DESTROY); 
   //      del_entry_form_timer(entry); //
         flow_entry_destroy(entry);
     }
+    HMAP_FOR_EACH_SAFE (p, pnext, struct flow_priority, node, &table->priorities) {
+        hmap_remove(&table->priorities, &p->node);
+        free(p);
+    }
+    hmap_destroy(&table->priorities);
+    tss_classifier_destroy(&table->classifier);
+    for (i = 0; i < MAX_HASH_BUCKETS_NUM; i++)
+    {
+        exact_hash_destroy(&table->exact[i]);
+    }
     free(table->features);
     free(table->stats);
     free(table);
 }
 
-static void
-wildcard_flow_table_stats(struct flow_table *table, struct ofl_msg_multipart_request_flow *msg,
-                 struct ofl_flow_stats ***stats, size_t *stats_size, size_t *stats_num) {
-    struct flow_entry *entry;
+bool
+flow_table_stats_match(struct flow_entry *entry, struct ofl_msg_multipart_request_flow *msg)
+{
+    return (msg->out_port == OFPP_ANY || flow_entry_has_out_port(entry, msg->out_port)) &&
+           (msg->out_group == OFPG_ANY || flow_entry_has_out_group(entry, msg->out_group)) &&
+           match_std_nonstrict((struct ofl_match *)msg->match,
+                               (struct ofl_match *)entry->stats->match) &&
+           ((entry->stats->cookie & msg->cookie_mask) == (msg->cookie & msg->cookie_mask));
+}
 
-    LIST_FOR_EACH(entry, struct flow_entry, match_node, &table->match_entries) {
-        if ((msg->out_port == OFPP_ANY || flow_entry_has_out_port(entry, msg->out_port)) &&
-            (msg->out_group == OFPG_ANY || flow_entry_has_out_group(entry, msg->out_group)) &&
-            match_std_nonstrict((struct ofl_match *)msg->match,
-                                (struct ofl_match *)entry->stats->match)&&
-                                ((entry->stats->cookie & msg->cookie_mask) == (msg->cookie & msg->cookie_mask)) ) {
+static struct flow_entry *
+flow_table_entry_after(struct flow_table *table, struct flow_entry *entry)
+{
+    struct list *next = entry->match_node.next;
 
-            flow_entry_update(entry);
+    return next == &table->match_entries ? NULL
+           : CONTAINER_OF(next, struct flow_entry, match_node);
+}
 
-            alta_logic_entry_count(entry);
+void
+flow_table_cursor_init(struct flow_table *table, struct flow_table_cursor *cursor)
+{
+    cursor->table = table;
+    cursor->next = list_is_empty(&table->match_entries) ? NULL
+                   : CONTAINER_OF(list_front(&table->match_entries),
+                                  struct flow_entry, match_node);
+    list_push_back(&table->cursors, &cursor->node);
+}
 
-            if ((*stats_size) == (*stats_num)) {
-                (*stats) = xrealloc(*stats, (sizeof(struct ofl_flow_stats *)) * (*stats_size) * 2);
-                *stats_size *= 2;
-            }
-            (*stats)[(*stats_num)] = entry->stats;
-            (*stats_num)++;
-        }
+struct flow_entry *
+flow_table_cursor_advance(struct flow_table_cursor *cursor)
+{
+    if (cursor->next != NULL) {
+        cursor->next = flow_table_entry_after(cursor->table, cursor->next);
     }
+    return cursor->next;
 }
 
 void
-flow_table_stats(struct flow_table *table,
-                               struct ofl_msg_multipart_request_flow *msg,
-                               struct ofl_flow_stats ***stats,
-                               size_t *stats_size, size_t *stats_num)
+flow_table_cursor_destroy(struct flow_table_cursor *cursor)
 {
-    wildcard_flow_table_stats(table,msg, stats,stats_size,stats_num);
+    list_remove(&cursor->node);
+    list_init(&cursor->node);
+}
 
-    if(true == table->dp->use_exact_table)
-    {
-        exact_flow_table_stats(table,msg, stats,stats_size,stats_num);
+void
+flow_table_cursors_skip(struct flow_table *table, struct flow_entry *entry,
+                        struct flow_entry *new_entry)
+{
+    struct flow_table_cursor *cursor;
+
+    LIST_FOR_EACH(cursor, struct flow_table_cursor, node, &table->cursors) {
+        if (cursor->next == entry) {
+            cursor->next = new_entry != NULL ? new_entry
+                           : flow_table_entry_after(table, entry);
+        }
     }
 }
 
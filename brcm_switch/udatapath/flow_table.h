@@ -36,6 +36,8 @@
 #include "pipeline.h"
 #include "timeval.h"
 #include "timer_wheel.h"
+#include "flow_table_tss.h"
+#include "exact_hash.h"
 #include "util.h"
 //
 
@@ -51,41 +53,67 @@
 
 #define MAX_HASH_BUCKETS_NUM   8
 
-#define NUM_TIMEOUT_ONTIME 500
+/* Interval at which an idle timer still running after its deadline, as
+ * the hardware has not reported the entry idle yet, is checked again. */
+#define IDLE_TIMEOUT_RECHECK_MS 1000
 
 /****************************************************************************
  * Implementation of a flow table. The current implementation stores flow
- * entries in priority and then insertion order.
+ * entries in priority and then insertion order. Wildcard entries are also
+ * indexed by a tuple space search classifier, which is used for lookups and
+ * to find the entry a flow mod replaces, and by priority, to find the place
+ * of a new entry. Wildcard entries held in the prefix tries of the
+ * classifier do not count towards dp->flow_table_max_entries, the tries have
+ * their own limit.
  ****************************************************************************/
 
-struct table_timeout{
-    bool need_timeout;
-    unsigned int start_entry;
+/* The wildcard entries of a priority, which follow each other in the match
+ * entries of the table. */
+struct flow_priority {
+    struct hmap_node          node;           /* in priorities, by priority. */
+    struct list               list_node;      /* in priority_list, highest
+                                                 priority first. */
+    struct flow_entry        *last;           /* last entry of the priority. */
+    unsigned short int        priority;
 };
 
-
 struct flow_table {
     struct datapath           *dp;
     struct ofl_table_features *features;      /*store table features*/
     struct ofl_table_stats    *stats;         /* structure storing table statistics. */
 
     struct list               match_entries;  /* list of entries in order. */
-    struct list               hard_entries;   /* list of entries with hard timeout;
-                                                ordered by their timeout times. */
-    struct list               idle_entries;   /* unordered list of entries with
-                                                idle timeout. */
+    struct list               cursors;        /* walks of match_entries in
+                                                 progress. */
+    struct hmap               priorities;     /* flow_priority, by priority. */
+    struct list               priority_list;  /* flow_priority, in order. */
+    struct tss_classifier     classifier;     /* match_entries indexed by
+                                                 their match tuples. */
+    struct timer_wheel        hard_timers;    /* hard timers of the entries. */
+    struct timer_wheel        idle_timers;    /* idle timers of the entries. */
     unsigned long long int                   wildcards;     /* Bitmap of OFPFMF_* wildcards that are
                                                  supported by the table. */
     unsigned long long int                   match;         /* Bitmap of  OFPFMF_* that indicate
                                                   the fields the table can match on. */
     unsigned long long int                  hash_match[MAX_HASH_BUCKETS_NUM];
-    unsigned int                  hash_seed[MAX_HASH_BUCKETS_NUM];
-    struct hlist_head        *buckets[MAX_HASH_BUCKETS_NUM];      /* ڴžȷĹϣͰ */
+    struct flow_key_plan          key_plan[MAX_HASH_BUCKETS_NUM]; /* packet key
+                                                  extraction of hash_match. */
+    struct exact_hash             exact[MAX_HASH_BUCKETS_NUM]; /* exact entries,
+                                                  by their hash_match index. */
     unsigned char                   cur_index;
     unsigned char                   miss_flag;
     unsigned long long int                  ofp_matched_count;
     unsigned long long int                  ofp_lookup_count;
-    struct table_timeout timeout_entries; /*ʶϻʼλ*/
+};
+
+/* Position of a walk over the match entries of a table, which may span
+ * changes of the table: a cursor at an entry leaving the table moves on to
+ * the entry replacing it, or else to the entry after it. */
+struct flow_table_cursor {
+    struct list               node;           /* in the cursors of the table. */
+    struct flow_table        *table;
+    struct flow_entry        *next;           /* next entry of the walk, NULL
+                                                 at the end. */
 };
 
 extern unsigned int oxm_ids[];
@@ -103,10 +131,28 @@ flow_table_flow_mod(struct flow_table *table, struct ofl_msg_flow_mod *mod, bool
 struct flow_entry *
 flow_table_lookup(struct flow_table *table, struct packet *pkt);
 
-/* Orders the flow table to check the timeout its flows. */
+/* Same as flow_table_lookup, also adding the fields the lookup consulted to
+ * wc, if it is not NULL. */
+struct flow_entry *
+flow_table_lookup_wc(struct flow_table *table, struct packet *pkt, struct flow_key *wc);
+
+/* Accounts a packet matching an entry found without a table lookup. */
+void
+flow_table_count_hit(struct flow_table *table, struct packet *pkt, struct flow_entry *entry);
+
+/* Takes an entry off the match entries of its table. */
+void
+flow_table_unlink(struct flow_table *table, struct flow_entry *entry);
+
+/* Orders the flow table to remove its flows whose timers expired. */
 void
 flow_table_timeout(struct flow_table *table);
 
+/* Returns the time in ms by which flow_table_timeout() should run next, or
+ * LLONG_MAX if no flow has a timeout. */
+long long int
+flow_table_next_timeout(const struct flow_table *table);
+
 /* Creates a flow table. */
 struct flow_table *
 flow_table_create(struct datapath *dp, unsigned char table_id);
@@ -115,10 +161,27 @@ flow_table_create(struct datapath *dp, unsigned char table_id);
 void
 flow_table_destroy(struct flow_table *table);
 
-/* Collects statistics of the flow entries of the table. */
+/* Returns true if the flow stats request asks for the wildcard entry. */
+bool
+flow_table_stats_match(struct flow_entry *entry, struct ofl_msg_multipart_request_flow *msg);
+
+/* Starts a walk over the match entries of the table. */
+void
+flow_table_cursor_init(struct flow_table *table, struct flow_table_cursor *cursor);
+
+/* Moves the cursor past its next entry, and returns the new next entry. */
+struct flow_entry *
+flow_table_cursor_advance(struct flow_table_cursor *cursor);
+
+/* Ends the walk of the cursor. Ending it again does nothing. */
+void
+flow_table_cursor_destroy(struct flow_table_cursor *cursor);
+
+/* Moves the cursors of the table at an entry about to leave its match
+ * entries on to new_entry, or if it is NULL to the entry after it. */
 void
-flow_table_stats(struct flow_table *table, struct ofl_msg_multipart_request_flow *msg,
-                 struct ofl_flow_stats ***stats, size_t *stats_size, size_t *stats_num);
+flow_table_cursors_skip(struct flow_table *table, struct flow_entry *entry,
+                        struct flow_entry *new_entry);
 
 /* Collects aggregate statistics of the flow entries of the table. */
 void
@@ -129,6 +192,6 @@ char *
 flow_table_print(struct flow_table *table);
 
 void
-add_to_timeout_lists(struct flow_table *table, struct flow_entry *entry);
+add_to_timeout_wheels(struct flow_table *table, struct flow_entry *entry);
 
 #endif /* FLOW_TABLE_H */
@@ -48,28 +48,6 @@ static void fill_out32(unsigned char *dst,int pos,unsigned int value,enum change
     memcpy(dst + pos, (unsigned char *)&data, sizeof(unsigned int));
 }
 
-static void field_extract(unsigned char *dst,int pos,unsigned char len,
-                        unsigned char *src,enum change_order change)
-{
-     //ƥֵֶֽͬ
-     switch(len)
-     {
-           case 1:
-           case 6:
-           case 8:
-           case 16:
-                memcpy(dst + pos,src,len);
-                break;
-           case 2:
-                fill_out16(dst,pos,*((unsigned short int *)(src)),change);
-                break;
-           case 4:
-                fill_out32(dst,pos,*((unsigned int *)(src)),change);
-                break;
-    }
-}
-
-
 static void oxm_field_extract(unsigned char *dst,int pos,unsigned char len,unsigned char *src,unsigned char type)
 {
     //ƥֵֶֽͬ
@@ -124,42 +102,6 @@ static int flow_field_extract(unsigned char *dst,int pos,int oxm_field,
    return pos;
 }
 
-static int packet_field_extract(unsigned char *dst,int pos,int oxm_field,
-                struct packet *pkt)
-{
-
-   unsigned char len;
-   unsigned int hash;
-   bool  found = false;
-   struct packet_fields *packet_f;
-
-   hash = DP_FIELD_HASH(oxm_field);
-   HMAP_FOR_EACH_WITH_HASH(packet_f, struct packet_fields,
-            hmap_node, hash, &pkt->handle_std->match.match_fields)
-   {
-       len = OXM_LENGTH(packet_f->header);
-       //ofl_oxm_field_print(stdout,OXM_TYPE(packet_f->header));
-       //򣬲Ҫתֽ
-       field_extract(dst,pos,len,packet_f->value,NO_CHANGE);
-       pos += len;
-       found = true;
-   }
-   //Ҫƥڰûҵֱӷأ:Ҫƥudp srcupd dst,
-   //һtcpһƥ
-   if (!found && oxm_field != OXM_OF_VLAN_VID)
-       return -1;
-
-
-   //VLAN ID Ϊnoneʱƥûдvlan tagݰ
-   if (!found && oxm_field == OXM_OF_VLAN_VID)
-   {
-        pos += OXM_LENGTH(oxm_field);
-        pos += OXM_LENGTH(OXM_OF_VLAN_PCP);
-   }
-
-   return pos;
-}
-
 int flow_entry_extract(unsigned char *dst,unsigned long long int tbl_match,struct ofl_match *match)
 {
     unsigned char i;
@@ -182,64 +124,57 @@ int flow_entry_extract(unsigned char *dst,unsigned long long int tbl_match,struc
 }
 
 
-static int packet_extract(unsigned char *dst,unsigned long long int tbl_match,struct packet *pkt)
+/* Compiles the packet key extraction for a hash_match bitmap. The fields are
+ * laid out as flow_entry_extract() lays out the flow entry keys, so a lookup
+ * only copies the needed fields from the packet flow key. A missing VLAN id
+ * is gathered as zero, the key of the OFPVID_NONE entries. */
+void exact_key_plan_compile(struct flow_key_plan *plan,unsigned long long int tbl_match)
 {
     unsigned char i;
-    int pos = 0;
+    unsigned int field;
+    unsigned short int len = 0;
+
+    plan->required = 0;
+    plan->n_steps = 0;
+    flow_key_init(&plan->mask);
 
     for(i=0;i< (OFPXMT_OFB_MPLS_TC + 1);i++)
     {
         if(tbl_match & ((1ULL) << i))
         {
-            pos = packet_field_extract(dst,pos,g_oxm_fields[i],
-                              pkt);
-            if (pos == -1 )
-                return -1;
+            field = OXM_FIELD(g_oxm_fields[i]);
+            plan->steps[plan->n_steps].offset = flow_key_layout[field].offset;
+            plan->steps[plan->n_steps].len = OXM_LENGTH(g_oxm_fields[i]);
+            memset((unsigned char *)plan->mask.w + flow_key_layout[field].offset, 0xff,
+                   OXM_LENGTH(g_oxm_fields[i]));
+            plan->n_steps++;
+            len += OXM_LENGTH(g_oxm_fields[i]);
+
+            if (g_oxm_fields[i] != OXM_OF_VLAN_VID)
+            {
+                plan->required |= (1ULL) << field;
+            }
         }
     }
-    return pos;
-}
-
-static unsigned int packet_head_hash(unsigned char *dst,unsigned long long int tbl_match,
-                                struct packet *pkt,int *key_len, bool *found)
-{
-
-    unsigned int data_len;
-
-    data_len = packet_extract(dst,tbl_match,pkt);
-    if (data_len == -1) {
-        *found = false;
-        return 0;
-     }
-
-    *found = true;
-    *key_len = ROUND_UP(data_len,sizeof(unsigned int));
-
-    //hash
-    return jhash2((unsigned int *)dst,
-                    DIV_ROUND_UP(data_len, sizeof(unsigned int)), 0);
+    plan->key_len = ROUND_UP(len,sizeof(unsigned int));
 }
 
 
 static void exact_flow_table_delete_all(struct flow_table *table,struct ofl_msg_flow_mod *mod)
 {
-    int i,j;
-    struct hlist_head *head = NULL;
+    int j;
     struct flow_entry *entry = NULL;
-    struct flow_entry *entry_next = NULL;
-    struct hlist_node *n;
+    struct exact_hash_cursor cursor;
+
     for (j = 0; j < MAX_HASH_BUCKETS_NUM; j++) {
         if (table->hash_match[j] == 0)
             break;
-        for (i = 0; i < EXACT_FLOW_TABLE_MAX_ENTRIES; i++) {
-            head = &table->buckets[j][i];
-            hlist_for_each_entry_safe(entry, n, entry_next, head, hash_node) {
-                if (flow_entry_match_outport(entry, mod)) {
-                    free(entry->key);
-                    hlist_del(&entry->hash_node);
-                    alta_logic_entry_remove(entry,FLOW_DELETE);
-                    flow_entry_remove(entry,OFPRR_DELETE);
-                }
+        EXACT_HASH_FOR_EACH(entry, cursor, &table->exact[j]) {
+            if (flow_entry_match_outport(entry, mod)) {
+                free(entry->key);
+                exact_flow_entry_unlink(entry);
+                alta_logic_entry_remove(entry,FLOW_DELETE);
+                flow_entry_remove(entry,OFPRR_DELETE);
             }
         }
     }
@@ -248,23 +183,19 @@ static void exact_flow_table_delete_all(struct flow_table *table,struct ofl_msg_
 
 void exact_flow_table_timeout(struct flow_table *table)
 {
-     int i,j;
+     int j;
      struct flow_entry *entry = NULL;
-     struct hlist_head *head = NULL;
-     struct hlist_node *n;
+     struct exact_hash_cursor cursor;
 
      for (j = 0; j < MAX_HASH_BUCKETS_NUM; j++ ) {
         if (table->hash_match[j] == 0)
             break;
 
-        for (i = 0; i < EXACT_FLOW_TABLE_MAX_ENTRIES; i++) {
-            head = &table->buckets[j][i];
-
-            hlist_for_each_entry(entry, n, head, hash_node) {
-                alta_logic_entry_count(entry);
-                if (!flow_entry_hard_timeout(entry))
-                     flow_entry_idle_timeout(entry);
-            }
+        exact_hash_run(&table->exact[j]);
+        EXACT_HASH_FOR_EACH(entry, cursor, &table->exact[j]) {
+            alta_logic_entry_count(entry);
+            if (!flow_entry_hard_timeout(entry))
+                 flow_entry_idle_timeout(entry);
         }
 
      }
@@ -274,15 +205,12 @@ ofl_err exact_flow_table_delete(struct flow_table *table,
                                             struct ofl_msg_flow_mod *mod,bool strict)
 {
     /*ofl_err error;*/
-    int i,j;
-    struct hlist_head *head = NULL;
+    int j;
     struct flow_entry *entry = NULL;
-    struct flow_entry *entry_next = NULL;
-    struct hlist_node *n;
+    struct exact_hash_cursor cursor;
     unsigned int hash;
     unsigned char *flow_key = NULL;
     int key_len = 0;
-    int count = 0;
 
     if (VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE))
     {
@@ -303,18 +231,14 @@ ofl_err exact_flow_table_delete(struct flow_table *table,
             hash = exact_flow_entry_hash(flow_key,table->hash_match[table->cur_index],
              (struct ofl_match *)mod->match,&key_len);
 
-            head = exact_flow_entry_pos(hash, table);
-            hlist_for_each_entry_safe(entry, n, entry_next, head, hash_node) {
-                if (flow_entry_match_outport(entry, mod)
-                     && entry->stats->priority == mod->priority
-                     &&  entry->hash == hash
-                     && entry->key_len == key_len
-                     && !memcmp(entry->key, flow_key, key_len)) {
-                    free(entry->key);
-                    hlist_del(&entry->hash_node);
-                    alta_logic_entry_remove(entry,FLOW_DELETE);
-                    flow_entry_remove(entry,OFPRR_DELETE);
-                }
+            entry = exact_hash_find(&table->exact[table->cur_index], hash, flow_key, key_len);
+            if (entry != NULL
+                 && flow_entry_match_outport(entry, mod)
+                 && entry->stats->priority == mod->priority) {
+                free(entry->key);
+                exact_flow_entry_unlink(entry);
+                alta_logic_entry_remove(entry,FLOW_DELETE);
+                flow_entry_remove(entry,OFPRR_DELETE);
             }
             free(flow_key);
         }
@@ -323,19 +247,15 @@ ofl_err exact_flow_table_delete(struct flow_table *table,
                 if (table->hash_match[j] == 0)
                     break;
 
-                for (i = 0; i < EXACT_FLOW_TABLE_MAX_ENTRIES; i++)
+                EXACT_HASH_FOR_EACH(entry, cursor, &table->exact[j])
                 {
-                    head = &table->buckets[j][i];
-                    hlist_for_each_entry_safe(entry, n, entry_next, head, hash_node)
+                    if (flow_entry_match_outport(entry, mod)
+                        && flow_entry_matches(entry, mod, strict, false))
                     {
-                        if (flow_entry_match_outport(entry, mod)
-                            && flow_entry_matches(entry, mod, strict, false))
-                        {
-                            free(entry->key);
-                            hlist_del(&entry->hash_node);
-                            alta_logic_entry_remove(entry,FLOW_DELETE);
-                            flow_entry_remove(entry,OFPRR_DELETE);
-                        }
+                        free(entry->key);
+                        exact_flow_entry_unlink(entry);
+                        alta_logic_entry_remove(entry,FLOW_DELETE);
+                        flow_entry_remove(entry,OFPRR_DELETE);
                     }
                 }
             }
@@ -397,8 +317,6 @@ ofl_err exact_flow_table_modify(struct flow_table *table,
         flow_entry_replace_instructions(entry, mod->instructions_num, mod->instructions);
         entry->last_used = time_now_msec();
         alta_logic_entry_remove(entry,FLOW_MODIFY);
-        list_remove(&entry->idle_node);
-        list_init(&entry->idle_node);
         *insts_kept = true;
     }
 
@@ -412,12 +330,10 @@ ofl_err exact_flow_table_add(struct flow_table *table,
     unsigned int hash;
     /*int i = 0;*/
     ofl_err error = 0;
-    struct hlist_head *head = NULL;
     struct flow_entry *entry = NULL;
     struct flow_entry *old_entry = NULL;
     unsigned char *flow_key = NULL;
     int key_len = 0;
-    int count = 0;
     bool check_overlap = ((mod->flags & OFPFF_CHECK_OVERLAP) != 0);
 
     if (mod->match->length == 0)
@@ -426,7 +342,7 @@ ofl_err exact_flow_table_add(struct flow_table *table,
         goto fail;
     }
 
-    if (table->stats->active_count >= table->dp->flow_table_max_entries)
+    if (table->stats->active_count >= table->features->max_entries)
     {
         error = ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_TABLE_FULL);
         goto fail;
@@ -450,7 +366,6 @@ ofl_err exact_flow_table_add(struct flow_table *table,
         ofp_hex_dump(stdout, flow_key, key_len, 0, false);
     }
 
-    head = exact_flow_entry_pos(hash, table);
     old_entry = exact_flow_entry_lookup(table, (struct ofl_match *)mod->match);
     if (old_entry != NULL)
     {
@@ -470,11 +385,8 @@ ofl_err exact_flow_table_add(struct flow_table *table,
             return 0;
         }
 
-        hlist_del(&old_entry->hash_node);
-        hlist_add_head(&entry->hash_node, head);
-
-        list_remove(&old_entry->hard_node);
-        list_remove(&old_entry->idle_node);
+        exact_hash_replace(&table->exact[table->cur_index], old_entry, entry);
+        add_to_timeout_wheels(table, entry);
 
         free_flow_key(flow_key);
         flow_entry_destroy(old_entry);
@@ -485,25 +397,19 @@ ofl_err exact_flow_table_add(struct flow_table *table,
         entry = exact_flow_entry_create(table->dp, table, mod,hash,flow_key,key_len);
         if (entry != NULL)
         {
-            if (count >= EXACT_TABLE_CLASH_COUNT)
-            {
-                VLOG_DBG(LOG_MODULE, "hash clash\n");
-                free_flow_key(flow_key);
-                error = ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_UNKNOWN);
-                goto fail;
-            }
-
-            hlist_add_head(&entry->hash_node, head);
-            if (table->stats->active_count == EXACT_FLOW_TABLE_MAX_ENTRIES)
+            if (!exact_hash_insert(&table->exact[table->cur_index], entry))
             {
+                VLOG_DBG(LOG_MODULE, "exact hash full\n");
                 free_flow_key(flow_key);
+                free(entry->key);
+                flow_entry_destroy(entry);
                 error = ofl_error(OFPET_FLOW_MOD_FAILED, OFPFMFC_TABLE_FULL);
                 goto fail;
             }
             table->stats->active_count++;
             *match_kept = true;
             *insts_kept = true;
-            add_to_timeout_lists(table, entry);
+            add_to_timeout_wheels(table, entry);
         }
     }
 
@@ -522,182 +428,88 @@ static void update_flow_entry_count(struct flow_table *table,
                                     struct flow_entry *entry)
 {
 
+    /* the workers count concurrently */
     if (!entry->no_byt_count)
-       entry->stats->ofp_byte_count += pkt->buffer->size;
+       __sync_fetch_and_add(&entry->stats->ofp_byte_count, pkt->buffer->size);
     if (!entry->no_pkt_count)
-       entry->stats->ofp_packet_count++;
+       __sync_fetch_and_add(&entry->stats->ofp_packet_count, 1);
 
     entry->last_used = time_now_msec();
-    table->ofp_matched_count++;
-    table->ofp_lookup_count ++;
+    __sync_fetch_and_add(&table->ofp_matched_count, 1);
+    __sync_fetch_and_add(&table->ofp_lookup_count, 1);
 }
 
 // ƥֶεhashֵ
 struct flow_entry *exact_flow_table_lookup(struct flow_table *table,
-                                                  struct packet *pkt)
+                                                  struct packet *pkt,
+                                                  struct flow_key *wc)
 {
     int i;
+    unsigned char w;
     unsigned int hash;
     unsigned short int priority = 0;
     struct flow_entry *entry = NULL;
     struct flow_entry *ret_entry = NULL;
-    struct hlist_node *n;
-    struct hlist_head *head;
-    unsigned char *pkt_key = NULL;
+    unsigned int pkt_key[FLOW_KEY_PLAN_MAX_LEN / sizeof(unsigned int)];
     int key_len;
-    bool found;
 
-    table->ofp_lookup_count++;
+    __sync_fetch_and_add(&table->ofp_lookup_count, 1);
 
-    if (pkt->handle_std->match.header.length == 0 )
-        return entry;
-
-    pkt_key = malloc_flow_key(ROUND_UP(pkt->handle_std->match.header.length,sizeof(unsigned int)));
-    //ݾȷȡƥ
-    if (pkt_key == NULL)
+    if (pkt->handle_std->match_len == 0 )
         return entry;
 
     for ( i = 0; i < MAX_HASH_BUCKETS_NUM; i++ ) {
         if (table->hash_match[i] == 0)
             break;
 
-        hash = packet_head_hash(pkt_key, table->hash_match[i], pkt, &key_len, &found);
-        if (!found) {
-            memset(pkt_key, 0, ROUND_UP(pkt->handle_std->match.header.length,sizeof(unsigned int)));
+        //ݾȷȡƥ
+        key_len = flow_key_plan_extract(&table->key_plan[i], &pkt->handle_std->key,
+                                        (unsigned char *)pkt_key);
+        if (key_len == -1)
             continue;
+
+        // fields consulted by this lookup, for the megaflow cache
+        if (wc != NULL) {
+            for (w = 0; w < FLOW_KEY_WORDS; w++)
+                wc->w[w] |= table->key_plan[i].mask.w[w];
         }
 
+        hash = jhash2(pkt_key, key_len / sizeof(unsigned int), 0);
+
         if (VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE)) {
             VLOG_DBG(ALTA_LOG_MODULE, "packet_extract_fields ,len:%d\n", key_len);
             ofp_hex_dump(stdout, pkt_key, key_len, 0, false);
         }
 
-        table->cur_index = i;
-        head = exact_flow_entry_pos(hash, table);
-
-        hlist_for_each_entry(entry, n, head, hash_node)
+        entry = exact_hash_find(&table->exact[i], hash, (unsigned char *)pkt_key, key_len);
+        if (entry != NULL && entry->stats->priority > priority)
         {
-            if ((entry->hash == hash)
-                && (entry->key_len == key_len)
-                && !memcmp(entry->key, pkt_key, key_len))
-            {
-                if (entry->stats->priority > priority)
-                {
-                    ret_entry = entry;
-                }
-                priority = entry->stats->priority;
-                break;
-            }
+            ret_entry = entry;
+            priority = entry->stats->priority;
         }
-
-        memset(pkt_key,0,key_len);
     }
 
     if (ret_entry )
         update_flow_entry_count(table,pkt,ret_entry);
 
-    free_flow_key(pkt_key);
-
     return ret_entry;
 }
 
-static void exact_flow_table_stats_all(struct flow_table *table,
-                                     struct ofl_flow_stats ***stats,
-                                     size_t *stats_size,
-                                     size_t *stats_num)
-{
-    int i,j;
-    struct flow_entry *entry = NULL;
-    struct hlist_head *head = NULL;
-    struct hlist_node *n;
-    struct ofl_flow_stats * flow_stats;
-
-    for ( j = 0; j < MAX_HASH_BUCKETS_NUM; j++ )
-    {
-        if (table->hash_match[j] == 0)
-            break;
-
-        for ( i = 0; i < EXACT_FLOW_TABLE_MAX_ENTRIES; i++)
-        {
-            head = &table->buckets[j][i];
-            hlist_for_each_entry(entry, n, head, hash_node)
-            {
-                flow_entry_update(entry);
-
-                alta_logic_entry_count(entry);
-
-                if ((*stats_size) == (*stats_num))
-                {
-                   (*stats) = xrealloc(*stats,
-                           (sizeof(struct ofl_flow_stats *)) * (*stats_size) * 2);
-                   *stats_size *= 2;
-                }
-
-                (*stats)[(*stats_num)] = entry->stats;
-                (*stats_num)++;
-            }
-        }
-    }
-}
-
-void exact_flow_table_stats(struct flow_table *table,
-                                 struct ofl_msg_multipart_request_flow *msg,
-                                 struct ofl_flow_stats ***stats,
-                                 size_t *stats_size,
-                                 size_t *stats_num)
-{
-    struct flow_entry *entry;
-
-    //ûƥʱϴ
-    if(msg->match->length == 0)
-    {
-        exact_flow_table_stats_all(table,stats,stats_size,stats_num);
-    }
-    else
-    {
-        entry = exact_flow_entry_lookup(table, (struct ofl_match *)(msg->match));
-        if (entry != NULL &&
-            (msg->out_port == OFPP_ANY || flow_entry_has_out_port(entry, msg->out_port)) &&
-            (msg->out_group == OFPG_ANY || flow_entry_has_out_group(entry, msg->out_group)))
-        {
-            flow_entry_update(entry);
-
-            alta_logic_entry_count(entry);
-            if (entry->no_pkt_count == true)
-            {
-                entry->stats->packet_count = 0xffffffffffffffff;
-            }
-            if (entry->no_byt_count == true)
-            {
-                entry->stats->byte_count = 0xffffffffffffffff;
-            }
-            if ((*stats_size) == (*stats_num)) {
-                (*stats) = xrealloc(*stats, (sizeof(struct ofl_flow_stats *)) * (*stats_size) * 2);
-                *stats_size *= 2;
-            }
-
-            (*stats)[(*stats_num)] = entry->stats;
-            (*stats_num)++;
-        }
-    }
-}
-
 static int packet_field_extract_pi(unsigned char *dst,int *pos,int oxm_field,
                 struct packet *pkt,unsigned int match_len)
 {
 
    unsigned char len;
-   struct packet_fields *packet_f;
+   unsigned char *value;
 
-   HMAP_FOR_EACH_WITH_HASH(packet_f, struct packet_fields,
-            hmap_node, DP_FIELD_HASH(oxm_field), &pkt->handle_std->match.match_fields)
+   value = flow_key_get(&pkt->handle_std->key, oxm_field);
+   if (value != NULL)
    {
-       len = OXM_LENGTH(packet_f->header);
-       //ofl_oxm_field_print(stdout,OXM_TYPE(packet_f->header));
+       len = OXM_LENGTH(oxm_field);
        //򣬲Ҫתֽ
        if(*pos + len <= match_len)
        {
-           memcpy(dst + *pos,packet_f->value,len);
+           memcpy(dst + *pos,value,len);
            *pos += len;
        }
        else
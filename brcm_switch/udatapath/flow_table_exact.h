@@ -183,17 +183,11 @@ ofl_err exact_flow_table_modify(struct flow_table *table,
 ofl_err exact_flow_table_delete(struct flow_table *table,
                                             struct ofl_msg_flow_mod *mod,bool strict);
 
-struct flow_entry *exact_flow_table_lookup(struct flow_table *table,struct packet *pkt);
+struct flow_entry *exact_flow_table_lookup(struct flow_table *table,struct packet *pkt,struct flow_key *wc);
 
 unsigned int packet_hash_pi(unsigned char *dst ,
                                 struct packet *pkt,unsigned int match_len);
 
-void exact_flow_table_stats(struct flow_table *table,
-                                 struct ofl_msg_multipart_request_flow *msg,
-                                 struct ofl_flow_stats ***stats,
-                                 size_t *stats_size,
-                                 size_t *stats_num);
-
 int flow_entry_extract(unsigned char *dst,unsigned long long int tbl_match,struct ofl_match *match);
 
 void exact_flow_table_timeout(struct flow_table *table);
@@ -0,0 +1,615 @@
+/* Tuple space search classifier for the wildcard flow tables. */
+
+#include <stdbool.h>
+#include <string.h>
+#include "hash.h"
+#include "util.h"
+#include "flow_table_tss.h"
+#include "flow_entry.h"
+#include "flow_table.h"
+#include "packets.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_flow_t
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+static const struct {
+    unsigned int             field;     /* OXM_FIELD() of the address. */
+    unsigned short int       eth_type;
+} tss_lpm_fields[TSS_LPM_FIELDS] = {
+    { OFPXMT_OFB_IPV4_SRC, ETH_TYPE_IP },
+    { OFPXMT_OFB_IPV4_DST, ETH_TYPE_IP },
+    { OFPXMT_OFB_IPV6_SRC, ETH_TYPE_IPV6 },
+    { OFPXMT_OFB_IPV6_DST, ETH_TYPE_IPV6 },
+};
+
+static inline unsigned short int
+tss_entry_priority(struct flow_entry *entry)
+{
+    return entry->stats->priority;
+}
+
+/* Returns the length of a contiguous prefix mask, or -1. */
+static int
+tss_prefix_len(const unsigned char *mask, unsigned char len)
+{
+    int n = 0;
+    unsigned char i;
+
+    while (n < len * 8 && (mask[n / 8] & (0x80 >> (n % 8))))
+    {
+        n++;
+    }
+    for (i = n / 8; i < len; i++)
+    {
+        if (mask[i] & (0xff >> (i == n / 8 ? n % 8 : 0)))
+        {
+            return -1;
+        }
+    }
+    return n;
+}
+
+/* Returns the prefix length of a match, given as a masked key and its mask,
+ * on only the Ethernet type and a prefix of the address field of a trie, or
+ * -1. */
+static int
+tss_lpm_prefix_len(const struct flow_key *key, const struct flow_key *mask,
+                   enum tss_lpm_field f)
+{
+    unsigned int field = tss_lpm_fields[f].field;
+    unsigned long long int present = (1ULL << OFPXMT_OFB_ETH_TYPE) | (1ULL << field);
+    const unsigned char *bits = (const unsigned char *)mask->w +
+                                flow_key_layout[field].offset;
+    struct flow_key expected;
+
+    if (mask->present != present ||
+        key->f.eth_type != htons(tss_lpm_fields[f].eth_type))
+    {
+        return -1;
+    }
+
+    flow_key_init(&expected);
+    expected.present = present;
+    expected.f.eth_type = 0xffff;
+    memcpy((unsigned char *)expected.w + flow_key_layout[field].offset, bits,
+           flow_key_layout[field].len);
+    if (memcmp(&expected, mask, sizeof expected))
+    {
+        return -1;
+    }
+    return tss_prefix_len(bits, flow_key_layout[field].len);
+}
+
+/* Returns the address prefix of a masked key in the trie of field f. */
+static inline const unsigned char *
+tss_lpm_prefix(const struct flow_key *key, enum tss_lpm_field f)
+{
+    return (const unsigned char *)key->w + flow_key_layout[tss_lpm_fields[f].field].offset;
+}
+
+/* Moves an entry to the prefix trie of its field, creating the trie once
+ * enough prefix rules are seen. The trie is then kept, even empty, until the
+ * classifier is destroyed, so that rule churn does not build it over and
+ * over. Returns false if the entry is left to the subtables. */
+static bool
+tss_lpm_insert(struct tss_classifier *cls, struct flow_entry *entry)
+{
+    enum tss_lpm_field f;
+
+    for (f = 0; f < TSS_LPM_FIELDS; f++)
+    {
+        unsigned int field = tss_lpm_fields[f].field;
+        int len = tss_lpm_prefix_len(&entry->match_key, &entry->match_mask, f);
+
+        if (len < 0)
+        {
+            continue;
+        }
+        if (cls->lpm[f] == NULL)
+        {
+            if (++cls->n_prefixes[f] < TSS_LPM_MIN_RULES)
+            {
+                return false;
+            }
+            cls->lpm[f] = lpm_create(flow_key_layout[field].len);
+        }
+        if (cls->lpm[f]->n_rules >= TSS_LPM_MAX_RULES)
+        {
+            return false;
+        }
+        return lpm_insert(cls->lpm[f], tss_lpm_prefix(&entry->match_key, f),
+                          len, entry) != NULL;
+    }
+    return false;
+}
+
+static void
+tss_lpm_remove(struct tss_classifier *cls, struct flow_entry *entry)
+{
+    lpm_remove(entry->lpm_rule);
+    cls->n_entries--;
+}
+
+/* Looks a packet up in the prefix tries, adding what it depends on to wc. */
+static struct flow_entry *
+tss_lpm_lookup(struct tss_classifier *cls, const struct flow_key *pkt_key,
+               struct flow_key *wc)
+{
+    struct flow_entry *best = NULL;
+    enum tss_lpm_field f;
+
+    for (f = 0; f < TSS_LPM_FIELDS; f++)
+    {
+        unsigned int field = tss_lpm_fields[f].field;
+        struct flow_entry *entry;
+        unsigned int n_bits;
+
+        if (cls->lpm[f] == NULL || cls->lpm[f]->n_rules == 0 ||
+            !flow_key_has(pkt_key, field))
+        {
+            continue;
+        }
+        if (wc != NULL)
+        {
+            wc->f.eth_type = 0xffff;
+        }
+        if (pkt_key->f.eth_type != htons(tss_lpm_fields[f].eth_type))
+        {
+            continue;
+        }
+
+        entry = lpm_lookup(cls->lpm[f], (const unsigned char *)pkt_key->w +
+                           flow_key_layout[field].offset, &n_bits);
+        if (wc != NULL)
+        {
+            unsigned char *m = (unsigned char *)wc->w + flow_key_layout[field].offset;
+
+            memset(m, 0xff, n_bits / 8);
+            if (n_bits % 8)
+            {
+                m[n_bits / 8] |= 0xff << (8 - n_bits % 8);
+            }
+        }
+        if (entry != NULL && (best == NULL || tss_entry_priority(entry) > tss_entry_priority(best)))
+        {
+            best = entry;
+        }
+    }
+    return best;
+}
+
+/* Gathers the words of a key selected by the subtable mask and returns their
+ * hash. */
+static unsigned int
+tss_subtable_hash(const struct tss_subtable *sub, const struct flow_key *key,
+                  unsigned long long int *words)
+{
+    unsigned char i;
+
+    for (i = 0; i < sub->n_words; i++)
+    {
+        words[i] = key->w[sub->words[i]] & sub->mask.w[sub->words[i]];
+    }
+    return hash_words((const unsigned int *)words,
+                      sub->n_words * (sizeof *words / sizeof(unsigned int)), 0);
+}
+
+static struct tss_rule *
+tss_rule_find(struct tss_subtable *sub, const unsigned long long int *words,
+              unsigned int hash)
+{
+    struct tss_rule *rule;
+
+    HMAP_FOR_EACH_WITH_HASH (rule, struct tss_rule, node, hash, &sub->rules)
+    {
+        unsigned char i;
+
+        for (i = 0; i < sub->n_words; i++)
+        {
+            if (rule->key.w[sub->words[i]] != words[i])
+            {
+                break;
+            }
+        }
+        if (i == sub->n_words)
+        {
+            return rule;
+        }
+    }
+    return NULL;
+}
+
+/* Moves a subtable to its place in the classifier list after its
+ * max_priority changed. */
+static void
+tss_subtable_reorder(struct tss_subtable *sub)
+{
+    struct tss_classifier *cls = sub->cls;
+    struct tss_subtable *iter;
+
+    list_remove(&sub->node);
+    LIST_FOR_EACH (iter, struct tss_subtable, node, &cls->subtables)
+    {
+        if (sub->max_priority > iter->max_priority)
+        {
+            break;
+        }
+    }
+    list_insert(&iter->node, &sub->node);
+}
+
+static struct tss_subtable *
+tss_subtable_create(struct tss_classifier *cls, const struct flow_key *mask,
+                    unsigned short int priority)
+{
+    struct tss_subtable *sub = xmalloc(sizeof *sub);
+    unsigned char i;
+
+    sub->cls = cls;
+    sub->n_entries = 0;
+    sub->max_priority = priority;
+    sub->mask = *mask;
+    sub->n_words = 0;
+    for (i = 0; i < FLOW_KEY_WORDS; i++)
+    {
+        if (mask->w[i] != 0)
+        {
+            sub->words[sub->n_words++] = i;
+        }
+    }
+    hmap_init(&sub->rules);
+    list_init(&sub->node);
+    tss_subtable_reorder(sub);
+    cls->n_subtables++;
+
+    return sub;
+}
+
+static void
+tss_subtable_destroy(struct tss_subtable *sub)
+{
+    struct tss_rule *rule, *next;
+
+    HMAP_FOR_EACH_SAFE (rule, next, struct tss_rule, node, &sub->rules)
+    {
+        struct flow_entry *entry, *enext;
+
+        LIST_FOR_EACH_SAFE (entry, enext, struct flow_entry, tss_node, &rule->entries)
+        {
+            list_remove(&entry->tss_node);
+            entry->tss_rule = NULL;
+        }
+        hmap_remove(&sub->rules, &rule->node);
+        free(rule);
+    }
+    hmap_destroy(&sub->rules);
+    list_remove(&sub->node);
+    sub->cls->n_subtables--;
+    free(sub);
+}
+
+void
+tss_classifier_init(struct tss_classifier *cls)
+{
+    list_init(&cls->subtables);
+    cls->n_subtables = 0;
+    cls->n_entries = 0;
+    memset(cls->lpm, 0, sizeof cls->lpm);
+    memset(cls->n_prefixes, 0, sizeof cls->n_prefixes);
+}
+
+void
+tss_classifier_destroy(struct tss_classifier *cls)
+{
+    struct tss_subtable *sub, *next;
+    enum tss_lpm_field f;
+
+    LIST_FOR_EACH_SAFE (sub, next, struct tss_subtable, node, &cls->subtables)
+    {
+        tss_subtable_destroy(sub);
+    }
+    for (f = 0; f < TSS_LPM_FIELDS; f++)
+    {
+        if (cls->lpm[f] != NULL)
+        {
+            lpm_destroy(cls->lpm[f]);
+            cls->lpm[f] = NULL;
+        }
+    }
+    cls->n_entries = 0;
+}
+
+bool
+tss_classifier_insert(struct tss_classifier *cls, struct flow_entry *entry)
+{
+    unsigned long long int words[FLOW_KEY_WORDS];
+    struct tss_subtable *sub;
+    struct tss_rule *rule;
+    struct flow_entry *iter;
+    unsigned short int priority = tss_entry_priority(entry);
+    unsigned int hash;
+
+    if (!entry->match_keyed)
+    {
+        VLOG_WARN_RL(LOG_MODULE, &rl, "Trying to classify flow entry with unsupported match.");
+        return false;
+    }
+
+    if (tss_lpm_insert(cls, entry))
+    {
+        cls->n_entries++;
+        return true;
+    }
+
+    LIST_FOR_EACH (sub, struct tss_subtable, node, &cls->subtables)
+    {
+        if (!memcmp(&sub->mask, &entry->match_mask, sizeof sub->mask))
+        {
+            break;
+        }
+    }
+
+    if (&sub->node == &cls->subtables)
+    {
+        sub = tss_subtable_create(cls, &entry->match_mask, priority);
+    }
+
+    hash = tss_subtable_hash(sub, &entry->match_key, words);
+    rule = tss_rule_find(sub, words, hash);
+    if (rule == NULL)
+    {
+        rule = xmalloc(sizeof *rule);
+        rule->subtable = sub;
+        list_init(&rule->entries);
+        rule->key = entry->match_key;
+        hmap_insert(&sub->rules, &rule->node, hash);
+    }
+
+    /* new entries are placed behind those with equal priority */
+    LIST_FOR_EACH (iter, struct flow_entry, tss_node, &rule->entries)
+    {
+        if (priority > tss_entry_priority(iter))
+        {
+            break;
+        }
+    }
+    list_insert(&iter->tss_node, &entry->tss_node);
+    entry->tss_rule = rule;
+
+    sub->n_entries++;
+    cls->n_entries++;
+    if (priority > sub->max_priority)
+    {
+        sub->max_priority = priority;
+        tss_subtable_reorder(sub);
+    }
+    return true;
+}
+
+void
+tss_classifier_remove(struct flow_entry *entry)
+{
+    struct tss_rule *rule = entry->tss_rule;
+    struct tss_subtable *sub;
+    struct tss_rule *iter;
+    unsigned short int max_priority = 0;
+
+    if (entry->lpm_rule != NULL)
+    {
+        tss_lpm_remove(&entry->table->classifier, entry);
+        return;
+    }
+
+    if (rule == NULL)
+    {
+        return;
+    }
+
+    sub = rule->subtable;
+    list_remove(&entry->tss_node);
+    entry->tss_rule = NULL;
+    sub->n_entries--;
+    sub->cls->n_entries--;
+
+    if (list_is_empty(&rule->entries))
+    {
+        hmap_remove(&sub->rules, &rule->node);
+        free(rule);
+    }
+
+    if (sub->n_entries == 0)
+    {
+        tss_subtable_destroy(sub);
+        return;
+    }
+
+    if (tss_entry_priority(entry) < sub->max_priority)
+    {
+        return;
+    }
+
+    HMAP_FOR_EACH (iter, struct tss_rule, node, &sub->rules)
+    {
+        struct flow_entry *head = CONTAINER_OF(list_front(&iter->entries),
+                                               struct flow_entry, tss_node);
+
+        if (tss_entry_priority(head) > max_priority)
+        {
+            max_priority = tss_entry_priority(head);
+        }
+    }
+
+    if (max_priority != sub->max_priority)
+    {
+        sub->max_priority = max_priority;
+        tss_subtable_reorder(sub);
+    }
+}
+
+void
+tss_classifier_replace(struct flow_entry *old_entry, struct flow_entry *new_entry)
+{
+    if (old_entry->lpm_rule != NULL)
+    {
+        new_entry->lpm_rule = old_entry->lpm_rule;
+        new_entry->lpm_rule->entry = new_entry;
+        old_entry->lpm_rule = NULL;
+        return;
+    }
+
+    if (old_entry->tss_rule == NULL)
+    {
+        return;
+    }
+
+    list_replace(&new_entry->tss_node, &old_entry->tss_node);
+    new_entry->tss_rule = old_entry->tss_rule;
+    list_init(&old_entry->tss_node);
+    old_entry->tss_rule = NULL;
+}
+
+bool
+tss_classifier_lpm_fits(const struct tss_classifier *cls, const struct flow_key *key,
+                        const struct flow_key *mask, unsigned short int priority)
+{
+    enum tss_lpm_field f;
+
+    for (f = 0; f < TSS_LPM_FIELDS; f++)
+    {
+        int len = tss_lpm_prefix_len(key, mask, f);
+
+        if (len < 0)
+        {
+            continue;
+        }
+        if (cls->lpm[f] == NULL)
+        {
+            return cls->n_prefixes[f] + 1 >= TSS_LPM_MIN_RULES;
+        }
+        return cls->lpm[f]->n_rules < TSS_LPM_MAX_RULES &&
+               lpm_fits(cls->lpm[f], tss_lpm_prefix(key, f), len, priority);
+    }
+    return false;
+}
+
+unsigned int
+tss_classifier_lpm_entries(const struct tss_classifier *cls)
+{
+    unsigned int n = 0;
+    enum tss_lpm_field f;
+
+    for (f = 0; f < TSS_LPM_FIELDS; f++)
+    {
+        if (cls->lpm[f] != NULL)
+        {
+            n += cls->lpm[f]->n_rules;
+        }
+    }
+    return n;
+}
+
+struct flow_entry *
+tss_classifier_find(const struct tss_classifier *cls, const struct flow_key *key,
+                    const struct flow_key *mask, unsigned short int priority)
+{
+    unsigned long long int words[FLOW_KEY_WORDS];
+    struct flow_entry *best = NULL;
+    struct tss_subtable *sub;
+    enum tss_lpm_field f;
+
+    /* a prefix is in the trie at most once, other rules with the same prefix
+     * are in the subtables */
+    for (f = 0; f < TSS_LPM_FIELDS; f++)
+    {
+        int len = tss_lpm_prefix_len(key, mask, f);
+
+        if (len >= 0 && cls->lpm[f] != NULL)
+        {
+            best = lpm_find(cls->lpm[f], tss_lpm_prefix(key, f), len);
+            if (best != NULL && tss_entry_priority(best) > priority)
+            {
+                best = NULL;
+            }
+            break;
+        }
+    }
+
+    LIST_FOR_EACH (sub, struct tss_subtable, node, &cls->subtables)
+    {
+        if (!memcmp(&sub->mask, mask, sizeof sub->mask))
+        {
+            struct tss_rule *rule = tss_rule_find(sub, words,
+                                                  tss_subtable_hash(sub, key, words));
+            struct flow_entry *entry;
+
+            if (rule == NULL)
+            {
+                break;
+            }
+            LIST_FOR_EACH (entry, struct flow_entry, tss_node, &rule->entries)
+            {
+                if (tss_entry_priority(entry) <= priority)
+                {
+                    if (best == NULL || tss_entry_priority(entry) > tss_entry_priority(best))
+                    {
+                        best = entry;
+                    }
+                    break;
+                }
+            }
+            break;
+        }
+    }
+    return best;
+}
+
+struct flow_entry *
+tss_classifier_lookup(struct tss_classifier *cls, const struct flow_key *pkt_key,
+                      struct flow_key *wc)
+{
+    unsigned long long int words[FLOW_KEY_WORDS];
+    struct tss_subtable *sub;
+    struct flow_entry *best = tss_lpm_lookup(cls, pkt_key, wc);
+
+    LIST_FOR_EACH (sub, struct tss_subtable, node, &cls->subtables)
+    {
+        struct tss_rule *rule;
+        unsigned int hash;
+
+        if (best != NULL && tss_entry_priority(best) >= sub->max_priority)
+        {
+            break;
+        }
+
+        if ((pkt_key->present & sub->mask.present) != sub->mask.present)
+        {
+            continue;
+        }
+
+        if (wc != NULL)
+        {
+            unsigned char i;
+
+            for (i = 0; i < FLOW_KEY_WORDS; i++)
+            {
+                wc->w[i] |= sub->mask.w[i];
+            }
+        }
+
+        hash = tss_subtable_hash(sub, pkt_key, words);
+        rule = tss_rule_find(sub, words, hash);
+        if (rule != NULL)
+        {
+            struct flow_entry *head = CONTAINER_OF(list_front(&rule->entries),
+                                                   struct flow_entry, tss_node);
+
+            if (best == NULL || tss_entry_priority(head) > tss_entry_priority(best))
+            {
+                best = head;
+            }
+        }
+    }
+
+    return best;
+}
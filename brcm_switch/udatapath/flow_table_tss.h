@@ -0,0 +1,115 @@
+#ifndef FLOW_TABLE_TSS_H
+#define FLOW_TABLE_TSS_H 1
+
+#include <stdbool.h>
+#include "list.h"
+#include "hmap.h"
+#include "flow_key.h"
+#include "lpm.h"
+
+/****************************************************************************
+ * Tuple space search classifier for the wildcard flow tables.
+ *
+ * Flow entries are grouped into subtables by their "tuple": the flow key mask
+ * of their match. Inside a subtable the entries are hashed on their masked
+ * flow key, so a lookup costs one hash probe per distinct tuple instead of
+ * one match per flow entry.
+ * Subtables are kept sorted by the highest priority they contain, which lets
+ * the lookup stop as soon as no remaining subtable can beat the best match.
+ *
+ * Rules matching only the Ethernet type and a prefix of one IPv4 or IPv6
+ * address field are moved to a longest prefix match trie of that field once
+ * TSS_LPM_MIN_RULES of them have been added, instead of taking one subtable
+ * per prefix length. A trie holds up to TSS_LPM_MAX_RULES rules; a rule the
+ * trie refuses stays in the subtables. A trie takes at least 256 KB (see
+ * lpm.h), and is kept once created.
+ ****************************************************************************/
+
+struct flow_entry;
+struct tss_classifier;
+
+struct tss_subtable {
+    struct list              node;         /* classifier list, ordered by
+                                              max_priority. */
+    struct tss_classifier   *cls;
+    struct hmap              rules;        /* tss_rule, by masked key hash. */
+    unsigned int             n_entries;
+    unsigned short int       max_priority; /* highest priority of the entries. */
+    struct flow_key          mask;         /* the tuple. */
+    unsigned char            n_words;
+    unsigned char            words[FLOW_KEY_WORDS]; /* key words with a
+                                                       non-zero mask. */
+};
+
+/* The entries sharing the same masked key in a subtable. */
+struct tss_rule {
+    struct hmap_node         node;
+    struct tss_subtable     *subtable;
+    struct list              entries;   /* in priority then insertion order. */
+    struct flow_key          key;       /* masked by the subtable mask. */
+};
+
+#define TSS_LPM_MIN_RULES  64
+#define TSS_LPM_MAX_RULES  (1 << 21)
+
+enum tss_lpm_field {
+    TSS_LPM_IPV4_SRC,
+    TSS_LPM_IPV4_DST,
+    TSS_LPM_IPV6_SRC,
+    TSS_LPM_IPV6_DST,
+    TSS_LPM_FIELDS
+};
+
+struct tss_classifier {
+    struct list              subtables; /* ordered by max_priority. */
+    unsigned int             n_subtables;
+    unsigned int             n_entries;
+    struct lpm              *lpm[TSS_LPM_FIELDS];      /* prefix rules, or NULL. */
+    unsigned int             n_prefixes[TSS_LPM_FIELDS]; /* prefix rules added
+                                                           while lpm is NULL. */
+};
+
+void
+tss_classifier_init(struct tss_classifier *cls);
+
+void
+tss_classifier_destroy(struct tss_classifier *cls);
+
+/* Indexes an entry by its match key and mask. Returns false if the entry has
+ * no flow key; it is then left out of the classifier. */
+bool
+tss_classifier_insert(struct tss_classifier *cls, struct flow_entry *entry);
+
+/* Removes an entry from the classifier it was inserted in, if any. */
+void
+tss_classifier_remove(struct flow_entry *entry);
+
+/* Puts new_entry in the place held by old_entry, which must have the same
+ * match and priority. */
+void
+tss_classifier_replace(struct flow_entry *old_entry, struct flow_entry *new_entry);
+
+/* Returns true if an entry with the given match, a masked key and its mask,
+ * and priority would be inserted in a prefix trie. */
+bool
+tss_classifier_lpm_fits(const struct tss_classifier *cls, const struct flow_key *key,
+                        const struct flow_key *mask, unsigned short int priority);
+
+/* Returns the number of entries in the prefix tries. */
+unsigned int
+tss_classifier_lpm_entries(const struct tss_classifier *cls);
+
+/* Returns the entry with exactly the given match, a masked key and its mask,
+ * of the highest priority not above 'priority', or NULL. */
+struct flow_entry *
+tss_classifier_find(const struct tss_classifier *cls, const struct flow_key *key,
+                    const struct flow_key *mask, unsigned short int priority);
+
+/* Returns the highest priority entry matching the packet key. If wc is not
+ * NULL, the masks of the subtables probed and the address bits the prefix
+ * tries looked at are added to it. */
+struct flow_entry *
+tss_classifier_lookup(struct tss_classifier *cls, const struct flow_key *pkt_key,
+                      struct flow_key *wc);
+
+#endif /* FLOW_TABLE_TSS_H */
@@ -30,6 +30,7 @@
 
 #include <stdbool.h>
 #include "flow_entry.h"
+#include "flow_entry_exact.h"
 #include "group_entry.h"
 #include "group_table.h"
 #include "dp_actions.h"
@@ -172,7 +173,7 @@ void group_entry_destroy_physic(struct group_entry *entry)
          if (ref->entry->key_len != 0)
          {
             free(ref->entry->key);
-            hlist_del(&ref->entry->hash_node);
+            exact_flow_entry_unlink(ref->entry);
          }
          flow_entry_remove(ref->entry, OFPRR_GROUP_DELETE);
 
@@ -188,7 +189,7 @@ group_entry_destroy(struct group_entry *entry) {
         if (ref->entry->key_len != 0)
         {
             free(ref->entry->key);
-            hlist_del(&ref->entry->hash_node);
+            exact_flow_entry_unlink(ref->entry);
         }
         flow_entry_remove(ref->entry, OFPRR_GROUP_DELETE);
         // Note: the flow_ref_entryf will be destroyed after a chain of calls in flow_entry_remove
@@ -234,10 +235,11 @@ execute_all(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(p->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += p->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[i]->byte_count += p->buffer->size;
-        entry->stats->counters[i]->packet_count++;
+        /* the workers run the groups concurrently */
+        __sync_fetch_and_add(&entry->stats->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->packet_count, 1);
+        __sync_fetch_and_add(&entry->stats->counters[i]->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->counters[i]->packet_count, 1);
 
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
@@ -269,10 +271,10 @@ execute_select(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(p->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += p->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[b]->byte_count += p->buffer->size;
-        entry->stats->counters[b]->packet_count++;
+        __sync_fetch_and_add(&entry->stats->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->packet_count, 1);
+        __sync_fetch_and_add(&entry->stats->counters[b]->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->counters[b]->packet_count, 1);
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
            particular flow */
@@ -303,10 +305,10 @@ execute_indirect(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(p->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += p->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[0]->byte_count += p->buffer->size;
-        entry->stats->counters[0]->packet_count++;
+        __sync_fetch_and_add(&entry->stats->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->packet_count, 1);
+        __sync_fetch_and_add(&entry->stats->counters[0]->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->counters[0]->packet_count, 1);
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
            particular flow */
@@ -342,10 +344,10 @@ execute_ff(struct group_entry *entry, struct packet *pkt) {
 
         action_set_write_actions(p->action_set, bucket->actions_num, bucket->actions);
 
-        entry->stats->byte_count += p->buffer->size;
-        entry->stats->packet_count++;
-        entry->stats->counters[b]->byte_count += p->buffer->size;
-        entry->stats->counters[b]->packet_count++;
+        __sync_fetch_and_add(&entry->stats->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->packet_count, 1);
+        __sync_fetch_and_add(&entry->stats->counters[b]->byte_count, p->buffer->size);
+        __sync_fetch_and_add(&entry->stats->counters[b]->packet_count, 1);
         /* Cookie field is set 0xffffffffffffffff
            because we cannot associate to any
            particular flow */
@@ -265,18 +265,25 @@ group_table_handle_group_mod(struct group_table *table, struct ofl_msg_group_mod
 
     switch (mod->command) {
         case (OFPGC_ADD): {
-            return group_table_add(table, mod);
+            error = group_table_add(table, mod);
+            break;
         }
         case (OFPGC_MODIFY): {
-            return group_table_modify(table, mod);
+            error = group_table_modify(table, mod);
+            break;
         }
         case (OFPGC_DELETE): {
-            return group_table_delete(table, mod);
+            error = group_table_delete(table, mod);
+            break;
         }
         default: {
             return ofl_error(OFPET_BAD_REQUEST, OFPBRC_BAD_TYPE);
         }
     }
+
+    /* the cached paths through the group are looked up again */
+    table->dp->flow_generation++;
+    return error;
 }
 
 ofl_err
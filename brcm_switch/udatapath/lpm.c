@@ -0,0 +1,505 @@
+/* Longest prefix match on an IPv4 or IPv6 address. */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow_entry.h"
+#include "hash.h"
+#include "lpm.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_flow_t
+
+#define LPM_EXT        0x80000000U  /* the slot holds a group of the next level. */
+#define LPM_NONE       UINT_MAX
+
+static const unsigned char lpm_strides_v4[] = { 16, 8, 8 };
+static const unsigned char lpm_strides_v6[] = { 16, 8, 8, 4, 4, 4, 4, 4, 4, 4, 4,
+                                                4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+                                                4, 4, 4, 4, 4, 4 };
+
+/* Returns n address bits from bit offset off, n <= 24. */
+static inline unsigned int
+lpm_bits(const unsigned char *addr, unsigned int off, unsigned int n)
+{
+    unsigned int first = off / 8;
+    unsigned int last = (off + n - 1) / 8;
+    unsigned int v = 0;
+    unsigned int i;
+
+    for (i = first; i <= last; i++)
+    {
+        v = (v << 8) | addr[i];
+    }
+    return (v >> ((last + 1) * 8 - off - n)) & ((1U << n) - 1);
+}
+
+static inline unsigned int *
+lpm_group(const struct lpm *lpm, unsigned char level, unsigned int group)
+{
+    return &lpm->levels[level].slots[(size_t)group << lpm->levels[level].stride];
+}
+
+/* Returns the prefix length of the rule held by a slot, or -1 if empty. */
+static inline int
+lpm_slot_len(const struct lpm *lpm, unsigned int slot)
+{
+    return slot == 0 ? -1 : lpm->by_index[slot - 1]->len;
+}
+
+static unsigned int
+lpm_group_alloc(struct lpm *lpm, unsigned char level, unsigned int fill)
+{
+    struct lpm_level *l = &lpm->levels[level];
+    unsigned int size = 1U << l->stride;
+    unsigned int group;
+    unsigned int *slots;
+    unsigned int i;
+
+    if (l->free_group == LPM_NONE)
+    {
+        unsigned int n = l->n_groups < 16 ? 16 : l->n_groups * 2;
+
+        if (n >= LPM_EXT)
+        {
+            ofp_fatal(0, "too many prefix trie groups");
+        }
+        l->slots = xrealloc(l->slots, (size_t)n * size * sizeof *l->slots);
+        for (i = l->n_groups; i < n; i++)
+        {
+            l->slots[(size_t)i * size] = i + 1 < n ? i + 1 : LPM_NONE;
+        }
+        l->free_group = l->n_groups;
+        l->n_groups = n;
+    }
+
+    group = l->free_group;
+    slots = lpm_group(lpm, level, group);
+    l->free_group = slots[0];
+    for (i = 0; i < size; i++)
+    {
+        slots[i] = fill;
+    }
+    return group;
+}
+
+static void
+lpm_group_free(struct lpm *lpm, unsigned char level, unsigned int group)
+{
+    struct lpm_level *l = &lpm->levels[level];
+
+    lpm_group(lpm, level, group)[0] = l->free_group;
+    l->free_group = group;
+}
+
+/* Sets value in the slots of a group and of its subgroups that hold a
+ * prefix no longer than len. */
+static void
+lpm_fill_group(struct lpm *lpm, unsigned char level, unsigned int group,
+               unsigned int value, int len)
+{
+    unsigned int *slots = lpm_group(lpm, level, group);
+    unsigned int size = 1U << lpm->levels[level].stride;
+    unsigned int i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (slots[i] & LPM_EXT)
+        {
+            lpm_fill_group(lpm, level + 1, slots[i] & ~LPM_EXT, value, len);
+        }
+        else if (lpm_slot_len(lpm, slots[i]) <= len)
+        {
+            slots[i] = value;
+        }
+    }
+}
+
+/* Frees the group held by a slot if all its slots hold the same prefix. */
+static void
+lpm_compact(struct lpm *lpm, unsigned char level, unsigned int *slot)
+{
+    unsigned int group = *slot & ~LPM_EXT;
+    unsigned int *slots = lpm_group(lpm, level, group);
+    unsigned int size = 1U << lpm->levels[level].stride;
+    unsigned int i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (slots[i] != slots[0] || (slots[i] & LPM_EXT))
+        {
+            return;
+        }
+    }
+    *slot = slots[0];
+    lpm_group_free(lpm, level, group);
+}
+
+/* Replaces old by value in the slots of a group and of its subgroups. */
+static void
+lpm_replace_group(struct lpm *lpm, unsigned char level, unsigned int group,
+                  unsigned int old, unsigned int value)
+{
+    unsigned int *slots = lpm_group(lpm, level, group);
+    unsigned int size = 1U << lpm->levels[level].stride;
+    unsigned int i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (slots[i] & LPM_EXT)
+        {
+            lpm_replace_group(lpm, level + 1, slots[i] & ~LPM_EXT, old, value);
+            lpm_compact(lpm, level + 1, &slots[i]);
+        }
+        else if (slots[i] == old)
+        {
+            slots[i] = value;
+        }
+    }
+}
+
+/* Updates the slots covered by a prefix. On insertion (old == LPM_NONE), the
+ * slots holding a shorter prefix get value; on removal, the slots holding
+ * old get value. */
+static void
+lpm_update(struct lpm *lpm, unsigned char level, unsigned int group,
+           const unsigned char *prefix, int len, unsigned int old,
+           unsigned int value)
+{
+    const struct lpm_level *l = &lpm->levels[level];
+    unsigned int *slots = lpm_group(lpm, level, group);
+    unsigned int idx = lpm_bits(prefix, l->offset, l->stride);
+    int end = l->offset + l->stride;
+
+    if (len <= end)
+    {
+        unsigned int n = 1U << (end - len);
+        unsigned int i;
+
+        for (i = idx; i < idx + n; i++)
+        {
+            if (slots[i] & LPM_EXT)
+            {
+                if (old == LPM_NONE)
+                {
+                    lpm_fill_group(lpm, level + 1, slots[i] & ~LPM_EXT, value, len);
+                }
+                else
+                {
+                    lpm_replace_group(lpm, level + 1, slots[i] & ~LPM_EXT, old, value);
+                    lpm_compact(lpm, level + 1, &slots[i]);
+                }
+            }
+            else if (old == LPM_NONE ? lpm_slot_len(lpm, slots[i]) <= len
+                                     : slots[i] == old)
+            {
+                slots[i] = value;
+            }
+        }
+        return;
+    }
+
+    if (!(slots[idx] & LPM_EXT))
+    {
+        if (old != LPM_NONE)
+        {
+            return;
+        }
+        /* the group starts with the prefix covering the whole slot */
+        slots[idx] = LPM_EXT | lpm_group_alloc(lpm, level + 1, slots[idx]);
+    }
+
+    lpm_update(lpm, level + 1, slots[idx] & ~LPM_EXT, prefix, len, old, value);
+    if (old != LPM_NONE)
+    {
+        lpm_compact(lpm, level + 1, &slots[idx]);
+    }
+}
+
+static unsigned int
+lpm_rule_hash(const unsigned char *prefix, unsigned char addr_len, unsigned char len)
+{
+    return hash_bytes(prefix, addr_len, len);
+}
+
+static inline unsigned short int
+lpm_rule_priority(const struct lpm_rule *rule)
+{
+    return rule->entry->stats->priority;
+}
+
+static struct lpm_rule *
+lpm_rule_find(const struct lpm *lpm, const unsigned char *prefix, unsigned char len)
+{
+    struct lpm_rule *rule;
+
+    HMAP_FOR_EACH_WITH_HASH (rule, struct lpm_rule, node,
+                             lpm_rule_hash(prefix, lpm->addr_len, len), &lpm->rules)
+    {
+        if (rule->len == len && !memcmp(rule->prefix, prefix, lpm->addr_len))
+        {
+            return rule;
+        }
+    }
+    return NULL;
+}
+
+/* Returns true if a rule of the given length and priority keeps the priority
+ * non-decreasing with the prefix length. */
+static bool
+lpm_priority_fits(const struct lpm *lpm, unsigned char len, unsigned short int priority)
+{
+    int i;
+
+    for (i = 0; i <= lpm->addr_len * 8; i++)
+    {
+        if (lpm->n_len[i] == 0)
+        {
+            continue;
+        }
+        if ((i < len && lpm->max_priority[i] > priority) ||
+            (i > len && lpm->min_priority[i] < priority))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Accounts a rule in the priority range of its prefix length. */
+static void
+lpm_len_add(struct lpm *lpm, unsigned char len, unsigned short int priority)
+{
+    if (lpm->n_len[len]++ == 0)
+    {
+        lpm->min_priority[len] = priority;
+        lpm->max_priority[len] = priority;
+        lpm->n_min[len] = 1;
+        lpm->n_max[len] = 1;
+        return;
+    }
+
+    if (priority < lpm->min_priority[len])
+    {
+        lpm->min_priority[len] = priority;
+        lpm->n_min[len] = 1;
+    }
+    else if (priority == lpm->min_priority[len])
+    {
+        lpm->n_min[len]++;
+    }
+
+    if (priority > lpm->max_priority[len])
+    {
+        lpm->max_priority[len] = priority;
+        lpm->n_max[len] = 1;
+    }
+    else if (priority == lpm->max_priority[len])
+    {
+        lpm->n_max[len]++;
+    }
+}
+
+/* Takes a rule, already off lpm.by_len, out of the priority range of its
+ * prefix length. The range is only recomputed once the last rule at one of
+ * its ends is gone. */
+static void
+lpm_len_remove(struct lpm *lpm, unsigned char len, unsigned short int priority)
+{
+    struct lpm_rule *rule;
+    bool recompute = false;
+
+    if (--lpm->n_len[len] == 0)
+    {
+        return;
+    }
+    if (priority == lpm->min_priority[len] && --lpm->n_min[len] == 0)
+    {
+        recompute = true;
+    }
+    if (priority == lpm->max_priority[len] && --lpm->n_max[len] == 0)
+    {
+        recompute = true;
+    }
+    if (!recompute)
+    {
+        return;
+    }
+
+    lpm->n_len[len] = 0;
+    LIST_FOR_EACH (rule, struct lpm_rule, len_node, &lpm->by_len[len])
+    {
+        lpm_len_add(lpm, len, lpm_rule_priority(rule));
+    }
+}
+
+struct lpm *
+lpm_create(unsigned char addr_len)
+{
+    struct lpm *lpm = xmalloc(sizeof *lpm);
+    const unsigned char *strides = addr_len == 4 ? lpm_strides_v4 : lpm_strides_v6;
+    unsigned char n_levels = addr_len == 4 ? ARRAY_SIZE(lpm_strides_v4)
+                                           : ARRAY_SIZE(lpm_strides_v6);
+    unsigned char offset = 0;
+    unsigned int i;
+
+    memset(lpm, 0, sizeof *lpm);
+    lpm->addr_len = addr_len;
+    lpm->n_levels = n_levels;
+    for (i = 0; i < n_levels; i++)
+    {
+        lpm->levels[i].offset = offset;
+        lpm->levels[i].stride = strides[i];
+        lpm->levels[i].free_group = LPM_NONE;
+        offset += strides[i];
+    }
+
+    /* the root is never freed */
+    lpm->levels[0].slots = xcalloc(1U << strides[0], sizeof *lpm->levels[0].slots);
+    lpm->levels[0].n_groups = 1;
+
+    hmap_init(&lpm->rules);
+    for (i = 0; i <= LPM_MAX_PREFIX; i++)
+    {
+        list_init(&lpm->by_len[i]);
+    }
+    lpm->free_index = LPM_NONE;
+    VLOG_DBG(LOG_MODULE, "created IPv%d prefix trie", addr_len == 4 ? 4 : 6);
+    return lpm;
+}
+
+void
+lpm_destroy(struct lpm *lpm)
+{
+    struct lpm_rule *rule, *next;
+    unsigned char i;
+
+    HMAP_FOR_EACH_SAFE (rule, next, struct lpm_rule, node, &lpm->rules)
+    {
+        hmap_remove(&lpm->rules, &rule->node);
+        rule->entry->lpm_rule = NULL;
+        free(rule);
+    }
+    hmap_destroy(&lpm->rules);
+    for (i = 0; i < lpm->n_levels; i++)
+    {
+        free(lpm->levels[i].slots);
+    }
+    free(lpm->by_index);
+    free(lpm);
+}
+
+bool
+lpm_fits(const struct lpm *lpm, const unsigned char *prefix, unsigned char len,
+         unsigned short int priority)
+{
+    return len <= lpm->addr_len * 8 && lpm_rule_find(lpm, prefix, len) == NULL &&
+           lpm_priority_fits(lpm, len, priority);
+}
+
+struct lpm_rule *
+lpm_insert(struct lpm *lpm, const unsigned char *prefix, unsigned char len,
+           struct flow_entry *entry)
+{
+    unsigned short int priority = entry->stats->priority;
+    struct lpm_rule *rule;
+
+    if (!lpm_fits(lpm, prefix, len, priority))
+    {
+        return NULL;
+    }
+
+    rule = xmalloc(sizeof *rule);
+    rule->lpm = lpm;
+    rule->entry = entry;
+    rule->len = len;
+    memset(rule->prefix, 0, sizeof rule->prefix);
+    memcpy(rule->prefix, prefix, lpm->addr_len);
+
+    if (lpm->free_index == LPM_NONE)
+    {
+        unsigned int n = lpm->n_index < 64 ? 64 : lpm->n_index * 2;
+        unsigned int i;
+
+        lpm->by_index = xrealloc(lpm->by_index, n * sizeof *lpm->by_index);
+        for (i = lpm->n_index; i < n; i++)
+        {
+            /* free indexes are chained through their slot */
+            lpm->by_index[i] = (struct lpm_rule *)(size_t)(i + 1 < n ? i + 1 : LPM_NONE);
+        }
+        lpm->free_index = lpm->n_index;
+        lpm->n_index = n;
+    }
+    rule->index = lpm->free_index;
+    lpm->free_index = (unsigned int)(size_t)lpm->by_index[rule->index];
+    lpm->by_index[rule->index] = rule;
+
+    hmap_insert(&lpm->rules, &rule->node, lpm_rule_hash(rule->prefix, lpm->addr_len, len));
+    list_push_back(&lpm->by_len[len], &rule->len_node);
+    lpm_len_add(lpm, len, priority);
+    lpm->n_rules++;
+
+    lpm_update(lpm, 0, 0, rule->prefix, len, LPM_NONE, rule->index + 1);
+    entry->lpm_rule = rule;
+    return rule;
+}
+
+void
+lpm_remove(struct lpm_rule *rule)
+{
+    struct lpm *lpm = rule->lpm;
+    unsigned char prefix[LPM_MAX_ADDR_LEN];
+    unsigned int value = 0;
+    int len;
+
+    /* the slots of the prefix fall back to the longest shorter prefix */
+    memcpy(prefix, rule->prefix, sizeof prefix);
+    for (len = rule->len - 1; len >= 0; len--)
+    {
+        struct lpm_rule *cover;
+
+        prefix[len / 8] &= ~(0x80 >> (len % 8));
+        cover = lpm_rule_find(lpm, prefix, len);
+        if (cover != NULL)
+        {
+            value = cover->index + 1;
+            break;
+        }
+    }
+
+    lpm_update(lpm, 0, 0, rule->prefix, rule->len, rule->index + 1, value);
+
+    hmap_remove(&lpm->rules, &rule->node);
+    list_remove(&rule->len_node);
+    lpm_len_remove(lpm, rule->len, lpm_rule_priority(rule));
+    lpm->by_index[rule->index] = (struct lpm_rule *)(size_t)lpm->free_index;
+    lpm->free_index = rule->index;
+    lpm->n_rules--;
+    rule->entry->lpm_rule = NULL;
+    free(rule);
+}
+
+struct flow_entry *
+lpm_find(const struct lpm *lpm, const unsigned char *prefix, unsigned char len)
+{
+    struct lpm_rule *rule = lpm_rule_find(lpm, prefix, len);
+
+    return rule != NULL ? rule->entry : NULL;
+}
+
+struct flow_entry *
+lpm_lookup(const struct lpm *lpm, const unsigned char *addr, unsigned int *n_bits)
+{
+    const struct lpm_level *l = &lpm->levels[0];
+    unsigned int slot = l->slots[lpm_bits(addr, 0, l->stride)];
+
+    while (slot & LPM_EXT)
+    {
+        l++;
+        slot = l->slots[((size_t)(slot & ~LPM_EXT) << l->stride) +
+                        lpm_bits(addr, l->offset, l->stride)];
+    }
+
+    *n_bits = l->offset + l->stride;
+    return slot == 0 ? NULL : lpm->by_index[slot - 1]->entry;
+}
@@ -0,0 +1,109 @@
+#ifndef LPM_H
+#define LPM_H 1
+
+#include <stdbool.h>
+#include "hmap.h"
+#include "list.h"
+
+/****************************************************************************
+ * Longest prefix match on an IPv4 or IPv6 address.
+ *
+ * A multibit trie with prefix expansion: each level indexes a fixed number
+ * of address bits, and every slot holds either the longest prefix covering
+ * it, or a group of the next level. IPv4 uses 16, 8 then 8 bits, so a lookup
+ * reads at most three slots. IPv6 uses 16, 8 and 8 bits, then 4 bits per
+ * level, which keeps the groups of the long prefixes one cache line wide;
+ * routes up to /48 resolve in at most seven reads.
+ *
+ * The root of a trie, 2^16 slots, takes 256 KB, and every group of a lower
+ * level 1 KB (8 bits) or 64 bytes (4 bits). A 24 bit root (DIR-24-8) would
+ * save a read for prefixes longer than /16, but take 64 MB per trie.
+ *
+ * Prefixes carry flow entries. The trie returns the entry of the longest
+ * prefix, so it only accepts entries whose priority does not decrease with
+ * the prefix length; lpm_insert() refuses the others, which are left to the
+ * caller.
+ ****************************************************************************/
+
+#define LPM_MAX_LEVELS    32
+#define LPM_MAX_ADDR_LEN  16
+#define LPM_MAX_PREFIX    (LPM_MAX_ADDR_LEN * 8)
+
+struct flow_entry;
+struct lpm;
+
+struct lpm_rule {
+    struct hmap_node         node;      /* in lpm.rules, by prefix hash. */
+    struct list              len_node;  /* in lpm.by_len[len]. */
+    struct lpm              *lpm;
+    struct flow_entry       *entry;
+    unsigned int             index;     /* in lpm.by_index. */
+    unsigned char            len;
+    unsigned char            prefix[LPM_MAX_ADDR_LEN]; /* zero beyond len. */
+};
+
+/* The groups of a trie level, in a single array. */
+struct lpm_level {
+    unsigned char            offset;    /* first address bit indexed. */
+    unsigned char            stride;    /* address bits indexed. */
+    unsigned int            *slots;
+    unsigned int             n_groups;  /* allocated groups. */
+    unsigned int             free_group; /* head of the free groups, chained
+                                            through their first slot. */
+};
+
+struct lpm {
+    unsigned char            addr_len;  /* 4 or 16. */
+    unsigned char            n_levels;
+    struct lpm_level         levels[LPM_MAX_LEVELS]; /* level 0 is one group. */
+    struct hmap              rules;
+    struct lpm_rule        **by_index;
+    unsigned int             n_index;
+    unsigned int             free_index; /* head of the free indexes, or
+                                            UINT_MAX. */
+    unsigned int             n_rules;
+    /* rules of each prefix length, and their priority range along with the
+     * number of rules at either end of it. */
+    struct list              by_len[LPM_MAX_PREFIX + 1];
+    unsigned int             n_len[LPM_MAX_PREFIX + 1];
+    unsigned short int       min_priority[LPM_MAX_PREFIX + 1];
+    unsigned short int       max_priority[LPM_MAX_PREFIX + 1];
+    unsigned int             n_min[LPM_MAX_PREFIX + 1];
+    unsigned int             n_max[LPM_MAX_PREFIX + 1];
+};
+
+/* Creates an empty trie for addresses of addr_len bytes, 4 or 16. */
+struct lpm *
+lpm_create(unsigned char addr_len);
+
+void
+lpm_destroy(struct lpm *lpm);
+
+/* Returns true if lpm_insert() would take a prefix with the given priority:
+ * the prefix is not in the trie yet, and the priority is not out of order
+ * with the prefixes of other lengths. */
+bool
+lpm_fits(const struct lpm *lpm, const unsigned char *prefix, unsigned char len,
+         unsigned short int priority);
+
+/* Adds a prefix, given with its bits beyond len zeroed, carrying an entry.
+ * Returns NULL if lpm_fits() does not hold. */
+struct lpm_rule *
+lpm_insert(struct lpm *lpm, const unsigned char *prefix, unsigned char len,
+           struct flow_entry *entry);
+
+void
+lpm_remove(struct lpm_rule *rule);
+
+/* Returns the entry of a prefix, given with its bits beyond len zeroed, or
+ * NULL if the prefix is not in the trie. */
+struct flow_entry *
+lpm_find(const struct lpm *lpm, const unsigned char *prefix, unsigned char len);
+
+/* Returns the entry of the longest prefix matching addr, or NULL. The
+ * number of leading address bits the result depends on is stored in
+ * n_bits. */
+struct flow_entry *
+lpm_lookup(const struct lpm *lpm, const unsigned char *addr, unsigned int *n_bits);
+
+#endif /* LPM_H */
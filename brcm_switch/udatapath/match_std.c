@@ -34,7 +34,7 @@
 #include "lib/hash.h"
 #include "oflib/oxm-match.h"
 #include "match_std.h"
-#include "nbee_link/nbee_link.h"
+#include "flow_key.h"
 #include "vlog.h"
 
 /* Two matches overlap, if there exists a packet,
@@ -49,21 +49,6 @@ matches_8(unsigned char *a, unsigned char *b) {
      return ((a[0] ^ b[0]) == 0x00);
 }     
 
-/* Returns true if two values of 8 bit size match, considering their masks. */
-static int
-pkt_mask8(unsigned char *a, unsigned char *am, unsigned char *b) {
-     return ((~(am[0]) & (a[0] ^ b[0])) == 0x00);
-}     
-
-/* Returns true if two values of 16 bit size match */
-static int
-pkt_match_16(unsigned char *a, unsigned char *b) {
-    unsigned short int *a1 = (unsigned short int *) a;
-    unsigned short int *b1 = (unsigned short int *) b;
-    return ((*a1 ^ ntohs(*b1)) == 0);
-}
-
-
 /* Returns true if two values of 16 bit size match */
 static int
 matches_16(unsigned char *a, unsigned char *b) {
@@ -73,35 +58,6 @@ matches_16(unsigned char *a, unsigned char *b) {
 }
 
 
-/* Returns true if two values of 16 bit size match, considering their masks. */
-static int
-pkt_mask16(unsigned char *a, unsigned char *am, unsigned char *b) {
-    unsigned short int *a1 = (unsigned short int *) a;
-    unsigned short int *b1 = (unsigned short int *) b;
-    unsigned short int *mask = (unsigned short int *) am;
-    
-    return (((*mask) & (*a1 ^ ntohs(*b1))) == 0); /* modify by linke */
-}
-
-/* Returns true if two values of 16 bit size match, considering their masks. */
-static int
-matches_mask16(unsigned char *a, unsigned char *am, unsigned char *b) {
-    unsigned short int *a1 = (unsigned short int *) a;
-    unsigned short int *b1 = (unsigned short int *) b;
-    unsigned short int *mask = (unsigned short int *) am;
-
-    return (((*mask) & (*a1 ^ *b1)) == 0); // modify by linke
-}
-
-
-/*Returns true if two values of 32 bit size match . */
-static int
-pkt_match_32(unsigned char *a, unsigned char *b) {  
-    unsigned int *a1 = (unsigned int *) a;
-    unsigned int *b1 = (unsigned int *) b;
-    return ((*a1 ^ ntohl(*b1)) == 0);
-}
-
 /*Returns true if two values of 32 bit size match . */
 static int
 matches_32(unsigned char *a, unsigned char *b) {
@@ -110,34 +66,6 @@ matches_32(unsigned char *a, unsigned char *b) {
     return ((*a1 ^ *b1) == 0);   // modify by linke
 }
 
-/*Returns true if two values of 32 bit size match, considering their masks. */
-static int
-pkt_mask32(unsigned char *a, unsigned char *am, unsigned char *b) { 
-    unsigned int *a1 = (unsigned int *) a;
-    unsigned int *b1 = (unsigned int *) b;
-    unsigned int *mask = (unsigned int *) am;
-    
-    return (((*mask) & (*a1 ^ ntohl(*b1))) == 0);   // modify by linke
-}
-
-/*Returns true if two values of 32 bit size match, considering their masks. */
-static int
-matches_mask32(unsigned char *a, unsigned char *am, unsigned char *b) {
-    unsigned int *a1 = (unsigned int *) a;
-    unsigned int *b1 = (unsigned int *) b;
-    unsigned int *mask = (unsigned int *) am;
-    return (((*mask) & (*a1 ^ *b1)) == 0);   // modify by linke
-}
-
-/* Returns true if two values of 64 bits size match*/
-static int
-pkt_64(unsigned char *a, unsigned char *b) {
-    unsigned long long int *a1 = (unsigned long long int *) a;
-    unsigned long long int *b1 = (unsigned long long int *) b;
-
-    return ((*a1 ^ ntohll(*b1)) == 0);
-}
-
 /* Returns true if two values of 64 bits size match*/ 
 static int
 matches_64(unsigned char *a, unsigned char *b) {    
@@ -147,48 +75,17 @@ matches_64(unsigned char *a, unsigned char *b) {
     return ((*a1 ^ *b1) == 0);
 } 
 
-/* Returns true if two values of 64 bits size match, considering their masks.*/ 
-static int
-pkt_mask64(unsigned char *a,unsigned char *am, unsigned char *b) {   
-    unsigned long long int *a1 = (unsigned long long int *) a; 
-    unsigned long long int *b1 = (unsigned long long int *) b;
-    unsigned long long int *mask = (unsigned long long int *) am;
-    
-    return (((*mask) & (*a1 ^ ntohll(*b1))) == 0);   // modify by linke
-} 
-
-/* Returns true if two values of 64 bits size match, considering their masks.*/
-static int
-matches_mask64(unsigned char *a,unsigned char *am, unsigned char *b) { 
-    unsigned long long int *a1 = (unsigned long long int *) a;
-    unsigned long long int *b1 = (unsigned long long int *) b;
-    unsigned long long int *mask = (unsigned long long int *) am;
-
-    return (((*mask) & (*a1 ^ *b1)) == 0);      // modify by linke
-} 
-
 /* Returns true if the two ethernet addresses match */
 static int
 eth_match(unsigned char *a, unsigned char *b) {
      return (matches_32(a,b) && matches_16(a+4,b+4) );
 }
 
-/* Returns true if the two ethernet addresses match, considering their masks. */
-static int
-eth_mask(unsigned char *a, unsigned char *am, unsigned char *b) {
-     return (matches_mask32(a,am,b) && matches_mask16(a+4,am+4,b+4) );
-}
-
 static int
 ipv6_match(unsigned char *a, unsigned char *b) {
     return (matches_64(a,b) && matches_64(a+8,b+8));
 }
 
-static int
-ipv6_mask(unsigned char *a, unsigned char *am, unsigned char *b) {    
-    return (matches_mask64(a,am,b) && matches_mask64(a+8,am+8,b+8));
-}
-
 #if 0
 static unsigned int match_nonmask_header(struct ofl_match_tlv *f)
 {
@@ -281,214 +178,22 @@ static unsigned int getOxmHeadType(struct ofl_match_tlv *f) {     // added by li
 }
 #endif
 
-bool packet_match(struct ofl_match *flow_match, struct ofl_match *packet)
+/* Returns true if the packet key matches the flow match. */
+bool packet_match(struct ofl_match *flow_match, struct flow_key *packet)
 {
+    struct flow_key key, mask;
 
-    struct ofl_match_tlv *f;
-    struct packet_fields *packet_f;
-    bool ret = false;
-    unsigned short int *matchv = NULL;
-    bool any_vlan = false;
-    unsigned int headerTmp;
-    
     if (flow_match->header.length == 0)
     {
         return true;
     }
-    /*TODO: Possible combinations of VLAN_ID and masks */
-    
-    HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv, hmap_node, DP_FIELD_HASH(OXM_OF_VLAN_VID_W), &flow_match->match_fields)
-    {
-         unsigned short int *matchv = (unsigned short int*) f->value;
-     
-         HMAP_FOR_EACH_WITH_HASH(packet_f, struct packet_fields, hmap_node, DP_FIELD_HASH(OXM_OF_VLAN_VID), &packet->match_fields)
-         {
-              unsigned short int *maskv = (unsigned short int*) (f->value + 2);
-              if ((*matchv == OFPVID_PRESENT) && (*maskv == OFPVID_PRESENT))
-              {
-                 any_vlan = true;
-              }
-         }
-    }
-    
-    HMAP_FOR_EACH_WITH_HASH(f, struct ofl_match_tlv, hmap_node,DP_FIELD_HASH(OXM_OF_VLAN_VID), &flow_match->match_fields)
-    {
-        matchv = (unsigned short int*) f->value;
-        /* Check if the field is present in the packet */
-        HMAP_FOR_EACH_WITH_HASH(packet_f, struct packet_fields, hmap_node, DP_FIELD_HASH(OXM_OF_VLAN_VID), &packet->match_fields)
-        {     
-            /* Do not match packets with a VLAN Tag */
-            if (*matchv == OFPVID_NONE)
-            {
-                return false;
-            }
-        }  
-    } 
-   
-    /* Loop through the match fields */
-    HMAP_FOR_EACH(f, struct ofl_match_tlv, hmap_node, &flow_match->match_fields)
-    {
-        /* Check if the field is present in the packet */
-        //headerTmp = getOxmHeadType(f);
-        headerTmp = f->header;
-        
-        if (OXM_HASMASK(f->header))
-        {
-            headerTmp = OXM_HEADER(OXM_VENDOR(f->header),OXM_FIELD(f->header),OXM_LENGTH(f->header)/2);
-        }
-        
-        if(headerTmp == OXM_OF_VLAN_VID)
-        {
-            matchv = (unsigned short int*) f->value;
-            //vlan vid = none ʱpacket ûvlan tagʱƥ
-            if (*matchv == OFPVID_NONE)
-            {
-                ret = true;
-            }
-        }
 
-        HMAP_FOR_EACH_WITH_HASH(packet_f, struct packet_fields, hmap_node, DP_FIELD_HASH(headerTmp), &packet->match_fields)
-        { 
-            int field_len =  OXM_LENGTH(f->header);
-            bool has_mask = OXM_HASMASK(f->header);
-            ret = true;
-                
-            if (has_mask) 
-            {
-                field_len = field_len / 2;
-            }
-            
-            switch (field_len){
-                case (sizeof(unsigned char)):
-                {
-                    if (has_mask){
-                        if (pkt_mask8(f->value,f->value + field_len, packet_f->value) == 0){
-                          return false;
-                        }
-                    }
-                    else 
-                        if (matches_8(f->value, packet_f->value) == 0){
-                          return false;
-                    }
-                    break;   
-                }
-                case (sizeof(unsigned short int)):
-                {
-                    if ((headerTmp != OXM_OF_VLAN_VID) || (!any_vlan))
-                    {
-                        if (has_mask)
-                        {
-                            if (pkt_mask16(f->value,f->value+ field_len, packet_f->value) == 0)
-                            {
-                              return false;
-                            }
-                        }
-                        else 
-                        {
-                            if (pkt_match_16(f->value, packet_f->value) == 0)
-                            {
-                              return false;
-                            }
-                        }
-                    } else {
-                       //if vlan id is present
-                       ret = true;
-                    }
-                    break;
-                }
-                case (sizeof(unsigned int)):
-                {
-                    if (has_mask){
-                        if (f->header == OXM_OF_IPV4_DST_W || f->header == OXM_OF_IPV4_SRC_W
-						    ||f->header == OXM_OF_ARP_SPA_W || f->header == OXM_OF_ARP_TPA_W){
-						    if (matches_mask32(f->value,f->value + field_len, packet_f->value) == 0){
-                                 return false;
-                            }
-                        }
-                        else
-                            if (pkt_mask32(f->value,f->value + field_len, packet_f->value) == 0){
-                                return false;
-                        }
-                    }
-                    else
-                        if (f->header == OXM_OF_IPV4_DST || f->header == OXM_OF_IPV4_SRC
-						    ||f->header == OXM_OF_ARP_SPA || f->header == OXM_OF_ARP_TPA){
-						    if (matches_32(f->value, packet_f->value) == 0){
-                                 return false;
-                            }
-                        }
-
-                        else
-                            if (pkt_match_32(f->value, packet_f->value) == 0){
-                                return false;
-                        }
-                    break;
-                 }
-                case (ETH_ADDR_LEN):{
-                     if (has_mask){
-                        if (eth_mask(f->value,f->value + field_len, packet_f->value) == 0){
-                          return false;
-                        }
-                     }
-                    else
-                        if (eth_match(f->value, packet_f->value) == 0){
-                          return false;
-                        }
-                    break;
-                }
-                case (sizeof(unsigned long long int)):{
-                    /* metadata in host byte order */
-                    if (has_mask) {
-                        if (OXM_OF_METADATA_W == f->header)
-                        {
-                            if (matches_mask64(f->value,f->value + field_len, packet_f->value) == 0)
-                            {
-                                return false;
-                            }
-                        }
-                        else if (pkt_mask64(f->value,f->value + field_len, packet_f->value) == 0)
-                        {
-                          return false;
-                        }
-                    }
-                    else {
-                        if (OXM_OF_METADATA == f->header)
-                        {
-                            if (matches_64(f->value, packet_f->value) == 0)
-                            {
-                                return false;
-                            }
-                        }
-                        else if (pkt_64(f->value, packet_f->value) == 0)
-                        {
-                          return false;
-                        }
-                    }
-                    break;
-                }
-		            case (16):{
-                    if (has_mask){
-                        if (ipv6_mask(f->value,f->value + field_len, packet_f->value) == 0){
-                          return false;
-                        }
-                    }
-                    else
-                        if (ipv6_match(f->value, packet_f->value) == 0){
-                          return false;
-                        }
-                    break;
-                }
-            }
-        }
-            
-         if (!ret)
-            return ret;
-         else 
-            ret = false;      
+    if (!flow_key_from_match(&key, &mask, flow_match))
+    {
+        return false;
     }
 
-    return true;
-
+    return flow_key_match(packet, &key, &mask);
 }
 
 
@@ -0,0 +1,195 @@
+/* Megaflow cache in front of the pipeline tables. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "megaflow.h"
+#include "util.h"
+#include "vlog.h"
+#define LOG_MODULE VLM_pipeline
+
+/* Gathers the words of a key selected by the mask and returns their hash,
+ * seeded with the present fields. */
+static unsigned int
+megaflow_hash(const struct megaflow_mask *mask, const struct flow_key *key,
+              unsigned long long int *words)
+{
+    unsigned char i;
+
+    for (i = 0; i < mask->n_words; i++)
+    {
+        words[i] = key->w[mask->words[i]] & mask->mask.w[mask->words[i]];
+    }
+    return hash_words((const unsigned int *)words,
+                      mask->n_words * (sizeof *words / sizeof(unsigned int)),
+                      (unsigned int)(key->present ^ (key->present >> 32)));
+}
+
+static struct megaflow *
+megaflow_find(struct megaflow_mask *mask, unsigned long long int present,
+              const unsigned long long int *words, unsigned int hash)
+{
+    struct megaflow *flow;
+
+    HMAP_FOR_EACH_WITH_HASH (flow, struct megaflow, node, hash, &mask->flows)
+    {
+        unsigned char i;
+
+        if (flow->key.present != present)
+        {
+            continue;
+        }
+        for (i = 0; i < mask->n_words; i++)
+        {
+            if (flow->key.w[mask->words[i]] != words[i])
+            {
+                break;
+            }
+        }
+        if (i == mask->n_words)
+        {
+            return flow;
+        }
+    }
+    return NULL;
+}
+
+static void
+megaflow_remove(struct megaflow_cache *cache, struct megaflow *flow)
+{
+    struct megaflow_mask *mask = flow->mask;
+
+    hmap_remove(&mask->flows, &flow->node);
+    free(flow);
+    cache->n_flows--;
+
+    if (hmap_is_empty(&mask->flows))
+    {
+        hmap_destroy(&mask->flows);
+        list_remove(&mask->node);
+        free(mask);
+    }
+}
+
+void
+megaflow_cache_init(struct megaflow_cache *cache)
+{
+    list_init(&cache->masks);
+    cache->n_flows = 0;
+}
+
+void
+megaflow_cache_flush(struct megaflow_cache *cache)
+{
+    struct megaflow_mask *mask, *next_mask;
+
+    LIST_FOR_EACH_SAFE (mask, next_mask, struct megaflow_mask, node, &cache->masks)
+    {
+        struct megaflow *flow, *next;
+
+        HMAP_FOR_EACH_SAFE (flow, next, struct megaflow, node, &mask->flows)
+        {
+            hmap_remove(&mask->flows, &flow->node);
+            free(flow);
+        }
+        hmap_destroy(&mask->flows);
+        list_remove(&mask->node);
+        free(mask);
+    }
+    cache->n_flows = 0;
+}
+
+const struct megaflow *
+megaflow_cache_lookup(struct megaflow_cache *cache, const struct flow_key *key,
+                      unsigned long long int generation)
+{
+    unsigned long long int words[FLOW_KEY_WORDS];
+    struct megaflow_mask *mask, *next;
+
+    LIST_FOR_EACH_SAFE (mask, next, struct megaflow_mask, node, &cache->masks)
+    {
+        unsigned int hash = megaflow_hash(mask, key, words);
+        struct megaflow *flow = megaflow_find(mask, key->present, words, hash);
+
+        if (flow == NULL)
+        {
+            continue;
+        }
+        if (flow->generation != generation)
+        {
+            megaflow_remove(cache, flow);
+            continue;
+        }
+        return flow;
+    }
+    return NULL;
+}
+
+void
+megaflow_cache_insert(struct megaflow_cache *cache, const struct flow_key *key,
+                      const struct flow_key *mask, struct flow_entry **entries,
+                      unsigned char n_entries, unsigned long long int generation)
+{
+    unsigned long long int words[FLOW_KEY_WORDS];
+    struct megaflow_mask *m;
+    struct megaflow *flow;
+    unsigned int hash;
+    unsigned char i;
+
+    if (n_entries == 0 || n_entries > PIPELINE_TABLES)
+    {
+        return;
+    }
+
+    if (cache->n_flows >= MEGAFLOW_MAX_FLOWS)
+    {
+        VLOG_DBG(LOG_MODULE, "megaflow cache full, flushing %u flows.", cache->n_flows);
+        megaflow_cache_flush(cache);
+    }
+
+    LIST_FOR_EACH (m, struct megaflow_mask, node, &cache->masks)
+    {
+        if (!memcmp(m->mask.w, mask->w, sizeof m->mask.w))
+        {
+            break;
+        }
+    }
+
+    if (&m->node == &cache->masks)
+    {
+        m = xmalloc(sizeof *m);
+        m->mask = *mask;
+        m->mask.present = 0;
+        m->n_words = 0;
+        for (i = 0; i < FLOW_KEY_WORDS; i++)
+        {
+            if (mask->w[i] != 0)
+            {
+                m->words[m->n_words++] = i;
+            }
+        }
+        hmap_init(&m->flows);
+        list_push_back(&cache->masks, &m->node);
+    }
+
+    hash = megaflow_hash(m, key, words);
+    flow = megaflow_find(m, key->present, words, hash);
+    if (flow == NULL)
+    {
+        flow = xmalloc(sizeof *flow);
+        flow->mask = m;
+        flow_key_init(&flow->key);
+        flow->key.present = key->present;
+        for (i = 0; i < m->n_words; i++)
+        {
+            flow->key.w[m->words[i]] = words[i];
+        }
+        hmap_insert(&m->flows, &flow->node, hash);
+        cache->n_flows++;
+    }
+
+    flow->generation = generation;
+    flow->n_entries = n_entries;
+    memcpy(flow->entries, entries, n_entries * sizeof *entries);
+}
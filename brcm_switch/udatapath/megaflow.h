@@ -0,0 +1,70 @@
+#ifndef MEGAFLOW_H
+#define MEGAFLOW_H 1
+
+#include <stdbool.h>
+#include "list.h"
+#include "hmap.h"
+#include "flow_key.h"
+#include "oflib/ofl.h"
+
+/****************************************************************************
+ * Megaflow cache in front of the pipeline tables.
+ *
+ * A megaflow records the flow entries a packet went through, keyed on the
+ * packet flow key under the union of the fields the table lookups consulted.
+ * Any packet with the same fields present and the same values in those
+ * fields takes the same path, so a cache hit replaces the lookup in every
+ * table of the path by one hash probe per distinct mask.
+ * A megaflow is valid for the datapath flow generation it was built in; any
+ * flow, group or meter change moves the generation on and the stale
+ * megaflows are dropped as they are hit.
+ ****************************************************************************/
+
+#define MEGAFLOW_MAX_FLOWS  65536
+
+struct flow_entry;
+
+struct megaflow_mask {
+    struct list              node;      /* cache list of masks. */
+    struct hmap              flows;     /* megaflow, by masked key hash. */
+    struct flow_key          mask;
+    unsigned char            n_words;
+    unsigned char            words[FLOW_KEY_WORDS]; /* key words with a
+                                                       non-zero mask. */
+};
+
+struct megaflow {
+    struct hmap_node         node;
+    struct megaflow_mask    *mask;
+    struct flow_key          key;       /* masked by mask; present holds the
+                                           exact set of packet fields. */
+    unsigned long long int   generation;
+    unsigned char            n_entries;
+    struct flow_entry       *entries[PIPELINE_TABLES]; /* in pipeline order. */
+};
+
+struct megaflow_cache {
+    struct list              masks;
+    unsigned int             n_flows;
+};
+
+void
+megaflow_cache_init(struct megaflow_cache *cache);
+
+/* Removes all the megaflows. */
+void
+megaflow_cache_flush(struct megaflow_cache *cache);
+
+/* Returns the megaflow matching a packet key in the given generation, or
+ * NULL. A stale megaflow matching the key is removed. */
+const struct megaflow *
+megaflow_cache_lookup(struct megaflow_cache *cache, const struct flow_key *key,
+                      unsigned long long int generation);
+
+/* Caches the path of a packet. mask holds the fields the lookups consulted. */
+void
+megaflow_cache_insert(struct megaflow_cache *cache, const struct flow_key *key,
+                      const struct flow_key *mask, struct flow_entry **entries,
+                      unsigned char n_entries, unsigned long long int generation);
+
+#endif /* MEGAFLOW_H */
@@ -33,6 +33,7 @@
 #include <pthread.h>
 
 #include "flow_entry.h"
+#include "flow_entry_exact.h"
 #include "meter_entry.h"
 #include "meter_table.h"
 #include "dp_actions.h"
@@ -214,7 +215,7 @@ meter_entry_destroy(struct meter_entry *entry) {
         if(ref->entry->key_len != 0)
         {
             free(ref->entry->key);
-            hlist_del(&ref->entry->hash_node);
+            exact_flow_entry_unlink(ref->entry);
         }
         alta_logic_entry_remove(ref->entry,METER_DESTROY);
         flow_entry_remove(ref->entry, OFPRR_METER_DELETE);// METER_DELETE ???????
@@ -290,15 +291,16 @@ choose_band(struct meter_entry *entry, struct packet *pkt)
 
 /// type - conversion
 // Not handle burst size
-void
+bool
 meter_entry_apply(struct meter_entry *entry, struct packet **pkt){
     
     size_t b;
     bool drop = false;
     unsigned char new_dscp ;
 
-    entry->stats->packet_in_count++;
-    entry->stats->byte_in_count += (*pkt)->buffer->size;
+    /* the workers apply the meters concurrently */
+    __sync_fetch_and_add(&entry->stats->packet_in_count, 1);
+    __sync_fetch_and_add(&entry->stats->byte_in_count, (*pkt)->buffer->size);
 
     //set_meter_config(*pkt,entry,&entry->dp->pol_config);
 
@@ -336,16 +338,11 @@ meter_entry_apply(struct meter_entry *entry, struct packet **pkt){
                 break;
             }
         }
-        entry->stats->band_stats[b]->byte_band_count += (*pkt)->buffer->size;
-        entry->stats->band_stats[b]->packet_band_count++;
-        if (drop){
-//            VLOG_ERR_RL(LOG_MODULE, &rl, "Meter table Dropping packet: rate %d  tpye :%s ", band_header->rate,
-//                                    entry->config->flags & OFPMF_KBPS ? "OFPMF_KBPS" : "OFPMF_PKTPS");
-            packet_destroy(*pkt);
-            *pkt = NULL;
-        }
+        __sync_fetch_and_add(&entry->stats->band_stats[b]->byte_band_count, (*pkt)->buffer->size);
+        __sync_fetch_and_add(&entry->stats->band_stats[b]->packet_band_count, 1);
     }
 
+    return !drop;
 }
 
 
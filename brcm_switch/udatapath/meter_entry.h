@@ -86,8 +86,9 @@ meter_entry_destroy(struct meter_entry *entry);
 void
 meter_entry_destroy2(struct meter_entry *entry,struct meter_entry *new_entry);
 
-/* Apply the meter entry on the packet. */
-void
+/* Apply the meter entry on the packet. Returns false if the packet is to be
+ * dropped, which is left to the caller. */
+bool
 meter_entry_apply(struct meter_entry *entry, struct packet **pkt);
 
 
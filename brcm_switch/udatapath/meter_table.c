@@ -59,6 +59,7 @@ meter_table_create(struct datapath *dp) {
     table->dp = dp;
     table->entries_num = 0;
     hmap_init(&table->meter_entries);
+    pthread_mutex_init(&table->lock, NULL);
 
     table->features = xmalloc(sizeof(struct ofl_meter_features));
     table->features->max_meter = DEFAULT_MAX_METER;
@@ -80,6 +81,7 @@ meter_table_destroy(struct meter_table *table) {
         meter_entry_destroy(entry);
     }
 
+    pthread_mutex_destroy(&table->lock);
     free(table);
 }
 
@@ -102,19 +104,32 @@ meter_table_find(struct meter_table *table, unsigned int meter_id) {
 
 
 
-void
-meter_table_apply(struct meter_table *table, struct packet **packet, unsigned int meter_id) {
+bool
+meter_table_admit(struct meter_table *table, struct packet *packet, unsigned int meter_id) {
     struct meter_entry *entry;
+    bool admit;
 
     entry = meter_table_find(table, meter_id);
-    table->dp->m_entry = entry;
+    packet->meter_entry = entry;
 
     if (entry == NULL)
     {
-        return;
+        return true;
     }
 
-    meter_entry_apply(entry, packet);
+    pthread_mutex_lock(&table->lock);
+    admit = meter_entry_apply(entry, &packet);
+    pthread_mutex_unlock(&table->lock);
+    return admit;
+}
+
+void
+meter_table_apply(struct meter_table *table, struct packet **packet, unsigned int meter_id) {
+    if (!meter_table_admit(table, *packet, meter_id))
+    {
+        packet_destroy(*packet);
+        *packet = NULL;
+    }
 }
 
 
@@ -233,23 +248,32 @@ meter_table_delete(struct meter_table *table, struct ofl_msg_meter_mod *mod) {
 ofl_err
 meter_table_handle_meter_mod(struct meter_table *table, struct ofl_msg_meter_mod *mod,
                                                           const struct sender *sender) {
+    ofl_err error;
+
     if(sender->remote->role == OFPCR_ROLE_SLAVE)
         return ofl_error(OFPET_BAD_REQUEST, OFPBRC_IS_SLAVE);
 
     switch (mod->command) {
         case (OFPMC_ADD): {
-            return meter_table_add(table, mod);
+            error = meter_table_add(table, mod);
+            break;
         }
         case (OFPMC_MODIFY): {
-            return meter_table_modify(table, mod);
+            error = meter_table_modify(table, mod);
+            break;
         }
         case (OFPMC_DELETE): {
-            return meter_table_delete(table, mod);
+            error = meter_table_delete(table, mod);
+            break;
         }
         default: {
             return ofl_error(OFPET_BAD_REQUEST, OFPBRC_BAD_TYPE);
         }
     }
+
+    /* the cached paths through the meter are looked up again */
+    table->dp->flow_generation++;
+    return error;
 }
 
 ofl_err
@@ -384,9 +408,12 @@ void
 meter_table_add_tokens(struct meter_table *table){
 
     struct meter_entry *entry;
+
+    pthread_mutex_lock(&table->lock);
     HMAP_FOR_EACH(entry, struct meter_entry, node, &table->meter_entries){
         refill_bucket(entry);
     }
+    pthread_mutex_unlock(&table->lock);
 
 }
 
@@ -32,6 +32,7 @@
 #ifndef METER_TABLE_H
 #define METER_TABLE_H 1
 
+#include <pthread.h>
 #include <stdbool.h>
 #include "hmap.h"
 #include "list.h"
@@ -57,6 +58,8 @@ struct meter_table {
     unsigned short int  entries_num; /* The number of meters */
   struct hmap			meter_entries;	    /* Meter entries */
     unsigned short int              bands_num;
+    pthread_mutex_t     lock;               /* Token buckets, shared by the
+                                               packet processing threads */
 
 };
 
@@ -73,7 +76,13 @@ meter_table_destroy(struct meter_table *table);
 struct meter_entry *
 meter_table_find(struct meter_table *table, unsigned int meter_id);
 
-/* Apply the given meter on the packet. */
+/* Apply the given meter on the packet. Returns false if the meter drops the
+ * packet, which is left to the caller. */
+bool
+meter_table_admit(struct meter_table *table, struct packet *packet, unsigned int meter_id);
+
+/* Apply the given meter on the packet, destroying it and setting *packet to
+ * NULL if the meter drops it. */
 void
 meter_table_apply(struct meter_table *table, struct packet **packet, unsigned int meter_id);
 
@@ -34,6 +34,7 @@
 #include <sys/types.h>
 #include "datapath.h"
 #include "dp_buffers.h"
+#include "dp_pool.h"
 #include "packet.h"
 #include "packets.h"
 #include "action_set.h"
@@ -42,13 +43,22 @@
 #include "oflib/ofl-print.h"
 #include "util.h"
 
+static struct dp_pool *packet_pool;
+
+void
+packet_pools_init(void) {
+    packet_pool = dp_pool_create("packet", sizeof(struct packet), PACKET_POOL_SIZE);
+    /* each packet has an action set, and the actions applied */
+    action_set_pools_init(2 * PACKET_POOL_SIZE);
+    packet_handle_std_pool_init(PACKET_POOL_SIZE);
+}
 
 struct packet *
 packet_create(struct datapath *dp, unsigned int in_port,
     struct ofpbuf *buf, bool packet_out) {
     struct packet *pkt;
 
-    pkt = xmalloc(sizeof(struct packet));
+    pkt = dp_pool_get(packet_pool);
 
     pkt->dp         = dp;
     pkt->buffer     = buf;
@@ -67,6 +77,8 @@ packet_create(struct datapath *dp, unsigned int in_port,
     pkt->reason           = 0;
 
     pkt->mis_match_entry_hited = false;
+    pkt->last_output = false;
+    pkt->meter_entry = NULL;
     pkt->l3_options = L3_OPTION_NONE;
 
     pkt->handle_std = packet_handle_std_create(pkt);
@@ -77,13 +89,10 @@ struct packet *
 packet_clone(struct packet *pkt) {
     struct packet *clone;
 
-    clone = xmalloc(sizeof(struct packet));
-    if (NULL == clone) {
-        return NULL;
-    }
+    clone = dp_pool_get(packet_pool);
 
     clone->dp         = pkt->dp;
-    clone->buffer     = ofpbuf_clone(pkt->buffer);
+    clone->buffer     = ofpbuf_slab_clone(pkt->buffer);
     clone->in_port    = pkt->in_port;
     clone->action_set = action_set_clone(pkt->action_set);
     clone->action_set_apply = action_set_clone(pkt->action_set_apply);
@@ -98,12 +107,30 @@ packet_clone(struct packet *pkt) {
                                              // but this buffer is a copy of that,
                                              // and might be altered later
     clone->table_id         = pkt->table_id;
+    clone->meter_entry      = pkt->meter_entry;
+    clone->last_output      = false;
 
     clone->handle_std = packet_handle_std_clone(clone, pkt->handle_std);
 
     return clone;
 }
 
+void
+packet_unshare(struct packet *pkt) {
+    struct ofpbuf *buf = pkt->buffer;
+    struct ofpbuf *copy;
+
+    /* the messages only let go of it, so an unshared frame stays so */
+    if (buf->refcount == 1) {
+        return;
+    }
+    copy = ofpbuf_slab_clone(buf);
+    protocol_rebase(pkt->handle_std->proto,
+                    (char *) copy->data - (char *) buf->data);
+    pkt->buffer = copy;
+    ofpbuf_delete(buf);
+}
+
 void
 packet_destroy(struct packet *pkt) {
     /* If packet is saved in a buffer, do not destroy it,
@@ -121,16 +148,16 @@ packet_destroy(struct packet *pkt) {
     action_set_destroy(pkt->action_set_apply);
     ofpbuf_delete(pkt->buffer);
     packet_handle_std_destroy(pkt->handle_std);
-    free(pkt);
-    pkt = NULL;
+    dp_pool_put(packet_pool, pkt);
 }
 
 
 void
 packet_match_reset(struct packet *pkt)
 {
-	packet_handle_std_destroy(pkt->handle_std);
-	pkt->handle_std = packet_handle_std_create(pkt);
+	/* parse again into the same handler */
+	pkt->handle_std->valid = false;
+	packet_handle_std_validate(pkt->handle_std);
 }
 
 
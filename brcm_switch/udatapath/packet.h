@@ -72,6 +72,9 @@ struct packet {
 
     struct packet_handle_std  *handle_std; /* handler for standard match structure */
     bool mis_match_entry_hited;
+    bool last_output;   /* no action follows the output being executed, which
+                           may then take the buffer of the packet */
+    struct meter_entry *meter_entry; /* last meter applied, if any */
 
     unsigned int l3_options;
     
@@ -80,6 +83,14 @@ struct packet {
     unsigned long long int cookie;
 };
 
+/* Packets allocated when the datapath starts; the pools grow past that if
+ * more packets are in flight or buffered. */
+#define PACKET_POOL_SIZE  1024
+
+/* Creates the pools of packets and of their action sets and handlers. */
+void
+packet_pools_init(void);
+
 /* Creates a packet. */
 struct packet *
 packet_create(struct datapath *dp, unsigned int in_port, struct ofpbuf *buf, bool packet_out);
@@ -96,6 +107,11 @@ packet_destroy(struct packet *pkt);
 struct packet *
 packet_clone(struct packet *pkt);
 
+/* Gives the packet a copy of its frame if the frame is shared with the
+ * packet in messages sent so far, before an action changes it. */
+void
+packet_unshare(struct packet *pkt);
+
 void 
 packet_match_reset(struct packet *pkt);
 
@@ -42,6 +42,7 @@
 #include "oflib/ofl-structs.h"
 #include "openflow/openflow.h"
 #include "compiler.h"
+#include "dp_pool.h"
 
 #include "lib/hash.h"
 #include "oflib/oxm-match.h"
@@ -57,12 +58,9 @@ void insert_field(struct packet_handle_std *handle,
 
 static void replace_eth_type(struct packet_handle_std *handle, unsigned short int eth_type)
 {
-    struct packet_fields *iter;
-
-    HMAP_FOR_EACH_WITH_HASH(iter, struct packet_fields, hmap_node,
-                            DP_FIELD_HASH(OXM_OF_ETH_TYPE), &handle->match.match_fields)
+    if (flow_key_has(&handle->key, OFPXMT_OFB_ETH_TYPE))
     {
-        memcpy(iter->value, &eth_type, OXM_LENGTH(OXM_OF_ETH_TYPE));
+        flow_key_set(&handle->key, OXM_OF_ETH_TYPE, &eth_type);
     }
 }
 
@@ -696,17 +694,7 @@ static bool packet_head_extract(struct packet_handle_std *handle)
 void insert_field(struct packet_handle_std *handle,
                     unsigned int field_header,unsigned char *ptr)
 {
-    struct packet_fields *pktout;
-    unsigned char len;
-
-    len = OXM_LENGTH(field_header);
-    pktout = (struct packet_fields*) malloc(sizeof(struct packet_fields));  
-    pktout->header = field_header;
-    pktout->value = (unsigned char*) malloc(len);
-    memset(pktout->value,0x0,len);
-    memcpy(pktout->value,ptr,len);
-    hmap_insert(&handle->match.match_fields, &pktout->hmap_node,
-                DP_FIELD_HASH(field_header));
+    flow_key_set(&handle->key, field_header, ptr);
 #if 0
     if(VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE))
     {
@@ -720,26 +708,15 @@ void insert_field(struct packet_handle_std *handle,
 void packet_handle_std_validate(struct packet_handle_std *handle) 
 {
     /*struct packet_fields *pktout_inport, *pktout_metadata;*/
-    struct packet_fields *pkt_f;
     unsigned int in_port;
     unsigned long long int metadata;
-    struct packet_fields * iter, *next;
     
     if(handle->valid)
     {
         return;
     }
 
-    HMAP_FOR_EACH_SAFE(iter, next, struct packet_fields, hmap_node, &handle->match.match_fields)
-    {
-        free(iter->value);
-        free(iter);
-    }
-    
-    hmap_destroy(&handle->match.match_fields);
-    hmap_init(&handle->match.match_fields); 
-    handle->match.header.length = 0;
-
+    flow_key_init(&handle->key);
 
     packet_head_extract(handle);
     
@@ -756,30 +733,39 @@ void packet_handle_std_validate(struct packet_handle_std *handle)
 
     //packet_match_field_print(&handle->match);
     //ȡƥֶݳ
-    handle->match_num = 0;
-
-    HMAP_FOR_EACH(pkt_f, struct packet_fields, hmap_node, &handle->match.match_fields)
-    {
-        handle->match.header.length +=  OXM_LENGTH(pkt_f->header);
-
-        if( 0 != OXM_LENGTH(pkt_f->header))
-        {
-            handle->match_num++;
-        }
-    }
+    handle->match_len = flow_key_length(&handle->key, &handle->match_num);
     //add end
     return;
 }
 
  
+/* A handler and its protocol headers, allocated together. */
+struct packet_handle_obj {
+    struct packet_handle_std    handle;
+    struct protocols_std        proto;
+};
+
+static struct dp_pool *handle_pool;
+
+void
+packet_handle_std_pool_init(unsigned int n_handles) {
+    handle_pool = dp_pool_create("packet handle",
+                                 sizeof(struct packet_handle_obj), n_handles);
+}
+
+static struct packet_handle_std *
+packet_handle_std_alloc(void) {
+    struct packet_handle_obj *obj = dp_pool_get(handle_pool);
+
+    obj->handle.proto = &obj->proto;
+    return &obj->handle;
+}
+
 struct packet_handle_std *
 packet_handle_std_create(struct packet *pkt) {
-    struct packet_handle_std *handle = xmalloc(sizeof(struct packet_handle_std));
-    handle->proto = xmalloc(sizeof(struct protocols_std));
+    struct packet_handle_std *handle = packet_handle_std_alloc();
     handle->pkt = pkt;
     
-    hmap_init(&handle->match.match_fields);
-    
     handle->valid = false;
     packet_handle_std_validate(handle);
         
@@ -788,11 +774,9 @@ packet_handle_std_create(struct packet *pkt) {
 
 struct packet_handle_std *
 packet_handle_std_clone(struct packet *pkt, struct packet_handle_std *handle UNUSED) {
-    struct packet_handle_std *clone = xmalloc(sizeof(struct packet_handle_std));
+    struct packet_handle_std *clone = packet_handle_std_alloc();
 
     clone->pkt = pkt;
-    clone->proto = xmalloc(sizeof(struct protocols_std));
-    hmap_init(&clone->match.match_fields);
     clone->valid = false;
     // TODO Zoltan: if handle->valid, then match could be memcpy'd, and protocol
     //              could be offset
@@ -804,18 +788,7 @@ packet_handle_std_clone(struct packet *pkt, struct packet_handle_std *handle UNU
 void
 packet_handle_std_destroy(struct packet_handle_std *handle) 
 {
-    struct packet_fields * iter, *next;
-    
-    HMAP_FOR_EACH_SAFE(iter, next, struct packet_fields, hmap_node, &handle->match.match_fields)
-    {
-        free(iter->value);
-        free(iter);
-    }
-    free(handle->proto);
-    
-    hmap_destroy(&handle->match.match_fields);
-    free(handle);
-    handle = NULL;
+    dp_pool_put(handle_pool, CONTAINER_OF(handle, struct packet_handle_obj, handle));
 }
 
 bool packet_handle_std_is_ttl_valid(struct packet_handle_std *handle) 
@@ -869,7 +842,7 @@ packet_handle_std_match(struct packet_handle_std *handle, struct ofl_match *matc
         }
     }
 
-    return packet_match(match ,&handle->match );
+    return packet_match(match ,&handle->key );
 }
 
 
@@ -36,6 +36,7 @@
 #include "packet.h"
 #include "packets.h"
 #include "match_std.h"
+#include "flow_key.h"
 #include "oflib/ofl-structs.h"
 #include "nbee_link/nbee_link.h"
 
@@ -48,15 +49,19 @@
 struct packet_handle_std {
    struct packet              *pkt;
    struct protocols_std       *proto;
-   struct ofl_match  match;  /* Match fields extracted from the packet
-                                           are also stored in a match structure
-                                           for convenience */
+   struct flow_key             key;    /* Match fields extracted from the packet,
+                                           in fixed flow key layout. */
+   unsigned int match_len;         //the length of the match field values
    unsigned int match_num ;        //the num of match fields 
    bool                        valid; /* Set to true if the handler data is valid.
                                            if false, it is revalidated before
                                            executing any methods. */
 };
 
+/* Creates the pool of handlers, with n_handles to start with. */
+void
+packet_handle_std_pool_init(unsigned int n_handles);
+
 /* Creates a handler */
 struct packet_handle_std *
 packet_handle_std_create(struct packet *pkt);
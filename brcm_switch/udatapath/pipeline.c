@@ -29,6 +29,7 @@
  */
 
 #include <sys/types.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
@@ -37,6 +38,8 @@
 #include "dp_actions.h"
 #include "dp_buffers.h"
 #include "dp_exp.h"
+#include "dp_hw_installer.h"
+#include "dp_pi_limit.h"
 #include "dp_ports.h"
 #include "utilities/dpctl.h"
 #include "dp_capabilities.h"
@@ -45,6 +48,8 @@
 #include "pipeline.h"
 #include "flow_table.h"
 #include "flow_entry.h"
+#include "flow_entry_exact.h"
+#include "exact_hash.h"
 #include "meter_table.h"
 #include "oflib/ofl.h"
 #include "oflib/ofl-structs.h"
@@ -61,10 +66,50 @@
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
+/* State of a packet between the stages of the pipeline. */
+struct pipeline_pkt {
+    struct packet           *pkt;
+    struct flow_entry       *hops[PIPELINE_TABLES]; /* cached or found path. */
+    unsigned char            n_cached;
+    bool                     cached;      /* hops holds a cached path. */
+    bool                     cacheable;   /* the path found can be cached. */
+    struct flow_entry       *first;       /* table 0 entry, if looked up. */
+    bool                     looked_up;
+    unsigned long long int   generation;  /* of the cached path. */
+    unsigned int             key_hash;
+    struct flow_key          key;
+    struct flow_key          wc;
+};
+
+/* Caches of the calling thread, if it is a worker thread. */
+static __thread struct pipeline_thread *current_thread = NULL;
+
 static void
 execute_entry(struct pipeline *pl, struct flow_entry *entry,
               struct flow_table **table, struct packet **pkt);
 
+static void
+pipeline_thread_init(struct pipeline *pl, struct pipeline_thread *pt)
+{
+    megaflow_cache_init(&pt->megaflows);
+    emc_init(&pt->emc, pl->dp->emc_size);
+    pt->batch = xmalloc(PIPELINE_BATCH_MAX * sizeof *pt->batch);
+}
+
+static void
+pipeline_thread_uninit(struct pipeline_thread *pt)
+{
+    megaflow_cache_flush(&pt->megaflows);
+    emc_destroy(&pt->emc);
+    free(pt->batch);
+}
+
+static inline struct pipeline_thread *
+pipeline_thread(struct pipeline *pl)
+{
+    return current_thread != NULL ? current_thread : &pl->main;
+}
+
 struct pipeline *
 pipeline_create(struct datapath *dp) {
     struct pipeline *pl;
@@ -77,10 +122,33 @@ pipeline_create(struct datapath *dp) {
     pl->dp = dp;
 
     pl->miss_table = miss_table_create(dp, PIPELINE_TABLES);
+    pipeline_thread_init(pl, &pl->main);
 
     return pl;
 }
 
+struct pipeline_thread *
+pipeline_thread_create(struct pipeline *pl)
+{
+    struct pipeline_thread *pt = xmalloc(sizeof *pt);
+
+    pipeline_thread_init(pl, pt);
+    return pt;
+}
+
+void
+pipeline_thread_destroy(struct pipeline_thread *pt)
+{
+    pipeline_thread_uninit(pt);
+    free(pt);
+}
+
+void
+pipeline_thread_set(struct pipeline_thread *pt)
+{
+    current_thread = pt;
+}
+
 
 void send_packet_to_controller(struct pipeline *pl, struct packet *pkt, unsigned char table_id, unsigned char reason)
 {
@@ -149,7 +217,7 @@ void send_packet_to_controller(struct pipeline *pl, struct packet *pkt, unsigned
 
     m = xmalloc (sizeof(struct ofl_match));
     ofl_structs_match_init(m);
-    ofl_structs_match_convert_pktf2oflm(&pkt->handle_std->match.match_fields, m);
+    flow_key_to_ofl_match(&pkt->handle_std->key, m);
     msg.match = (struct ofl_match_header*)m;
 
     dp_send_message(pl->dp, (struct ofl_msg_header *)&msg, NULL);
@@ -158,18 +226,9 @@ void send_packet_to_controller(struct pipeline *pl, struct packet *pkt, unsigned
 }
 
 
-int pi_pkt2ofp_send2controller(struct pipeline *pl, struct packet *pkt_in, unsigned char table_id, unsigned char reason)
+int pi_pkt2ofp_send2controller(struct pipeline *pl, struct packet *pkt, unsigned char table_id, unsigned char reason)
 {
-    struct packet *pkt = pkt_in;
-    struct ofp_packet_in *packet_in;
-    unsigned short int total_len = 0;
-    unsigned int buf_len = 0;
-    unsigned int match_len = 0;
     struct sw_port *p = NULL;
-    size_t data_length = 0;
-    struct ofpbuf  *ofpbuf = NULL;
-    int error = 0;
-    unsigned char *ptr = NULL;
 
     p = dp_ports_lookup(pl->dp, pkt->in_port);
     if( p == NULL)
@@ -181,22 +240,38 @@ int pi_pkt2ofp_send2controller(struct pipeline *pl, struct packet *pkt_in, unsig
     {
         VLOG_ERR(LOG_MODULE, "(p->conf->config & OFPPC_NO_PACKET_IN) is %u\n",
             (p->conf->config & OFPPC_NO_PACKET_IN));
-        pkt->buffer_id = OFP_NO_BUFFER;
-        packet_destroy(pkt);
         VLOG_ERR(LOG_MODULE, "Packet-in disabled on port (%u)", p->stats->port_no);
         return -1;
     }
 
-    meter_table_apply(pl->dp->meters, &pkt , OFPM_CONTROLLER);
-    if( pkt == NULL)
+    if (!meter_table_admit(pl->dp->meters, pkt, OFPM_CONTROLLER))
     {
         return -1;
     }
 
-    if( (0 == pkt->handle_std->match.header.length) && (0 != pkt->handle_std->match_num) )
+    if (!dp_pi_limit_admit(pl->dp->pi_limit, pkt, table_id, reason))
     {
-        VLOG_ERR(LOG_MODULE, "****before  pkt->handle_std->match.header.length is equal to 0 *****\n");
-        packet_destroy(pkt);
+        return 0;
+    }
+
+    return pi_pkt2ofp_send(pl, pkt, table_id, reason);
+}
+
+
+int pi_pkt2ofp_send(struct pipeline *pl, struct packet *pkt, unsigned char table_id, unsigned char reason)
+{
+    struct ofp_packet_in *packet_in;
+    unsigned short int total_len = 0;
+    unsigned int hdr_len = 0;
+    unsigned int match_len = 0;
+    size_t data_length = 0;
+    struct ofpbuf  *ofpbuf = NULL;
+    int error = 0;
+    unsigned char *ptr = NULL;
+
+    if( (0 == pkt->handle_std->match_len) && (0 != pkt->handle_std->match_num) )
+    {
+        VLOG_ERR(LOG_MODULE, "****before  pkt->handle_std->match_len is equal to 0 *****\n");
         return -1;
     }
 
@@ -239,14 +314,33 @@ int pi_pkt2ofp_send2controller(struct pipeline *pl, struct packet *pkt_in, unsig
     //ͳȱmiss_send_lenС
     total_len = MIN(pl->dp->config.miss_send_len,total_len);
 
-    match_len = (pkt->handle_std->match_num)*4 + pkt->handle_std->match.header.length;
-    buf_len = sizeof(struct ofp_packet_in)-sizeof(struct ofp_match) + ROUND_UP(match_len+4 ,8) + total_len + 2;
-    packet_in = (struct ofp_packet_in *)malloc(buf_len);
+    match_len = (pkt->handle_std->match_num)*4 + pkt->handle_std->match_len;
+    hdr_len = sizeof(struct ofp_packet_in)-sizeof(struct ofp_match) + ROUND_UP(match_len+4 ,8) + 2;
+
+    if (pkt->last_output && pkt->buffer_id == OFP_NO_BUFFER
+        && ofpbuf_headroom(pkt->buffer) >= hdr_len)
+    {
+        /* nothing uses the packet after this output: the message takes its
+         * buffer, and the headers go in the headroom before the frame */
+        ofpbuf = pkt->buffer;
+        pkt->buffer = NULL;
+        ofpbuf->size = total_len;
+        packet_in = ofpbuf_push_uninit(ofpbuf, hdr_len);
+    }
+    else
+    {
+        /* the packet goes on, or is held for the controller: the message
+         * shares its frame, which the actions that change the packet then
+         * leave to the message (see packet_unshare()) */
+        ofpbuf = ofpbuf_slab_new(hdr_len);
+        packet_in = ofpbuf_put_uninit(ofpbuf, hdr_len);
+        ofpbuf_chain(ofpbuf, ofpbuf_view(pkt->buffer, 0, total_len));
+    }
     packet_in->match.length = htons(match_len+4);
 
     packet_in->header.type = OFPT_PACKET_IN;
     packet_in->header.version = OFP_VERSION;
-    packet_in->header.length  = htons(buf_len);
+    packet_in->header.length  = htons(ofpbuf_msg_size(ofpbuf));
     packet_in->header.xid     = 0; //need modify
     packet_in->buffer_id   = htonl(pkt->buffer_id);
     packet_in->total_len   = htons(total_len);
@@ -258,19 +352,14 @@ int pi_pkt2ofp_send2controller(struct pipeline *pl, struct packet *pkt_in, unsig
 
     packet_in->match.type = htons(OFPMT_OXM);
 
-    ofp_structs_match_convert_pkt2ofp(&pkt->handle_std->match.match_fields, \
-                                      &(packet_in->match),ptr, NULL);
+    ptr += flow_key_put_oxm(&pkt->handle_std->key, ptr);
+
+    //oxm padding
+    memset(ptr, 0, ROUND_UP(match_len + 4, 8) - (match_len + 4));
 
     ptr = (unsigned char *)(packet_in)+(sizeof(struct ofp_packet_in)-sizeof(struct ofp_match))+ROUND_UP(match_len+4,8);
 
     memset(ptr,0,2);
-    if ( total_len > 0 ) {
-        memcpy(ptr + 2 , pkt->buffer->data, total_len);
-    }
-
-    ofpbuf = ofpbuf_new(0);
-    ofpbuf_use(ofpbuf, (unsigned char *)packet_in, buf_len);
-    ofpbuf_put_uninit(ofpbuf, buf_len);
 
     error = send_openflow_buffer(pl->dp, ofpbuf, NULL);
 
@@ -402,24 +491,47 @@ static void pipeline_write_path_info(struct packet *pkt,
 
     path_entry->table_class_id = TABLE_CLASS_ID(0, entry->table->features->table_id);
 
-    path->meter.meter_entry = pkt->dp->m_entry;
+    path->meter.meter_entry = pkt->meter_entry;
     list_push_back(&path->head, &path_entry->node);
 }
 
-void
-pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
+/* A path can be cached as long as no entry modifies the packet before the
+ * next lookup, which would then depend on the packet fields it rewrote. */
+static bool
+pipeline_entry_cacheable(struct flow_entry *entry)
 {
-    struct flow_table *table, *next_table;
-    struct path path;
-    struct path_entry path_entry[PIPELINE_TABLES];
-    struct path_contex context;
-    unsigned int uiRet;
-    DPAL_MESSAGE_DATA_S stMSGData = {0};
+    size_t i;
+
+    for (i = 0; i < entry->stats->instructions_num; i++)
+    {
+        if (entry->stats->instructions[i]->type == OFPIT_APPLY_ACTIONS ||
+            entry->stats->instructions[i]->type == OFPIT_EXPERIMENTER)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Checks and parses the packet, and looks its path up in the caches.
+ * Returns false if the packet was consumed. */
+static bool
+pipeline_classify(struct pipeline *pl, struct pipeline_pkt *p)
+{
+    struct pipeline_thread *pt = pipeline_thread(pl);
+    struct packet *pkt = p->pkt;
+    const struct emc_entry *microflow;
+    const struct megaflow *megaflow;
 
     g_send_to_ctl_count ++;
 
-    memset(path_entry, 0, sizeof(path_entry));
-    pipeline_logic_path_init(pkt,&path,&context);
+    p->n_cached = 0;
+    p->cached = false;
+    p->cacheable = true;
+    p->first = NULL;
+    p->looked_up = false;
+    p->generation = pl->dp->flow_generation;
+    p->key_hash = 0;
 
     if (VLOG_IS_DBG_ENABLED(LOG_MODULE)) {
         char *pkt_str = packet_to_string(pkt);
@@ -430,12 +542,82 @@ pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
     if (!packet_handle_std_is_ttl_valid(pkt->handle_std))
     {
         VLOG_DBG_RL(LOG_MODULE, &rl, "Packet has invalid TTL, sending to controller.");
+        pkt->last_output = true;
         pi_pkt2ofp_send2controller(pl, pkt, 0/*table_id*/, OFPR_INVALID_TTL);
         packet_destroy(pkt);
-        return;
+        return false;
+    }
+
+    packet_handle_std_validate(pkt->handle_std);
+    if (pkt->handle_std->valid)
+    {
+        p->key = pkt->handle_std->key;
+        p->key_hash = emc_hash(&p->key);
+        microflow = emc_lookup(&pt->emc, &p->key, p->key_hash, p->generation);
+        if (microflow != NULL)
+        {
+            p->n_cached = microflow->n_entries;
+            memcpy(p->hops, microflow->entries, p->n_cached * sizeof *p->hops);
+            p->cached = true;
+        }
+        else
+        {
+            megaflow = megaflow_cache_lookup(&pt->megaflows, &p->key, p->generation);
+            if (megaflow != NULL)
+            {
+                p->n_cached = megaflow->n_entries;
+                memcpy(p->hops, megaflow->entries, p->n_cached * sizeof *p->hops);
+                p->cached = true;
+                emc_insert(&pt->emc, &p->key, p->key_hash, p->hops, p->n_cached,
+                           p->generation);
+            }
+        }
+        flow_key_init(&p->wc);
+    }
+    else
+    {
+        p->cacheable = false;
+    }
+    return true;
+}
+
+/* Looks the packet up in the first table, for a packet the caches missed. */
+static void
+pipeline_lookup_first(struct pipeline *pl, struct pipeline_pkt *p)
+{
+    p->first = flow_table_lookup_wc(pl->tables[0], p->pkt,
+                                    p->cacheable ? &p->wc : NULL);
+    p->looked_up = true;
+}
+
+/* Runs a classified packet through the tables and executes its actions. */
+static void
+pipeline_execute(struct pipeline *pl, struct pipeline_pkt *p)
+{
+    struct flow_table *table, *next_table;
+    struct path path;
+    struct path_entry path_entry[PIPELINE_TABLES];
+    struct path_contex context;
+    unsigned int uiRet;
+    DPAL_MESSAGE_DATA_S stMSGData = {0};
+    struct packet *pkt = p->pkt;
+    unsigned char n_hops = 0;
+
+    /* Entries met by the previous packets of a batch may have changed the
+     * flow tables, and the path found for this one with them. */
+    if ((p->cached || p->looked_up) && p->generation != pl->dp->flow_generation)
+    {
+        p->cached = false;
+        p->looked_up = false;
+        p->cacheable = pkt->handle_std->valid;
+        p->generation = pl->dp->flow_generation;
+        flow_key_init(&p->wc);
     }
 
-    pl->dp->m_entry = NULL;
+    memset(path_entry, 0, sizeof(path_entry));
+    pipeline_logic_path_init(pkt,&path,&context);
+
+    pkt->meter_entry = NULL;
     next_table = pl->tables[0];
     while (next_table != NULL)
     {
@@ -449,7 +631,33 @@ pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
 
         pkt->mis_match_entry_hited = false;
 
-        entry = flow_table_lookup(table, pkt);
+        if (p->cached)
+        {
+            /* the cached path holds the entry this lookup would find */
+            entry = n_hops < p->n_cached ? p->hops[n_hops++] : NULL;
+            if (entry != NULL)
+            {
+                flow_table_count_hit(table, pkt, entry);
+            }
+        }
+        else
+        {
+            if (p->looked_up)
+            {
+                entry = p->first;
+                p->looked_up = false;
+            }
+            else
+            {
+                entry = flow_table_lookup_wc(table, pkt, p->cacheable ? &p->wc : NULL);
+            }
+            if (entry != NULL && p->cacheable)
+            {
+                p->hops[n_hops++] = entry;
+                p->cacheable = pipeline_entry_cacheable(entry);
+            }
+        }
+
         if (entry != NULL)
         {
             if (VLOG_IS_DBG_ENABLED(ALTA_LOG_MODULE))
@@ -479,6 +687,16 @@ pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
 
             if (next_table == NULL)
             {
+                if (!p->cached && p->cacheable)
+                {
+                    struct pipeline_thread *pt = pipeline_thread(pl);
+
+                    megaflow_cache_insert(&pt->megaflows, &p->key, &p->wc, p->hops,
+                                          n_hops, p->generation);
+                    emc_insert(&pt->emc, &p->key, p->key_hash, p->hops, n_hops,
+                               p->generation);
+                }
+
                 if ((!pl->dp->soft_switch) && (!pkt->mis_match_entry_hited))
                 {
                     ofp_path_dump(NULL, &path);
@@ -491,13 +709,8 @@ pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
                         uiRet = DPAL_TranslatePkt(DPAL_MSG_TYPE_FLOWTABLE_ADD, &context, &stMSGData);
                         if (0 == uiRet)
                         {
-                            //ͱ
-                            uiRet = Hybrid_Chatwith_V8_new(&stMSGData);
-                            free(stMSGData.pData);
-                            if (uiRet)
-                            {
-                                VLOG_ERR_RL(LOG_MODULE, &rl, "alta logic get entry count, send to v8 failed!\n");
-                            }
+                            /* sent, and freed, by the hardware installer */
+                            dp_hw_install(pl->dp, &stMSGData, context.data_type);
                         }
                         else
                         {
@@ -526,6 +739,54 @@ pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
     }
 }
 
+void
+pipeline_process_packet(struct pipeline *pl, struct packet *pkt)
+{
+    struct pipeline_pkt p;
+
+    p.pkt = pkt;
+    if (pipeline_classify(pl, &p))
+    {
+        pipeline_execute(pl, &p);
+    }
+}
+
+void
+pipeline_process_batch(struct pipeline *pl, struct packet **pkts, size_t n)
+{
+    struct pipeline_pkt *batch = pipeline_thread(pl)->batch;
+    size_t i, n_valid = 0;
+
+    while (n > PIPELINE_BATCH_MAX)
+    {
+        pipeline_process_batch(pl, pkts, PIPELINE_BATCH_MAX);
+        pkts += PIPELINE_BATCH_MAX;
+        n -= PIPELINE_BATCH_MAX;
+    }
+
+    /* Each stage runs over the whole batch, so the caches and the first
+     * table stay warm from one packet to the next. */
+    for (i = 0; i < n; i++)
+    {
+        batch[n_valid].pkt = pkts[i];
+        if (pipeline_classify(pl, &batch[n_valid]))
+        {
+            n_valid++;
+        }
+    }
+    for (i = 0; i < n_valid; i++)
+    {
+        if (!batch[i].cached)
+        {
+            pipeline_lookup_first(pl, &batch[i]);
+        }
+    }
+    for (i = 0; i < n_valid; i++)
+    {
+        pipeline_execute(pl, &batch[i]);
+    }
+}
+
 static
 int inst_compare(const void *inst1, const void *inst2){
     struct ofl_instruction_header * i1 = *(struct ofl_instruction_header **) inst1;
@@ -585,6 +846,7 @@ pipeline_handle_flow_mod(struct pipeline *pl, struct ofl_msg_flow_mod *msg,
                     break;
                 }
             }
+            pl->dp->flow_generation++;
             if (error) {
                 return error;
             } else {
@@ -596,6 +858,7 @@ pipeline_handle_flow_mod(struct pipeline *pl, struct ofl_msg_flow_mod *msg,
         }
     } else {
         error = flow_table_flow_mod(pl->tables[msg->table_id], msg, &match_kept, &insts_kept);
+        pl->dp->flow_generation++;
         if (error) {
             return error;
         }
@@ -641,6 +904,7 @@ pipeline_handle_table_mod(struct pipeline *pl,
     } else {
         pl->tables[msg->table_id]->features->config = msg->config;
     }
+    pl->dp->flow_generation++;
 
     ofl_msg_free((struct ofl_msg_header *)msg, pl->dp->exp);
     return 0;
@@ -648,79 +912,214 @@ pipeline_handle_table_mod(struct pipeline *pl,
 
 #define FLOW_STATS_REPLY_PEER 100
 
-ofl_err
-pipeline_handle_stats_request_flow(struct pipeline *pl,
-                                   struct ofl_msg_multipart_request_flow *msg,
-                                   const struct sender *sender)
+/* A flow stats request being answered, a reply of up to
+ * FLOW_STATS_REPLY_PEER entries each time the remote has room for it, the
+ * replies packed straight from the entries. The tables are walked in turn,
+ * first the wildcard entries and then those of the exact hashes. */
+struct flow_stats_dump {
+    struct pipeline                        *pl;
+    struct ofl_msg_multipart_request_flow  *msg;
+    struct sender                           sender;
+    size_t                                  table_id;   /* table walked. */
+    size_t                                  last_table_id;
+    bool                                    in_exact;   /* walking the
+                                                           exact hashes. */
+    size_t                                  exact_id;   /* exact hash walked. */
+    struct exact_hash_cursor                exact_cursor;
+    struct flow_table_cursor                cursor;     /* of the wildcard
+                                                           entries. */
+};
+
+static struct flow_entry *
+flow_stats_dump_seek_exact(struct flow_stats_dump *dump, struct flow_table *table)
 {
+    struct ofl_msg_multipart_request_flow *msg = dump->msg;
+    struct flow_entry *entry;
 
-    struct ofl_flow_stats **stats = xmalloc(sizeof(struct ofl_flow_stats *));
-    size_t stats_size = 1;
-    size_t stats_num = 0;
-    size_t num = 0;
-    size_t i;
-    struct ofl_flow_stats **ptr;
+    if (msg->match->length != 0)
+    {
+        /* only the entry of the match, as exact hash 0 */
+        if (dump->exact_id != 0)
+        {
+            return NULL;
+        }
+        entry = exact_flow_entry_lookup(table, (struct ofl_match *)(msg->match));
+        if (entry != NULL &&
+            (msg->out_port == OFPP_ANY || flow_entry_has_out_port(entry, msg->out_port)) &&
+            (msg->out_group == OFPG_ANY || flow_entry_has_out_group(entry, msg->out_group)))
+        {
+            return entry;
+        }
+        return NULL;
+    }
 
-    if (msg->table_id == 0xff)
+    /* without a match, all the entries */
+    for (; dump->exact_id < MAX_HASH_BUCKETS_NUM && table->hash_match[dump->exact_id] != 0;
+         dump->exact_id++)
     {
-        for ( i = 0; i < PIPELINE_TABLES; i++ )
+        struct exact_hash_cursor cursor = dump->exact_cursor;
+
+        entry = exact_hash_next(&table->exact[dump->exact_id], &cursor);
+        if (entry != NULL)
         {
-            flow_table_stats(pl->tables[i], msg, &stats, &stats_size, &stats_num);
+            return entry;
         }
+        memset(&dump->exact_cursor, 0, sizeof dump->exact_cursor);
+    }
+    return NULL;
+}
+
+/* Returns the next entry the request asks for, without moving past it, or
+ * NULL if there are no more. */
+static struct flow_entry *
+flow_stats_dump_seek(struct flow_stats_dump *dump)
+{
+    while (dump->table_id <= dump->last_table_id)
+    {
+        struct flow_table *table = dump->pl->tables[dump->table_id];
+        struct flow_entry *entry;
+
+        if (!dump->in_exact)
+        {
+            for (entry = dump->cursor.next; entry != NULL;
+                 entry = flow_table_cursor_advance(&dump->cursor))
+            {
+                if (flow_table_stats_match(entry, dump->msg))
+                {
+                    return entry;
+                }
+            }
+            flow_table_cursor_destroy(&dump->cursor);
+            dump->in_exact = true;
+            dump->exact_id = 0;
+            memset(&dump->exact_cursor, 0, sizeof dump->exact_cursor);
+        }
+
+        if (table->dp->use_exact_table)
+        {
+            entry = flow_stats_dump_seek_exact(dump, table);
+            if (entry != NULL)
+            {
+                return entry;
+            }
+        }
+
+        dump->in_exact = false;
+        if (++dump->table_id <= dump->last_table_id)
+        {
+            flow_table_cursor_init(dump->pl->tables[dump->table_id], &dump->cursor);
+        }
+    }
+    return NULL;
+}
+
+/* Moves past the entry flow_stats_dump_seek() returned, and brings its
+ * stats up to date. */
+static void
+flow_stats_dump_take(struct flow_stats_dump *dump, struct flow_entry *entry)
+{
+    if (!dump->in_exact)
+    {
+        flow_table_cursor_advance(&dump->cursor);
+    }
+    else if (dump->msg->match->length != 0)
+    {
+        dump->exact_id++;
     }
     else
     {
-        flow_table_stats(pl->tables[msg->table_id], msg, &stats, &stats_size, &stats_num);
+        exact_hash_next(&dump->pl->tables[dump->table_id]->exact[dump->exact_id],
+                        &dump->exact_cursor);
+    }
+
+    flow_entry_update(entry);
+    alta_logic_entry_count(entry);
+
+    if (dump->in_exact && dump->msg->match->length != 0)
+    {
+        if (entry->no_pkt_count == true)
+        {
+            entry->stats->packet_count = 0xffffffffffffffff;
+        }
+        if (entry->no_byt_count == true)
+        {
+            entry->stats->byte_count = 0xffffffffffffffff;
+        }
+    }
+}
+
+/* Sends the next reply of the dump. The tables may change between two
+ * replies: the entries removed are not reported, and those added may or
+ * may not be. */
+static int
+flow_stats_dump_run(struct datapath *dp, void *dump_)
+{
+    struct flow_stats_dump *dump = dump_;
+    struct ofl_flow_stats *stats[FLOW_STATS_REPLY_PEER];
+    struct flow_entry *entry;
+    size_t stats_num = 0;
+    int error;
+
+    while ((entry = flow_stats_dump_seek(dump)) != NULL
+           && stats_num < FLOW_STATS_REPLY_PEER)
+    {
+        flow_stats_dump_take(dump, entry);
+        stats[stats_num++] = entry->stats;
     }
 
-    if(stats_num == 0)
     {
         struct ofl_msg_multipart_reply_flow reply =
                 {{{.type = OFPT_MULTIPART_REPLY},
-                  .type = OFPMP_FLOW, .flags = 0x0000},
+                  .type = OFPMP_FLOW,
+                  .flags = entry != NULL ? OFPMPF_REPLY_MORE : 0x0000},
                  .stats     = stats,
                  .stats_num = stats_num
                 };
 
-        dp_send_message(pl->dp, (struct ofl_msg_header *)&reply, sender);
+        error = dp_send_message(dp, (struct ofl_msg_header *)&reply, &dump->sender);
     }
-    else
+
+    if (error)
     {
-        while (stats_num != 0)
-        {
-            ptr = stats + FLOW_STATS_REPLY_PEER * num;
-            if (stats_num > FLOW_STATS_REPLY_PEER)
-            {
-                struct ofl_msg_multipart_reply_flow reply =
-                    {{{.type = OFPT_MULTIPART_REPLY},
-                      .type = OFPMP_FLOW, .flags = OFPMPF_REPLY_MORE},
-                     .stats     = ptr,
-                     .stats_num = FLOW_STATS_REPLY_PEER
-                    };
+        return -error;
+    }
+    return entry != NULL;
+}
 
-                dp_send_message(pl->dp, (struct ofl_msg_header *)&reply, sender);
+static void
+flow_stats_dump_done(void *dump_)
+{
+    struct flow_stats_dump *dump = dump_;
 
-                stats_num -= FLOW_STATS_REPLY_PEER;
-                num++;
-            }
-            else
-            {
-                struct ofl_msg_multipart_reply_flow reply =
-                    {{{.type = OFPT_MULTIPART_REPLY},
-                      .type = OFPMP_FLOW, .flags = 0x0000},
-                     .stats     = ptr,
-                     .stats_num = stats_num
-                    };
+    flow_table_cursor_destroy(&dump->cursor);
+    ofl_msg_free((struct ofl_msg_header *)dump->msg, dump->pl->dp->exp);
+    free(dump);
+}
 
-                dp_send_message(pl->dp, (struct ofl_msg_header *)&reply, sender);
+ofl_err
+pipeline_handle_stats_request_flow(struct pipeline *pl,
+                                   struct ofl_msg_multipart_request_flow *msg,
+                                   const struct sender *sender)
+{
+    struct flow_stats_dump *dump = xcalloc(1, sizeof *dump);
 
-                stats_num = 0;
-            }
-        }
+    dump->pl = pl;
+    dump->msg = msg;
+    dump->sender = *sender;
+    if (msg->table_id == 0xff)
+    {
+        dump->table_id = 0;
+        dump->last_table_id = PIPELINE_TABLES - 1;
     }
+    else
+    {
+        dump->table_id = msg->table_id;
+        dump->last_table_id = msg->table_id;
+    }
+    flow_table_cursor_init(pl->tables[dump->table_id], &dump->cursor);
 
-    free(stats);
-    ofl_msg_free((struct ofl_msg_header *)msg, pl->dp->exp);
+    /* the dump frees msg once done */
+    remote_start_dump(sender->remote, flow_stats_dump_run, flow_stats_dump_done, dump);
     return 0;
 }
 
@@ -839,6 +1238,7 @@ pipeline_destroy(struct pipeline *pl) {
     struct flow_table *table;
     int i;
 
+    pipeline_thread_uninit(&pl->main);
     for (i=0; i<PIPELINE_TABLES; i++) {
         table = pl->tables[i];
         if (table != NULL) {
@@ -853,31 +1253,32 @@ void
 pipeline_timeout(struct pipeline *pl) {
     int i;
 
-    pthread_rwlock_rdlock(&pl->dp->rw_lock);
+    /* Only the datapath thread arms the timers, so the worker threads are
+     * only held off the flow tables when some timer is due. */
+    if (pipeline_next_timeout(pl) > time_now_msec())
+    {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&pl->dp->rw_lock);
     for(i = 0; i < PIPELINE_TABLES; i++)
     {
-        if(pl->tables[i]->timeout_entries.need_timeout == false)
-        {
-            /* Ѿɵtable */
-            continue;
-        }
         flow_table_timeout(pl->tables[i]);
-        if(pl->tables[i]->timeout_entries.need_timeout == true)
-        {
-            /* Ѿ500entryȴһα */
-            pthread_rwlock_unlock(&pl->dp->rw_lock);
-            return;
-        }
     }
+    pthread_rwlock_unlock(&pl->dp->rw_lock);
+}
 
+long long int
+pipeline_next_timeout(struct pipeline *pl) {
+    long long int next = LLONG_MAX;
+    int i;
+
+    /* the timers are only armed by the datapath thread, which runs this */
     for(i = 0; i < PIPELINE_TABLES; i++)
     {
-        /* ȫɺ󣬽table±ΪҪ */
-        pl->tables[i]->timeout_entries.need_timeout = true;
+        next = MIN(next, flow_table_next_timeout(pl->tables[i]));
     }
-
-    pthread_rwlock_unlock(&pl->dp->rw_lock);
-    return;
+    return next;
 }
 
 static void
@@ -901,15 +1302,12 @@ execute_entry(struct pipeline *pl, struct flow_entry *entry,
             }
             case OFPIT_WRITE_METADATA: {
                 struct ofl_instruction_write_metadata *wi = (struct ofl_instruction_write_metadata *)inst;
-                struct  packet_fields *f;
+                struct flow_key *key = &(*pkt)->handle_std->key;
                 packet_handle_std_validate((*pkt)->handle_std);
 
-                HMAP_FOR_EACH_WITH_HASH(f,struct packet_fields, hmap_node, DP_FIELD_HASH(OXM_OF_METADATA), &(*pkt)->handle_std->match.match_fields)
+                if (flow_key_has(key, OFPXMT_OFB_METADATA))
                 {
-                    unsigned long long int *metadata = (unsigned long long int*) f->value;
-                    unsigned long long int abc;
-                    abc = ((*metadata & ~wi->metadata_mask) | (wi->metadata & wi->metadata_mask));
-                    memcpy(f->value, &abc, sizeof(unsigned long long int));
+                    key->f.metadata = (key->f.metadata & ~wi->metadata_mask) | (wi->metadata & wi->metadata_mask);
                 }
                 break;
             }
@@ -35,6 +35,8 @@
 #include "datapath.h"
 #include "packet.h"
 #include "flow_table.h"
+#include "megaflow.h"
+#include "emc.h"
 #include "oflib/ofl.h"
 #include "oflib/ofl-messages.h"
 
@@ -103,11 +105,27 @@ enum table_class
 #define TABLE_CLASS_ID(table_class, table_id)   (((table_class) << 16) | ((table_id) & 0xff))
 
 /* A pipeline structure */
+/* Most packets pipeline_process_batch() handles in one go. */
+#define PIPELINE_BATCH_MAX  256
+
+struct pipeline_pkt;
+
+/* Caches and packet states of a thread running packets through the
+ * pipeline. Each thread has its own, so they need no locking; the flow
+ * entries they point to are shared, and only read under the datapath lock. */
+struct pipeline_thread {
+    struct megaflow_cache megaflows;
+    struct emc          emc;
+    struct pipeline_pkt *batch;     /* PIPELINE_BATCH_MAX packet states. */
+};
+
 struct pipeline {
     struct datapath    *dp;
     struct flow_table  *tables[PIPELINE_TABLES];
 
     struct flow_table  *miss_table;
+
+    struct pipeline_thread main;    /* of the datapath thread. */
 };
 
 
@@ -204,6 +222,12 @@ pipeline_create(struct datapath *dp);
 void
 pipeline_process_packet(struct pipeline *pl, struct packet *pkt);
 
+/* Processes packets in the pipeline, each stage for all of them in turn:
+ * parsing and cache lookups, then the first table, then the remaining
+ * tables and the actions, packet by packet. */
+void
+pipeline_process_batch(struct pipeline *pl, struct packet **pkts, size_t n);
+
 
 /* Handles a flow_mod message. */
 ofl_err
@@ -241,18 +265,45 @@ pipeline_handle_stats_request_aggregate(struct pipeline *pl,
                                   const struct sender *sender);
 
 
-/* Commands pipeline to check if any flow in any table is timed out. */
+/* Commands pipeline to check if any flow in any table is timed out. The
+ * datapath lock is only taken for writing when flows do time out. */
 void
 pipeline_timeout(struct pipeline *pl);
 
+/* Returns the time in ms by which pipeline_timeout() should run next, or
+ * LLONG_MAX if no flow has a timeout. */
+long long int
+pipeline_next_timeout(struct pipeline *pl);
+
 /* Detroys the pipeline. */
 void
 pipeline_destroy(struct pipeline *pl);
 
+/* Creates the caches of a worker thread. */
+struct pipeline_thread *
+pipeline_thread_create(struct pipeline *pl);
+
+/* Destroys the caches of a worker thread. */
+void
+pipeline_thread_destroy(struct pipeline_thread *pt);
+
+/* Makes the calling thread process packets with the given caches, instead
+ * of those of the datapath thread. */
+void
+pipeline_thread_set(struct pipeline_thread *pt);
+
 void send_packet_to_controller(struct pipeline *pl, struct packet *pkt, unsigned char table_id, unsigned char reason);
 
+/* Sends a packet in, subject to the port config, the controller meter and
+ * the packet in limits. Returns -1 if the packet in was not sent. The caller
+ * keeps the packet either way, and destroys it. */
 int  pi_pkt2ofp_send2controller(struct pipeline *pl, struct packet *pkt, unsigned char table_id, unsigned char reason);
 
+/* Sends a packet in without checking the port config, the meter and the
+ * packet in limits. Returns -1 if the packet in was not sent. The caller
+ * keeps the packet. */
+int  pi_pkt2ofp_send(struct pipeline *pl, struct packet *pkt, unsigned char table_id, unsigned char reason);
+
 void pipeline_del_path_ref(struct flow_entry *fe);
 
 #endif /* PIPELINE_H */
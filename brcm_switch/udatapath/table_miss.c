@@ -39,6 +39,7 @@ struct flow_table *miss_table_create(struct datapath *dp,
     table->features->properties_num = TABLE_FEATURES_NUM;
 
     list_init(&table->match_entries);
+    list_init(&table->cursors);
 //	list_init(&table->hard_entries);
 //	list_init(&table->idle_entries);
 
@@ -52,6 +52,13 @@
 #include "daemon.h"
 #include "dp_capabilities.h"
 #include "datapath.h"
+#include "dp_ports.h"
+#include "dp_worker.h"
+#include "dp_pi_limit.h"
+#include "dp_hw_installer.h"
+#include "dp_hw_stats.h"
+#include "emc.h"
+#include "pipeline.h"
 #include "fault.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
@@ -404,6 +411,26 @@ udatapath_cmd(int argc, char *argv[], struct datapath *dp)
     die_if_already_running();
     daemonize();
 
+    if (!dp->soft_switch)
+    {
+        error = dp_hw_installer_start(dp);
+        if (error)
+        {
+            OFP_FATAL(error, "could not start the hardware flow installer");
+        }
+
+        error = dp_hw_stats_start(dp);
+        if (error)
+        {
+            OFP_FATAL(error, "could not start the hardware counter collector");
+        }
+    }
+
+    error = dp_workers_start(dp);
+    if (error) {
+        OFP_FATAL(error, "could not start the packet processing workers");
+    }
+
     if (pthread_create(&tid_datapath, NULL, udatapath_thread, (void*)dp))
     {
         VLOG_ERR(LOG_MODULE, "create free failed\n");
@@ -525,7 +552,10 @@ void* udatapath_thread(void* arg)
     bool pass = true;
     time_t now;
     struct datapath *dp = (struct datapath *)arg;
+    long long int busy_until = 0;
 
+    /* Busy poll while packets come in, and for poll_dwell_us after the last
+     * one, then sleep until there is work again. */
     while(1)
     {
         if (pass)
@@ -538,7 +568,10 @@ void* udatapath_thread(void* arg)
                 pass = false;
             }
         }
-        dp_run(dp);
+        if (dp_run(dp) || (time_now_usec() >= busy_until && dp_sleep(dp)))
+        {
+            busy_until = time_now_usec() + dp->poll_dwell_us;
+        }
     }
     pthread_rwlock_destroy(&dp->rw_lock);
 
@@ -557,6 +590,13 @@ parse_options(struct datapath *dp, int argc, char *argv[])
         OPT_BOOTSTRAP_CA_CERT,
         OPT_NO_LOCAL_PORT,
         OPT_NO_SLICING,
+        OPT_EMC_SIZE,
+        OPT_RX_BATCH,
+        OPT_POLL_DWELL,
+        OPT_POLL_BACKOFF,
+        OPT_N_WORKERS,
+        OPT_PI_LIMIT,
+        OPT_HW_STATS_INTERVAL,
         VLOG_OPTION_ENUMS
     };
 
@@ -576,6 +616,13 @@ parse_options(struct datapath *dp, int argc, char *argv[])
                                                             /* ӲrʾǷɾ */
         {"verbose",           required_argument, 0, 'v'},
         {"log-file",          required_argument, 0, 'a'},   
+        {"emc-size",          required_argument, 0, OPT_EMC_SIZE},
+        {"rx-batch",          required_argument, 0, OPT_RX_BATCH},
+        {"poll-dwell",        required_argument, 0, OPT_POLL_DWELL},
+        {"poll-backoff",      required_argument, 0, OPT_POLL_BACKOFF},
+        {"n-workers",         required_argument, 0, OPT_N_WORKERS},
+        {"pi-limit",          required_argument, 0, OPT_PI_LIMIT},
+        {"hw-stats-interval", required_argument, 0, OPT_HW_STATS_INTERVAL},
         {0, 0, 0, 0},
     };
 
@@ -658,6 +705,89 @@ parse_options(struct datapath *dp, int argc, char *argv[])
             vlog_set_log_file(optarg);
             break;
         }
+        case OPT_EMC_SIZE:
+        {
+            char *end;
+            unsigned long size = strtoul(optarg, &end, 10);
+
+            if (*optarg == '\0' || *end != '\0' || size > EMC_MAX_SIZE)
+            {
+                ofp_fatal(0, "argument to --emc-size must be a number of "
+                          "entries from 0 to %d", EMC_MAX_SIZE);
+            }
+            dp->emc_size = size;
+            break;
+        }
+        case OPT_RX_BATCH:
+        {
+            char *end;
+            unsigned long batch = strtoul(optarg, &end, 10);
+
+            if (*optarg == '\0' || *end != '\0' || batch == 0 || batch > PIPELINE_BATCH_MAX)
+            {
+                ofp_fatal(0, "argument to --rx-batch must be a number of "
+                          "packets from 1 to %d", PIPELINE_BATCH_MAX);
+            }
+            dp->rx_batch = batch;
+            break;
+        }
+        case OPT_POLL_DWELL:
+        case OPT_POLL_BACKOFF:
+        {
+            char *end;
+            unsigned long value = strtoul(optarg, &end, 10);
+
+            if (*optarg == '\0' || *end != '\0' || value > 1000000)
+            {
+                ofp_fatal(0, "argument to --%s must be a number from 0 to 1000000",
+                          c == OPT_POLL_DWELL ? "poll-dwell" : "poll-backoff");
+            }
+            if (c == OPT_POLL_DWELL)
+            {
+                dp->poll_dwell_us = value;
+            }
+            else
+            {
+                dp->poll_backoff_ms = value;
+            }
+            break;
+        }
+        case OPT_N_WORKERS:
+        {
+            char *end;
+            unsigned long n = strtoul(optarg, &end, 10);
+
+            if (*optarg == '\0' || *end != '\0' || n > DP_WORKERS_MAX)
+            {
+                ofp_fatal(0, "argument to --n-workers must be a number of "
+                          "threads from 0 to %d", DP_WORKERS_MAX);
+            }
+            dp->n_workers = n;
+            break;
+        }
+        case OPT_PI_LIMIT:
+        {
+            if (dp_pi_limit_parse(dp->pi_limit, optarg))
+            {
+                ofp_fatal(0, "argument to --pi-limit must be SCOPE=RATE[/BURST], "
+                          "with SCOPE one of no-match, action, invalid-ttl, "
+                          "table:ID or port:NO");
+            }
+            break;
+        }
+        case OPT_HW_STATS_INTERVAL:
+        {
+            char *end;
+            unsigned long value = strtoul(optarg, &end, 10);
+
+            if (*optarg == '\0' || *end != '\0' || value > 3600000)
+            {
+                ofp_fatal(0, "argument to --hw-stats-interval must be a number "
+                          "from 0 to 3600000");
+            }
+            dp->hw_stats_interval_ms = value;
+            break;
+        }
         default:
             exit(EXIT_FAILURE);
         }
@@ -700,7 +830,27 @@ usage(void)
            "  -r, --reset             reset configurations\n"
            "  -v, --verbose=MODULE[:FACILITY[:LEVEL]]  set logging levels\n"
            "  -a, --file[=FILE]       enable logging to specified FILE\n"
-           );
+           "  --emc-size=N            exact match cache entries per thread\n"
+           "                          (0 disables it, default: %d)\n"
+           "  --rx-batch=N            packets processed between control\n"
+           "                          plane runs (1 to %d, default: %d)\n"
+           "  --poll-dwell=USEC       busy poll after the last packet\n"
+           "                          (default: %d)\n"
+           "  --poll-backoff=MSEC     longest sleep when idle, 0 to busy\n"
+           "                          poll always (default: %d)\n"
+           "  --n-workers=N           packet processing threads, 0 to\n"
+           "                          process packets in the datapath\n"
+           "                          thread (0 to %d, default: 0)\n"
+           "  --pi-limit=SCOPE=RATE[/BURST]  packet ins per second of a\n"
+           "                          reason (no-match, action, invalid-ttl),\n"
+           "                          table (table:ID) or port (port:NO),\n"
+           "                          BURST back to back (may be repeated)\n"
+           "  --hw-stats-interval=MSEC  between reads of the hardware flow\n"
+           "                          counters, 0 to never read them\n"
+           "                          (default: %d)\n",
+           EMC_DEFAULT_SIZE, PIPELINE_BATCH_MAX, DP_RX_BATCH_DEFAULT,
+           DP_POLL_DWELL_DEFAULT, DP_POLL_BACKOFF_DEFAULT, DP_WORKERS_MAX,
+           DP_HW_STATS_INTERVAL_DEFAULT);
 
     exit(EXIT_SUCCESS);
 }
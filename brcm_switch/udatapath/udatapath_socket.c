@@ -12,7 +12,9 @@
 #include <linux/if_packet.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
+#include "util.h"
 #include "vlog.h"
 #include "Hybrid_Framework_Common.h"
 #include "udatapath_socket.h"
@@ -22,14 +24,14 @@
 /* V8-datapathsocket fd */
 int g_uiListenfd = -1;
 
-char g_RcvBuf[MAX_SOCKET_MSG_SIZE];     /* OPENFLOWĽջ*/
+/* Buffer of the frame being received. Set to NULL by Sock_Recv_Keep() when a
+ * reply is handed over in it, and replaced before the next frame. */
+static char *g_RcvBuf = NULL;
 
 int g_SockFd = 0;   //linuxFEIͨSockFdǸȫֱʼʱһΣ½Ҫ
 int g_RevData_Len=0;  //յݱĵĳȣֵΪ65495
 int g_Socket_Thread_Alive_Flag = 1;       //socket ߳˳־
 
-extern HYBRID_INFOCHANGE_BUFFER_S g_ua_info_buf[HYBRID_INFOCHANGE_BUFFER_LENGTH];
-
 int udatapath_GetLocalMac(char *pucMac)
 {
     int iIfreqFd = 0;
@@ -57,130 +59,157 @@ int udatapath_GetLocalMac(char *pucMac)
     return 0;
 }
 
-int send_socket_msg(char* pcMsg, unsigned short usMsgLen)
+/* Sending side of the raw socket to the V8 agent. The MAC and ifindex of
+ * eth0 are read once, by the first send that finds eth0, and the frame
+ * headers of a batch are laid out once; a frame is sent as an iovec of its
+ * headers and of the caller's data, so that the data is neither allocated
+ * nor copied. Senders take turns on the mutex. */
+typedef struct tagSOCK_TRANSPORT
+{
+    pthread_mutex_t             mutex;
+    int                         iReady;     /* addresses of eth0 read. */
+    struct sockaddr_ll          stAddr;
+    openflow_socket_mac_head    stMacHead;
+    MLA_FRAME_SOCKET_TLV_HEAD_S astTlvHead[SOCK_V8_BATCH];
+    struct iovec                astIov[SOCK_V8_BATCH][3];
+    struct mmsghdr              astMsg[SOCK_V8_BATCH];
+}SOCK_TRANSPORT_S;
+
+static SOCK_TRANSPORT_S g_stSockTransport = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+/* Reads the addresses of eth0, unless done already. Called with the mutex
+ * held. */
+static int sock_transport_ready(SOCK_TRANSPORT_S *pstTrans)
 {
-    char*              pcSendBuff  = NULL;
-    struct ifreq       ifr;
-    struct sockaddr_ll stServaddr;
-    int recv_len = 0;
-    openflow_socket_mac_head *pstMacHead = NULL;
     char aucSrcMac[SOCKET_MAC_LEN] = {0};
+    unsigned int uiIfIndex;
+    unsigned int i;
 
-    memset(&ifr, 0, sizeof(ifr));
+    if (pstTrans->iReady)
+    {
+        return 0;
+    }
 
     if (-1 == udatapath_GetLocalMac(aucSrcMac))
     {
         VLOG_ERR(LOG_MODULE, "get mac failed.");
         return -1;
     }
-
-    pcSendBuff = malloc(usMsgLen + sizeof(openflow_socket_mac_head));
-    if(NULL == pcSendBuff)
+    uiIfIndex = if_nametoindex("eth0");
+    if (0 == uiIfIndex)
     {
-        VLOG_ERR(LOG_MODULE, "Apply Memory SendBuff Error!\n");
+        VLOG_ERR(LOG_MODULE, "get eth0 index failed: %s", strerror(errno));
         return -1;
     }
-    memset(pcSendBuff, 0, (usMsgLen + sizeof(openflow_socket_mac_head)));
-    pstMacHead = (openflow_socket_mac_head *)(void *)pcSendBuff;
-    memset(pstMacHead->aucDMac, 0xFF, SOCKET_MAC_LEN);
-    (void)memcpy(pstMacHead->aucSMac, aucSrcMac, SOCKET_MAC_LEN);
-    pstMacHead->usEthType = (unsigned short)htons(OPENFLOW_ETH_TYPE);
 
-    (void)memcpy(pcSendBuff + sizeof(openflow_socket_mac_head), pcMsg, usMsgLen);
+    memset(&pstTrans->stMacHead, 0, sizeof(pstTrans->stMacHead));
+    memset(pstTrans->stMacHead.aucDMac, 0xFF, SOCKET_MAC_LEN);
+    (void)memcpy(pstTrans->stMacHead.aucSMac, aucSrcMac, SOCKET_MAC_LEN);
+    pstTrans->stMacHead.usEthType = (unsigned short)htons(OPENFLOW_ETH_TYPE);
 
-    /* vethof˿ */
-    memset(&stServaddr, 0, sizeof(stServaddr));
-    stServaddr.sll_family   = AF_PACKET;
-    stServaddr.sll_protocol = (unsigned short)htons(OPENFLOW_ETH_TYPE);
-    stServaddr.sll_ifindex  = if_nametoindex("eth0");
-    (void)memcpy(stServaddr.sll_addr, pstMacHead->aucDMac, SOCKET_MAC_LEN);
+    memset(&pstTrans->stAddr, 0, sizeof(pstTrans->stAddr));
+    pstTrans->stAddr.sll_family   = AF_PACKET;
+    pstTrans->stAddr.sll_protocol = (unsigned short)htons(OPENFLOW_ETH_TYPE);
+    pstTrans->stAddr.sll_ifindex  = uiIfIndex;
+    (void)memcpy(pstTrans->stAddr.sll_addr, pstTrans->stMacHead.aucDMac, SOCKET_MAC_LEN);
 
-    /* жRAWģʽsocketǷ */
-    if (-1 == g_uiListenfd)
+    memset(pstTrans->astTlvHead, 0, sizeof(pstTrans->astTlvHead));
+    memset(pstTrans->astMsg, 0, sizeof(pstTrans->astMsg));
+    for (i = 0; i < SOCK_V8_BATCH; i++)
     {
-        VLOG_ERR(LOG_MODULE, "Listen ID is illegal.");
-        (void)free(pcSendBuff);
-        return -1;
-    }
+        pstTrans->astTlvHead[i].uiPid = 1;
 
-    recv_len = sendto(g_uiListenfd, pcSendBuff, usMsgLen + sizeof(openflow_socket_mac_head), MSG_DONTWAIT,
-                      (struct sockaddr *)&stServaddr, sizeof(stServaddr));
-    if(0 >= recv_len)
-    {
-        VLOG_ERR(LOG_MODULE, "openflow send socket fail!\n");
-        (void)free(pcSendBuff);
-        return -1;
+        pstTrans->astIov[i][0].iov_base = &pstTrans->stMacHead;
+        pstTrans->astIov[i][0].iov_len  = sizeof(openflow_socket_mac_head);
+        pstTrans->astIov[i][1].iov_base = &pstTrans->astTlvHead[i];
+        pstTrans->astIov[i][1].iov_len  = sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S);
+
+        pstTrans->astMsg[i].msg_hdr.msg_name    = &pstTrans->stAddr;
+        pstTrans->astMsg[i].msg_hdr.msg_namelen = sizeof(pstTrans->stAddr);
+        pstTrans->astMsg[i].msg_hdr.msg_iov     = pstTrans->astIov[i];
+        pstTrans->astMsg[i].msg_hdr.msg_iovlen  = 3;
     }
 
-    (void)free(pcSendBuff);
+    pstTrans->iReady = 1;
     return 0;
 }
 
-/* V8ݷͺ */
-int Sock_Sendto_V8(void *recvdata, unsigned short revnum, unsigned int uiReverse)
+int Sock_Sendto_V8_Batch(const SOCK_V8_MSG_S *pstMsgs, unsigned int uiNum, unsigned int uiReverse)
 {
-    int iRet =0;
-    char* pBuf = NULL;
-    MLA_FRAME_SOCKET_TLV_HEAD_S* ptmp = NULL;
+    SOCK_TRANSPORT_S *pstTrans = &g_stSockTransport;
+    unsigned int uiSent = 0;
+    unsigned int uiBatch;
+    unsigned int i;
+    int iRet;
 
-    // һϢͷ
-    pBuf = malloc(revnum + sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S));
-    if(NULL == pBuf)
+    /* жRAWģʽsocketǷ */
+    if (-1 == g_uiListenfd)
     {
-        VLOG_ERR(LOG_MODULE, "Apply Memory pBuf Error for Sock_Sendto_V8\n");
+        VLOG_ERR(LOG_MODULE, "Listen ID is illegal.");
         return -1;
     }
-    memset(pBuf, 0, (revnum + sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S)));
-
-    ptmp = (MLA_FRAME_SOCKET_TLV_HEAD_S*)pBuf;
-
-    ptmp->uiIndex = 0;
-    ptmp->uiPid = 1;
-    ptmp->usProgram = 0;
-    ptmp->uiReverse = uiReverse;
-    ptmp->usDataLength = revnum;
-    ptmp->usLength = sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S) + revnum;
-    memcpy(pBuf + sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S), recvdata, revnum);
-
-    iRet = send_socket_msg(pBuf, ptmp->usLength);
 
-    free(pBuf);
-
-    if(iRet < 0)
+    pthread_mutex_lock(&pstTrans->mutex);
+    if (0 != sock_transport_ready(pstTrans))
     {
-        VLOG_ERR(LOG_MODULE, "SOCK Send to V8 Fail\n");
+        pthread_mutex_unlock(&pstTrans->mutex);
         return -1;
     }
-    VLOG_DBG(LOG_MODULE, "SOCK Send to V8 success\n");
 
-    return 0;
+    while (uiSent < uiNum)
+    {
+        uiBatch = uiNum - uiSent < SOCK_V8_BATCH ? uiNum - uiSent : SOCK_V8_BATCH;
+        for (i = 0; i < uiBatch; i++)
+        {
+            const SOCK_V8_MSG_S *pstMsg = &pstMsgs[uiSent + i];
+            MLA_FRAME_SOCKET_TLV_HEAD_S *ptmp = &pstTrans->astTlvHead[i];
+
+            ptmp->uiReverse = uiReverse;
+            ptmp->usDataLength = pstMsg->usDataLength;
+            ptmp->usLength = sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S) + pstMsg->usDataLength;
+            pstTrans->astIov[i][2].iov_base = pstMsg->pData;
+            pstTrans->astIov[i][2].iov_len  = pstMsg->usDataLength;
+        }
 
-}
+        iRet = sendmmsg(g_uiListenfd, pstTrans->astMsg, uiBatch, MSG_DONTWAIT);
+        if (iRet > 0)
+        {
+            uiSent += iRet;
+        }
+        if (iRet != (int)uiBatch)
+        {
+            VLOG_ERR(LOG_MODULE, "openflow send socket fail: %s\n",
+                     iRet < 0 ? strerror(errno) : "partial send");
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pstTrans->mutex);
 
+    VLOG_DBG(LOG_MODULE, "SOCK Send to V8 %u of %u frames\n", uiSent, uiNum);
+    return (int)uiSent;
+}
 
-int SockRecv_Find_WaitBuf(unsigned int uiIdentifier, unsigned int *uiBufId)
+/* V8ݷͺ */
+int Sock_Sendto_V8(void *recvdata, unsigned short revnum, unsigned int uiReverse)
 {
-    unsigned int iLoop = 0;
-    for (iLoop=0; iLoop<HYBRID_INFOCHANGE_BUFFER_LENGTH; iLoop++)
+    SOCK_V8_MSG_S stMsg;
+
+    stMsg.pData = recvdata;
+    stMsg.usDataLength = revnum;
+    if (1 != Sock_Sendto_V8_Batch(&stMsg, 1, uiReverse))
     {
-        if ((uiIdentifier == g_ua_info_buf[iLoop].ui_identifier) &&
-            (g_ua_info_buf[iLoop].wait_v8reply_flag == HYBRID_INFOCHANGE_WAITV8REPLY))
-        {
-            *uiBufId = iLoop;
-            return FOUND;
-        }
+        VLOG_ERR(LOG_MODULE, "SOCK Send to V8 Fail\n");
+        return -1;
     }
-
-    return NOTFOUND;
+    return 0;
 }
 
+
 /*V8ݴ*/
 int SOCK_Recvdata_Process(char *recvdata, unsigned int revnum)
 {
     openflow_socket_mac_head    *pstMsgMacHead = NULL;
     HYBRID_INFO_CHANGE_S        *pstSendDate  = NULL;
-    unsigned int uiIdentifier = 0;
-    unsigned int uiBufId = 0;
     unsigned int uiProcessRet = 0;
 
     if(revnum < sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S) +
@@ -204,37 +233,21 @@ int SOCK_Recvdata_Process(char *recvdata, unsigned int revnum)
     revnum = revnum - sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S) - sizeof(openflow_socket_mac_head);
 
     // յϢ  ui_identifier ֶ
-    uiIdentifier = pstSendDate->ui_identifier;
+    // жǷΪҪȴӦı, ӦĻص
+    if (VOS_OK == Hybrid_Reply_V8(pstSendDate, revnum))
+    {
+        return 0;
+    }
 
-    // жǷΪҪȴӦı
-    // ûлֻevent
-    if(NOTFOUND == SockRecv_Find_WaitBuf(uiIdentifier, &uiBufId))
+    // HybridܴV8͵EVENTģPacket inLLDP,˿Ϣ˿״̬౨
+    uiProcessRet = Hybird_Frame_Process_UnknownIdentifier_Packet((char *)pstSendDate, revnum);
+    if(VOS_OK == uiProcessRet)
     {
-        // HybridܴV8͵EVENTģPacket inLLDP,˿Ϣ˿״̬౨
-        uiProcessRet = Hybird_Frame_Process_UnknownIdentifier_Packet((char *)pstSendDate, revnum);
-        if(VOS_OK == uiProcessRet)
-        {
-            return 0;
-        }
-        else
-        {
-            return -1;
-        }
+        return 0;
     }
-    // ҪȴӦϢŴ
     else
     {
-        g_ua_info_buf[uiBufId].pst_info = pstSendDate;
-        g_ua_info_buf[uiBufId].data_len = revnum;
-
-        /*ʱӦȣݿɺͷź֪ͨȥȡ*/
-        sem_post(&(g_ua_info_buf[uiBufId].sem_isused));
-
-        /*ȴܽж,ͷźȣSOCK̲߳*/
-        // ܵȰɣeventĶ
-        // ľˣûвĲᴦģselectû
-        //sem_wait(&g_sem_waitframe_restordata);
-        return 0;
+        return -1;
     }
 }
 
@@ -250,13 +263,13 @@ void openflow_recvdata(void *pArg)
     struct timespec    stTime;
     struct sockaddr_ll stServaddr;
     fd_set sockFds;
+    struct timeval stTick;
 
     stTime.tv_sec  = 0;
     stTime.tv_nsec = 100000 * 1000;
 
     memset(&ifr, 0, sizeof(ifr));
     memset(&stServaddr, 0, sizeof(stServaddr));
-    memset(g_RcvBuf, 0, MAX_SOCKET_MSG_SIZE);
 
     /* ѭжϣȴvethof˿ڴ */
     if ((iIfreqFd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
@@ -294,10 +307,17 @@ void openflow_recvdata(void *pArg)
 
     for (;;)
     {
+        if (NULL == g_RcvBuf)
+        {
+            g_RcvBuf = xmalloc(MAX_SOCKET_MSG_SIZE);
+        }
+
         FD_ZERO(&sockFds);
         FD_SET(uiListenfd, &sockFds);
 
-        if (select(uiListenfd + 1, &sockFds, NULL, NULL, NULL) > 0)
+        stTick.tv_sec = 0;
+        stTick.tv_usec = HYBRID_REQUEST_TICK_MS * 1000;
+        if (select(uiListenfd + 1, &sockFds, NULL, NULL, &stTick) > 0)
         {
             if (FD_ISSET(uiListenfd, &sockFds))
             {
@@ -317,14 +337,28 @@ void openflow_recvdata(void *pArg)
                 }
             }
         }
+        Hybrid_Request_Expire();
     }
 
     (void)close(uiListenfd);
     return;
 }
 
+void Sock_Recv_Keep(void)
+{
+    g_RcvBuf = NULL;
+}
+
+void Sock_Recv_Free(void *pData)
+{
+    if (NULL != pData)
+    {
+        free((char *)pData - sizeof(openflow_socket_mac_head) - sizeof(MLA_FRAME_SOCKET_TLV_HEAD_S));
+    }
+}
+
 /*V8-Linux SOCKETʼ*/
-void Socket_Create()
+static void Socket_Create(void)
 {
     g_uiListenfd = socket(AF_PACKET, SOCK_RAW, htons(OPENFLOW_ETH_TYPE));
     if (-1 == g_uiListenfd)
@@ -334,7 +368,7 @@ void Socket_Create()
     }
 }
 
-int Socket_Initial()
+int Socket_Initial(void)
 {
     pthread_t  tid_socketFEI = 0;
     void*      temppoint     = NULL;
@@ -349,12 +383,17 @@ int Socket_Initial()
     return 0;
 }
 
-void Socket_Close()
+void Socket_Close(void)
 {
     (void)close(g_uiListenfd);
 
     g_uiListenfd = -1;
 
+    /* eth0 is looked up again by the next send */
+    pthread_mutex_lock(&g_stSockTransport.mutex);
+    g_stSockTransport.iReady = 0;
+    pthread_mutex_unlock(&g_stSockTransport.mutex);
+
     return 0;
 }
 
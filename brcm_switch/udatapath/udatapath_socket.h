@@ -18,6 +18,7 @@
 #define NOTFOUND                0
 #define OPENFLOW_ETH_TYPE       (0x1211)
 #define SOCKET_MAC_LEN          6
+#define SOCK_V8_BATCH           32      /* frames sent by a sendmmsg call. */
 
 typedef struct openflow_socket_mac_head
 {
@@ -54,15 +55,30 @@ typedef struct tagMLA_FRAME_SOCKET_TLV_HEAD
 
 }MLA_FRAME_SOCKET_TLV_HEAD_S;
 
+/* Data of a frame to the V8 agent, sent after the frame headers. */
+typedef struct tagSOCK_V8_MSG
+{
+    void               *pData;
+    unsigned short      usDataLength;
+}SOCK_V8_MSG_S;
+
 
 
 /*֣*/
 
 // ʱ uiReverse Ͻӿ
 int Sock_Sendto_V8(void *recvdata, unsigned short revnum, unsigned int uiReverse);
+/* Sends a frame per message, SOCK_V8_BATCH frames per system call. Returns the
+ * number of messages sent, which are the first ones, or -1 on error. */
+int Sock_Sendto_V8_Batch(const SOCK_V8_MSG_S *pstMsgs, unsigned int uiNum, unsigned int uiReverse);
 int SOCK_Recvdata_Process(char *recvdata, unsigned int revnum);
+/* Keeps the buffer of the frame being processed, instead of receiving the next
+ * one into it. Called on the receive thread, by the handler of a reply. */
+void Sock_Recv_Keep(void);
+/* Frees the buffer kept with the reply at pData. */
+void Sock_Recv_Free(void *pData);
 void openflow_recvdata(void *pArg);
-int Socket_Initial();
-void Socket_Close();
+int Socket_Initial(void);
+void Socket_Close(void);
 
 /*The end*/